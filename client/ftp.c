@@ -36,6 +36,7 @@ int main(int argc, char *argv[]) {
   }
 
   struct sockfds sockfds = {-1, -1, -1};
+  struct stream_reader control_reader = {0};
 
   const char *ip = argv[1];
   const char *port = argv[2];
@@ -46,6 +47,11 @@ int main(int argc, char *argv[]) {
     goto fds_cleanup;
   }
 
+  if (!stream_reader_init(&control_reader, sockfds.control_sockfd, 0, STREAM_READER_MIN_LEN)) {
+    logger_log(logger, ERROR, "[%s] failed to init a reader for the control connection", __func__);
+    goto fds_cleanup;
+  }
+
   char local_ip[INET6_ADDRSTRLEN];
   char local_port[NI_MAXSERV];
   get_sock_local_name(sockfds.control_sockfd, local_ip, sizeof local_ip, local_port, sizeof local_port);
@@ -79,6 +85,10 @@ int main(int argc, char *argv[]) {
 
   // main event loop
   struct request request = {0};
+  enum request_type req_type = REQ_UNKNOWN;  // the type of the last request sent. its reply might start a transfer
+  uint32_t block_size = DATA_BLOCK_MAX_LEN;  // changes only once the server accepted an 'opts blksize' request
+  off_t restart_offset = 0;                  // set once the server accepted a 'rest' request. used by one transfer
+  bool compressed = false;                   // set once the server accepted a 'mode z' request
   do {
     int event_count = epoll_wait(epollfd, epoll_events, epoll_events_size, -1);
     if (event_count == -1) {
@@ -86,7 +96,6 @@ int main(int argc, char *argv[]) {
       continue;
     }
 
-    enum request_type req_type = REQ_UNKNOWN;
     for (size_t i = 0; event_count > 0 && i < epoll_events_size; i++) {  // look for events
       event_count--;
 
@@ -101,26 +110,45 @@ int main(int argc, char *argv[]) {
           }
           sockfds.data_sockfd = data_fd;
         } else if (epoll_events[i].data.fd == sockfds.control_sockfd) {
-          struct reply reply;
-          int recv_ret = recieve_reply(&reply, sockfds.control_sockfd, 0);
-
-          if (recv_ret != ERR_SUCCESS) {
-            logger_log(logger,
-                       ERROR,
-                       "[%s] encountered an error while reading from file fd [%d]. reason [%s]",
-                       __func__,
-                       sockfds.control_sockfd,
-                       str_err_code(recv_ret));
-            continue;
-          }
-
-          fprintf(stdout, "\t\t%s\n", reply.reply);
-
-          if (reply.code == RPLY_CLOSING_CTRL_CONN) {
-            goto epoll_cleanup;
-          } else if (reply.code == RPLY_DATA_CONN_OPEN_STARTING_TRANSFER) {
-            perform_file_operation(logger, req_type, &request, sockfds.data_sockfd);
-          }
+          // handle every reply the reader already holds. epoll won't report the bytes it buffered
+          do {
+            struct reply reply;
+            int recv_ret = stream_reader_next_reply(&control_reader, &reply);
+
+            if (recv_ret != ERR_SUCCESS) {
+              logger_log(logger,
+                         ERROR,
+                         "[%s] encountered an error while reading from file fd [%d]. reason [%s]",
+                         __func__,
+                         sockfds.control_sockfd,
+                         str_err_code(recv_ret));
+              break;
+            }
+
+            fprintf(stdout, "\t\t%s\n", reply.reply);
+
+            if (reply.code == RPLY_CLOSING_CTRL_CONN) {
+              goto epoll_cleanup;
+            } else if (reply.code == RPLY_DATA_CONN_OPEN_STARTING_TRANSFER) {
+              perform_file_operation(logger,
+                                     req_type,
+                                     &request,
+                                     sockfds.data_sockfd,
+                                     block_size,
+                                     compressed,
+                                     restart_offset);
+            } else if (reply.code == RPLY_CMD_OK && req_type == REQ_OPTS) {
+              uint32_t requested = get_block_size(&request);
+              if (requested) block_size = requested;
+            } else if (reply.code == RPLY_CMD_OK && req_type == REQ_MODE) {
+              get_transfer_mode(&request, &compressed);
+            } else if (reply.code == RPLY_FILE_ACTION_PENDING && req_type == REQ_REST) {
+              restart_offset = get_restart_offset(&request);
+            }
+
+            // the server resets the offset once a transfer starts (or fails to)
+            if (req_type == REQ_RETR || req_type == REQ_STOR) restart_offset = 0;
+          } while (stream_reader_has_reply(&control_reader));
         }
 
       } else if (epoll_events[i].events & EPOLLHUP) {  // other end closed
@@ -137,6 +165,21 @@ int main(int argc, char *argv[]) {
 
     do {
       req_type = get_request(&request);
+
+      // a parallel download or upload runs over sessions of its own. there's nothing to send over this one
+      if (req_type == REQ_RANG) {
+        parallel_retrieve(logger, ip, port, &request, block_size);
+        req_type = REQ_UNKNOWN;
+      } else if (req_type == REQ_MPPT) {
+        parallel_store(logger, ip, port, &request, block_size);
+        req_type = REQ_UNKNOWN;
+      } else if (req_type == REQ_HAVE && !complete_have_request(logger, &request)) {
+        req_type = REQ_UNKNOWN;
+      } else if (req_type == REQ_ALLO && !complete_allo_request(logger, &request)) {
+        req_type = REQ_UNKNOWN;
+      } else if (req_type == REQ_STOR) {
+        complete_stor_request(&request);
+      }
     } while (req_type == REQ_UNKNOWN);
 
     // send the request
@@ -158,6 +201,7 @@ epoll_cleanup:
   close(epollfd);
 
 fds_cleanup:
+  stream_reader_destroy(&control_reader);
   if (sockfds.control_sockfd >= 0) close(sockfds.control_sockfd);
   if (sockfds.data_sockfd >= 0) close(sockfds.data_sockfd);
   if (sockfds.passive_sockfd >= 0) close(sockfds.passive_sockfd);
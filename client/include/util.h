@@ -2,9 +2,12 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>  // off_t
 #include "list.h"
 #include "logger.h"
 #include "payload.h"
+#include "sha256.h"
 
 struct sockfds {
   int control_sockfd;
@@ -23,6 +26,58 @@ void get_sock_local_name(int sockfd, char *ip, size_t ip_size, char *port, size_
 
 enum request_type parse_command(char *cmd);
 
-void perform_file_operation(struct logger *logger, enum request_type req_type, struct request *request, int sockfd);
+// block_size is the data block size negotiated with the server (DATA_BLOCK_MAX_LEN by default). compressed is set once
+// the server accepted 'mode z': a stored file is then sent in compressed blocks where they shrink. compressed blocks
+// recieved are decompressed in either mode. a transfer restarted with 'rest' starts at offset: a retrieved file is
+// written from offset on, a stored file is sent from offset on
+void perform_file_operation(struct logger *logger,
+                            enum request_type req_type,
+                            struct request *request,
+                            int sockfd,
+                            uint32_t block_size,
+                            bool compressed,
+                            off_t offset);
 
-enum request_type get_request(struct request *request);
\ No newline at end of file
+// returns the block size requested by an 'opts blksize <n>' request, or 0 if the request isn't a valid one
+uint32_t get_block_size(const struct request *request);
+
+// sets *compressed to whether a 'mode <b|z>' request asks for compressed mode. returns false if the request isn't a
+// valid one
+bool get_transfer_mode(const struct request *request, bool *compressed);
+
+// returns the offset requested by a 'rest <offset>' request, or 0 if the request isn't a valid one
+off_t get_restart_offset(const struct request *request);
+
+enum request_type get_request(struct request *request);
+
+// completes a 'have <file>' request with the sha-256 and the size of the local file ('have <sha-256> <size> <file>'),
+// so the server can tell whether it holds the content of the file already. a request which carries them already is
+// left as is. returns false if the file can't be read
+bool complete_have_request(struct logger *logger, struct request *request);
+
+// completes an 'allo <file>' request with the size of the local file ('allo <size>'), so the next 'stor <file>' has
+// the server allocate the file ahead. a request which carries a size already is left as is. returns false if the file
+// can't be found
+bool complete_allo_request(struct logger *logger, struct request *request);
+
+// completes a 'stor <file>' request with a size hint, the size of the local file ('stor -s <size> <file>'), so the
+// server allocates the file ahead and refuses it before the transfer if it has no room for it
+void complete_stor_request(struct request *request);
+
+// handles 'pget <connections> <file>': downloads a file over several sessions with host:serv at once, each fetching a
+// disjoint range of it with 'rang' (at most 16 sessions, and none for less than 1 MiB). the ranges are written into
+// the local file at their own offsets. block_size is requested by every session
+void parallel_retrieve(struct logger *logger,
+                       const char *host,
+                       const char *serv,
+                       struct request *request,
+                       uint32_t block_size);
+// handles 'pput <connections> <file> [<upload id>]': uploads a file over several sessions with host:serv at once, as a
+// multipart upload of 8 MiB parts. every session reads the parts it sends from the local file at their own offsets.
+// the upload is committed once all of its parts were stored. an upload which failed can be resumed by passing its id:
+// only the parts which weren't stored yet are sent. block_size is requested by every session
+void parallel_store(struct logger *logger,
+                    const char *host,
+                    const char *serv,
+                    struct request *request,
+                    uint32_t block_size);
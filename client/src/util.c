@@ -1,19 +1,48 @@
 #include "include/util.h"
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>     // open()
+#include <inttypes.h>  // PRIu32
 #include <limits.h>
 #include <netdb.h>   // getaddrinfo, getnameinfo
 #include <signal.h>  // sigaction, sigset, sigemptyset, sigaddset, sigprocmask
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>     // strncasecmp
 #include <sys/socket.h>  // getaddrinfo, socket, connect, getsockname, getnameinfo
+#include <sys/stat.h>    // fstat
 #include <sys/types.h>   // getaddrinfo
-#include <unistd.h>      //close
+#include <threads.h>
+#include <unistd.h>  //close, pread, pwrite, ftruncate
 
 #define CMD_MAX_LEN 4
 #define CMD_MIN_LEN 3
 
+// the number of data blocks read from a file and sent with a single flush
+#define STORE_BATCH_BLOCKS (STREAM_WRITER_MAX_IOV / 2)
+// the size of the buffer a batch is read into. a negotiated block larger than this is sent in a batch of its own
+#define STORE_BATCH_LEN (STORE_BATCH_BLOCKS * DATA_BLOCK_MAX_LEN)
+// the size of the largest data block header (descriptor + 32 bit length)
+#define DATA_BLOCK_EXT_HEADER_LEN (sizeof(uint8_t) + sizeof(uint32_t))
+
+// the most sessions a parallel download opens
+#define PARALLEL_MAX_CONNECTIONS 16
+// the shortest range worth a session of its own
+#define PARALLEL_MIN_RANGE_LEN (1024 * 1024)
+// the length of every part of a parallel upload (but the last one)
+#define PARALLEL_PART_LEN (8 * 1024 * 1024)
+// the length of an upload id and of the longest line of a list of uploaded parts
+#define UPLOAD_ID_LEN 16
+#define PART_LINE_LEN 64
+// how many times (and how often) a transfer is requested while the server hasn't accepted its data connection yet
+#define TRANSFER_MAX_ATTEMPTS 100
+#define TRANSFER_RETRY_INTERVAL_MS 10
+// the size of the chunks a file is read in to be hashed
+#define HASH_CHUNK_LEN (1024 * 1024)
+
 static const char *trim_str(const char *str) {
   if (!str) return str;
 
@@ -202,6 +231,36 @@ enum request_type parse_command(char *cmd) {
         return REQ_STOR;
       } else if (memcmp(cmd_ptr, "quit", cmd_len) == 0) {
         return REQ_QUIT;
+      } else if (memcmp(cmd_ptr, "opts", cmd_len) == 0) {
+        return REQ_OPTS;
+      } else if (memcmp(cmd_ptr, "mlsd", cmd_len) == 0) {
+        return REQ_MLSD;
+      } else if (memcmp(cmd_ptr, "mlst", cmd_len) == 0) {
+        return REQ_MLST;
+      } else if (memcmp(cmd_ptr, "rest", cmd_len) == 0) {
+        return REQ_REST;
+      } else if (memcmp(cmd_ptr, "pget", cmd_len) == 0) {
+        return REQ_RANG;  // a parallel download. it's made of 'rang' requests sent over sessions of its own
+      } else if (memcmp(cmd_ptr, "pput", cmd_len) == 0) {
+        return REQ_MPPT;  // a parallel upload. it's made of 'mppt' requests sent over sessions of its own
+      } else if (memcmp(cmd_ptr, "mpin", cmd_len) == 0) {
+        return REQ_MPIN;
+      } else if (memcmp(cmd_ptr, "mpls", cmd_len) == 0) {
+        return REQ_MPLS;
+      } else if (memcmp(cmd_ptr, "mpcm", cmd_len) == 0) {
+        return REQ_MPCM;
+      } else if (memcmp(cmd_ptr, "mode", cmd_len) == 0) {
+        return REQ_MODE;
+      } else if (memcmp(cmd_ptr, "hash", cmd_len) == 0) {
+        return REQ_HASH;
+      } else if (memcmp(cmd_ptr, "xcrc", cmd_len) == 0) {
+        return REQ_XCRC;
+      } else if (memcmp(cmd_ptr, "have", cmd_len) == 0) {
+        return REQ_HAVE;
+      } else if (memcmp(cmd_ptr, "stat", cmd_len) == 0) {
+        return REQ_STAT;
+      } else if (memcmp(cmd_ptr, "allo", cmd_len) == 0) {
+        return REQ_ALLO;
       }
       break;
     default:
@@ -210,6 +269,148 @@ enum request_type parse_command(char *cmd) {
   return REQ_UNKNOWN;
 }
 
+uint32_t get_block_size(const struct request *request) {
+  const char *arg = get_args(request);
+  if (!arg || strncasecmp(arg, "blksize ", strlen("blksize ")) != 0) return 0;
+
+  char *end = NULL;
+  errno = 0;
+  unsigned long block_size = strtoul(arg + strlen("blksize "), &end, 10);
+  if (errno || *trim_str(end)) return 0;
+  if (block_size < DATA_BLOCK_MAX_LEN || block_size > DATA_BLOCK_EXT_MAX_LEN) return 0;
+
+  return (uint32_t)block_size;
+}
+
+bool get_transfer_mode(const struct request *request, bool *compressed) {
+  const char *arg = get_args(request);
+  if (!arg || !compressed) return false;
+
+  if (strcasecmp(arg, "b") == 0) {
+    *compressed = false;
+  } else if (strcasecmp(arg, "z") == 0) {
+    *compressed = true;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+off_t get_restart_offset(const struct request *request) {
+  const char *arg = get_args(request);
+  if (!arg) return 0;
+
+  char *end = NULL;
+  errno = 0;
+  long long offset = strtoll(arg, &end, 10);
+  if (errno || end == arg || *trim_str(end) || offset < 0) return 0;
+
+  return (off_t)offset;
+}
+
+bool complete_have_request(struct logger *logger, struct request *request) {
+  const char *arg = get_args(request);
+  if (!arg) return false;
+
+  // the request carries the sha-256 and the size already
+  if (strspn(arg, "0123456789abcdefABCDEF") == SHA256_HEX_LEN && arg[SHA256_HEX_LEN] == ' ') return true;
+
+  char file_name[REQUEST_MAX_LEN];
+  strcpy(file_name, arg);
+
+  int fd = open(file_name, O_RDONLY);
+  if (fd == -1) {
+    logger_log(logger, ERROR, "[%s] failed to open the file [%s]", __func__, file_name);
+    return false;
+  }
+
+  uint8_t *buf = malloc(HASH_CHUNK_LEN);
+  if (!buf) {
+    logger_log(logger, ERROR, "[%s] memory allocation failure", __func__);
+    close(fd);
+    return false;
+  }
+
+  struct sha256 ctx;
+  sha256_init(&ctx);
+  off_t size = 0;
+  ssize_t len;
+  while ((len = read(fd, buf, HASH_CHUNK_LEN)) > 0 || (len == -1 && errno == EINTR)) {
+    if (len == -1) continue;
+    sha256_update(&ctx, buf, (size_t)len);
+    size += len;
+  }
+  free(buf);
+  close(fd);
+
+  if (len == -1) {
+    logger_log(logger, ERROR, "[%s] failed to read the file [%s]", __func__, file_name);
+    return false;
+  }
+
+  uint8_t digest[SHA256_LEN];
+  char hex[SHA256_HEX_LEN + 1];
+  sha256_final(&ctx, digest);
+  sha256_hex(digest, hex);
+
+  int request_len =
+      snprintf((char *)request->request, REQUEST_MAX_LEN, "have %s %jd %s", hex, (intmax_t)size, file_name);
+  if (request_len < 0 || request_len >= REQUEST_MAX_LEN) {
+    logger_log(logger, ERROR, "[%s] the file name [%s] is too long", __func__, file_name);
+    return false;
+  }
+  request->length = (uint16_t)request_len;
+
+  return true;
+}
+
+bool complete_allo_request(struct logger *logger, struct request *request) {
+  const char *arg = get_args(request);
+  if (!arg) return false;
+
+  // the request carries the size already ('allo <size> [r <record size>]')
+  size_t digits = strspn(arg, "0123456789");
+  if (digits && (!arg[digits] || arg[digits] == ' ')) return true;
+
+  char file_name[REQUEST_MAX_LEN];
+  strcpy(file_name, arg);
+
+  struct stat statbuf;
+  if (stat(file_name, &statbuf) == -1) {
+    logger_log(logger, ERROR, "[%s] failed to stat the file [%s]", __func__, file_name);
+    return false;
+  }
+
+  int request_len = snprintf((char *)request->request, REQUEST_MAX_LEN, "allo %jd", (intmax_t)statbuf.st_size);
+  if (request_len < 0 || request_len >= REQUEST_MAX_LEN) return false;
+  request->length = (uint16_t)request_len;
+
+  return true;
+}
+
+void complete_stor_request(struct request *request) {
+  const char *arg = get_args(request);
+  if (!arg || strncmp(arg, "-s ", strlen("-s ")) == 0) return;
+
+  // a file which can't be found fails the transfer later on, with or without a hint
+  struct stat statbuf;
+  if (stat(arg, &statbuf) == -1 || !statbuf.st_size) return;
+
+  char file_name[REQUEST_MAX_LEN];
+  strcpy(file_name, arg);
+
+  struct request completed = {0};
+  int request_len = snprintf((char *)completed.request,
+                             REQUEST_MAX_LEN,
+                             "stor -s %jd %s",
+                             (intmax_t)statbuf.st_size,
+                             file_name);
+  if (request_len < 0 || request_len >= REQUEST_MAX_LEN) return;  // sent without a hint
+
+  completed.length = (uint16_t)request_len;
+  *request = completed;
+}
+
 enum request_type get_request(struct request *request) {
   if (!request) return REQ_UNKNOWN;
 
@@ -233,9 +434,17 @@ enum request_type get_request(struct request *request) {
 }
 
 static void list(struct logger *logger, int sockfd) {
-  struct data_block data = {0};
+  struct stream_reader reader;
+  if (!stream_reader_init(&reader, sockfd, 0, STREAM_READER_LEN)) {
+    logger_log(logger, ERROR, "[%s] memory allocation failure", __func__);
+    return;
+  }
+
+  // a listing is sent in standard blocks, compressed or not
+  uint8_t inflated[DATA_BLOCK_MAX_LEN];
+  struct data_view view = {0};
   do {
-    int recv_ret = receive_data(&data, sockfd, MSG_DONTWAIT);
+    int recv_ret = stream_reader_next_data(&reader, &view);
     if (recv_ret != ERR_SUCCESS) {
       logger_log(logger,
                  ERROR,
@@ -245,22 +454,49 @@ static void list(struct logger *logger, int sockfd) {
       break;
     }
 
-    fprintf(stdout, "%s", (char *)data.data);
-  } while (data.descriptor != DESCPTR_EOF);
-}
+    if (view.descriptor & DESCPTR_COMPRESSED) {
+      ssize_t len = data_view_decompress(&view, inflated, sizeof inflated);
+      if (len == -1) {
+        logger_log(logger, ERROR, "[%s] recieved a malformed compressed block", __func__);
+        break;
+      }
+      fwrite(inflated, sizeof *inflated, (size_t)len, stdout);
+    } else {
+      fwrite(view.data, sizeof *view.data, view.length, stdout);
+    }
+  } while (!(view.descriptor & DESCPTR_EOF));
 
-static void retrieve_file(struct logger *logger, struct request *request, int sockfd) {
-  struct data_block data = {0};
+  stream_reader_destroy(&reader);
+}
 
+static void retrieve_file(struct logger *logger, struct request *request, int sockfd, uint32_t block_size, off_t offset) {
   const char *arg = get_args(request);
-  FILE *fp = fopen(arg, "w");
-  if (!fp) {
+
+  // a restarted transfer keeps what was retrieved before the offset
+  FILE *fp = offset ? fopen(arg, "r+") : fopen(arg, "w");
+  if (!fp || (offset && fseeko(fp, offset, SEEK_SET) != 0)) {
     logger_log(logger, ERROR, "[%s] failed to create the file [%s]", __func__, arg ? arg : "null");
+    if (fp) fclose(fp);
+    return;
+  }
+
+  // the reader buffer holds at least one whole block, so no view is ever cut short
+  size_t capacity = STREAM_READER_LEN;
+  if (capacity < block_size + DATA_BLOCK_EXT_HEADER_LEN) capacity = block_size + DATA_BLOCK_EXT_HEADER_LEN;
+
+  struct stream_reader reader;
+  if (!stream_reader_init(&reader, sockfd, 0, capacity)) {
+    logger_log(logger, ERROR, "[%s] memory allocation failure", __func__);
+    fclose(fp);
     return;
   }
+  reader.max_length = block_size;
 
+  // the blocks are written straight out of the reader buffer. compressed blocks are decompressed into a buffer first
+  uint8_t *inflated = NULL;
+  struct data_view view = {0};
   do {
-    int recv_ret = receive_data(&data, sockfd, MSG_DONTWAIT);
+    int recv_ret = stream_reader_next_data(&reader, &view);
     if (recv_ret != ERR_SUCCESS) {
       logger_log(logger,
                  ERROR,
@@ -270,48 +506,123 @@ static void retrieve_file(struct logger *logger, struct request *request, int so
       break;
     }
 
-    size_t written = fwrite(data.data, sizeof *data.data, data.length, fp);
-    if (written != data.length) {
-      logger_log(logger, ERROR, "[%s] recieved [%hu] bytes but managed to write [%zu]", __func__, data.length, written);
+    const uint8_t *data = view.data;
+    size_t length = view.length;
+    if (view.descriptor & DESCPTR_COMPRESSED) {
+      if (!inflated && !(inflated = malloc(block_size))) {
+        logger_log(logger, ERROR, "[%s] memory allocation failure", __func__);
+        break;
+      }
+
+      ssize_t len = data_view_decompress(&view, inflated, block_size);
+      if (len == -1) {
+        logger_log(logger, ERROR, "[%s] recieved a malformed compressed block", __func__);
+        break;
+      }
+      data = inflated;
+      length = (size_t)len;
+    }
+
+    size_t written = fwrite(data, sizeof *data, length, fp);
+    if (written != length) {
+      logger_log(logger, ERROR, "[%s] recieved [%zu] bytes but managed to write [%zu]", __func__, length, written);
       break;
     }
 
-  } while (data.descriptor != DESCPTR_EOF);
+  } while (!(view.descriptor & DESCPTR_EOF));
 
+  free(inflated);
+  stream_reader_destroy(&reader);
   fclose(fp);
 }
 
-static void store_file(struct logger *logger, struct request *request, int sockfd) {
+/* returns the local file of a 'stor [-s <size>] <file>' request */
+static const char *get_stor_file_name(const struct request *request) {
   const char *arg = get_args(request);
+  if (!arg || strncmp(arg, "-s ", strlen("-s ")) != 0) return arg;
+
+  arg = trim_str(arg + strlen("-s "));
+  return trim_str(arg + strspn(arg, "0123456789"));
+}
+
+static void store_file(struct logger *logger,
+                       struct request *request,
+                       int sockfd,
+                       uint32_t block_size,
+                       bool compressed,
+                       off_t offset) {
+  const char *arg = get_stor_file_name(request);
   FILE *fp = fopen(arg, "r");
-  if (!fp) {
+  if (!fp || fseeko(fp, offset, SEEK_SET) != 0) {
     logger_log(logger, ERROR, "[%s] failed to open the file [%s]", __func__, arg ? arg : "null");
+    if (fp) fclose(fp);
     return;
   }
 
-  struct data_block data = {0};
+  // the blocks of a batch are referenced by the writer, so they must stay intact until the batch is flushed
+  size_t batch_len = block_size > STORE_BATCH_LEN ? block_size : STORE_BATCH_LEN;
+  size_t batch_blocks = batch_len / block_size;
+  uint8_t *batch = malloc(batch_len);
 
-  do {
-    size_t bytes_read = fread(data.data, sizeof *data.data, DATA_BLOCK_MAX_LEN, fp);
-    if (feof(fp)) { data.descriptor = DESCPTR_EOF; }
+  // in compressed mode the blocks which shrink are sent out of the compressor instead
+  struct block_compressor compressor_buf = {0};
+  struct block_compressor *compressor = compressed ? &compressor_buf : NULL;
+  if (!batch || (compressor && !block_compressor_init(compressor, block_size))) {
+    logger_log(logger, ERROR, "[%s] memory allocation failure", __func__);
+    block_compressor_destroy(compressor);
+    free(batch);
+    fclose(fp);
+    return;
+  }
 
-    data.length = (uint16_t)bytes_read;
-    int sent = send_data(&data, sockfd, 0);
-    if (sent != ERR_SUCCESS) {
+  struct stream_writer writer;
+  stream_writer_init(&writer, sockfd, 0);
+
+  bool done = false;
+  while (!done) {
+    int ret = ERR_SUCCESS;
+    for (size_t i = 0; i < batch_blocks && !done && ret == ERR_SUCCESS; i++) {
+      uint8_t *data = batch + i * block_size;
+      size_t bytes_read = fread(data, sizeof *data, block_size, fp);
+
+      uint8_t descriptor = 0;
+      if (bytes_read < block_size) {  // either the end of the file or an error. both end the transfer
+        if (ferror(fp)) logger_log(logger, ERROR, "[%s] failed to read the file [%s]", __func__, arg);
+        descriptor = DESCPTR_EOF;
+        done = true;
+      }
+
+      if (compressor) {
+        ret = stream_writer_compressed_block(&writer, compressor, descriptor, data, (uint32_t)bytes_read);
+      } else {
+        ret = stream_writer_block(&writer, descriptor, data, (uint32_t)bytes_read);
+      }
+    }
+
+    if (ret == ERR_SUCCESS) ret = stream_writer_flush(&writer);
+    if (ret != ERR_SUCCESS) {
       logger_log(logger,
                  ERROR,
                  "[%s] failed to send the data to the server on socket [%d]. reason: [%s]",
                  __func__,
                  sockfd,
-                 str_err_code(sent));
+                 str_err_code(ret));
       break;
     }
-  } while (data.descriptor != DESCPTR_EOF);
+  }
 
+  block_compressor_destroy(compressor);
+  free(batch);
   fclose(fp);
 }
 
-void perform_file_operation(struct logger *logger, enum request_type req_type, struct request *request, int sockfd) {
+void perform_file_operation(struct logger *logger,
+                            enum request_type req_type,
+                            struct request *request,
+                            int sockfd,
+                            uint32_t block_size,
+                            bool compressed,
+                            off_t offset) {
   if (!logger) return;
 
   if (!request) {
@@ -321,16 +632,611 @@ void perform_file_operation(struct logger *logger, enum request_type req_type, s
 
   switch (req_type) {
     case REQ_LIST:
+    case REQ_MLSD:
+    case REQ_MPLS:
       list(logger, sockfd);
       break;
     case REQ_RETR:
-      retrieve_file(logger, request, sockfd);
+      retrieve_file(logger, request, sockfd, block_size, offset);
       break;
     case REQ_STOR:
-      store_file(logger, request, sockfd);
+      store_file(logger, request, sockfd, block_size, compressed, offset);
       break;
     default:
       logger_log(logger, ERROR, "[%s] unknown request", __func__);
       break;
   }
-}
\ No newline at end of file
+}
+/* a range of the file a parallel download fetches over a session of its own */
+struct range {
+  struct logger *logger;
+  const char *host;
+  const char *serv;
+  const char *file_name;
+  int fd;  // the local file. every range is written at its own offsets
+  uint32_t block_size;
+  off_t offset;
+  off_t length;
+  bool done;
+};
+
+static bool vexchange(int sockfd, struct stream_reader *reader, struct reply *reply, const char *fmt, va_list args) {
+  struct request request = {0};
+  int len = vsnprintf((char *)request.request, sizeof request.request, fmt, args);
+  if (len < 0 || (size_t)len >= sizeof request.request) return false;
+  request.length = (uint16_t)len;
+
+  if (send_request(&request, sockfd, 0) != ERR_SUCCESS) return false;
+  return stream_reader_next_reply(reader, reply) == ERR_SUCCESS;
+}
+
+/* sends a request and waits for its reply. returns true on success, false otherwise */
+static bool exchange(int sockfd, struct stream_reader *reader, struct reply *reply, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  bool success = vexchange(sockfd, reader, reply, fmt, args);
+  va_end(args);
+  return success;
+}
+
+/* sends a request which starts a transfer over a passive data connection, and waits for its reply. the server accepts
+ * the data connection on its own time. a request which beats it to it finds the session without a data connection, so
+ * it's repeated for a while. returns true on success, false otherwise */
+static bool start_transfer(int sockfd, struct stream_reader *reader, struct reply *reply, const char *fmt, ...) {
+  for (size_t attempt = 0; attempt < TRANSFER_MAX_ATTEMPTS; attempt++) {
+    va_list args;
+    va_start(args, fmt);
+    bool success = vexchange(sockfd, reader, reply, fmt, args);
+    va_end(args);
+
+    if (!success) return false;
+    if (reply->code != RPLY_DATA_CONN_CLOSED) break;
+
+    thrd_sleep(&(struct timespec){.tv_nsec = TRANSFER_RETRY_INTERVAL_MS * 1000000L}, NULL);
+  }
+  return true;
+}
+
+/* opens a session with the server: connects and reads its greeting. returns the control socket on success, -1
+ * otherwise */
+static int open_session(struct logger *logger, const char *host, const char *serv, struct stream_reader *reader) {
+  int sockfd = connect_to_host(logger, host, serv);
+  if (sockfd == -1) return -1;
+
+  if (!stream_reader_init(reader, sockfd, 0, STREAM_READER_MIN_LEN)) {
+    close(sockfd);
+    return -1;
+  }
+
+  struct reply reply;
+  if (stream_reader_next_reply(reader, &reply) != ERR_SUCCESS || reply.code != RPLY_SERVICE_READY) {
+    stream_reader_destroy(reader);
+    close(sockfd);
+    return -1;
+  }
+
+  return sockfd;
+}
+
+static void close_session(int sockfd, struct stream_reader *reader) {
+  struct reply reply;
+  exchange(sockfd, reader, &reply, "quit");
+  stream_reader_destroy(reader);
+  close(sockfd);
+}
+
+/* has the server open a passive data socket and connects to it. returns the data socket on success, -1 otherwise */
+static int open_data_connection(struct logger *logger, int sockfd, struct stream_reader *reader) {
+  struct reply reply;
+  if (!exchange(sockfd, reader, &reply, "pasv") || reply.code != RPLY_PASSIVE) return -1;
+
+  // the reply ends with (ip,port)
+  char *ip = strrchr((char *)reply.reply, '(');
+  char *port = strrchr((char *)reply.reply, ',');
+  char *end = strrchr((char *)reply.reply, ')');
+  if (!ip || !port || !end || port < ip || end < port) return -1;
+
+  *port++ = 0;
+  *end = 0;
+  return connect_to_host(logger, ip + 1, port);
+}
+
+/* fetches a single range into the local file. returns true on success, false otherwise */
+static bool fetch_range(struct range *range) {
+  struct stream_reader control_reader;
+  int sockfd = open_session(range->logger, range->host, range->serv, &control_reader);
+  if (sockfd == -1) {
+    logger_log(range->logger, ERROR, "[%s] couldn't connect to [%s:%s]", __func__, range->host, range->serv);
+    return false;
+  }
+
+  bool success = false;
+  int data_fd = -1;
+  struct reply reply;
+  if (range->block_size != DATA_BLOCK_MAX_LEN &&
+      (!exchange(sockfd, &control_reader, &reply, "opts blksize %" PRIu32, range->block_size) ||
+       reply.code != RPLY_CMD_OK)) {
+    logger_log(range->logger, ERROR, "[%s] the server refused a block size of [%" PRIu32 "]", __func__, range->block_size);
+    goto session_cleanup;
+  }
+
+  data_fd = open_data_connection(range->logger, sockfd, &control_reader);
+  if (data_fd == -1) {
+    logger_log(range->logger, ERROR, "[%s] failed to open a data connection", __func__);
+    goto session_cleanup;
+  }
+
+  if (!start_transfer(sockfd,
+                      &control_reader,
+                      &reply,
+                      "rang %jd %jd %s",
+                      (intmax_t)range->offset,
+                      (intmax_t)range->length,
+                      range->file_name)) {
+    goto session_cleanup;
+  }
+
+  if (reply.code != RPLY_DATA_CONN_OPEN_STARTING_TRANSFER) {
+    logger_log(range->logger, ERROR, "[%s] the server refused the range. reply: [%s]", __func__, (char *)reply.reply);
+    goto session_cleanup;
+  }
+
+  // the reader buffer holds at least one whole block, so no view is ever cut short
+  size_t capacity = STREAM_READER_LEN;
+  if (capacity < range->block_size + DATA_BLOCK_EXT_HEADER_LEN) capacity = range->block_size + DATA_BLOCK_EXT_HEADER_LEN;
+
+  struct stream_reader reader;
+  if (!stream_reader_init(&reader, data_fd, 0, capacity)) {
+    logger_log(range->logger, ERROR, "[%s] memory allocation failure", __func__);
+    goto session_cleanup;
+  }
+  reader.max_length = range->block_size;
+
+  // the blocks are written straight out of the reader buffer, at the offsets of the range
+  off_t received = 0;
+  struct data_view view = {0};
+  do {
+    int recv_ret = stream_reader_next_data(&reader, &view);
+    if (recv_ret != ERR_SUCCESS) {
+      logger_log(range->logger,
+                 ERROR,
+                 "[%s] encountered an error while recieveing data. reason: [%s]",
+                 __func__,
+                 str_err_code(recv_ret));
+      break;
+    }
+
+    for (size_t written = 0; written < view.length;) {
+      ssize_t ret = pwrite(range->fd, view.data + written, view.length - written, range->offset + received);
+      if (ret == -1) {
+        if (errno == EINTR) continue;
+        logger_log(range->logger, ERROR, "[%s] failed to write the file [%s]", __func__, range->file_name);
+        goto reader_cleanup;
+      }
+
+      written += (size_t)ret;
+      received += ret;
+    }
+  } while (!(view.descriptor & DESCPTR_EOF));
+
+  // the file might have shrunk since its size was taken
+  success = (view.descriptor & DESCPTR_EOF) && received == range->length &&
+            stream_reader_next_reply(&control_reader, &reply) == ERR_SUCCESS && reply.code == RPLY_FILE_ACTION_COMPLETE;
+
+reader_cleanup:
+  stream_reader_destroy(&reader);
+
+session_cleanup:
+  if (data_fd != -1) close(data_fd);
+  close_session(sockfd, &control_reader);
+  return success;
+}
+
+static int fetch(void *arg) {
+  struct range *range = arg;
+  range->done = fetch_range(range);
+  return 0;
+}
+
+/* asks the server for the size of a file with 'mlst'. returns the size on success, -1 otherwise */
+static off_t get_remote_size(struct logger *logger, const char *host, const char *serv, const char *file_name) {
+  struct stream_reader reader;
+  int sockfd = open_session(logger, host, serv, &reader);
+  if (sockfd == -1) return -1;
+
+  off_t size = -1;
+  struct reply reply;
+  if (exchange(sockfd, &reader, &reply, "mlst %s", file_name) && reply.code == RPLY_FILE_ACTION_COMPLETE) {
+    const char *fact = strstr((char *)reply.reply, ";size=");
+    if (fact) size = (off_t)strtoll(fact + strlen(";size="), NULL, 10);
+  }
+
+  close_session(sockfd, &reader);
+  return size;
+}
+
+/* parses the arguments of 'pget <connections> <file>' and 'pput <connections> <file> [<upload id>]'. the file name is
+ * copied into file_name. returns a pointer to what follows the file name on success, NULL otherwise */
+static const char *parse_parallel_args(const struct request *request,
+                                       size_t *connections,
+                                       char *file_name,
+                                       size_t size) {
+  const char *arg = get_args(request);
+  if (!arg) return NULL;
+
+  char *end = NULL;
+  errno = 0;
+  unsigned long value = strtoul(arg, &end, 10);
+  if (errno || end == arg || !isspace((unsigned char)*end) || !value) return NULL;
+
+  const char *name = trim_str(end);
+  size_t len = strcspn(name, " ");
+  if (!len || len >= size) return NULL;
+
+  memcpy(file_name, name, len);
+  file_name[len] = 0;
+
+  *connections = value > PARALLEL_MAX_CONNECTIONS ? PARALLEL_MAX_CONNECTIONS : value;
+  return trim_str(name + len);
+}
+
+void parallel_retrieve(struct logger *logger,
+                       const char *host,
+                       const char *serv,
+                       struct request *request,
+                       uint32_t block_size) {
+  if (!logger) return;
+
+  if (!host || !serv || !request) {
+    logger_log(logger, ERROR, "[%s] host, serv and request may not be NULL", __func__);
+    return;
+  }
+
+  size_t connections = 0;
+  char file_name[REQUEST_MAX_LEN];
+  const char *rest = parse_parallel_args(request, &connections, file_name, sizeof file_name);
+  if (!rest || *rest) {
+    logger_log(logger, ERROR, "[%s] usage: pget <connections> <file>", __func__);
+    return;
+  }
+
+  off_t size = get_remote_size(logger, host, serv, file_name);
+  if (size == -1) {
+    logger_log(logger, ERROR, "[%s] failed to get the size of [%s]", __func__, file_name);
+    return;
+  }
+
+  // small files aren't worth the extra sessions
+  if ((off_t)connections > size / PARALLEL_MIN_RANGE_LEN) connections = (size_t)(size / PARALLEL_MIN_RANGE_LEN);
+  if (!connections) connections = 1;
+
+  int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1 || ftruncate(fd, size) == -1) {
+    logger_log(logger, ERROR, "[%s] failed to create the file [%s]", __func__, file_name);
+    if (fd != -1) close(fd);
+    return;
+  }
+
+  if (!size) {
+    close(fd);
+    fprintf(stdout, "\t\t[%s] retrieved. 0 bytes\n", file_name);
+    return;
+  }
+
+  struct range ranges[PARALLEL_MAX_CONNECTIONS] = {0};
+  thrd_t fetchers[PARALLEL_MAX_CONNECTIONS];
+
+  // split the file into disjoint ranges of (nearly) the same length, one per session
+  off_t range_len = size / (off_t)connections;
+  size_t started = 0;
+  for (; started < connections; started++) {
+    struct range *range = &ranges[started];
+    *range = (struct range){.logger = logger,
+                            .host = host,
+                            .serv = serv,
+                            .file_name = file_name,
+                            .fd = fd,
+                            .block_size = block_size,
+                            .offset = (off_t)started * range_len};
+    range->length = started == connections - 1 ? size - range->offset : range_len;
+
+    if (thrd_create(&fetchers[started], fetch, range) != thrd_success) break;
+  }
+
+  // a range whose fetcher couldn't be started is fetched by the calling thread
+  for (size_t i = started; i < connections; i++) {
+    ranges[i].done = fetch_range(&ranges[i]);
+  }
+
+  bool success = true;
+  for (size_t i = 0; i < connections; i++) {
+    if (i < started) thrd_join(fetchers[i], NULL);
+    success = success && ranges[i].done;
+  }
+  close(fd);
+
+  if (success) {
+    fprintf(stdout, "\t\t[%s] retrieved over [%zu] connections. %jd bytes\n", file_name, connections, (intmax_t)size);
+  } else {
+    logger_log(logger, ERROR, "[%s] failed to retrieve [%s]", __func__, file_name);
+  }
+}
+
+/* a parallel upload. its parts are sent by several sessions at once, each taking the next part which wasn't sent yet */
+struct upload {
+  struct logger *logger;
+  const char *host;
+  const char *serv;
+  const char *id;
+  int fd;  // the local file. every part is read at its own offsets
+  uint32_t block_size;
+  off_t size;
+  size_t parts_num;
+  const bool *stored;  // the parts stored by an earlier attempt
+  atomic_size_t next;  // the next part to be sent
+  atomic_bool failed;
+};
+
+/* reads exactly len bytes of fd from offset on. returns true on success, false otherwise */
+static bool read_fully(int fd, uint8_t *buf, size_t len, off_t offset) {
+  while (len) {
+    ssize_t ret = pread(fd, buf, len, offset);
+    if (ret == -1 && errno == EINTR) continue;
+    if (ret <= 0) return false;
+
+    buf += ret;
+    len -= (size_t)ret;
+    offset += ret;
+  }
+  return true;
+}
+
+/* sends length bytes of fd, from offset on, as data blocks over sockfd. returns true on success, false otherwise */
+static bool send_part(int sockfd, int fd, off_t offset, off_t length, uint32_t block_size) {
+  // the blocks of a batch are referenced by the writer, so they must stay intact until the batch is flushed
+  size_t batch_len = block_size > STORE_BATCH_LEN ? block_size : STORE_BATCH_LEN;
+  size_t batch_blocks = batch_len / block_size;
+  uint8_t *batch = malloc(batch_len);
+  if (!batch) return false;
+
+  struct stream_writer writer;
+  stream_writer_init(&writer, sockfd, 0);
+
+  off_t sent = 0;
+  int ret = ERR_SUCCESS;
+  while (ret == ERR_SUCCESS && sent < length) {
+    for (size_t i = 0; i < batch_blocks && sent < length && ret == ERR_SUCCESS; i++) {
+      uint8_t *data = batch + i * block_size;
+      uint32_t len = length - sent < block_size ? (uint32_t)(length - sent) : block_size;
+      if (!read_fully(fd, data, len, offset + sent)) {
+        ret = ERR_INVALID_ARGS;
+        break;
+      }
+
+      sent += len;
+      ret = stream_writer_block(&writer, sent == length ? DESCPTR_EOF : 0, data, len);
+    }
+
+    if (ret == ERR_SUCCESS) ret = stream_writer_flush(&writer);
+  }
+
+  free(batch);
+  return ret == ERR_SUCCESS;
+}
+
+/* sends the parts of an upload which weren't sent yet, over a session of its own, until there's none left or one of
+ * the sessions failed */
+static int send_parts(void *arg) {
+  struct upload *upload = arg;
+
+  struct stream_reader control_reader;
+  int sockfd = open_session(upload->logger, upload->host, upload->serv, &control_reader);
+  if (sockfd == -1) {
+    logger_log(upload->logger, ERROR, "[%s] couldn't connect to [%s:%s]", __func__, upload->host, upload->serv);
+    atomic_store(&upload->failed, true);
+    return 1;
+  }
+
+  struct reply reply;
+  if (upload->block_size != DATA_BLOCK_MAX_LEN &&
+      (!exchange(sockfd, &control_reader, &reply, "opts blksize %" PRIu32, upload->block_size) ||
+       reply.code != RPLY_CMD_OK)) {
+    logger_log(upload->logger, ERROR, "[%s] the server refused a block size of [%" PRIu32 "]", __func__, upload->block_size);
+    atomic_store(&upload->failed, true);
+  }
+
+  while (!atomic_load(&upload->failed)) {
+    size_t part = atomic_fetch_add(&upload->next, 1);
+    if (part >= upload->parts_num) break;
+    if (upload->stored[part]) continue;
+
+    off_t offset = (off_t)part * PARALLEL_PART_LEN;
+    off_t length = upload->size - offset < PARALLEL_PART_LEN ? upload->size - offset : PARALLEL_PART_LEN;
+
+    bool success = false;
+    int data_fd = open_data_connection(upload->logger, sockfd, &control_reader);
+    if (data_fd != -1 &&
+        start_transfer(sockfd, &control_reader, &reply, "mppt %s %zu %jd", upload->id, part, (intmax_t)offset) &&
+        reply.code == RPLY_DATA_CONN_OPEN_STARTING_TRANSFER) {
+      success = send_part(data_fd, upload->fd, offset, length, upload->block_size) &&
+                stream_reader_next_reply(&control_reader, &reply) == ERR_SUCCESS &&
+                reply.code == RPLY_FILE_ACTION_COMPLETE;
+    }
+    if (data_fd != -1) close(data_fd);
+
+    if (!success) {
+      logger_log(upload->logger, ERROR, "[%s] failed to send part [%zu] of upload [%s]", __func__, part, upload->id);
+      atomic_store(&upload->failed, true);
+    }
+  }
+
+  close_session(sockfd, &control_reader);
+  return 0;
+}
+
+/* marks the parts an earlier attempt of an upload stored, as listed by 'mpls'. a part counts only if it was stored with
+ * the offset and length this client gives it. returns true on success, false otherwise */
+static bool get_stored_parts(struct upload *upload, int sockfd, struct stream_reader *control_reader, bool *stored) {
+  int data_fd = open_data_connection(upload->logger, sockfd, control_reader);
+  if (data_fd == -1) return false;
+
+  struct reply reply;
+  struct stream_reader reader = {0};
+  bool success = start_transfer(sockfd, control_reader, &reply, "mpls %s", upload->id) &&
+                 reply.code == RPLY_DATA_CONN_OPEN_STARTING_TRANSFER &&
+                 stream_reader_init(&reader, data_fd, 0, STREAM_READER_LEN);
+
+  // the listing is a '<part> <offset> <length>' line per part. a line might be split between blocks
+  char line[PART_LINE_LEN];
+  size_t line_len = 0;
+  struct data_view view = {.descriptor = success ? 0 : DESCPTR_EOF};
+  while (!(view.descriptor & DESCPTR_EOF)) {
+    if (stream_reader_next_data(&reader, &view) != ERR_SUCCESS) {
+      success = false;
+      break;
+    }
+
+    for (uint32_t i = 0; i < view.length; i++) {
+      if (view.data[i] != '\n') {
+        if (line_len < sizeof line - 1) line[line_len++] = (char)view.data[i];
+        continue;
+      }
+
+      line[line_len] = 0;
+      line_len = 0;
+
+      intmax_t part, offset, length;
+      if (sscanf(line, "%jd %jd %jd", &part, &offset, &length) != 3) continue;
+      if (part < 0 || (uintmax_t)part >= upload->parts_num || offset != part * PARALLEL_PART_LEN) continue;
+
+      off_t expected = upload->size - offset < PARALLEL_PART_LEN ? upload->size - offset : PARALLEL_PART_LEN;
+      stored[part] = length == expected;
+    }
+  }
+
+  if (success) {
+    success = stream_reader_next_reply(control_reader, &reply) == ERR_SUCCESS && reply.code == RPLY_FILE_ACTION_COMPLETE;
+  }
+
+  stream_reader_destroy(&reader);
+  close(data_fd);
+  return success;
+}
+
+void parallel_store(struct logger *logger,
+                    const char *host,
+                    const char *serv,
+                    struct request *request,
+                    uint32_t block_size) {
+  if (!logger) return;
+
+  if (!host || !serv || !request) {
+    logger_log(logger, ERROR, "[%s] host, serv and request may not be NULL", __func__);
+    return;
+  }
+
+  size_t connections = 0;
+  char file_name[REQUEST_MAX_LEN];
+  const char *id_arg = parse_parallel_args(request, &connections, file_name, sizeof file_name);
+  if (!id_arg || strcspn(id_arg, " ") != strlen(id_arg) || strlen(id_arg) > UPLOAD_ID_LEN) {
+    logger_log(logger, ERROR, "[%s] usage: pput <connections> <file> [upload id]", __func__);
+    return;
+  }
+
+  struct stat statbuf;
+  int fd = open(file_name, O_RDONLY);
+  if (fd == -1 || fstat(fd, &statbuf) == -1) {
+    logger_log(logger, ERROR, "[%s] failed to open the file [%s]", __func__, file_name);
+    if (fd != -1) close(fd);
+    return;
+  }
+
+  struct stream_reader control_reader;
+  int sockfd = open_session(logger, host, serv, &control_reader);
+  if (sockfd == -1) {
+    logger_log(logger, ERROR, "[%s] couldn't connect to [%s:%s]", __func__, host, serv);
+    close(fd);
+    return;
+  }
+
+  char id[UPLOAD_ID_LEN + 1] = {0};
+  struct reply reply;
+  if (*id_arg) {
+    strcpy(id, id_arg);
+  } else if (exchange(sockfd, &control_reader, &reply, "mpin %s", file_name) && reply.code == RPLY_CMD_OK) {
+    // the reply ends with 'upload [<upload id>]'
+    const char *id_start = strstr((char *)reply.reply, "upload [");
+    if (id_start) sscanf(id_start, "upload [%16[0-9a-f]]", id);
+  }
+
+  if (strlen(id) != UPLOAD_ID_LEN) {
+    logger_log(logger, ERROR, "[%s] failed to start an upload of [%s]", __func__, file_name);
+    close_session(sockfd, &control_reader);
+    close(fd);
+    return;
+  }
+  fprintf(stdout, "\t\tupload [%s] of [%s]\n", id, file_name);
+
+  struct upload upload = {.logger = logger,
+                          .host = host,
+                          .serv = serv,
+                          .id = id,
+                          .fd = fd,
+                          .block_size = block_size,
+                          .size = statbuf.st_size,
+                          .parts_num = (size_t)((statbuf.st_size + PARALLEL_PART_LEN - 1) / PARALLEL_PART_LEN)};
+  atomic_init(&upload.next, 0);
+  atomic_init(&upload.failed, false);
+
+  bool *stored = calloc(upload.parts_num ? upload.parts_num : 1, sizeof *stored);
+  bool success = stored != NULL;
+  upload.stored = stored;
+
+  // a resumed upload sends only the parts which weren't stored yet
+  if (success && *id_arg) success = get_stored_parts(&upload, sockfd, &control_reader, stored);
+
+  if (success) {
+    if (connections > upload.parts_num) connections = upload.parts_num ? upload.parts_num : 1;
+
+    thrd_t senders[PARALLEL_MAX_CONNECTIONS];
+    size_t started = 0;
+    for (; started < connections; started++) {
+      if (thrd_create(&senders[started], send_parts, &upload) != thrd_success) break;
+    }
+
+    // every sender takes parts until there's none left. if none could be started the calling thread sends them
+    if (!started) send_parts(&upload);
+
+    for (size_t i = 0; i < started; i++) {
+      thrd_join(senders[i], NULL);
+    }
+
+    success = !atomic_load(&upload.failed);
+  }
+
+  if (success) {
+    success = exchange(sockfd, &control_reader, &reply, "mpcm %s %jd", id, (intmax_t)statbuf.st_size) &&
+              reply.code == RPLY_FILE_ACTION_COMPLETE;
+  }
+
+  if (success) {
+    fprintf(stdout,
+            "\t\t[%s] stored over [%zu] connections. %jd bytes\n",
+            file_name,
+            connections,
+            (intmax_t)statbuf.st_size);
+  } else {
+    logger_log(logger,
+               ERROR,
+               "[%s] failed to store [%s]. resume it with 'pput %zu %s %s'",
+               __func__,
+               file_name,
+               connections,
+               file_name,
+               id);
+  }
+
+  free(stored);
+  close_session(sockfd, &control_reader);
+  close(fd);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* crc32c (the castagnoli polynomial, as used by iscsi, ext4 and sctp). a crc is computed incrementally: start with 0
+ * and pass the crc of the data so far along with the data which follows it. crc32c(0, "123456789", 9) == 0xe3069283 */
+
+/* returns the crc32c of len bytes of data appended to data whose crc32c is crc. uses the crc32 instruction of sse4.2
+ * when the cpu has it, on three interleaved streams so the latency of the instruction is hidden. falls back to
+ * crc32c_portable() otherwise. mt-safe */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+/* the same as crc32c(), computed with plain table lookups (slicing by 8) on any cpu */
+uint32_t crc32c_portable(uint32_t crc, const void *data, size_t len);
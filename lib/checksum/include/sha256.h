@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* sha-256 (fips 180-4). a digest is computed incrementally: init a context, update it with the data in any number of
+ * pieces, and finalize it into the digest */
+
+#define SHA256_LEN 32
+#define SHA256_BLOCK_LEN 64
+#define SHA256_HEX_LEN (SHA256_LEN * 2)
+
+struct sha256 {
+  uint32_t state[8];
+  uint64_t length;  // the number of bytes hashed so far
+  uint8_t block[SHA256_BLOCK_LEN];
+  size_t block_len;  // the number of bytes waiting in block
+
+  // hashes a number of whole blocks into the state
+  void (*compress)(uint32_t *state, const uint8_t *data, size_t blocks);
+};
+
+/* initializes a context. uses the sha extensions when the cpu has them, plain code otherwise. mt-safe */
+void sha256_init(struct sha256 *ctx);
+
+/* the same as sha256_init(), but the digest is always computed with plain code */
+void sha256_init_portable(struct sha256 *ctx);
+
+/* hashes len bytes of data */
+void sha256_update(struct sha256 *ctx, const void *data, size_t len);
+
+/* writes the digest of all the data hashed into digest. the context has to be initialized again before it's reused */
+void sha256_final(struct sha256 *ctx, uint8_t digest[SHA256_LEN]);
+
+/* formats a digest as SHA256_HEX_LEN lowercase hex digits and a null terminator */
+void sha256_hex(const uint8_t digest[SHA256_LEN], char hex[SHA256_HEX_LEN + 1]);
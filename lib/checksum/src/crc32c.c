@@ -0,0 +1,197 @@
+#include "include/crc32c.h"
+#include <stdbool.h>
+#include <string.h>  // memcpy
+#include <threads.h>  // call_once
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define HAVE_SSE42
+#endif
+
+#define POLY 0x82f63b78  // the castagnoli polynomial, reflected
+
+// the lengths of the interleaved streams. the crcs of the streams are combined by shifting them over the length
+#define LONG_LEN 8192
+#define SHORT_LEN 256
+
+static once_flag init_flag = ONCE_FLAG_INIT;
+
+// table[0] is the crc of a single byte. table[k] is the crc of a byte followed by k zero bytes
+static uint32_t table[8][256];
+
+#ifdef HAVE_SSE42
+static bool has_sse42;
+
+// the operators which shift a crc over LONG_LEN and SHORT_LEN zero bytes, a byte of the crc at a time
+static uint32_t long_shifts[4][256];
+static uint32_t short_shifts[4][256];
+
+/* multiplies the 32x32 matrix over gf(2) mat by vec */
+static uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec) {
+  uint32_t sum = 0;
+  for (; vec; vec >>= 1, mat++) {
+    if (vec & 1) sum ^= *mat;
+  }
+  return sum;
+}
+
+static void gf2_matrix_square(uint32_t *square, const uint32_t *mat) {
+  for (size_t i = 0; i < 32; i++) {
+    square[i] = gf2_matrix_times(mat, mat[i]);
+  }
+}
+
+/* builds the tables of the operator which appends len zero bytes to a crc. len must be a power of two */
+static void init_shifts(uint32_t shifts[4][256], size_t len) {
+  uint32_t even[32];
+  uint32_t odd[32];
+
+  // the operator for a single zero bit
+  odd[0] = POLY;
+  for (size_t i = 1; i < 32; i++) {
+    odd[i] = 1U << (i - 1);
+  }
+
+  gf2_matrix_square(even, odd);  // two zero bits
+  gf2_matrix_square(odd, even);  // four zero bits
+
+  // every square doubles the number of zero bytes, starting from one. the last operator may end up in either matrix
+  const uint32_t *op = NULL;
+  for (;;) {
+    gf2_matrix_square(even, odd);
+    len >>= 1;
+    if (!len) {
+      op = even;
+      break;
+    }
+    gf2_matrix_square(odd, even);
+    len >>= 1;
+    if (!len) {
+      op = odd;
+      break;
+    }
+  }
+
+  for (uint32_t i = 0; i < 256; i++) {
+    shifts[0][i] = gf2_matrix_times(op, i);
+    shifts[1][i] = gf2_matrix_times(op, i << 8);
+    shifts[2][i] = gf2_matrix_times(op, i << 16);
+    shifts[3][i] = gf2_matrix_times(op, i << 24);
+  }
+}
+
+static uint32_t shift(uint32_t shifts[4][256], uint32_t crc) {
+  return shifts[0][crc & 0xff] ^ shifts[1][(crc >> 8) & 0xff] ^ shifts[2][(crc >> 16) & 0xff] ^ shifts[3][crc >> 24];
+}
+#endif
+
+static void init_tables(void) {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (size_t bit = 0; bit < 8; bit++) {
+      crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+    }
+    table[0][i] = crc;
+  }
+  for (uint32_t i = 0; i < 256; i++) {
+    for (size_t k = 1; k < 8; k++) {
+      table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+    }
+  }
+
+#ifdef HAVE_SSE42
+  has_sse42 = __builtin_cpu_supports("sse4.2");
+  if (has_sse42) {
+    init_shifts(long_shifts, LONG_LEN);
+    init_shifts(short_shifts, SHORT_LEN);
+  }
+#endif
+}
+
+static uint64_t read_u64(const uint8_t *ptr) {
+  uint64_t value;
+  memcpy(&value, ptr, sizeof value);
+  return value;
+}
+
+#ifdef HAVE_SSE42
+/* the crc32 instruction takes 3 cycles but a new one may start every cycle. three streams are crced at once (the first,
+ * second and third part of a block) and combined: the crc of a || b is the crc of a shifted over len(b) zero bytes,
+ * xored with the crc of b */
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *ptr, size_t len) {
+  uint64_t crc0 = crc ^ 0xffffffff;
+
+  // align the reads
+  for (; len && ((uintptr_t)ptr & 7); len--) {
+    crc0 = _mm_crc32_u8((uint32_t)crc0, *ptr++);
+  }
+
+  while (len >= LONG_LEN * 3) {
+    uint64_t crc1 = 0;
+    uint64_t crc2 = 0;
+    for (const uint8_t *end = ptr + LONG_LEN; ptr < end; ptr += sizeof(uint64_t)) {
+      crc0 = _mm_crc32_u64(crc0, read_u64(ptr));
+      crc1 = _mm_crc32_u64(crc1, read_u64(ptr + LONG_LEN));
+      crc2 = _mm_crc32_u64(crc2, read_u64(ptr + LONG_LEN * 2));
+    }
+    crc0 = shift(long_shifts, (uint32_t)crc0) ^ crc1;
+    crc0 = shift(long_shifts, (uint32_t)crc0) ^ crc2;
+    ptr += LONG_LEN * 2;
+    len -= LONG_LEN * 3;
+  }
+
+  while (len >= SHORT_LEN * 3) {
+    uint64_t crc1 = 0;
+    uint64_t crc2 = 0;
+    for (const uint8_t *end = ptr + SHORT_LEN; ptr < end; ptr += sizeof(uint64_t)) {
+      crc0 = _mm_crc32_u64(crc0, read_u64(ptr));
+      crc1 = _mm_crc32_u64(crc1, read_u64(ptr + SHORT_LEN));
+      crc2 = _mm_crc32_u64(crc2, read_u64(ptr + SHORT_LEN * 2));
+    }
+    crc0 = shift(short_shifts, (uint32_t)crc0) ^ crc1;
+    crc0 = shift(short_shifts, (uint32_t)crc0) ^ crc2;
+    ptr += SHORT_LEN * 2;
+    len -= SHORT_LEN * 3;
+  }
+
+  for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t), ptr += sizeof(uint64_t)) {
+    crc0 = _mm_crc32_u64(crc0, read_u64(ptr));
+  }
+  for (; len; len--) {
+    crc0 = _mm_crc32_u8((uint32_t)crc0, *ptr++);
+  }
+
+  return (uint32_t)crc0 ^ 0xffffffff;
+}
+#endif
+
+uint32_t crc32c_portable(uint32_t crc, const void *data, size_t len) {
+  call_once(&init_flag, init_tables);
+
+  const uint8_t *ptr = data;
+  crc ^= 0xffffffff;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t), ptr += sizeof(uint64_t)) {
+    uint64_t word = read_u64(ptr) ^ crc;
+    crc = table[7][word & 0xff] ^ table[6][(word >> 8) & 0xff] ^ table[5][(word >> 16) & 0xff] ^
+          table[4][(word >> 24) & 0xff] ^ table[3][(word >> 32) & 0xff] ^ table[2][(word >> 40) & 0xff] ^
+          table[1][(word >> 48) & 0xff] ^ table[0][word >> 56];
+  }
+#endif
+
+  for (; len; len--) {
+    crc = (crc >> 8) ^ table[0][(crc ^ *ptr++) & 0xff];
+  }
+
+  return crc ^ 0xffffffff;
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+  call_once(&init_flag, init_tables);
+
+#ifdef HAVE_SSE42
+  if (has_sse42) return crc32c_sse42(crc, data, len);
+#endif
+  return crc32c_portable(crc, data, len);
+}
@@ -0,0 +1,210 @@
+#include "include/sha256.h"
+#include <stdbool.h>
+#include <string.h>   // memcpy
+#include <threads.h>  // call_once
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_SHA_NI
+#endif
+
+static const uint32_t initial_state[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+static const uint32_t round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
+    0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
+    0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static uint32_t rotr(uint32_t value, unsigned bits) {
+  return (value >> bits) | (value << (32 - bits));
+}
+
+static uint32_t read_be32(const uint8_t *ptr) {
+  return (uint32_t)ptr[0] << 24 | (uint32_t)ptr[1] << 16 | (uint32_t)ptr[2] << 8 | ptr[3];
+}
+
+static void compress_portable(uint32_t *state, const uint8_t *data, size_t blocks) {
+  for (; blocks; blocks--, data += SHA256_BLOCK_LEN) {
+    uint32_t schedule[64];
+    for (size_t i = 0; i < 16; i++) {
+      schedule[i] = read_be32(data + i * sizeof(uint32_t));
+    }
+    for (size_t i = 16; i < 64; i++) {
+      uint32_t s0 = rotr(schedule[i - 15], 7) ^ rotr(schedule[i - 15], 18) ^ (schedule[i - 15] >> 3);
+      uint32_t s1 = rotr(schedule[i - 2], 17) ^ rotr(schedule[i - 2], 19) ^ (schedule[i - 2] >> 10);
+      schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (size_t i = 0; i < 64; i++) {
+      uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + round_constants[i] + schedule[i];
+      uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+#ifdef HAVE_SHA_NI
+static once_flag init_flag = ONCE_FLAG_INIT;
+static bool has_sha_ni;
+
+static void detect_cpu(void) {
+  has_sha_ni = __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+}
+
+/* the sha extensions keep the state in two registers, abef and cdgh. every sha256rnds2 does two rounds, and the
+ * message schedule is computed 4 words at a time with sha256msg1 and sha256msg2, a group of 4 rounds behind */
+__attribute__((target("sha,sse4.1"))) static void compress_sha_ni(uint32_t *state, const uint8_t *data, size_t blocks) {
+  const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+
+  __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xb1);  // cdab
+  __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1b);  // efgh
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);  // abef
+  state1 = _mm_blend_epi16(state1, tmp, 0xf0);       // cdgh
+
+  for (; blocks; blocks--, data += SHA256_BLOCK_LEN) {
+    __m128i abef = state0;
+    __m128i cdgh = state1;
+
+    __m128i msgs[4];
+    for (size_t i = 0; i < 4; i++) {
+      msgs[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * sizeof(__m128i))), byte_swap);
+    }
+
+    // 16 groups of 4 rounds. msgs holds the 4 groups of schedule words around the current one. unrolled, so msgs
+    // stays in registers
+#pragma GCC unroll 16
+    for (size_t group = 0; group < 16; group++) {
+      __m128i msg = _mm_add_epi32(msgs[group % 4], _mm_loadu_si128((const __m128i *)&round_constants[group * 4]));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+
+      if (group >= 3 && group < 15) {
+        __m128i next = _mm_add_epi32(msgs[(group + 1) % 4], _mm_alignr_epi8(msgs[group % 4], msgs[(group + 3) % 4], 4));
+        msgs[(group + 1) % 4] = _mm_sha256msg2_epu32(next, msgs[group % 4]);
+      }
+
+      state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+
+      if (group >= 1 && group < 13) msgs[(group + 3) % 4] = _mm_sha256msg1_epu32(msgs[(group + 3) % 4], msgs[group % 4]);
+    }
+
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1b);        // feba
+  state1 = _mm_shuffle_epi32(state1, 0xb1);     // dchg
+  state0 = _mm_blend_epi16(tmp, state1, 0xf0);  // dcba
+  state1 = _mm_alignr_epi8(state1, tmp, 8);     // hgfe
+  _mm_storeu_si128((__m128i *)&state[0], state0);
+  _mm_storeu_si128((__m128i *)&state[4], state1);
+}
+#endif
+
+void sha256_init_portable(struct sha256 *ctx) {
+  if (!ctx) return;
+
+  memcpy(ctx->state, initial_state, sizeof ctx->state);
+  ctx->length = 0;
+  ctx->block_len = 0;
+  ctx->compress = compress_portable;
+}
+
+void sha256_init(struct sha256 *ctx) {
+  if (!ctx) return;
+
+  sha256_init_portable(ctx);
+#ifdef HAVE_SHA_NI
+  call_once(&init_flag, detect_cpu);
+  if (has_sha_ni) ctx->compress = compress_sha_ni;
+#endif
+}
+
+void sha256_update(struct sha256 *ctx, const void *data, size_t len) {
+  if (!ctx || !data) return;
+
+  const uint8_t *ptr = data;
+  ctx->length += len;
+
+  // fill up the pending block first
+  if (ctx->block_len) {
+    size_t fill = SHA256_BLOCK_LEN - ctx->block_len < len ? SHA256_BLOCK_LEN - ctx->block_len : len;
+    memcpy(ctx->block + ctx->block_len, ptr, fill);
+    ctx->block_len += fill;
+    ptr += fill;
+    len -= fill;
+
+    if (ctx->block_len < SHA256_BLOCK_LEN) return;
+    ctx->compress(ctx->state, ctx->block, 1);
+    ctx->block_len = 0;
+  }
+
+  // whole blocks are hashed straight out of data
+  size_t blocks = len / SHA256_BLOCK_LEN;
+  if (blocks) {
+    ctx->compress(ctx->state, ptr, blocks);
+    ptr += blocks * SHA256_BLOCK_LEN;
+    len -= blocks * SHA256_BLOCK_LEN;
+  }
+
+  memcpy(ctx->block, ptr, len);
+  ctx->block_len = len;
+}
+
+void sha256_final(struct sha256 *ctx, uint8_t digest[SHA256_LEN]) {
+  if (!ctx || !digest) return;
+
+  // a 1 bit, zeros up to 8 bytes before the end of a block, and the length in bits (big endian)
+  uint64_t bits = ctx->length * 8;
+  ctx->block[ctx->block_len++] = 0x80;
+  if (ctx->block_len > SHA256_BLOCK_LEN - sizeof bits) {
+    memset(ctx->block + ctx->block_len, 0, SHA256_BLOCK_LEN - ctx->block_len);
+    ctx->compress(ctx->state, ctx->block, 1);
+    ctx->block_len = 0;
+  }
+  memset(ctx->block + ctx->block_len, 0, SHA256_BLOCK_LEN - sizeof bits - ctx->block_len);
+  for (size_t i = 0; i < sizeof bits; i++) {
+    ctx->block[SHA256_BLOCK_LEN - 1 - i] = (uint8_t)(bits >> (i * 8));
+  }
+  ctx->compress(ctx->state, ctx->block, 1);
+
+  for (size_t i = 0; i < 8; i++) {
+    digest[i * 4] = (uint8_t)(ctx->state[i] >> 24);
+    digest[i * 4 + 1] = (uint8_t)(ctx->state[i] >> 16);
+    digest[i * 4 + 2] = (uint8_t)(ctx->state[i] >> 8);
+    digest[i * 4 + 3] = (uint8_t)ctx->state[i];
+  }
+}
+
+void sha256_hex(const uint8_t digest[SHA256_LEN], char hex[SHA256_HEX_LEN + 1]) {
+  if (!digest || !hex) return;
+
+  static const char digits[] = "0123456789abcdef";
+  for (size_t i = 0; i < SHA256_LEN; i++) {
+    hex[i * 2] = digits[digest[i] >> 4];
+    hex[i * 2 + 1] = digits[digest[i] & 0xf];
+  }
+  hex[SHA256_HEX_LEN] = '\0';
+}
@@ -0,0 +1,69 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/crc32c.h"
+
+static void fill_random(uint8_t *buf, size_t len) {
+  uint64_t state = 0x9E3779B97F4A7C15U;
+  for (size_t i = 0; i < len; i++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    buf[i] = (uint8_t)state;
+  }
+}
+
+void known_values_test(void) {
+  // then
+  assert(crc32c(0, "", 0) == 0);
+  assert(crc32c_portable(0, "", 0) == 0);
+  assert(crc32c(0, "123456789", 9) == 0xe3069283);
+  assert(crc32c_portable(0, "123456789", 9) == 0xe3069283);
+
+  uint8_t zeros[32] = {0};
+  assert(crc32c(0, zeros, sizeof zeros) == 0x8a9136aa);
+  assert(crc32c_portable(0, zeros, sizeof zeros) == 0x8a9136aa);
+}
+
+void lengths_test(void) {
+  // given
+  const size_t len = 3 * 8192 * 2 + 3 * 256 + 100;
+  uint8_t *buf = malloc(len + 8);
+  assert(buf);
+  fill_random(buf, len + 8);
+
+  // then
+  // every length crosses the interleaved blocks differently, and every alignment is read differently
+  for (size_t offset = 0; offset < 8; offset++) {
+    for (size_t i = 0; i <= len; i += i < 1024 ? 1 : 97) {
+      assert(crc32c(0, buf + offset, i) == crc32c_portable(0, buf + offset, i));
+    }
+  }
+
+  free(buf);
+}
+
+void incremental_test(void) {
+  // given
+  const size_t len = 100 * 1024;
+  uint8_t *buf = malloc(len);
+  assert(buf);
+  fill_random(buf, len);
+
+  uint32_t whole = crc32c(0, buf, len);
+
+  // then
+  for (size_t split = 0; split <= len; split += 4099) {
+    assert(crc32c(crc32c(0, buf, split), buf + split, len - split) == whole);
+    assert(crc32c_portable(crc32c_portable(0, buf, split), buf + split, len - split) == whole);
+  }
+
+  free(buf);
+}
+
+int main(void) {
+  known_values_test();
+  lengths_test();
+  incremental_test();
+}
@@ -0,0 +1,94 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/sha256.h"
+
+static void fill_random(uint8_t *buf, size_t len) {
+  uint64_t state = 0x9E3779B97F4A7C15U;
+  for (size_t i = 0; i < len; i++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    buf[i] = (uint8_t)state;
+  }
+}
+
+static void digest_hex(void (*init)(struct sha256 *), const void *data, size_t len, char hex[SHA256_HEX_LEN + 1]) {
+  struct sha256 ctx;
+  uint8_t digest[SHA256_LEN];
+  init(&ctx);
+  sha256_update(&ctx, data, len);
+  sha256_final(&ctx, digest);
+  sha256_hex(digest, hex);
+}
+
+void known_values_test(void (*init)(struct sha256 *)) {
+  // given
+  char hex[SHA256_HEX_LEN + 1];
+  const char *two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+  // then
+  digest_hex(init, "", 0, hex);
+  assert(strcmp(hex, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855") == 0);
+
+  digest_hex(init, "abc", 3, hex);
+  assert(strcmp(hex, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") == 0);
+
+  digest_hex(init, two_blocks, strlen(two_blocks), hex);
+  assert(strcmp(hex, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1") == 0);
+
+  // a million 'a's, hashed in pieces which don't line up with the blocks
+  uint8_t as[1000];
+  memset(as, 'a', sizeof as);
+  struct sha256 ctx;
+  uint8_t digest[SHA256_LEN];
+  init(&ctx);
+  for (size_t i = 0; i < 1000; i++) {
+    sha256_update(&ctx, as, sizeof as);
+  }
+  sha256_final(&ctx, digest);
+  sha256_hex(digest, hex);
+  assert(strcmp(hex, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0") == 0);
+}
+
+void pieces_test(void) {
+  // given
+  const size_t len = 10 * 1024 + 13;
+  uint8_t *buf = malloc(len);
+  assert(buf);
+  fill_random(buf, len);
+
+  char whole[SHA256_HEX_LEN + 1];
+  digest_hex(sha256_init_portable, buf, len, whole);
+
+  // then
+  // every length around the padding boundaries, and every way of splitting the data, give the same digest
+  for (size_t i = 0; i <= 130; i++) {
+    char accelerated[SHA256_HEX_LEN + 1];
+    char portable[SHA256_HEX_LEN + 1];
+    digest_hex(sha256_init, buf, i, accelerated);
+    digest_hex(sha256_init_portable, buf, i, portable);
+    assert(strcmp(accelerated, portable) == 0);
+  }
+
+  for (size_t split = 0; split <= len; split += 61) {
+    struct sha256 ctx;
+    uint8_t digest[SHA256_LEN];
+    char hex[SHA256_HEX_LEN + 1];
+    sha256_init(&ctx);
+    sha256_update(&ctx, buf, split);
+    sha256_update(&ctx, buf + split, len - split);
+    sha256_final(&ctx, digest);
+    sha256_hex(digest, hex);
+    assert(strcmp(hex, whole) == 0);
+  }
+
+  free(buf);
+}
+
+int main(void) {
+  known_values_test(sha256_init);
+  known_values_test(sha256_init_portable);
+  pieces_test();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <threads.h>
+
+#define TABLE_S_STRIPES 16
+#define TABLE_S_STRIPE_INIT_CAPACITY 16
+
+/* mt-safe hash table object. keys and values are of a fixed size (set on init) and are stored by value inside the
+ * table, so lookups, updates and removals copy them in and out of caller owned memory and never allocate. the table is
+ * split into TABLE_S_STRIPES independent stripes, each an open addressing table guarded by its own lock, so threads
+ * working on different keys rarely contend. keys are compared byte-wise */
+struct hash_table_s;
+
+/* creates a table for keys of key_size bytes and values of value_size bytes. destroy_value may be NULL. if it isn't
+ * NULL it's called for every value which is dropped by the table (see table_s_remove() and table_s_destroy()). returns
+ * a pointer to a heap allocated table on success, NULL on failure */
+struct hash_table_s *table_s_init(size_t key_size, size_t value_size, void (*destroy_value)(void *value));
+
+/* destroys the table. calls destroy_value for every value still in the table */
+void table_s_destroy(struct hash_table_s *table);
+
+/* returns the number of elements in the table */
+size_t table_s_size(struct hash_table_s *table);
+
+/* maps key to a copy of value. an existing mapping for key is overwritten (destroy_value isn't called for the old
+ * value). allocates only when a stripe has to grow. returns true on success, false otherwise */
+bool table_s_put(struct hash_table_s *table, const void *key, const void *value);
+
+/* copies the value mapped to key into value. returns true if key was found, false otherwise */
+bool table_s_get(struct hash_table_s *table, const void *key, void *value);
+
+/* overwrites the value mapped to key with a copy of value. unlike table_s_put() never creates a new mapping. returns
+ * true if key was found, false otherwise */
+bool table_s_replace(struct hash_table_s *table, const void *key, const void *value);
+
+/* removes the mapping for key. if value isn't NULL the removed value is copied into it and the caller owns it.
+ * otherwise destroy_value is called for it. returns true if key was found, false otherwise */
+bool table_s_remove(struct hash_table_s *table, const void *key, void *value);
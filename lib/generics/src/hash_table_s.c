@@ -0,0 +1,296 @@
+#include <stddef.h>  // max_align_t
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/hash_table_s.h"
+
+/* a stripe is a linear probing table. a slot holds a key followed by its value. removals shift the following slots
+ * back, so there are no tombstones and a lookup stops at the first empty slot */
+struct stripe {
+  mtx_t lock;
+
+  // the number of slots. always a power of 2
+  size_t capacity;
+  size_t num_of_elements;
+
+  bool *used;
+  unsigned char *slots;
+};
+
+struct hash_table_s {
+  size_t key_size;
+  size_t value_size;
+
+  // values are stored aligned, so the pointers handed to destroy_value are valid objects
+  size_t value_offset;
+  size_t slot_size;
+
+  void (*destroy_value)(void *value);
+
+  struct stripe stripes[TABLE_S_STRIPES];
+};
+
+/* used internally to hash the keys (djb2 by Dan Bernstein followed by a 64 bit finalizer, since keys are often small
+ * integers which djb2 alone spreads poorly) */
+static uint64_t hash(const void *key, size_t key_size) {
+  const unsigned char *k = key;
+  uint64_t hash = 5381;
+  for (size_t i = 0; i < key_size; i++, k++) {
+    hash = hash * 33 + *k;
+  }
+
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+/* the stripe is picked by the high bits of the hash, the slot by the low ones */
+static struct stripe *stripe_of(struct hash_table_s *table, uint64_t hash) {
+  return &table->stripes[(hash >> 56) % TABLE_S_STRIPES];
+}
+
+static unsigned char *slot_at(struct hash_table_s *table, struct stripe *stripe, size_t pos) {
+  return stripe->slots + pos * table->slot_size;
+}
+
+static bool stripe_alloc(struct hash_table_s *table, struct stripe *stripe, size_t capacity) {
+  stripe->used = calloc(capacity, sizeof *stripe->used);
+  stripe->slots = malloc(capacity * table->slot_size);
+  if (!stripe->used || !stripe->slots) {
+    free(stripe->used);
+    free(stripe->slots);
+    stripe->used = NULL;
+    stripe->slots = NULL;
+    return false;
+  }
+
+  stripe->capacity = capacity;
+  stripe->num_of_elements = 0;
+  return true;
+}
+
+/* returns the position of key in the stripe, or the position of the empty slot where it should be inserted. *found
+ * tells which one it is. the stripe lock must be held */
+static size_t stripe_find(struct hash_table_s *table,
+                          struct stripe *stripe,
+                          const void *key,
+                          uint64_t hash,
+                          bool *found) {
+  size_t mask = stripe->capacity - 1;
+  size_t pos = hash & mask;
+  while (stripe->used[pos]) {
+    if (memcmp(slot_at(table, stripe, pos), key, table->key_size) == 0) {
+      *found = true;
+      return pos;
+    }
+    pos = (pos + 1) & mask;
+  }
+
+  *found = false;
+  return pos;
+}
+
+/* doubles the capacity of a stripe. the stripe lock must be held */
+static bool stripe_grow(struct hash_table_s *table, struct stripe *stripe) {
+  if (stripe->capacity > (SIZE_MAX >> 1) / table->slot_size) return false;
+
+  struct stripe old = *stripe;
+  if (!stripe_alloc(table, stripe, old.capacity << 1)) {
+    stripe->used = old.used;
+    stripe->slots = old.slots;
+    stripe->capacity = old.capacity;
+    stripe->num_of_elements = old.num_of_elements;
+    return false;
+  }
+
+  for (size_t i = 0; i < old.capacity; i++) {
+    if (!old.used[i]) continue;
+
+    unsigned char *slot = old.slots + i * table->slot_size;
+    bool found;
+    size_t pos = stripe_find(table, stripe, slot, hash(slot, table->key_size), &found);
+    memcpy(slot_at(table, stripe, pos), slot, table->slot_size);
+    stripe->used[pos] = true;
+    stripe->num_of_elements++;
+  }
+
+  free(old.used);
+  free(old.slots);
+  return true;
+}
+
+/* removes the slot at pos and shifts back the slots following it which were displaced past their home position. the
+ * stripe lock must be held */
+static void stripe_erase(struct hash_table_s *table, struct stripe *stripe, size_t pos) {
+  size_t mask = stripe->capacity - 1;
+  size_t hole = pos;
+  for (size_t next = (hole + 1) & mask; stripe->used[next]; next = (next + 1) & mask) {
+    size_t home = hash(slot_at(table, stripe, next), table->key_size) & mask;
+
+    // next may fill the hole only if its home position isn't cyclically in (hole, next]
+    bool movable = hole <= next ? (home <= hole || home > next) : (home <= hole && home > next);
+    if (!movable) continue;
+
+    memcpy(slot_at(table, stripe, hole), slot_at(table, stripe, next), table->slot_size);
+    hole = next;
+  }
+
+  stripe->used[hole] = false;
+  stripe->num_of_elements--;
+}
+
+struct hash_table_s *table_s_init(size_t key_size, size_t value_size, void (*destroy_value)(void *value)) {
+  if (!key_size || !value_size) return NULL;
+
+  if (key_size > SIZE_MAX / 4 || value_size > SIZE_MAX / 4) return NULL;
+  const size_t align = _Alignof(max_align_t);
+
+  struct hash_table_s *table = calloc(1, sizeof *table);
+  if (!table) return NULL;
+
+  table->key_size = key_size;
+  table->value_size = value_size;
+  table->value_offset = (key_size + align - 1) / align * align;
+  table->slot_size = (table->value_offset + value_size + align - 1) / align * align;
+  table->destroy_value = destroy_value;
+
+  size_t initialized = 0;
+  for (; initialized < TABLE_S_STRIPES; initialized++) {
+    struct stripe *stripe = &table->stripes[initialized];
+    if (!stripe_alloc(table, stripe, TABLE_S_STRIPE_INIT_CAPACITY)) break;
+
+    if (mtx_init(&stripe->lock, mtx_plain) != thrd_success) {
+      free(stripe->used);
+      free(stripe->slots);
+      break;
+    }
+  }
+
+  if (initialized < TABLE_S_STRIPES) {
+    for (size_t i = 0; i < initialized; i++) {
+      mtx_destroy(&table->stripes[i].lock);
+      free(table->stripes[i].used);
+      free(table->stripes[i].slots);
+    }
+    free(table);
+    return NULL;
+  }
+
+  return table;
+}
+
+void table_s_destroy(struct hash_table_s *table) {
+  if (!table) return;
+
+  for (size_t i = 0; i < TABLE_S_STRIPES; i++) {
+    struct stripe *stripe = &table->stripes[i];
+    for (size_t pos = 0; table->destroy_value && pos < stripe->capacity; pos++) {
+      if (stripe->used[pos]) table->destroy_value(slot_at(table, stripe, pos) + table->value_offset);
+    }
+
+    mtx_destroy(&stripe->lock);
+    free(stripe->used);
+    free(stripe->slots);
+  }
+  free(table);
+}
+
+size_t table_s_size(struct hash_table_s *table) {
+  if (!table) return 0;
+
+  size_t size = 0;
+  for (size_t i = 0; i < TABLE_S_STRIPES; i++) {
+    mtx_lock(&table->stripes[i].lock);
+    size += table->stripes[i].num_of_elements;
+    mtx_unlock(&table->stripes[i].lock);
+  }
+  return size;
+}
+
+bool table_s_put(struct hash_table_s *table, const void *key, const void *value) {
+  if (!table || !key || !value) return false;
+
+  uint64_t key_hash = hash(key, table->key_size);
+  struct stripe *stripe = stripe_of(table, key_hash);
+
+  mtx_lock(&stripe->lock);
+  bool found;
+  size_t pos = stripe_find(table, stripe, key, key_hash, &found);
+
+  // keep the load factor under 3/4
+  if (!found && (stripe->num_of_elements + 1) * 4 > stripe->capacity * 3) {
+    if (!stripe_grow(table, stripe)) {
+      mtx_unlock(&stripe->lock);
+      return false;
+    }
+    pos = stripe_find(table, stripe, key, key_hash, &found);
+  }
+
+  unsigned char *slot = slot_at(table, stripe, pos);
+  memcpy(slot, key, table->key_size);
+  memcpy(slot + table->value_offset, value, table->value_size);
+  if (!found) {
+    stripe->used[pos] = true;
+    stripe->num_of_elements++;
+  }
+  mtx_unlock(&stripe->lock);
+
+  return true;
+}
+
+bool table_s_get(struct hash_table_s *table, const void *key, void *value) {
+  if (!table || !key || !value) return false;
+
+  uint64_t key_hash = hash(key, table->key_size);
+  struct stripe *stripe = stripe_of(table, key_hash);
+
+  mtx_lock(&stripe->lock);
+  bool found;
+  size_t pos = stripe_find(table, stripe, key, key_hash, &found);
+  if (found) memcpy(value, slot_at(table, stripe, pos) + table->value_offset, table->value_size);
+  mtx_unlock(&stripe->lock);
+
+  return found;
+}
+
+bool table_s_replace(struct hash_table_s *table, const void *key, const void *value) {
+  if (!table || !key || !value) return false;
+
+  uint64_t key_hash = hash(key, table->key_size);
+  struct stripe *stripe = stripe_of(table, key_hash);
+
+  mtx_lock(&stripe->lock);
+  bool found;
+  size_t pos = stripe_find(table, stripe, key, key_hash, &found);
+  if (found) memcpy(slot_at(table, stripe, pos) + table->value_offset, value, table->value_size);
+  mtx_unlock(&stripe->lock);
+
+  return found;
+}
+
+bool table_s_remove(struct hash_table_s *table, const void *key, void *value) {
+  if (!table || !key) return false;
+
+  uint64_t key_hash = hash(key, table->key_size);
+  struct stripe *stripe = stripe_of(table, key_hash);
+
+  mtx_lock(&stripe->lock);
+  bool found;
+  size_t pos = stripe_find(table, stripe, key, key_hash, &found);
+  if (found) {
+    unsigned char *removed = slot_at(table, stripe, pos) + table->value_offset;
+    if (value) {
+      memcpy(value, removed, table->value_size);
+    } else if (table->destroy_value) {
+      table->destroy_value(removed);
+    }
+    stripe_erase(table, stripe, pos);
+  }
+  mtx_unlock(&stripe->lock);
+
+  return found;
+}
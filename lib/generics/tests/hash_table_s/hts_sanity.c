@@ -0,0 +1,193 @@
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "include/hash_table_s.h"
+
+#define THREADS_NUM 8
+#define KEYS_PER_THREAD 4096
+
+struct value {
+  int key;
+  char *str;
+  size_t updates;
+};
+
+static atomic_size_t destroyed;
+
+void value_destroy(void *value) {
+  struct value *val = value;
+  free(val->str);
+  atomic_fetch_add(&destroyed, 1);
+}
+
+struct value make_value(int key) {
+  struct value val = {.key = key, .str = malloc(16)};
+  assert(val.str);
+  strcpy(val.str, "value");
+  return val;
+}
+
+struct hash_table_s *before(size_t size) {
+  struct hash_table_s *table = table_s_init(sizeof(int), sizeof(struct value), value_destroy);
+  assert(table);
+
+  for (int key = 0; key < (int)size; key++) {
+    struct value val = make_value(key);
+    assert(table_s_put(table, &key, &val));
+  }
+
+  return table;
+}
+
+void table_s_put_get_test(size_t size) {
+  // given
+  struct hash_table_s *table = before(size);
+
+  // then
+  assert(table_s_size(table) == size);
+  for (int key = 0; key < (int)size; key++) {
+    struct value val;
+    assert(table_s_get(table, &key, &val));
+    assert(val.key == key);
+    assert(strcmp(val.str, "value") == 0);
+  }
+
+  int missing = -1;
+  struct value val;
+  assert(!table_s_get(table, &missing, &val));
+
+  // cleanup
+  atomic_store(&destroyed, 0);
+  table_s_destroy(table);
+  assert(atomic_load(&destroyed) == size);
+}
+
+void table_s_replace_test(void) {
+  // given
+  struct hash_table_s *table = before(8);
+
+  int key = 3;
+  struct value val;
+  assert(table_s_get(table, &key, &val));
+
+  // when
+  val.updates = 42;
+  bool replaced = table_s_replace(table, &key, &val);
+
+  int missing = 100;
+  bool created = table_s_replace(table, &missing, &val);
+
+  // then
+  assert(replaced);
+  assert(!created);
+  assert(table_s_size(table) == 8);
+
+  struct value updated;
+  assert(table_s_get(table, &key, &updated));
+  assert(updated.updates == 42);
+
+  // cleanup
+  table_s_destroy(table);
+}
+
+void table_s_remove_test(size_t size) {
+  // given
+  struct hash_table_s *table = before(size);
+
+  // when. remove every other key. the remaining keys must still be reachable after the slots shift back
+  atomic_store(&destroyed, 0);
+  for (int key = 0; key < (int)size; key += 2) {
+    if (key % 4) {
+      assert(table_s_remove(table, &key, NULL));
+    } else {
+      struct value removed;
+      assert(table_s_remove(table, &key, &removed));
+      assert(removed.key == key);
+      value_destroy(&removed);
+    }
+  }
+
+  // then
+  assert(atomic_load(&destroyed) == size / 2);
+  assert(table_s_size(table) == size / 2);
+  for (int key = 0; key < (int)size; key++) {
+    struct value val;
+    assert(table_s_get(table, &key, &val) == (key % 2 == 1));
+  }
+
+  int key = 0;
+  assert(!table_s_remove(table, &key, NULL));
+
+  // cleanup
+  table_s_destroy(table);
+}
+
+struct worker_args {
+  struct hash_table_s *table;
+  int first_key;
+};
+
+int worker(void *arg) {
+  struct worker_args *args = arg;
+
+  for (int key = args->first_key; key < args->first_key + KEYS_PER_THREAD; key++) {
+    struct value val = {.key = key};
+    assert(table_s_put(args->table, &key, &val));
+  }
+
+  for (int key = args->first_key; key < args->first_key + KEYS_PER_THREAD; key++) {
+    struct value val;
+    assert(table_s_get(args->table, &key, &val));
+    val.updates++;
+    assert(table_s_replace(args->table, &key, &val));
+  }
+
+  for (int key = args->first_key; key < args->first_key + KEYS_PER_THREAD; key += 2) {
+    struct value val;
+    assert(table_s_remove(args->table, &key, &val));
+    assert(val.key == key && val.updates == 1);
+  }
+
+  return 0;
+}
+
+void table_s_concurrent_test(void) {
+  // given
+  struct hash_table_s *table = table_s_init(sizeof(int), sizeof(struct value), NULL);
+  assert(table);
+
+  thrd_t threads[THREADS_NUM];
+  struct worker_args args[THREADS_NUM];
+
+  // when
+  for (int i = 0; i < THREADS_NUM; i++) {
+    args[i] = (struct worker_args){.table = table, .first_key = i * KEYS_PER_THREAD};
+    assert(thrd_create(&threads[i], worker, &args[i]) == thrd_success);
+  }
+
+  for (int i = 0; i < THREADS_NUM; i++) {
+    thrd_join(threads[i], NULL);
+  }
+
+  // then
+  assert(table_s_size(table) == THREADS_NUM * KEYS_PER_THREAD / 2);
+  for (int key = 0; key < THREADS_NUM * KEYS_PER_THREAD; key++) {
+    struct value val;
+    bool found = table_s_get(table, &key, &val);
+    assert(found == (key % 2 == 1));
+    if (found) assert(val.updates == 1);
+  }
+
+  // cleanup
+  table_s_destroy(table);
+}
+
+int main(void) {
+  table_s_put_get_test(TABLE_S_STRIPES * TABLE_S_STRIPE_INIT_CAPACITY * 4);
+  table_s_replace_test();
+  table_s_remove_test(TABLE_S_STRIPES * TABLE_S_STRIPE_INIT_CAPACITY * 4);
+  table_s_concurrent_test();
+}
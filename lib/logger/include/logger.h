@@ -15,6 +15,11 @@ struct logger;
 /* log levels */
 enum level { ERROR, WARN, DEBUG, INFO };
 
+/* what an async logger does with a message when the ring of the logging thread is full. OVERFLOW_DROP discards the
+ * message (the number of dropped messages is logged later on), OVERFLOW_BLOCK waits until the flusher thread makes room
+ * for it */
+enum overflow { OVERFLOW_DROP, OVERFLOW_BLOCK };
+
 /* initializes the logger 'object'. must be called before any use of the logger.
  * expects a valid file_name. if the file doesn't exists - the logger will
  * create one for you. file_name may be NULL - in such case the logger will
@@ -22,11 +27,19 @@ enum level { ERROR, WARN, DEBUG, INFO };
  * otherwise */
 struct logger *logger_init(char *file_name);
 
+/* initializes an asynchronous logger 'object'. same as logger_init() except that logger_log() doesn't write to the
+ * stream. every thread formats its messages into a ring of its own, and a background thread writes them to the stream
+ * in batches. messages of a single thread keep their order, messages of different threads may be interleaved
+ * differently than they were logged. overflow decides what happens when a thread logs faster than the messages are
+ * written. returns a pointer to a logger object on success, NULL otherwise */
+struct logger *logger_init_async(char *file_name, enum overflow overflow);
+
 /* logs a message. fmt is a string which may contains the specifiers used by fprintf. if such specifiers found - expects
  * matching number of argumnets */
 void logger_log(struct logger *logger, enum level level, const char *fmt, ...);
 
 /* destroys the logger 'object'. must be called after all threads are
  * joined(or killed). any attempt to call the function while the threads
- * still uses the logger - may result in undefined behavior */
+ * still uses the logger - may result in undefined behavior. an async logger writes every pending message before it's
+ * destroyed */
 void logger_destroy(struct logger *logger);
@@ -1,5 +1,6 @@
 #include "include/logger.h"
 
+#include <signal.h>  // sigprocmask(), sigfillset()
 #include <stdarg.h>
 #include <stdlib.h>
 #include <time.h>
@@ -21,22 +22,50 @@ static void get_time(struct logger *logger, char *time_rep, size_t size) {
   if (calendar_time) { strftime(time_rep, size, "%F %T %z", calendar_time); }
 }
 
+static const char *get_log_level(enum level level) {
+  switch (level) {
+    case ERROR:
+      return "ERROR";
+    case WARN:
+      return "WARN";
+    case DEBUG:
+      return "DEBUG";
+    case INFO:
+      return "INFO";
+    default:
+      return "OTHER";
+  }
+}
+
+/* opens the stream of the logger. returns true on success, false otherwise */
+static bool open_stream(struct logger *logger, char *file_name) {
+  logger->stream = stdout;
+  if (file_name) {
+    logger->stream_type = TYPE_FILE;
+    logger->stream = fopen(file_name, "a");
+  }
+
+  return logger->stream;
+}
+
+static void close_stream(struct logger *logger) {
+  fflush(logger->stream);
+  if (logger->stream_type == TYPE_FILE) { fclose(logger->stream); }
+}
+
 // still single threaded at this point
 struct logger *logger_init(char *file_name) {
   struct logger *log_info = calloc(1, sizeof *log_info);
   if (!log_info) { return NULL; }
 
-  FILE *log_fp = stdout;
-  if (file_name) {
-    log_info->stream_type = TYPE_FILE;
-    log_fp = fopen(file_name, "a");
+  if (!open_stream(log_info, file_name)) {
+    free(log_info);
+    return NULL;
   }
 
-  log_info->stream = log_fp;
-
   bool ret = mtx_init(&log_info->stream_mtx, mtx_plain) == thrd_success;
   if (!ret) {
-    if (log_info->stream_type == TYPE_FILE) fclose(log_info->stream);
+    close_stream(log_info);
     free(log_info);
     return NULL;
   }
@@ -44,24 +73,242 @@ struct logger *logger_init(char *file_name) {
   return log_info;
 }
 
-static const char *get_log_level(enum level level) {
-  switch (level) {
-    case ERROR:
-      return "ERROR";
-    case WARN:
-      return "WARN";
-    case DEBUG:
-      return "DEBUG";
-    case INFO:
-      return "INFO";
-    default:
-      return "OTHER";
+/* called by a thread on exit with the ring it owned */
+static void orphan_ring(void *arg) {
+  struct ring *ring = arg;
+  atomic_store(&ring->orphaned, true);
+}
+
+/* returns the ring of the calling thread. creates one on the first call of every thread. returns NULL on failure */
+static struct ring *get_ring(struct logger *logger) {
+  struct ring *ring = tss_get(logger->ring_key);
+  if (ring) return ring;
+
+  ring = aligned_alloc(_Alignof(struct ring), sizeof *ring);
+  if (!ring) return NULL;
+
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->orphaned, false);
+
+  if (tss_set(logger->ring_key, ring) != thrd_success) {
+    free(ring);
+    return NULL;
+  }
+
+  mtx_lock(&logger->rings_mtx);  // assume never fails
+  ring->next = logger->rings;
+  logger->rings = ring;
+  mtx_unlock(&logger->rings_mtx);  // assume never fails
+
+  return ring;
+}
+
+static void wakeup_flusher(struct logger *logger) {
+  mtx_lock(&logger->flush_mtx);  // assume never fails
+  cnd_signal(&logger->flush_cnd);
+  mtx_unlock(&logger->flush_mtx);  // assume never fails
+}
+
+/* formats a message into the ring of the calling thread */
+static void log_async(struct logger *logger, enum level level, const char *fmt, va_list args) {
+  struct ring *ring = get_ring(logger);
+  if (!ring) {
+    atomic_fetch_add(&logger->dropped, 1);
+    return;
+  }
+
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == LOGGER_RING_LEN) {
+    if (logger->overflow == OVERFLOW_DROP) {
+      atomic_fetch_add(&logger->dropped, 1);
+      return;
+    }
+
+    // the ring is full. have the flusher drain it and wait for it to make room
+    wakeup_flusher(logger);
+    thrd_sleep(&(struct timespec){.tv_nsec = 100000}, NULL);
+  }
+
+  struct record *record = &ring->records[tail & (LOGGER_RING_LEN - 1)];
+  record->time = time(NULL);
+  record->level = level;
+
+  int len = vsnprintf(record->msg, sizeof record->msg, fmt, args);
+  if (len < 0) len = 0;
+  if (len > LOGGER_MSG_LEN - 1) len = LOGGER_MSG_LEN - 1;
+  record->len = len;
+
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+static const char *format_time(struct timestamp *timestamp, time_t time) {
+  if (time == timestamp->time) return timestamp->str;
+
+  struct tm tmp = {0};
+  timestamp->time = time;
+  timestamp->str[0] = 0;
+  if (time != (time_t)-1 && gmtime_r(&time, &tmp)) {
+    strftime(timestamp->str, sizeof timestamp->str, "%F %T %z", &tmp);
+  }
+  return timestamp->str;
+}
+
+/* writes every record in the rings to the stream and frees the drained rings of threads which exited. returns true if
+ * anything was written, false otherwise */
+static bool flush_rings(struct logger *logger, struct timestamp *timestamp) {
+  bool written = false;
+
+  mtx_lock(&logger->rings_mtx);  // assume never fails
+  for (struct ring **curr = &logger->rings; *curr;) {
+    struct ring *ring = *curr;
+
+    // must be read before ring::tail. once the owner exited no records are added after the ones read here
+    bool orphaned = atomic_load(&ring->orphaned);
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    for (; head != tail; head++) {
+      struct record *record = &ring->records[head & (LOGGER_RING_LEN - 1)];
+      fprintf(logger->stream,
+              "[%s] : [%s] %.*s\n",
+              format_time(timestamp, record->time),
+              get_log_level(record->level),
+              record->len,
+              record->msg);
+      written = true;
+    }
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+
+    if (orphaned) {
+      *curr = ring->next;
+      free(ring);
+    } else {
+      curr = &ring->next;
+    }
+  }
+  mtx_unlock(&logger->rings_mtx);  // assume never fails
+
+  size_t dropped = atomic_exchange(&logger->dropped, 0);
+  if (dropped) {
+    fprintf(logger->stream,
+            "[%s] : [%s] [logger] dropped [%zu] messages\n",
+            format_time(timestamp, time(NULL)),
+            get_log_level(WARN),
+            dropped);
+    written = true;
+  }
+
+  if (written) fflush(logger->stream);
+  return written;
+}
+
+static int flusher(void *arg) {
+  struct logger *logger = arg;
+  struct timestamp timestamp = {.time = (time_t)-1};
+
+  while (!atomic_load(&logger->terminate)) {
+    if (flush_rings(logger, &timestamp)) continue;
+
+    // nothing was logged. sleep for a while (or until a blocked thread wakes the flusher up)
+    struct timespec deadline;
+    timespec_get(&deadline, TIME_UTC);
+    deadline.tv_nsec += LOGGER_FLUSH_INTERVAL_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+
+    mtx_lock(&logger->flush_mtx);  // assume never fails
+    if (!atomic_load(&logger->terminate)) cnd_timedwait(&logger->flush_cnd, &logger->flush_mtx, &deadline);
+    mtx_unlock(&logger->flush_mtx);  // assume never fails
+  }
+
+  // write whatever was logged up until now
+  flush_rings(logger, &timestamp);
+  return 0;
+}
+
+static void cleanup_async(struct logger *logger, bool rings_mtx, bool flush_mtx, bool flush_cnd, bool ring_key) {
+  for (struct ring *ring = logger->rings; ring;) {
+    struct ring *next = ring->next;
+    free(ring);
+    ring = next;
+  }
+
+  if (rings_mtx) mtx_destroy(&logger->rings_mtx);
+
+  if (flush_mtx) mtx_destroy(&logger->flush_mtx);
+
+  if (flush_cnd) cnd_destroy(&logger->flush_cnd);
+
+  if (ring_key) tss_delete(logger->ring_key);
+
+  mtx_destroy(&logger->stream_mtx);
+  close_stream(logger);
+  free(logger);
+}
+
+// still single threaded at this point
+struct logger *logger_init_async(char *file_name, enum overflow overflow) {
+  struct logger *log_info = logger_init(file_name);
+  if (!log_info) return NULL;
+
+  log_info->async = true;
+  log_info->overflow = overflow;
+  atomic_init(&log_info->dropped, 0);
+  atomic_init(&log_info->terminate, false);
+
+  if (mtx_init(&log_info->rings_mtx, mtx_plain) != thrd_success) {
+    cleanup_async(log_info, false, false, false, false);
+    return NULL;
+  }
+
+  if (mtx_init(&log_info->flush_mtx, mtx_plain) != thrd_success) {
+    cleanup_async(log_info, true, false, false, false);
+    return NULL;
   }
+
+  if (cnd_init(&log_info->flush_cnd) != thrd_success) {
+    cleanup_async(log_info, true, true, false, false);
+    return NULL;
+  }
+
+  if (tss_create(&log_info->ring_key, orphan_ring) != thrd_success) {
+    cleanup_async(log_info, true, true, true, false);
+    return NULL;
+  }
+
+  // the flusher thread must never handle signals meant for the threads of the program, so it starts with all of them
+  // blocked
+  sigset_t sigset;
+  sigset_t old_sigset;
+  sigfillset(&sigset);
+  sigprocmask(SIG_BLOCK, &sigset, &old_sigset);
+
+  bool ret = thrd_create(&log_info->flusher, flusher, log_info) == thrd_success;
+
+  sigprocmask(SIG_SETMASK, &old_sigset, NULL);
+
+  if (!ret) {
+    cleanup_async(log_info, true, true, true, true);
+    return NULL;
+  }
+
+  return log_info;
 }
 
 void logger_log(struct logger *logger, enum level level, const char *fmt, ...) {
   if (!logger) return;
 
+  if (logger->async) {
+    va_list args;
+    va_start(args, fmt);
+    log_async(logger, level, fmt, args);
+    va_end(args);
+    return;
+  }
+
   char time_buf[SIZE] = {0};
   get_time(logger, time_buf, sizeof time_buf);
 
@@ -81,9 +328,18 @@ void logger_log(struct logger *logger, enum level level, const char *fmt, ...) {
 void logger_destroy(struct logger *logger) {
   if (!logger) return;
 
+  if (logger->async) {
+    // stop the flusher. it writes every pending message before it exits
+    atomic_store(&logger->terminate, true);
+    wakeup_flusher(logger);
+    thrd_join(logger->flusher, NULL);
+
+    cleanup_async(logger, true, true, true, true);
+    return;
+  }
+
   mtx_destroy(&logger->stream_mtx);
 
-  fflush(logger->stream);
-  if (logger->stream_type == TYPE_FILE) { fclose(logger->stream); }
+  close_stream(logger);
   free(logger);
-}
\ No newline at end of file
+}
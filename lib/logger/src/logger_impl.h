@@ -1,10 +1,66 @@
 #pragma once
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <threads.h>
+#include <time.h>
+
+#include "include/logger.h"
+
+// the number of records in every thread ring. must be a power of 2
+#define LOGGER_RING_LEN 256
+
+// the maximal length of a message of an async logger. longer messages are truncated
+#define LOGGER_MSG_LEN 512
+
+// how often the flusher thread wakes up to look for records when nobody wakes it up earlier
+#define LOGGER_FLUSH_INTERVAL_MS 50
+
+/* a formatted message waiting in a ring */
+struct record {
+  time_t time;
+  enum level level;
+  int len;
+  char msg[LOGGER_MSG_LEN];
+};
+
+/* a single producer single consumer ring of records. every thread which logs through an async logger owns one. the
+ * owner thread is the only one which writes ring::tail, the flusher thread is the only one which writes ring::head */
+struct ring {
+  _Alignas(64) atomic_size_t head;  // the next record to be written to the stream
+  _Alignas(64) atomic_size_t tail;  // the next free record
+
+  atomic_bool orphaned;  // the owner thread exited. the flusher frees the ring once it's drained
+  struct ring *next;
+
+  struct record records[LOGGER_RING_LEN];
+};
+
+/* the timestamp of the last second a record was written in. records are formatted with it as long as they were logged
+ * in the same second, so strftime() runs at most once a second */
+struct timestamp {
+  time_t time;
+  char str[64];
+};
 
 struct logger {
   enum { TYPE_SYSTEM = 0, TYPE_FILE } stream_type;
   FILE *stream;
   mtx_t stream_mtx;
-};
\ No newline at end of file
+
+  // async mode only
+  bool async;
+  enum overflow overflow;
+
+  tss_t ring_key;      // the ring of the calling thread
+  struct ring *rings;  // all rings. guarded by rings_mtx
+  mtx_t rings_mtx;
+
+  atomic_size_t dropped;  // the number of messages dropped since the last flush
+  atomic_bool terminate;
+
+  thrd_t flusher;
+  mtx_t flush_mtx;
+  cnd_t flush_cnd;
+};
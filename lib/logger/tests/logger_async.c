@@ -0,0 +1,138 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "include/logger.h"
+#include "src/logger_impl.h"
+
+#define THREADS_NUM 8
+#define MESSAGES_PER_THREAD 4096
+#define LINE_LEN 1024
+
+struct thread_arg {
+  struct logger *logger;
+  int id;
+};
+
+int log_stuff(void *arg) {
+  struct thread_arg *t_args = arg;
+  for (int i = 0; i < MESSAGES_PER_THREAD; i++) {
+    logger_log(t_args->logger, INFO, "thread [%d] message [%d]", t_args->id, i);
+  }
+  return 0;
+}
+
+void log_concurrently(struct logger *logger) {
+  thrd_t threads[THREADS_NUM];
+  struct thread_arg args[THREADS_NUM];
+
+  for (int i = 0; i < THREADS_NUM; i++) {
+    args[i] = (struct thread_arg){.logger = logger, .id = i};
+    assert(thrd_create(&threads[i], log_stuff, &args[i]) == thrd_success);
+  }
+
+  for (int i = 0; i < THREADS_NUM; i++) {
+    assert(thrd_join(threads[i], NULL) == thrd_success);
+  }
+}
+
+/* counts the messages in the log file and checks that the messages of every thread are in order. returns the number of
+ * messages logged by the threads. *dropped is set to the number of messages the logger reported as dropped */
+size_t read_log(const char *file_name, size_t *dropped) {
+  FILE *fp = fopen(file_name, "r");
+  assert(fp);
+
+  int next[THREADS_NUM] = {0};
+  size_t messages = 0;
+  *dropped = 0;
+
+  char line[LINE_LEN];
+  while (fgets(line, sizeof line, fp)) {
+    int id;
+    int index;
+    size_t count;
+    char *msg = strstr(line, "] : [");
+    assert(msg);
+
+    if (sscanf(msg, "] : [INFO] thread [%d] message [%d]", &id, &index) == 2) {
+      assert(id >= 0 && id < THREADS_NUM);
+      assert(index >= next[id]);  // in order. might skip the dropped ones
+      next[id] = index + 1;
+      messages++;
+    } else if (sscanf(msg, "] : [WARN] [logger] dropped [%zu] messages", &count) == 1) {
+      *dropped += count;
+    }
+  }
+
+  fclose(fp);
+  return messages;
+}
+
+void block_test(void) {
+  // given
+  const char *file_name = "log_async_block.bin";
+  remove(file_name);
+  struct logger *logger = logger_init_async((char *)file_name, OVERFLOW_BLOCK);
+  assert(logger);
+
+  // when
+  log_concurrently(logger);
+  logger_destroy(logger);
+
+  // then. nothing is lost
+  size_t dropped;
+  assert(read_log(file_name, &dropped) == THREADS_NUM * MESSAGES_PER_THREAD);
+  assert(dropped == 0);
+}
+
+void drop_test(void) {
+  // given
+  const char *file_name = "log_async_drop.bin";
+  remove(file_name);
+  struct logger *logger = logger_init_async((char *)file_name, OVERFLOW_DROP);
+  assert(logger);
+
+  // when
+  log_concurrently(logger);
+  logger_destroy(logger);
+
+  // then. every message is either written or accounted for as dropped
+  size_t dropped;
+  size_t messages = read_log(file_name, &dropped);
+  assert(messages + dropped == THREADS_NUM * MESSAGES_PER_THREAD);
+}
+
+void truncate_test(void) {
+  // given
+  const char *file_name = "log_async_truncate.bin";
+  remove(file_name);
+  struct logger *logger = logger_init_async((char *)file_name, OVERFLOW_BLOCK);
+  assert(logger);
+
+  char long_msg[LOGGER_MSG_LEN * 2];
+  memset(long_msg, 'a', sizeof long_msg - 1);
+  long_msg[sizeof long_msg - 1] = 0;
+
+  // when
+  logger_log(logger, INFO, "%s", long_msg);
+  logger_destroy(logger);
+
+  // then
+  FILE *fp = fopen(file_name, "r");
+  assert(fp);
+
+  char line[LINE_LEN * 2];
+  assert(fgets(line, sizeof line, fp));
+  char *msg = strstr(line, "[INFO] ") + strlen("[INFO] ");
+  assert(strspn(msg, "a") == LOGGER_MSG_LEN - 1);
+  assert(strcmp(msg + LOGGER_MSG_LEN - 1, "\n") == 0);
+  fclose(fp);
+}
+
+int main(void) {
+  block_test();
+  drop_test();
+  truncate_test();
+}
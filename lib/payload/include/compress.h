@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>  // ssize_t
+
+/* a fast block compressor for data blocks. a block is compressed on its own (no state is carried from one block to the
+ * next) into the LZ4 block format: a series of sequences, each made of a token (4 bits of literals length, 4 bits of
+ * match length), the literals, a 16 bit little endian offset back into the output and the match length. the last
+ * sequence holds literals only. there's no entropy coding, so compression is cheap and decompression is a series of
+ * copies */
+
+// blocks shorter than this aren't worth compressing
+#define COMPRESS_MIN_LEN 64
+
+// the estimated entropy (in bits per byte) above which a block is deemed incompressible (e.g. media or archives)
+#define COMPRESS_MAX_ENTROPY 7.5
+
+/* returns the largest size len bytes may compress into */
+size_t compress_bound(size_t len);
+
+/* estimates the entropy of data in bits per byte (0 - 8) out of its byte histogram. a block longer than 4 KiB is
+ * sampled in windows spread evenly over it, so the estimate costs the same for a block of any size */
+double estimate_entropy(const uint8_t *data, size_t len);
+
+/* returns true if data is worth compressing: it's long enough and its estimated entropy is low enough */
+bool is_compressible(const uint8_t *data, size_t len);
+
+/* compresses len bytes of src into dst. returns the compressed length, or 0 if the compressed block doesn't fit in
+ * capacity bytes. passing a capacity smaller than len gives up on blocks which don't shrink */
+size_t compress_block(const uint8_t *src, size_t len, uint8_t *dst, size_t capacity);
+
+/* decompresses len bytes of src into dst. returns the decompressed length, or -1 if src is malformed or doesn't
+ * decompress into capacity bytes */
+ssize_t decompress_block(const uint8_t *src, size_t len, uint8_t *dst, size_t capacity);
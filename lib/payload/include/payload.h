@@ -1,11 +1,21 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>  // ssize_t
+#include <sys/uio.h>    // struct iovec
 
 #define REQUEST_MAX_LEN 512
 #define REPLY_MAX_LEN 4096
 #define DATA_BLOCK_MAX_LEN 2048
+#define DATA_BLOCK_EXT_MAX_LEN (16 * 1024 * 1024)  // the largest block size a client may negotiate
+
+#define STREAM_WRITER_MAX_IOV 64
+#define STREAM_WRITER_HEADERS_LEN 256
+
+#define STREAM_READER_LEN (64 * 1024)
+#define STREAM_READER_MIN_LEN (2 * sizeof(uint16_t) + REPLY_MAX_LEN)
 
 enum err_codes {
   ERR_SUCCESS = 0,
@@ -20,12 +30,14 @@ enum reply_codes {
   RPLY_DATA_CONN_OPEN_STARTING_TRANSFER = 125,
   RPLY_FILE_OK_OPEN_DATA_CONN = 150,
   RPLY_CMD_OK = 200,
+  RPLY_SYSTEM_STATUS = 211,
   RPLY_SERVICE_READY = 220,
   RPLY_CLOSING_CTRL_CONN = 221,
   RPLY_DATA_CONN_OPEN_NO_TRANSFER = 225,
   RPLY_PASSIVE = 227,
   RPLY_FILE_ACTION_COMPLETE = 250,
   RPLY_PATHNAME_CREATED = 257,
+  RPLY_FILE_ACTION_PENDING = 350,
   RPLY_CANNOT_OPEN_DATA_CONN = 425,
   RPLY_DATA_CONN_CLOSED = 426,
   RPLY_FILE_ACTION_NOT_TAKEN_FILE_BUSY = 450,
@@ -35,10 +47,13 @@ enum reply_codes {
   RPLY_CMD_ARGS_SYNTAX_ERR = 501,
   RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE = 550,
   RPLY_FILE_ACTION_NOT_TAKEN_INVALID_FILENAME = 553,
+  RPLY_FILE_ACTION_NOT_TAKEN_INVALID_REST = 554,
 };
 
 enum descriptor_codes {
-  DESCPTR_EOF = 0x40,  // 64. specifies EOF for the last block of a file
+  DESCPTR_EOF = 0x40,         // 64. specifies EOF for the last block of a file
+  DESCPTR_EXT_LEN = 0x08,     // 8. the block length is a 32 bit field. used for blocks larger than DATA_BLOCK_MAX_LEN
+  DESCPTR_COMPRESSED = 0x04,  // 4. the payload is compressed (see compress.h). sent only once MODE Z was negotiated
 };
 
 enum request_type {
@@ -54,6 +69,21 @@ enum request_type {
   REQ_RETR,
   REQ_STOR,
   REQ_QUIT,
+  REQ_OPTS,
+  REQ_MLSD,
+  REQ_MLST,
+  REQ_REST,
+  REQ_RANG,
+  REQ_MPIN,
+  REQ_MPPT,
+  REQ_MPLS,
+  REQ_MPCM,
+  REQ_MODE,
+  REQ_HASH,
+  REQ_XCRC,
+  REQ_HAVE,
+  REQ_STAT,
+  REQ_ALLO,
 };
 
 struct reply {
@@ -73,6 +103,148 @@ struct data_block {
   uint8_t data[DATA_BLOCK_MAX_LEN];
 };
 
+/* a framed stream writer. queues frames (replies, requests and data blocks) and sends them with as few sendmsg() calls
+ * as possible. only the frames headers are copied into the writer, the frames bodies are referenced and must stay
+ * valid (and unmodified) until the next stream_writer_flush(). the writer flushes on its own, with MSG_MORE, whenever
+ * it runs out of room */
+struct stream_writer {
+  int sockfd;
+  int flags;
+
+  int iov_count;
+  struct iovec iov[STREAM_WRITER_MAX_IOV];
+
+  size_t headers_len;
+  uint8_t headers[STREAM_WRITER_HEADERS_LEN];
+};
+
+/* compresses the data blocks queued in a stream writer. the compressed blocks are kept in the compressor buffer, which
+ * is reused once the writer was flushed */
+struct block_compressor {
+  uint32_t block_size;
+
+  size_t capacity;  // the size of each of the buffers
+  size_t used;      // the bytes of out taken by blocks which weren't flushed yet
+  uint8_t *in;      // a chunk of a file waiting to be compressed (see send_compressed_file_data())
+  uint8_t *out;     // the compressed blocks
+};
+
+/* a framed stream reader. owns a buffer which it fills with as much as the socket has in a single recv(), and parses
+ * the frames out of it. data blocks are returned as views into the buffer rather than copied out. the buffer is
+ * compacted before each recv(), so views stay valid only until the next call which has to fill the buffer again (see
+ * stream_reader_has_data()) */
+struct stream_reader {
+  int sockfd;
+  int flags;
+
+  // the largest block accepted. DATA_BLOCK_MAX_LEN unless a larger block size was negotiated
+  uint32_t max_length;
+
+  size_t capacity;
+  size_t head;  // the start of the unparsed bytes
+  size_t tail;  // the end of the bytes recieved so far
+  uint8_t *buf;
+};
+
+/* a data block inside a stream_reader buffer */
+struct data_view {
+  uint8_t descriptor;
+
+  // the number of payload bytes data_view::data points to
+  uint32_t length;
+
+  /* the number of payload bytes still waiting in the socket. non zero only for a block larger than the reader buffer:
+   * these bytes must be consumed straight from the socket (e.g. with receive_file_data()) before the next block is
+   * read */
+  size_t remaining;
+
+  const uint8_t *data;
+};
+
+enum parser_status {
+  PARSER_INCOMPLETE,  // all the input was consumed. more bytes are needed to complete the request
+  PARSER_COMPLETE,    // request_parser::request holds a complete request
+  PARSER_INVALID      // the request is too long. it's rejected and its body is skipped as it arrives
+};
+
+/* a resumable request parser. assembles a request out of whatever bytes are available on a non-blocking socket,
+ * keeping the partial state between calls */
+struct request_parser {
+  enum { PARSE_LENGTH, PARSE_BODY, PARSE_SKIP } state;
+
+  // the number of bytes of the current field (length, body or skipped body) recieved so far
+  uint16_t recieved;
+  uint8_t length[sizeof(uint16_t)];
+
+  struct request request;
+};
+
+/* initializes a stream writer for sockfd. flags are passed to every sendmsg() call */
+void stream_writer_init(struct stream_writer *writer, int sockfd, int flags);
+
+/* queues a reply. returns ERR_SUCCESS on success */
+int stream_writer_reply(struct stream_writer *writer, const struct reply *reply);
+
+/* queues a request. returns ERR_SUCCESS on success */
+int stream_writer_request(struct stream_writer *writer, const struct request *request);
+
+/* queues a data block. an empty block is only valid as the last block (marked with DESCPTR_EOF). returns ERR_SUCCESS
+ * on success */
+int stream_writer_data(struct stream_writer *writer, const struct data_block *data);
+
+/* queues a data block of any size up to DATA_BLOCK_EXT_MAX_LEN. a block larger than DATA_BLOCK_MAX_LEN is framed with
+ * DESCPTR_EXT_LEN and a 32 bit length, which only a peer who negotiated a larger block size accepts. data must stay
+ * valid until the next flush. returns ERR_SUCCESS on success */
+int stream_writer_block(struct stream_writer *writer, uint8_t descriptor, const void *data, uint32_t length);
+
+/* sends everything queued so far. returns ERR_SUCCESS on success */
+int stream_writer_flush(struct stream_writer *writer);
+
+/* initializes a compressor for blocks of up to block_size bytes. a compressor which failed to initialize may still be
+ * destroyed. returns true on success, false otherwise */
+bool block_compressor_init(struct block_compressor *compressor, uint32_t block_size);
+
+/* frees the compressor buffers */
+void block_compressor_destroy(struct block_compressor *compressor);
+
+/* forgets the compressed blocks queued so far, so their room is reused. the writer they were queued into must have
+ * been flushed. compressor may be NULL */
+void block_compressor_reset(struct block_compressor *compressor);
+
+/* queues a data block of up to block_compressor::block_size bytes like stream_writer_block(). the block is sent
+ * compressed (marked with DESCPTR_COMPRESSED) if it looks compressible (see is_compressible()) and actually shrinks, and
+ * 'as is' otherwise. the writer is flushed whenever the compressor runs out of room. data must stay valid until the next
+ * flush. returns ERR_SUCCESS on success */
+int stream_writer_compressed_block(struct stream_writer *writer,
+                                   struct block_compressor *compressor,
+                                   uint8_t descriptor,
+                                   const void *data,
+                                   uint32_t length);
+
+/* initializes a stream reader for sockfd with a buffer of capacity bytes (at least STREAM_READER_MIN_LEN). flags are
+ * passed to every recv() call. the reader accepts blocks up to DATA_BLOCK_MAX_LEN. raise stream_reader::max_length
+ * once a larger block size was negotiated. returns true on success, false otherwise */
+bool stream_reader_init(struct stream_reader *reader, int sockfd, int flags, size_t capacity);
+
+/* frees the reader buffer */
+void stream_reader_destroy(struct stream_reader *reader);
+
+/* returns the next data block as a view into the reader buffer. understands both the standard and the extended
+ * (DESCPTR_EXT_LEN) framing. recv()s only if the buffer doesn't hold the entire block. returns ERR_SUCCESS on success,
+ * ERR_INVALID_LEN if the block is larger than stream_reader::max_length */
+int stream_reader_next_data(struct stream_reader *reader, struct data_view *view);
+
+/* returns true if the next data block is entirely buffered, i.e. stream_reader_next_data() won't recv() and the views
+ * returned so far stay valid */
+bool stream_reader_has_data(const struct stream_reader *reader);
+
+/* copies the next reply out of the reader buffer. returns reply:reply as a null terminated string. recv()s only if the
+ * buffer doesn't hold the entire reply. returns ERR_SUCCESS on success */
+int stream_reader_next_reply(struct stream_reader *reader, struct reply *reply);
+
+/* returns true if the next reply is entirely buffered */
+bool stream_reader_has_reply(const struct stream_reader *reader);
+
 /* sends a reply. returns ERR_SUCCESS on success */
 int send_reply(struct reply *reply, int sockfd, int flags);
 
@@ -85,13 +257,94 @@ int send_request(struct request *request, int sockfd, int flags);
 /* recieve a request. returns ERR_SUCCESS on success. returns request::request as a null terminated string */
 int recieve_request(struct request *request, int sockfd, int flags);
 
-/* sends a data block 'as is'. returns ERR_SUCCESS on success */
+/* resets a request parser to expect the length of a new request */
+void request_parser_reset(struct request_parser *parser);
+
+/* feeds up to len bytes of buf into the parser. stops as soon as a complete request was assembled, so buf might not be
+ * consumed entirely. *consumed holds the number of bytes consumed from buf. returns PARSER_COMPLETE if
+ * request_parser::request holds a complete request (as a null terminated string). the parser must be reset before it's
+ * fed again. returns PARSER_INCOMPLETE if buf was consumed without completing a request. returns PARSER_INVALID as
+ * soon as the length of a request which is too long arrives: the parser skips its body (in this call and the following
+ * ones) and picks up the request which follows it, so it must be fed again as is, without a reset */
+enum parser_status request_parser_feed(struct request_parser *parser,
+                                       const uint8_t *buf,
+                                       size_t len,
+                                       size_t *consumed);
+
+/* sends a data block 'as is'. an empty block is only valid as the last block (marked with DESCPTR_EOF). returns
+ * ERR_SUCCESS on success */
 int send_data(struct data_block *data, int sockfd, int flags);
 
+/* sends count bytes of the file fd, starting at offset, as a series of data blocks of up to block_size bytes (framed
+ * with DESCPTR_EXT_LEN when larger than DATA_BLOCK_MAX_LEN). the last block is marked with DESCPTR_EOF (an empty file
+ * is sent as a single empty block). every block header is written from user space while its payload is moved by the
+ * kernel directly from the page cache into the socket with sendfile(), so the file content is never copied through
+ * user space. doesn't change the file offset of fd. returns ERR_SUCCESS on success */
+int send_file_data(int sockfd, int fd, off_t offset, off_t count, uint32_t block_size, int flags);
+
+/* like send_file_data() but every block goes through stream_writer_compressed_block(). the file is read a chunk of
+ * blocks at a time into the compressor, so its content is copied through user space. the blocks are up to
+ * block_compressor::block_size bytes. returns ERR_SUCCESS on success */
+int send_compressed_file_data(int sockfd,
+                              int fd,
+                              off_t offset,
+                              off_t count,
+                              struct block_compressor *compressor,
+                              int flags);
+
+/* like send_file_data() but the last block is marked with DESCPTR_EOF only if eof is set, so a file may be sent a part
+ * at a time over the same data connection. a part which isn't the last must be made of whole blocks (count a multiple
+ * of block_size) for the parts to frame the same blocks a single call would. an empty part which isn't the last sends
+ * nothing. returns ERR_SUCCESS on success */
+int send_file_part(int sockfd, int fd, off_t offset, off_t count, uint32_t block_size, bool eof, int flags);
+
+/* the same as send_file_part() for send_compressed_file_data() */
+int send_compressed_file_part(int sockfd,
+                              int fd,
+                              off_t offset,
+                              off_t count,
+                              struct block_compressor *compressor,
+                              bool eof,
+                              int flags);
+
+/* returns the number of bytes send_file_data() sends for a file of count bytes in blocks of up to block_size bytes:
+ * the payload and the headers of its blocks. returns 0 if block_size is invalid */
+size_t framed_file_length(off_t count, uint32_t block_size);
+
+/* reads count bytes of the file fd, starting at offset, into buf framed exactly the way send_file_data() sends them.
+ * buf must hold framed_file_length() bytes. doesn't change the file offset of fd. returns the number of bytes written
+ * into buf on success, -1 on failure (the file couldn't be read, or holds fewer bytes than requested) */
+ssize_t frame_file_data(uint8_t *buf, int fd, off_t offset, off_t count, uint32_t block_size);
+
+/* sends len bytes of buf, which holds data blocks framed beforehand (see frame_file_data()). returns ERR_SUCCESS on
+ * success */
+int send_framed_data(int sockfd, const uint8_t *buf, size_t len, int flags);
+
+/* decompresses the payload of a view marked with DESCPTR_COMPRESSED into buf. returns the length of the payload, or -1
+ * if the view was cut short (see data_view::remaining), is malformed or doesn't decompress into capacity bytes */
+ssize_t data_view_decompress(const struct data_view *view, uint8_t *buf, size_t capacity);
+
 /* recieves a data block. returns ERR_SUCCESS on success. data_block::data is not necessarily a null terminated string
  */
 int receive_data(struct data_block *data, int sockfd, int flags);
 
+/* recieves only the header of a data block, i.e. data_block::descriptor and data_block::length. the payload is left
+ * in the socket to be consumed with receive_file_data(). like receive_data() only the standard framing is supported.
+ * returns ERR_SUCCESS on success */
+int receive_data_header(struct data_block *data, int sockfd, int flags);
+
+/* moves length bytes of a data block payload from sockfd into the file fd at *offset without copying them through
+ * user space: socket -> pipe -> file with splice(). pipefd must be an empty pipe, and is left empty on success. *offset
+ * is advanced by the number of bytes written. on failure the pipe may hold leftovers and must not be reused. returns
+ * ERR_SUCCESS on success, ERR_SOCKET_TRANSMISSION_ERR if the socket failed, ERR_INVALID_ARGS if the file couldn't be
+ * written */
+int receive_file_data(int sockfd, int fd, const int pipefd[2], off_t *offset, size_t length);
+
+/* recieves length bytes of a data block payload from sockfd into buf. the counterpart of receive_file_data() for a
+ * payload left in the socket (see data_view::remaining) which is written from user space. returns ERR_SUCCESS on
+ * success */
+int receive_block_payload(int sockfd, void *buf, size_t length);
+
 /* converts an enum err_codes to its string representation */
 const char *str_err_code(enum err_codes err_code);
 
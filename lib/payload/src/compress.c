@@ -0,0 +1,232 @@
+#include "include/compress.h"
+#include <string.h>  // memcpy
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5   // the last bytes of a block are always literals
+#define MATCH_LIMIT 12    // the last match starts at least this many bytes before the end of a block
+#define MAX_OFFSET 65535  // the farthest a match may reach back
+#define LENGTH_MASK 15    // a length which doesn't fit in its token nibble continues in extra bytes
+
+#define HASH_MAX_LOG 12
+#define HASH_MIN_LOG 8
+#define SKIP_SHIFT 6  // the longer no match is found, the faster the input is skipped
+
+#define ENTROPY_SAMPLE_LEN 4096
+#define ENTROPY_WINDOW_LEN 256
+#define FIXED_SHIFT 16  // log2 values are computed in 16.16 fixed point
+
+static uint32_t read_u32(const uint8_t *ptr) {
+  uint32_t value;
+  memcpy(&value, ptr, sizeof value);
+  return value;
+}
+
+static uint32_t hash(uint32_t sequence, unsigned hash_log) {
+  return (sequence * 2654435761U) >> (32 - hash_log);
+}
+
+/* writes the extra bytes of a length which didn't fit in its token nibble. returns the end of the written bytes */
+static uint8_t *write_length(uint8_t *dst, size_t len) {
+  for (len -= LENGTH_MASK; len >= 255; len -= 255) {
+    *dst++ = 255;
+  }
+  *dst++ = (uint8_t)len;
+  return dst;
+}
+
+/* reads the extra bytes of a length whose token nibble is full. returns false if src ends first */
+static bool read_length(const uint8_t **src, const uint8_t *end, size_t *len) {
+  uint8_t byte;
+  do {
+    if (*src == end) return false;
+    byte = *(*src)++;
+    *len += byte;
+  } while (byte == 255);
+  return true;
+}
+
+/* the number of bytes a sequence of literals_len literals and a match of match_len bytes takes at most */
+static size_t sequence_bound(size_t literals_len, size_t match_len) {
+  return 1 + literals_len / 255 + 1 + literals_len + sizeof(uint16_t) + match_len / 255 + 1;
+}
+
+/* a linear approximation of log2(value) for value > 0, in 16.16 fixed point. off by less than 0.09 */
+static uint64_t log2_fixed(uint32_t value) {
+  uint32_t exponent = 31 - (uint32_t)__builtin_clz(value);
+  uint64_t mantissa = ((uint64_t)value << FIXED_SHIFT) >> exponent;  // [1, 2) in 16.16 fixed point
+  return ((uint64_t)exponent << FIXED_SHIFT) + mantissa - (1U << FIXED_SHIFT);
+}
+
+size_t compress_bound(size_t len) {
+  return len + len / 255 + 16;
+}
+
+double estimate_entropy(const uint8_t *data, size_t len) {
+  if (!data || !len) return 0;
+
+  // four histograms, so the counts of neighbouring bytes don't wait on one another when the bytes repeat
+  uint32_t histograms[4][256] = {0};
+
+  size_t windows = len > ENTROPY_SAMPLE_LEN ? ENTROPY_SAMPLE_LEN / ENTROPY_WINDOW_LEN : 1;
+  size_t window_len = len > ENTROPY_SAMPLE_LEN ? ENTROPY_WINDOW_LEN : len;
+  size_t stride = len / windows;
+  for (size_t window = 0; window < windows; window++) {
+    const uint8_t *ptr = data + window * stride;
+
+    size_t i = 0;
+    for (; i + 4 <= window_len; i += 4) {
+      histograms[0][ptr[i]]++;
+      histograms[1][ptr[i + 1]]++;
+      histograms[2][ptr[i + 2]]++;
+      histograms[3][ptr[i + 3]]++;
+    }
+    for (; i < window_len; i++) {
+      histograms[0][ptr[i]]++;
+    }
+  }
+
+  // the merge is a plain loop over the counters, which the compiler vectorizes
+  uint32_t counts[256];
+  for (size_t i = 0; i < 256; i++) {
+    counts[i] = histograms[0][i] + histograms[1][i] + histograms[2][i] + histograms[3][i];
+  }
+
+  // H = log2(n) - sum(c * log2(c)) / n
+  uint32_t sampled = (uint32_t)(windows * window_len);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < 256; i++) {
+    if (counts[i]) sum += counts[i] * log2_fixed(counts[i]);
+  }
+
+  double entropy = ((double)log2_fixed(sampled) - (double)sum / sampled) / (1U << FIXED_SHIFT);
+  return entropy < 0 ? 0 : entropy;
+}
+
+bool is_compressible(const uint8_t *data, size_t len) {
+  if (!data || len < COMPRESS_MIN_LEN) return false;
+  return estimate_entropy(data, len) <= COMPRESS_MAX_ENTROPY;
+}
+
+size_t compress_block(const uint8_t *src, size_t len, uint8_t *dst, size_t capacity) {
+  if (!src || !dst) return 0;
+
+  // the positions (relative to src) of the last sequences seen with every hash. a short block gets a smaller table, so
+  // clearing the table doesn't cost more than compressing the block
+  unsigned hash_log = HASH_MIN_LOG;
+  while (hash_log < HASH_MAX_LOG && (size_t)1 << (hash_log + 2) < len) {
+    hash_log++;
+  }
+  uint32_t table[1 << HASH_MAX_LOG];
+  memset(table, 0, sizeof *table << hash_log);
+
+  const uint8_t *ptr = src;
+  const uint8_t *anchor = src;  // the start of the literals not written yet
+  const uint8_t *end = src + len;
+  uint8_t *out = dst;
+  uint8_t *out_end = dst + capacity;
+
+  if (len > MATCH_LIMIT) {
+    const uint8_t *match_limit = end - MATCH_LIMIT;
+    const uint8_t *extend_limit = end - LAST_LITERALS;
+
+    while (ptr < match_limit) {
+      uint32_t sequence = read_u32(ptr);
+      uint32_t slot = hash(sequence, hash_log);
+      const uint8_t *ref = src + table[slot];
+      table[slot] = (uint32_t)(ptr - src);
+
+      if (ref >= ptr || ptr - ref > MAX_OFFSET || read_u32(ref) != sequence) {
+        ptr += 1 + ((size_t)(ptr - anchor) >> SKIP_SHIFT);
+        continue;
+      }
+
+      // extend the match backwards into the pending literals, and forwards as far as it goes
+      while (ptr > anchor && ref > src && ptr[-1] == ref[-1]) {
+        ptr--;
+        ref--;
+      }
+      size_t match_len = MIN_MATCH;
+      while (ptr + match_len < extend_limit && ptr[match_len] == ref[match_len]) {
+        match_len++;
+      }
+
+      size_t literals_len = (size_t)(ptr - anchor);
+      if (sequence_bound(literals_len, match_len - MIN_MATCH) > (size_t)(out_end - out)) return 0;
+
+      uint8_t *token = out++;
+      *token = (uint8_t)((literals_len < LENGTH_MASK ? literals_len : LENGTH_MASK) << 4);
+      if (literals_len >= LENGTH_MASK) out = write_length(out, literals_len);
+      memcpy(out, anchor, literals_len);
+      out += literals_len;
+
+      uint16_t offset = (uint16_t)(ptr - ref);
+      *out++ = (uint8_t)offset;
+      *out++ = (uint8_t)(offset >> 8);
+
+      size_t extra_len = match_len - MIN_MATCH;
+      *token |= (uint8_t)(extra_len < LENGTH_MASK ? extra_len : LENGTH_MASK);
+      if (extra_len >= LENGTH_MASK) out = write_length(out, extra_len);
+
+      ptr += match_len;
+      anchor = ptr;
+    }
+  }
+
+  // the last sequence: the literals left
+  size_t literals_len = (size_t)(end - anchor);
+  if (1 + literals_len / 255 + 1 + literals_len > (size_t)(out_end - out)) return 0;
+
+  *out++ = (uint8_t)((literals_len < LENGTH_MASK ? literals_len : LENGTH_MASK) << 4);
+  if (literals_len >= LENGTH_MASK) out = write_length(out, literals_len);
+  memcpy(out, anchor, literals_len);
+  out += literals_len;
+
+  return (size_t)(out - dst);
+}
+
+ssize_t decompress_block(const uint8_t *src, size_t len, uint8_t *dst, size_t capacity) {
+  if (!src || !dst) return -1;
+
+  const uint8_t *ptr = src;
+  const uint8_t *end = src + len;
+  uint8_t *out = dst;
+  uint8_t *out_end = dst + capacity;
+
+  while (ptr < end) {
+    uint8_t token = *ptr++;
+
+    size_t literals_len = token >> 4;
+    if (literals_len == LENGTH_MASK && !read_length(&ptr, end, &literals_len)) return -1;
+    if (literals_len > (size_t)(end - ptr) || literals_len > (size_t)(out_end - out)) return -1;
+
+    memcpy(out, ptr, literals_len);
+    out += literals_len;
+    ptr += literals_len;
+
+    // the last sequence holds literals only
+    if (ptr == end) break;
+
+    if (end - ptr < (ptrdiff_t)sizeof(uint16_t)) return -1;
+    size_t offset = ptr[0] | (size_t)ptr[1] << 8;
+    ptr += sizeof(uint16_t);
+    if (!offset || offset > (size_t)(out - dst)) return -1;
+
+    size_t match_len = token & LENGTH_MASK;
+    if (match_len == LENGTH_MASK && !read_length(&ptr, end, &match_len)) return -1;
+    match_len += MIN_MATCH;
+    if (match_len > (size_t)(out_end - out)) return -1;
+
+    // a match may overlap the bytes it produces (a repeating pattern), which memcpy() can't copy
+    const uint8_t *ref = out - offset;
+    if (offset >= match_len) {
+      memcpy(out, ref, match_len);
+    } else {
+      for (size_t i = 0; i < match_len; i++) {
+        out[i] = ref[i];
+      }
+    }
+    out += match_len;
+  }
+
+  return out - dst;
+}
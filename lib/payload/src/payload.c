@@ -1,9 +1,17 @@
+#define _GNU_SOURCE  // splice()
 #include "include/payload.h"
 #include <byteswap.h>  // bswap16
+#include <errno.h>
+#include <fcntl.h>  // splice()
+#include <poll.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>      // memcpy
+#include <sys/sendfile.h>
 #include <sys/socket.h>  // send, recv
+#include <unistd.h>      // pread
+#include "include/compress.h"
 
 static bool is_big_endian(void) {
   unsigned int one = 0x1;
@@ -15,31 +23,287 @@ static uint16_t change_order_u16(uint16_t num) {
   return is_big_endian() ? num : bswap_16(num);
 }
 
-int send_reply(struct reply *reply, int sockfd, int flags) {
-  if (!reply) return ERR_INVALID_ARGS;
-  if (sockfd < 0) return ERR_INVALID_SOCKET_FD;
-  if (reply->length >= REPLY_MAX_LEN - 1) return ERR_INVALID_LEN;
+static uint32_t change_order_u32(uint32_t num) {
+  return is_big_endian() ? num : bswap_32(num);
+}
 
-  reply->code = change_order_u16(reply->code);
-  uint16_t reply_length = change_order_u16(reply->length);
+/* writes a data block header (descriptor + length) into header. a block larger than DATA_BLOCK_MAX_LEN gets the
+ * extended framing. returns the size of the header */
+static size_t frame_block_header(uint8_t *header, uint8_t descriptor, uint32_t length) {
+  if (length > DATA_BLOCK_MAX_LEN || descriptor & DESCPTR_EXT_LEN) {
+    header[0] = descriptor | DESCPTR_EXT_LEN;
+    uint32_t block_length = change_order_u32(length);
+    memcpy(header + 1, &block_length, sizeof block_length);
+    return sizeof(uint8_t) + sizeof block_length;
+  }
 
-  // send reply code
-  ssize_t bytes_sent = send(sockfd, &reply->code, sizeof reply->code, flags);
-  if (bytes_sent == -1) return ERR_SOCKET_TRANSMISSION_ERR;
+  header[0] = descriptor;
+  uint16_t block_length = change_order_u16((uint16_t)length);
+  memcpy(header + 1, &block_length, sizeof block_length);
+  return sizeof(uint8_t) + sizeof block_length;
+}
 
-  // send reply length
-  bytes_sent = send(sockfd, &reply_length, sizeof reply_length, flags);
-  if (bytes_sent == -1) return ERR_SOCKET_TRANSMISSION_ERR;
+/* returns the size of the header frame_block_header() writes for a block of length bytes */
+static size_t block_header_length(uint32_t length) {
+  return length > DATA_BLOCK_MAX_LEN ? sizeof(uint8_t) + sizeof(uint32_t) : sizeof(uint8_t) + sizeof(uint16_t);
+}
 
-  // send reply body
-  ssize_t ret = 0;
-  for (uint16_t sent = 0; sent < reply->length; sent += ret) {
-    ret = send(sockfd, reply->reply + sent, reply->length - sent, flags);
-    if (ret == -1) return ERR_SOCKET_TRANSMISSION_ERR;  // error. possibly sockfd was closed
+/* parses a data block header out of buf (holding len bytes). returns the size of the header, or 0 if buf doesn't hold
+ * all of it */
+static size_t parse_block_header(const uint8_t *buf, size_t len, uint8_t *descriptor, uint32_t *length) {
+  if (len < sizeof(uint8_t)) return 0;
+
+  *descriptor = buf[0];
+  if (*descriptor & DESCPTR_EXT_LEN) {
+    uint32_t block_length;
+    if (len < sizeof(uint8_t) + sizeof block_length) return 0;
+
+    memcpy(&block_length, buf + 1, sizeof block_length);
+    *length = change_order_u32(block_length);
+    return sizeof(uint8_t) + sizeof block_length;
+  }
+
+  uint16_t block_length;
+  if (len < sizeof(uint8_t) + sizeof block_length) return 0;
+
+  memcpy(&block_length, buf + 1, sizeof block_length);
+  *length = change_order_u16(block_length);
+  return sizeof(uint8_t) + sizeof block_length;
+}
+
+/* waits for a non-blocking sockfd to become writable. returns ERR_SUCCESS on success */
+static int wait_writable(int sockfd) {
+  struct pollfd pollfd = {.fd = sockfd, .events = POLLOUT};
+  if (poll(&pollfd, 1, -1) == -1 && errno != EINTR) return ERR_SOCKET_TRANSMISSION_ERR;
+  return ERR_SUCCESS;
+}
+
+/* sends len bytes of buf. handles partial sends. if sockfd is a non-blocking socket waits for it to become writable
+ * whenever its send buffer is full. returns ERR_SUCCESS on success */
+static int send_all(int sockfd, const void *buf, size_t len, int flags) {
+  const uint8_t *ptr = buf;
+  for (size_t sent = 0; sent < len;) {
+    ssize_t ret = send(sockfd, ptr + sent, len - sent, flags);
+    if (ret == -1) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) return ERR_SOCKET_TRANSMISSION_ERR;
+      if (wait_writable(sockfd) != ERR_SUCCESS) return ERR_SOCKET_TRANSMISSION_ERR;
+      continue;
+    }
+    sent += ret;
+  }
+  return ERR_SUCCESS;
+}
+
+/* waits for a non-blocking sockfd to become readable. returns ERR_SUCCESS on success */
+static int wait_readable(int sockfd) {
+  struct pollfd pollfd = {.fd = sockfd, .events = POLLIN};
+  if (poll(&pollfd, 1, -1) == -1 && errno != EINTR) return ERR_SOCKET_TRANSMISSION_ERR;
+  return ERR_SUCCESS;
+}
+
+/* recieves exactly len bytes into buf. handles partial reads. if sockfd is a non-blocking socket waits for it to
+ * become readable whenever there's nothing to read. returns ERR_SUCCESS on success */
+static int recv_all(int sockfd, void *buf, size_t len, int flags) {
+  uint8_t *ptr = buf;
+  for (size_t recieved = 0; recieved < len;) {
+    ssize_t ret = recv(sockfd, ptr + recieved, len - recieved, flags);
+    if (ret == -1) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) return ERR_SOCKET_TRANSMISSION_ERR;
+      if (wait_readable(sockfd) != ERR_SUCCESS) return ERR_SOCKET_TRANSMISSION_ERR;
+      continue;
+    }
+    if (ret == 0) return ERR_SOCKET_TRANSMISSION_ERR;  // the peer closed the connection
+    recieved += ret;
   }
   return ERR_SUCCESS;
 }
 
+void stream_writer_init(struct stream_writer *writer, int sockfd, int flags) {
+  if (!writer) return;
+
+  writer->sockfd = sockfd;
+  writer->flags = flags;
+  writer->iov_count = 0;
+  writer->headers_len = 0;
+}
+
+/* sends all the queued iovecs with sendmsg(). handles partial sends. more_flags is added to writer::flags (used to pass
+ * MSG_MORE when the writer flushes on its own). returns ERR_SUCCESS on success */
+static int writer_send(struct stream_writer *writer, int more_flags) {
+  struct iovec *iov = writer->iov;
+  int count = writer->iov_count;
+
+  while (count) {
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = count};
+    ssize_t sent = sendmsg(writer->sockfd, &msg, writer->flags | more_flags);
+    if (sent == -1) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) return ERR_SOCKET_TRANSMISSION_ERR;
+      if (wait_writable(writer->sockfd) != ERR_SUCCESS) return ERR_SOCKET_TRANSMISSION_ERR;
+      continue;
+    }
+
+    // skip what was sent. the first iovec left might have been sent partially
+    while (count && (size_t)sent >= iov->iov_len) {
+      sent -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count) {
+      iov->iov_base = (uint8_t *)iov->iov_base + sent;
+      iov->iov_len -= sent;
+    }
+  }
+
+  writer->iov_count = 0;
+  writer->headers_len = 0;
+  return ERR_SUCCESS;
+}
+
+/* queues a frame: its header is copied into writer::headers, its body is referenced */
+static int writer_queue(struct stream_writer *writer,
+                        const void *header,
+                        size_t header_len,
+                        const void *body,
+                        size_t body_len) {
+  if (writer->iov_count + 2 > STREAM_WRITER_MAX_IOV || writer->headers_len + header_len > STREAM_WRITER_HEADERS_LEN) {
+    int ret = writer_send(writer, MSG_MORE);
+    if (ret != ERR_SUCCESS) return ret;
+  }
+
+  uint8_t *dst = writer->headers + writer->headers_len;
+  memcpy(dst, header, header_len);
+  writer->headers_len += header_len;
+
+  // headers of consecutive empty frames are contiguous in writer::headers. merge them into a single iovec
+  struct iovec *last = writer->iov_count ? &writer->iov[writer->iov_count - 1] : NULL;
+  if (last && (uint8_t *)last->iov_base + last->iov_len == dst) {
+    last->iov_len += header_len;
+  } else {
+    writer->iov[writer->iov_count++] = (struct iovec){.iov_base = dst, .iov_len = header_len};
+  }
+
+  if (body_len) writer->iov[writer->iov_count++] = (struct iovec){.iov_base = (void *)body, .iov_len = body_len};
+  return ERR_SUCCESS;
+}
+
+int stream_writer_reply(struct stream_writer *writer, const struct reply *reply) {
+  if (!writer || !reply) return ERR_INVALID_ARGS;
+  if (writer->sockfd < 0) return ERR_INVALID_SOCKET_FD;
+  if (reply->length >= REPLY_MAX_LEN - 1) return ERR_INVALID_LEN;
+
+  // code + length
+  uint16_t header[] = {change_order_u16(reply->code), change_order_u16(reply->length)};
+  return writer_queue(writer, header, sizeof header, reply->reply, reply->length);
+}
+
+int stream_writer_request(struct stream_writer *writer, const struct request *request) {
+  if (!writer || !request) return ERR_INVALID_ARGS;
+  if (writer->sockfd < 0) return ERR_INVALID_SOCKET_FD;
+  if (request->length >= REQUEST_MAX_LEN - 1) return ERR_INVALID_LEN;
+
+  uint16_t header = change_order_u16(request->length);
+  return writer_queue(writer, &header, sizeof header, request->request, request->length);
+}
+
+int stream_writer_data(struct stream_writer *writer, const struct data_block *data) {
+  if (!writer || !data) return ERR_INVALID_ARGS;
+  if (data->length > DATA_BLOCK_MAX_LEN) return ERR_INVALID_LEN;
+
+  return stream_writer_block(writer, data->descriptor, data->data, data->length);
+}
+
+int stream_writer_block(struct stream_writer *writer, uint8_t descriptor, const void *data, uint32_t length) {
+  if (!writer || (!data && length)) return ERR_INVALID_ARGS;
+  if (writer->sockfd < 0) return ERR_INVALID_SOCKET_FD;
+  if (length > DATA_BLOCK_EXT_MAX_LEN) return ERR_INVALID_LEN;
+  if (!length && !(descriptor & DESCPTR_EOF)) return ERR_INVALID_LEN;
+
+  uint8_t header[sizeof(uint8_t) + sizeof(uint32_t)];
+  size_t header_len = frame_block_header(header, descriptor, length);
+
+  return writer_queue(writer, header, header_len, data, length);
+}
+
+int stream_writer_flush(struct stream_writer *writer) {
+  if (!writer) return ERR_INVALID_ARGS;
+  if (writer->sockfd < 0) return ERR_INVALID_SOCKET_FD;
+
+  return writer_send(writer, 0);
+}
+
+bool block_compressor_init(struct block_compressor *compressor, uint32_t block_size) {
+  if (!compressor) return false;
+
+  // a compressor which failed to initialize is safe to destroy
+  *compressor = (struct block_compressor){0};
+  if (!block_size || block_size > DATA_BLOCK_EXT_MAX_LEN) return false;
+
+  // room for a chunk of whole blocks: a file is read a chunk at a time, and the blocks of a chunk are flushed at once
+  size_t blocks = block_size < STREAM_READER_LEN ? STREAM_READER_LEN / block_size : 1;
+  compressor->block_size = block_size;
+  compressor->capacity = blocks * block_size;
+
+  compressor->in = malloc(2 * compressor->capacity);
+  if (!compressor->in) return false;
+
+  compressor->out = compressor->in + compressor->capacity;
+  return true;
+}
+
+void block_compressor_destroy(struct block_compressor *compressor) {
+  if (!compressor) return;
+
+  free(compressor->in);
+  compressor->in = compressor->out = NULL;
+}
+
+void block_compressor_reset(struct block_compressor *compressor) {
+  if (compressor) compressor->used = 0;
+}
+
+int stream_writer_compressed_block(struct stream_writer *writer,
+                                   struct block_compressor *compressor,
+                                   uint8_t descriptor,
+                                   const void *data,
+                                   uint32_t length) {
+  if (!writer || !compressor || !compressor->out || (!data && length)) return ERR_INVALID_ARGS;
+  if (length > compressor->block_size) return ERR_INVALID_LEN;
+
+  // skip what won't compress (e.g. media or archives) before spending any time on it
+  if (!is_compressible(data, length)) return stream_writer_block(writer, descriptor, data, length);
+
+  // the compressed blocks queued so far are referenced by the writer. they can be overwritten once they were sent
+  if (compressor->capacity - compressor->used < length) {
+    int ret = stream_writer_flush(writer);
+    if (ret != ERR_SUCCESS) return ret;
+    block_compressor_reset(compressor);
+  }
+
+  // a block is worth sending compressed only if it shrinks
+  uint8_t *compressed = compressor->out + compressor->used;
+  size_t compressed_len = compress_block(data, length, compressed, length - 1);
+  if (!compressed_len) return stream_writer_block(writer, descriptor, data, length);
+
+  compressor->used += compressed_len;
+  return stream_writer_block(writer, descriptor | DESCPTR_COMPRESSED, compressed, (uint32_t)compressed_len);
+}
+
+int send_reply(struct reply *reply, int sockfd, int flags) {
+  if (!reply) return ERR_INVALID_ARGS;
+  if (sockfd < 0) return ERR_INVALID_SOCKET_FD;
+
+  struct stream_writer writer;
+  stream_writer_init(&writer, sockfd, flags);
+
+  int ret = stream_writer_reply(&writer, reply);
+  if (ret != ERR_SUCCESS) return ret;
+
+  return stream_writer_flush(&writer);
+}
+
 int recieve_reply(struct reply *reply, int sockfd, int flags) {
   if (!reply) return ERR_INVALID_ARGS;
   if (sockfd < 0) return ERR_INVALID_SOCKET_FD;
@@ -72,21 +336,14 @@ int recieve_reply(struct reply *reply, int sockfd, int flags) {
 int send_request(struct request *request, int sockfd, int flags) {
   if (!request) return ERR_INVALID_ARGS;
   if (sockfd < 0) return ERR_INVALID_SOCKET_FD;
-  if (request->length >= REQUEST_MAX_LEN - 1) return ERR_INVALID_LEN;
 
-  uint16_t request_length = change_order_u16(request->length);
+  struct stream_writer writer;
+  stream_writer_init(&writer, sockfd, flags);
 
-  // send request length
-  ssize_t bytes_sent = send(sockfd, &request_length, sizeof request_length, flags);
-  if (bytes_sent == -1) return ERR_SOCKET_TRANSMISSION_ERR;
+  int ret = stream_writer_request(&writer, request);
+  if (ret != ERR_SUCCESS) return ret;
 
-  // send request body
-  ssize_t ret = 0;
-  for (uint16_t sent = 0; sent < request->length; sent += ret) {
-    ret = send(sockfd, request->request + sent, request->length - sent, flags);
-    if (ret == -1) return ERR_SOCKET_TRANSMISSION_ERR;  // error. possibly sockfd was closed
-  }
-  return ERR_SUCCESS;
+  return stream_writer_flush(&writer);
 }
 
 int recieve_request(struct request *request, int sockfd, int flags) {
@@ -112,51 +369,431 @@ int recieve_request(struct request *request, int sockfd, int flags) {
   return ERR_SUCCESS;
 }
 
+bool stream_reader_init(struct stream_reader *reader, int sockfd, int flags, size_t capacity) {
+  if (!reader || capacity < STREAM_READER_MIN_LEN) return false;
+
+  *reader =
+    (struct stream_reader){.sockfd = sockfd, .flags = flags, .max_length = DATA_BLOCK_MAX_LEN, .capacity = capacity};
+  reader->buf = malloc(capacity);
+  return reader->buf != NULL;
+}
+
+void stream_reader_destroy(struct stream_reader *reader) {
+  if (!reader) return;
+
+  free(reader->buf);
+  reader->buf = NULL;
+  reader->head = reader->tail = 0;
+}
+
+/* moves the unparsed bytes to the start of the buffer and recv()s as much as the socket has (and the buffer can hold)
+ * with a single call. invalidates all views. returns ERR_SUCCESS on success */
+static int reader_fill(struct stream_reader *reader) {
+  if (reader->head) {
+    memmove(reader->buf, reader->buf + reader->head, reader->tail - reader->head);
+    reader->tail -= reader->head;
+    reader->head = 0;
+  }
+
+  for (;;) {
+    ssize_t ret = recv(reader->sockfd, reader->buf + reader->tail, reader->capacity - reader->tail, reader->flags);
+    if (ret == -1) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) return ERR_SOCKET_TRANSMISSION_ERR;
+      if (wait_readable(reader->sockfd) != ERR_SUCCESS) return ERR_SOCKET_TRANSMISSION_ERR;
+      continue;
+    }
+    if (ret == 0) return ERR_SOCKET_TRANSMISSION_ERR;  // the peer closed the connection
+
+    reader->tail += ret;
+    return ERR_SUCCESS;
+  }
+}
+
+/* makes sure at least len bytes (len <= reader::capacity) are buffered. returns ERR_SUCCESS on success */
+static int reader_require(struct stream_reader *reader, size_t len) {
+  while (reader->tail - reader->head < len) {
+    int ret = reader_fill(reader);
+    if (ret != ERR_SUCCESS) return ret;
+  }
+  return ERR_SUCCESS;
+}
+
+int stream_reader_next_data(struct stream_reader *reader, struct data_view *view) {
+  if (!reader || !view || !reader->buf) return ERR_INVALID_ARGS;
+  if (reader->sockfd < 0) return ERR_INVALID_SOCKET_FD;
+
+  // descriptor + length. the descriptor tells whether the length is a 16 or a 32 bit field
+  uint8_t descriptor = 0;
+  uint32_t length = 0;
+  size_t header_len;
+  for (;;) {
+    header_len = parse_block_header(reader->buf + reader->head, reader->tail - reader->head, &descriptor, &length);
+    if (header_len) break;
+
+    int ret = reader_fill(reader);
+    if (ret != ERR_SUCCESS) return ret;
+  }
+  if (length > reader->max_length) return ERR_INVALID_LEN;
+
+  view->descriptor = descriptor;
+  reader->head += header_len;
+
+  // the block fits in the buffer. make sure all of it is there
+  if (length <= reader->capacity) {
+    int ret = reader_require(reader, length);
+    if (ret != ERR_SUCCESS) return ret;
+  }
+
+  size_t buffered = reader->tail - reader->head;
+  view->length = buffered < length ? (uint32_t)buffered : length;
+  view->remaining = length - view->length;
+  view->data = reader->buf + reader->head;
+  reader->head += view->length;
+
+  return ERR_SUCCESS;
+}
+
+bool stream_reader_has_data(const struct stream_reader *reader) {
+  if (!reader || !reader->buf) return false;
+
+  uint8_t descriptor;
+  uint32_t length;
+  size_t buffered = reader->tail - reader->head;
+  size_t header_len = parse_block_header(reader->buf + reader->head, buffered, &descriptor, &length);
+  if (!header_len) return false;
+
+  return buffered - header_len >= length;
+}
+
+int stream_reader_next_reply(struct stream_reader *reader, struct reply *reply) {
+  if (!reader || !reply || !reader->buf) return ERR_INVALID_ARGS;
+  if (reader->sockfd < 0) return ERR_INVALID_SOCKET_FD;
+
+  // code + length
+  uint16_t header[2];
+  int ret = reader_require(reader, sizeof header);
+  if (ret != ERR_SUCCESS) return ret;
+
+  memcpy(header, reader->buf + reader->head, sizeof header);
+  uint16_t length = change_order_u16(header[1]);
+  if (length >= REPLY_MAX_LEN - 1) return ERR_INVALID_LEN;
+
+  ret = reader_require(reader, sizeof header + length);
+  if (ret != ERR_SUCCESS) return ret;
+
+  reply->code = change_order_u16(header[0]);
+  reply->length = length;
+  memcpy(reply->reply, reader->buf + reader->head + sizeof header, length);
+  reply->reply[length] = 0;  // null terminate the reply
+
+  reader->head += sizeof header + length;
+  return ERR_SUCCESS;
+}
+
+bool stream_reader_has_reply(const struct stream_reader *reader) {
+  if (!reader || !reader->buf) return false;
+
+  uint16_t header[2];
+  size_t buffered = reader->tail - reader->head;
+  if (buffered < sizeof header) return false;
+
+  memcpy(header, reader->buf + reader->head, sizeof header);
+  return buffered - sizeof header >= change_order_u16(header[1]);
+}
+
+void request_parser_reset(struct request_parser *parser) {
+  if (!parser) return;
+
+  parser->state = PARSE_LENGTH;
+  parser->recieved = 0;
+  parser->request.length = 0;
+}
+
+enum parser_status request_parser_feed(struct request_parser *parser,
+                                       const uint8_t *buf,
+                                       size_t len,
+                                       size_t *consumed) {
+  size_t pos = 0;
+  enum parser_status status = PARSER_INCOMPLETE;
+
+  while (pos < len && status == PARSER_INCOMPLETE) {
+    if (parser->state == PARSE_LENGTH) {
+      // the length might arrive split across several reads
+      size_t chunk = sizeof parser->length - parser->recieved;
+      if (chunk > len - pos) chunk = len - pos;
+
+      memcpy(parser->length + parser->recieved, buf + pos, chunk);
+      parser->recieved += chunk;
+      pos += chunk;
+      if (parser->recieved < sizeof parser->length) break;
+
+      uint16_t length;
+      memcpy(&length, parser->length, sizeof length);
+      parser->request.length = change_order_u16(length);
+      parser->state = parser->request.length >= REQUEST_MAX_LEN - 1 ? PARSE_SKIP : PARSE_BODY;
+      parser->recieved = 0;
+      if (parser->state == PARSE_SKIP) {
+        status = PARSER_INVALID;
+        break;
+      }
+    } else if (parser->state == PARSE_SKIP) {
+      size_t chunk = parser->request.length - parser->recieved;
+      if (chunk > len - pos) chunk = len - pos;
+
+      parser->recieved += chunk;
+      pos += chunk;
+      if (parser->recieved == parser->request.length) request_parser_reset(parser);
+    } else {
+      size_t chunk = parser->request.length - parser->recieved;
+      if (chunk > len - pos) chunk = len - pos;
+
+      memcpy(parser->request.request + parser->recieved, buf + pos, chunk);
+      parser->recieved += chunk;
+      pos += chunk;
+    }
+
+    // an empty request completes as soon as its length arrives
+    if (parser->state == PARSE_BODY && parser->recieved == parser->request.length) {
+      parser->request.request[parser->request.length] = 0;  // null terminate the request
+      status = PARSER_COMPLETE;
+    }
+  }
+
+  if (consumed) *consumed = pos;
+  return status;
+}
+
 int send_data(struct data_block *data, int sockfd, int flags) {
   if (!data) return ERR_INVALID_ARGS;
   if (sockfd < 0) return ERR_INVALID_SOCKET_FD;
-  if (!data->length || data->length > DATA_BLOCK_MAX_LEN) return ERR_INVALID_LEN;
 
-  // send the data descriptor
-  ssize_t bytes_sent = send(sockfd, &data->descriptor, sizeof data->descriptor, flags);
-  if (bytes_sent == -1) return ERR_SOCKET_TRANSMISSION_ERR;
+  struct stream_writer writer;
+  stream_writer_init(&writer, sockfd, flags);
 
-  // send data length
-  uint16_t data_length = change_order_u16(data->length);
-  bytes_sent = send(sockfd, &data_length, sizeof data_length, flags);
-  if (bytes_sent == -1) return ERR_SOCKET_TRANSMISSION_ERR;
+  int ret = stream_writer_data(&writer, data);
+  if (ret != ERR_SUCCESS) return ret;
+
+  return stream_writer_flush(&writer);
+}
+
+int send_file_data(int sockfd, int fd, off_t offset, off_t count, uint32_t block_size, int flags) {
+  return send_file_part(sockfd, fd, offset, count, block_size, true, flags);
+}
+
+int send_file_part(int sockfd, int fd, off_t offset, off_t count, uint32_t block_size, bool eof, int flags) {
+  if (sockfd < 0) return ERR_INVALID_SOCKET_FD;
+  if (fd < 0 || offset < 0 || count < 0) return ERR_INVALID_ARGS;
+  if (!block_size || block_size > DATA_BLOCK_EXT_MAX_LEN) return ERR_INVALID_LEN;
+  if (!count && !eof) return ERR_SUCCESS;
+
+  off_t remaining = count;
+  do {
+    uint32_t length = remaining > block_size ? block_size : (uint32_t)remaining;
+    remaining -= length;
+
+    // descriptor + length. MSG_MORE holds the header back so it leaves in the same segment as the payload
+    uint8_t header[sizeof(uint8_t) + sizeof(uint32_t)];
+    size_t header_len = frame_block_header(header, remaining || !eof ? 0 : DESCPTR_EOF, length);
+
+    int ret = send_all(sockfd, header, header_len, length ? flags | MSG_MORE : flags);
+    if (ret != ERR_SUCCESS) return ret;
+
+    for (size_t sent = 0; sent < length;) {
+      ssize_t bytes_sent = sendfile(sockfd, fd, &offset, length - sent);
+      if (bytes_sent == -1) {
+        if (errno == EINTR) continue;
+        if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(sockfd) == ERR_SUCCESS) continue;
+        return ERR_SOCKET_TRANSMISSION_ERR;
+      }
+
+      // the file was truncated while being sent. the block can't be completed
+      if (bytes_sent == 0) return ERR_INVALID_LEN;
+      sent += bytes_sent;
+    }
+  } while (remaining);
 
-  ssize_t ret = 0;
-  for (uint16_t sent = 0; sent < data->length; sent += ret) {
-    ret = send(sockfd, data->data + sent, data->length - sent, flags);
-    if (ret == -1) return ERR_SOCKET_TRANSMISSION_ERR;
-  }
   return ERR_SUCCESS;
 }
 
+size_t framed_file_length(off_t count, uint32_t block_size) {
+  if (count < 0 || !block_size || block_size > DATA_BLOCK_EXT_MAX_LEN) return 0;
+
+  // whole blocks, then the rest of the file in a shorter block. an empty file is a single empty block
+  size_t whole = (size_t)(count / block_size);
+  uint32_t rest = (uint32_t)(count % block_size);
+
+  size_t len = (size_t)count + whole * block_header_length(block_size);
+  if (rest || !count) len += block_header_length(rest);
+  return len;
+}
+
+ssize_t frame_file_data(uint8_t *buf, int fd, off_t offset, off_t count, uint32_t block_size) {
+  if (!buf || fd < 0 || offset < 0 || count < 0) return -1;
+  if (!block_size || block_size > DATA_BLOCK_EXT_MAX_LEN) return -1;
+
+  size_t pos = 0;
+  off_t remaining = count;
+  do {
+    uint32_t length = remaining > block_size ? block_size : (uint32_t)remaining;
+    remaining -= length;
+
+    pos += frame_block_header(buf + pos, remaining ? 0 : DESCPTR_EOF, length);
+    for (size_t read = 0; read < length;) {
+      ssize_t bytes_read = pread(fd, buf + pos + read, length - read, offset);
+      if (bytes_read == -1 && errno == EINTR) continue;
+
+      // a read error, or the file was truncated while being read
+      if (bytes_read <= 0) return -1;
+      read += bytes_read;
+      offset += bytes_read;
+    }
+    pos += length;
+  } while (remaining);
+
+  return (ssize_t)pos;
+}
+
+int send_framed_data(int sockfd, const uint8_t *buf, size_t len, int flags) {
+  if (sockfd < 0) return ERR_INVALID_SOCKET_FD;
+  if (!buf) return ERR_INVALID_ARGS;
+
+  return send_all(sockfd, buf, len, flags);
+}
+
+int send_compressed_file_data(int sockfd,
+                              int fd,
+                              off_t offset,
+                              off_t count,
+                              struct block_compressor *compressor,
+                              int flags) {
+  return send_compressed_file_part(sockfd, fd, offset, count, compressor, true, flags);
+}
+
+int send_compressed_file_part(int sockfd,
+                              int fd,
+                              off_t offset,
+                              off_t count,
+                              struct block_compressor *compressor,
+                              bool eof,
+                              int flags) {
+  if (sockfd < 0) return ERR_INVALID_SOCKET_FD;
+  if (fd < 0 || offset < 0 || count < 0 || !compressor || !compressor->in) return ERR_INVALID_ARGS;
+  if (!count && !eof) return ERR_SUCCESS;
+
+  struct stream_writer writer;
+  stream_writer_init(&writer, sockfd, flags);
+
+  off_t remaining = count;
+  do {
+    size_t chunk_len = remaining > (off_t)compressor->capacity ? compressor->capacity : (size_t)remaining;
+    for (size_t read_len = 0; read_len < chunk_len;) {
+      ssize_t ret = pread(fd, compressor->in + read_len, chunk_len - read_len, offset + (off_t)read_len);
+      if (ret == -1 && errno == EINTR) continue;
+      if (ret == -1) return ERR_INVALID_ARGS;
+
+      // the file was truncated while being sent. the block can't be completed
+      if (ret == 0) return ERR_INVALID_LEN;
+      read_len += ret;
+    }
+    offset += chunk_len;
+    remaining -= chunk_len;
+
+    // the chunk is made of whole blocks, so the compressed blocks fit in the compressor and are flushed at once
+    block_compressor_reset(compressor);
+    size_t chunk_offset = 0;
+    do {
+      size_t left = chunk_len - chunk_offset;
+      uint32_t length = left > compressor->block_size ? compressor->block_size : (uint32_t)left;
+      uint8_t descriptor = eof && !remaining && chunk_offset + length == chunk_len ? DESCPTR_EOF : 0;
+
+      int ret = stream_writer_compressed_block(&writer, compressor, descriptor, compressor->in + chunk_offset, length);
+      if (ret != ERR_SUCCESS) return ret;
+      chunk_offset += length;
+    } while (chunk_offset < chunk_len);
+
+    int ret = stream_writer_flush(&writer);
+    if (ret != ERR_SUCCESS) return ret;
+  } while (remaining);
+
+  return ERR_SUCCESS;
+}
+
+ssize_t data_view_decompress(const struct data_view *view, uint8_t *buf, size_t capacity) {
+  if (!view || !buf || view->remaining) return -1;
+  return decompress_block(view->data, view->length, buf, capacity);
+}
+
 int receive_data(struct data_block *data, int sockfd, int flags) {
+  int ret = receive_data_header(data, sockfd, flags);
+  if (ret != ERR_SUCCESS) return ret;
+
+  return recv_all(sockfd, data->data, data->length, flags);
+}
+
+int receive_data_header(struct data_block *data, int sockfd, int flags) {
   if (!data) return ERR_INVALID_ARGS;
   if (sockfd < 0) return ERR_INVALID_SOCKET_FD;
 
-  // recieve data descriptor
-  ssize_t recved = recv(sockfd, &data->descriptor, sizeof data->descriptor, flags);
-  if (recved == -1) return ERR_SOCKET_TRANSMISSION_ERR;
+  // descriptor + length
+  uint8_t header[sizeof data->descriptor + sizeof data->length];
+  if (recv_all(sockfd, header, sizeof header, flags) != ERR_SUCCESS) return ERR_SOCKET_TRANSMISSION_ERR;
 
-  // recieve data length
-  recved = recv(sockfd, &data->length, sizeof data->length, flags);
-  if (recved == -1) return ERR_SOCKET_TRANSMISSION_ERR;
+  data->descriptor = header[0];
+  if (data->descriptor & DESCPTR_EXT_LEN) return ERR_INVALID_LEN;  // a struct data_block can't hold such a block
 
+  memcpy(&data->length, header + 1, sizeof data->length);
   data->length = change_order_u16(data->length);
   if (data->length > DATA_BLOCK_MAX_LEN) return ERR_INVALID_LEN;
 
-  ssize_t ret = 0;
-  for (uint16_t recieved = 0; recieved < data->length; recieved += ret) {
-    ret = recv(sockfd, data->data + recieved, data->length - recieved, flags);
-    if (ret == -1) return ERR_SOCKET_TRANSMISSION_ERR;
+  return ERR_SUCCESS;
+}
+
+int receive_file_data(int sockfd, int fd, const int pipefd[2], off_t *offset, size_t length) {
+  if (sockfd < 0) return ERR_INVALID_SOCKET_FD;
+  if (fd < 0 || !pipefd || !offset) return ERR_INVALID_ARGS;
+
+  size_t in_pipe = 0;
+  while (length || in_pipe) {
+    // fill the pipe from the socket
+    if (length) {
+      ssize_t ret = splice(sockfd, NULL, pipefd[1], NULL, length, SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (ret == -1) {
+        int err = errno;
+        if (err == EINTR) continue;
+        if (err != EAGAIN && err != EWOULDBLOCK) return ERR_SOCKET_TRANSMISSION_ERR;
+
+        // nothing to read yet. drain whatever is already in the pipe, otherwise wait for the socket
+        if (!in_pipe && wait_readable(sockfd) != ERR_SUCCESS) return ERR_SOCKET_TRANSMISSION_ERR;
+      } else if (ret == 0) {
+        return ERR_SOCKET_TRANSMISSION_ERR;  // the peer closed the connection mid block
+      } else {
+        length -= ret;
+        in_pipe += ret;
+      }
+    }
+
+    // drain the pipe into the file
+    while (in_pipe) {
+      ssize_t ret = splice(pipefd[0], NULL, fd, offset, in_pipe, SPLICE_F_MOVE);
+      if (ret == -1) {
+        if (errno == EINTR) continue;
+        return ERR_INVALID_ARGS;  // the file can't be written
+      }
+      in_pipe -= ret;
+    }
   }
+
   return ERR_SUCCESS;
 }
 
+int receive_block_payload(int sockfd, void *buf, size_t length) {
+  if (sockfd < 0) return ERR_INVALID_SOCKET_FD;
+  if (!buf && length) return ERR_INVALID_ARGS;
+
+  return recv_all(sockfd, buf, length, 0);
+}
+
 const char *str_err_code(enum err_codes err_code) {
   switch (err_code) {
     case ERR_SUCCESS:
@@ -187,6 +824,9 @@ const char *str_reply_code(enum reply_codes reply_code) {
     case RPLY_CMD_OK:
       rply_code_str = "command okay";
       break;
+    case RPLY_SYSTEM_STATUS:
+      rply_code_str = "system status";
+      break;
     case RPLY_SERVICE_READY:
       rply_code_str = "service ready for new user";
       break;
@@ -205,6 +845,9 @@ const char *str_reply_code(enum reply_codes reply_code) {
     case RPLY_PATHNAME_CREATED:
       rply_code_str = "created";
       break;
+    case RPLY_FILE_ACTION_PENDING:
+      rply_code_str = "requested file action pending further information";
+      break;
     case RPLY_CANNOT_OPEN_DATA_CONN:
       rply_code_str = "can't open data connection";
       break;
@@ -232,6 +875,9 @@ const char *str_reply_code(enum reply_codes reply_code) {
     case RPLY_FILE_ACTION_NOT_TAKEN_INVALID_FILENAME:
       rply_code_str = "requested action not taken. file name not allowed.";
       break;
+    case RPLY_FILE_ACTION_NOT_TAKEN_INVALID_REST:
+      rply_code_str = "requested action not taken. invalid rest parameter";
+      break;
     default:
       rply_code_str = "unknown";
       break;
@@ -275,6 +921,51 @@ const char *str_request_type(enum request_type request_type) {
     case REQ_QUIT:
       req_type_str = "quit";
       break;
+    case REQ_OPTS:
+      req_type_str = "opts";
+      break;
+    case REQ_MLSD:
+      req_type_str = "mlsd";
+      break;
+    case REQ_MLST:
+      req_type_str = "mlst";
+      break;
+    case REQ_REST:
+      req_type_str = "rest";
+      break;
+    case REQ_RANG:
+      req_type_str = "rang";
+      break;
+    case REQ_MPIN:
+      req_type_str = "mpin";
+      break;
+    case REQ_MPPT:
+      req_type_str = "mppt";
+      break;
+    case REQ_MPLS:
+      req_type_str = "mpls";
+      break;
+    case REQ_MPCM:
+      req_type_str = "mpcm";
+      break;
+    case REQ_MODE:
+      req_type_str = "mode";
+      break;
+    case REQ_HASH:
+      req_type_str = "hash";
+      break;
+    case REQ_XCRC:
+      req_type_str = "xcrc";
+      break;
+    case REQ_HAVE:
+      req_type_str = "have";
+      break;
+    case REQ_STAT:
+      req_type_str = "stat";
+      break;
+    case REQ_ALLO:
+      req_type_str = "allo";
+      break;
     default:
       req_type_str = "unknown";
       break;
@@ -0,0 +1,263 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <threads.h>
+#include <unistd.h>
+#include "include/compress.h"
+#include "include/payload.h"
+
+/* the sending end of a compressed transfer. runs on its own thread so the sender can't block on a full socket buffer
+ * while the reader waits for it */
+struct sender {
+  int sockfd;
+  int fd;
+  uint32_t length;
+  uint32_t block_size;
+  int ret;
+};
+
+static void fill_text(uint8_t *buf, size_t len) {
+  static const char *const words[] = {"drwxr-xr-x ", "-rw-r--r-- ", "root ", "4.0K ", "Oct 17 ", "file.txt\n"};
+  for (size_t i = 0; i < len; i++) {
+    const char *word = words[(i / 11 * 7) % (sizeof words / sizeof *words)];
+    buf[i] = (uint8_t)word[i % strlen(word)];
+  }
+}
+
+static void fill_random(uint8_t *buf, size_t len) {
+  uint64_t state = 0x9E3779B97F4A7C15U;
+  for (size_t i = 0; i < len; i++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    buf[i] = (uint8_t)state;
+  }
+}
+
+static int send_file(void *arg) {
+  struct sender *sender = arg;
+
+  struct block_compressor compressor;
+  if (!block_compressor_init(&compressor, sender->block_size)) return 1;
+
+  sender->ret = send_compressed_file_data(sender->sockfd, sender->fd, 0, sender->length, &compressor, 0);
+  block_compressor_destroy(&compressor);
+  return sender->ret != ERR_SUCCESS;
+}
+
+void round_trip_test(void (*fill)(uint8_t *, size_t), size_t len, bool shrinks) {
+  // given
+  uint8_t *src = malloc(len);
+  size_t capacity = compress_bound(len);
+  uint8_t *compressed = malloc(capacity);
+  uint8_t *decompressed = malloc(len + 1);
+  assert(src && compressed && decompressed);
+  fill(src, len);
+
+  // when
+  size_t compressed_len = compress_block(src, len, compressed, capacity);
+  ssize_t decompressed_len = decompress_block(compressed, compressed_len, decompressed, len + 1);
+
+  // then
+  assert(compressed_len);
+  assert(shrinks ? compressed_len < len / 2 : compressed_len >= len);
+  assert(decompressed_len == (ssize_t)len);
+  assert(memcmp(src, decompressed, len) == 0);
+
+  // a block which doesn't shrink is given up on
+  if (!shrinks) assert(compress_block(src, len, compressed, len - 1) == 0);
+
+  // cleanup
+  free(src);
+  free(compressed);
+  free(decompressed);
+}
+
+void malformed_test(void) {
+  // given
+  uint8_t src[1024];
+  uint8_t compressed[2048];
+  uint8_t decompressed[1024];
+  fill_text(src, sizeof src);
+  size_t compressed_len = compress_block(src, sizeof src, compressed, sizeof compressed);
+  assert(compressed_len);
+
+  // then
+  // a truncated block or a block which doesn't fit are rejected
+  assert(decompress_block(compressed, compressed_len - 3, decompressed, sizeof decompressed) != sizeof src);
+  assert(decompress_block(compressed, compressed_len, decompressed, sizeof decompressed - 1) == -1);
+
+  // a match reaching back before the start of the block
+  const uint8_t bad_offset[] = {0x10, 'a', 0x10, 0x00};
+  assert(decompress_block(bad_offset, sizeof bad_offset, decompressed, sizeof decompressed) == -1);
+
+  // a match overlapping its own output (a repeating pattern)
+  const uint8_t overlap[] = {0x15, 'a', 0x01, 0x00, 0x50, 'b', 'c', 'd', 'e', 'f'};
+  assert(decompress_block(overlap, sizeof overlap, decompressed, sizeof decompressed) == 1 + 9 + 5);
+  assert(memcmp(decompressed, "aaaaaaaaaabcdef", 15) == 0);
+}
+
+void entropy_test(void) {
+  // given
+  const size_t len = 64 * 1024;
+  uint8_t *buf = malloc(len);
+  assert(buf);
+
+  // then
+  memset(buf, 'a', len);
+  assert(estimate_entropy(buf, len) < 0.1);
+  assert(is_compressible(buf, len));
+
+  fill_text(buf, len);
+  assert(estimate_entropy(buf, len) < 6);
+  assert(is_compressible(buf, len));
+
+  fill_random(buf, len);
+  assert(estimate_entropy(buf, len) > COMPRESS_MAX_ENTROPY);
+  assert(!is_compressible(buf, len));
+
+  // too short to be worth it
+  memset(buf, 'a', COMPRESS_MIN_LEN - 1);
+  assert(!is_compressible(buf, COMPRESS_MIN_LEN - 1));
+
+  // cleanup
+  free(buf);
+}
+
+void compressed_file_test(uint32_t block_size) {
+  // given
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  // a compressible half followed by an incompressible one
+  const uint32_t length = 6 * block_size + 17;
+  uint8_t *data = malloc(length);
+  assert(data);
+  fill_text(data, length / 2);
+  fill_random(data + length / 2, length - length / 2);
+
+  FILE *fp = tmpfile();
+  assert(fp);
+  assert(fwrite(data, 1, length, fp) == length);
+  assert(fflush(fp) == 0);
+
+  struct sender sender = {.sockfd = fds[0], .fd = fileno(fp), .length = length, .block_size = block_size};
+  thrd_t thread;
+
+  // when
+  assert(thrd_create(&thread, send_file, &sender) == thrd_success);
+
+  struct stream_reader reader;
+  assert(stream_reader_init(&reader, fds[1], 0, STREAM_READER_LEN + block_size));
+  reader.max_length = block_size;
+
+  // then
+  uint8_t *buf = malloc(block_size);
+  assert(buf);
+
+  size_t recieved = 0;
+  size_t compressed = 0;
+  size_t plain = 0;
+  struct data_view view = {0};
+  do {
+    assert(stream_reader_next_data(&reader, &view) == ERR_SUCCESS);
+    assert(view.remaining == 0);
+
+    if (view.descriptor & DESCPTR_COMPRESSED) {
+      ssize_t len = data_view_decompress(&view, buf, block_size);
+      assert(len > view.length);
+      assert(memcmp(buf, data + recieved, len) == 0);
+      recieved += len;
+      compressed++;
+    } else {
+      assert(memcmp(view.data, data + recieved, view.length) == 0);
+      recieved += view.length;
+      plain++;
+    }
+  } while (!(view.descriptor & DESCPTR_EOF));
+
+  assert(recieved == length);
+  assert(compressed && plain);
+
+  int ret;
+  thrd_join(thread, &ret);
+  assert(ret == 0);
+
+  // cleanup
+  free(buf);
+  stream_reader_destroy(&reader);
+  fclose(fp);
+  free(data);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void compressor_reset_test(void) {
+  // given
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  uint8_t *data = malloc(DATA_BLOCK_MAX_LEN);
+  assert(data);
+  fill_text(data, DATA_BLOCK_MAX_LEN);
+
+  struct block_compressor compressor;
+  assert(block_compressor_init(&compressor, DATA_BLOCK_MAX_LEN));
+
+  struct stream_writer writer;
+  stream_writer_init(&writer, fds[0], 0);
+
+  // when. a block is queued and flushed, and the compressor is reset
+  assert(stream_writer_compressed_block(&writer, &compressor, 0, data, DATA_BLOCK_MAX_LEN) == ERR_SUCCESS);
+  size_t used = compressor.used;
+  assert(used > 0);
+  assert(stream_writer_flush(&writer) == ERR_SUCCESS);
+  block_compressor_reset(&compressor);
+
+  // then. the next block reuses the room of the first one
+  assert(compressor.used == 0);
+  assert(stream_writer_compressed_block(&writer, &compressor, DESCPTR_EOF, data, DATA_BLOCK_MAX_LEN) == ERR_SUCCESS);
+  assert(compressor.used == used);
+  assert(stream_writer_flush(&writer) == ERR_SUCCESS);
+
+  struct stream_reader reader;
+  assert(stream_reader_init(&reader, fds[1], 0, STREAM_READER_LEN));
+
+  uint8_t *buf = malloc(DATA_BLOCK_MAX_LEN);
+  assert(buf);
+  struct data_view view = {0};
+  for (int i = 0; i < 2; i++) {
+    assert(stream_reader_next_data(&reader, &view) == ERR_SUCCESS);
+    assert(view.descriptor & DESCPTR_COMPRESSED);
+    assert(data_view_decompress(&view, buf, DATA_BLOCK_MAX_LEN) == DATA_BLOCK_MAX_LEN);
+    assert(memcmp(buf, data, DATA_BLOCK_MAX_LEN) == 0);
+  }
+  assert(view.descriptor & DESCPTR_EOF);
+
+  // a NULL compressor is ignored
+  block_compressor_reset(NULL);
+
+  // cleanup
+  free(buf);
+  stream_reader_destroy(&reader);
+  block_compressor_destroy(&compressor);
+  free(data);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+int main(void) {
+  round_trip_test(fill_text, DATA_BLOCK_MAX_LEN, true);
+  round_trip_test(fill_text, 1024 * 1024, true);
+  round_trip_test(fill_random, DATA_BLOCK_MAX_LEN, false);
+  round_trip_test(fill_random, 13, false);
+  malformed_test();
+  entropy_test();
+  compressed_file_test(DATA_BLOCK_MAX_LEN);
+  compressed_file_test(256 * 1024);
+  compressor_reset_test();
+}
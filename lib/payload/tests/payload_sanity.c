@@ -0,0 +1,689 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <threads.h>
+#include <unistd.h>
+#include "include/payload.h"
+
+#define EXT_BLOCK_LEN (1024 * 1024)
+
+/* the sending end of a test. runs on its own thread so a sender can't block on a full socket buffer while the reader
+ * waits for it */
+struct sender {
+  int sockfd;
+  const uint8_t *data;
+  uint32_t length;
+  uint32_t block_size;
+  int fd;
+  int ret;
+};
+
+static void fill_pattern(uint8_t *buf, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    buf[i] = (uint8_t)(i * 31 + 7);
+  }
+}
+
+static int send_blocks(void *arg) {
+  struct sender *sender = arg;
+
+  struct stream_writer writer;
+  stream_writer_init(&writer, sender->sockfd, 0);
+
+  uint32_t sent = 0;
+  do {
+    uint32_t length = sender->length - sent > sender->block_size ? sender->block_size : sender->length - sent;
+    uint8_t descriptor = sent + length == sender->length ? DESCPTR_EOF : 0;
+
+    sender->ret = stream_writer_block(&writer, descriptor, sender->data + sent, length);
+    if (sender->ret != ERR_SUCCESS) return 1;
+    sent += length;
+  } while (sent < sender->length);
+
+  sender->ret = stream_writer_flush(&writer);
+  return sender->ret != ERR_SUCCESS;
+}
+
+static int send_file(void *arg) {
+  struct sender *sender = arg;
+
+  sender->ret = send_file_data(sender->sockfd, sender->fd, 0, sender->length, sender->block_size, 0);
+  return sender->ret != ERR_SUCCESS;
+}
+
+static int send_framed(void *arg) {
+  struct sender *sender = arg;
+
+  sender->ret = send_framed_data(sender->sockfd, sender->data, sender->length, 0);
+  return sender->ret != ERR_SUCCESS;
+}
+
+/* sends the file in parts: two whole blocks, an empty part and the rest of the file */
+static int send_file_parts(void *arg) {
+  struct sender *sender = arg;
+
+  off_t offset = 0;
+  sender->ret = send_file_part(sender->sockfd, sender->fd, offset, 2 * sender->block_size, sender->block_size, false, 0);
+  if (sender->ret != ERR_SUCCESS) return 1;
+  offset += 2 * sender->block_size;
+
+  sender->ret = send_file_part(sender->sockfd, sender->fd, offset, 0, sender->block_size, false, 0);
+  if (sender->ret != ERR_SUCCESS) return 1;
+
+  sender->ret =
+      send_file_part(sender->sockfd, sender->fd, offset, sender->length - offset, sender->block_size, true, 0);
+  return sender->ret != ERR_SUCCESS;
+}
+
+/* reads blocks until DESCPTR_EOF. returns the number of payload bytes recieved and compares them against expected */
+static size_t read_blocks(struct stream_reader *reader, const uint8_t *expected) {
+  size_t recieved = 0;
+  struct data_view view = {0};
+  do {
+    assert(stream_reader_next_data(reader, &view) == ERR_SUCCESS);
+    assert(memcmp(view.data, expected + recieved, view.length) == 0);
+    recieved += view.length;
+
+    // a block larger than the reader buffer. the rest of it waits in the socket
+    while (view.remaining) {
+      uint8_t buf[4096];
+      size_t chunk = view.remaining < sizeof buf ? view.remaining : sizeof buf;
+      ssize_t ret = recv(reader->sockfd, buf, chunk, 0);
+      assert(ret > 0);
+
+      assert(memcmp(buf, expected + recieved, ret) == 0);
+      recieved += ret;
+      view.remaining -= ret;
+    }
+  } while (!(view.descriptor & DESCPTR_EOF));
+
+  return recieved;
+}
+
+void standard_blocks_test(void) {
+  // given
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  struct data_block *blocks = calloc(3, sizeof *blocks);
+  assert(blocks);
+  fill_pattern(blocks[0].data, DATA_BLOCK_MAX_LEN);
+  blocks[0].length = DATA_BLOCK_MAX_LEN;
+  memcpy(blocks[1].data, "hello", 5);
+  blocks[1].length = 5;
+  blocks[2].descriptor = DESCPTR_EOF;
+
+  // when
+  struct stream_writer writer;
+  stream_writer_init(&writer, fds[0], 0);
+  for (int i = 0; i < 3; i++) {
+    assert(stream_writer_data(&writer, &blocks[i]) == ERR_SUCCESS);
+  }
+  assert(stream_writer_flush(&writer) == ERR_SUCCESS);
+
+  // then
+  uint8_t header[3];
+  assert(recv(fds[1], header, sizeof header, MSG_PEEK) == sizeof header);
+  assert(!(header[0] & DESCPTR_EXT_LEN));
+
+  struct stream_reader reader;
+  assert(stream_reader_init(&reader, fds[1], 0, STREAM_READER_LEN));
+
+  struct data_view view;
+  for (int i = 0; i < 3; i++) {
+    assert(stream_reader_next_data(&reader, &view) == ERR_SUCCESS);
+    assert(view.descriptor == blocks[i].descriptor);
+    assert(view.length == blocks[i].length);
+    assert(view.remaining == 0);
+    assert(memcmp(view.data, blocks[i].data, view.length) == 0);
+  }
+
+  // cleanup
+  stream_reader_destroy(&reader);
+  free(blocks);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void extended_block_test(size_t capacity) {
+  // given
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  uint8_t *data = malloc(EXT_BLOCK_LEN);
+  assert(data);
+  fill_pattern(data, EXT_BLOCK_LEN);
+
+  struct sender sender = {.sockfd = fds[0], .data = data, .length = EXT_BLOCK_LEN, .block_size = EXT_BLOCK_LEN};
+  thrd_t thread;
+
+  // when
+  assert(thrd_create(&thread, send_blocks, &sender) == thrd_success);
+
+  struct stream_reader reader;
+  assert(stream_reader_init(&reader, fds[1], 0, capacity));
+  reader.max_length = EXT_BLOCK_LEN;
+
+  // then
+  struct data_view view;
+  assert(stream_reader_next_data(&reader, &view) == ERR_SUCCESS);
+  assert(view.descriptor & DESCPTR_EXT_LEN);
+  assert(view.length + view.remaining == EXT_BLOCK_LEN);
+  assert(capacity > EXT_BLOCK_LEN ? view.remaining == 0 : view.remaining > 0);
+  assert(memcmp(view.data, data, view.length) == 0);
+
+  size_t recieved = view.length;
+  while (recieved < EXT_BLOCK_LEN) {
+    uint8_t buf[4096];
+    ssize_t ret = recv(fds[1], buf, sizeof buf, 0);
+    assert(ret > 0);
+    assert(memcmp(buf, data + recieved, ret) == 0);
+    recieved += ret;
+  }
+
+  int ret;
+  thrd_join(thread, &ret);
+  assert(ret == 0);
+
+  // cleanup
+  stream_reader_destroy(&reader);
+  free(data);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void block_payload_test(void) {
+  // given
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  uint8_t *data = malloc(2 * EXT_BLOCK_LEN);
+  uint8_t *payload = malloc(EXT_BLOCK_LEN);
+  assert(data && payload);
+  fill_pattern(data, 2 * EXT_BLOCK_LEN);
+
+  struct sender sender = {.sockfd = fds[0], .data = data, .length = 2 * EXT_BLOCK_LEN, .block_size = EXT_BLOCK_LEN};
+  thrd_t thread;
+
+  // when
+  assert(thrd_create(&thread, send_blocks, &sender) == thrd_success);
+
+  struct stream_reader reader;
+  assert(stream_reader_init(&reader, fds[1], 0, STREAM_READER_LEN));
+  reader.max_length = EXT_BLOCK_LEN;
+
+  // then. the payload left in the socket is recieved in one go, and the reader goes on with the next block
+  struct data_view view;
+  for (size_t block = 0; block < 2; block++) {
+    assert(stream_reader_next_data(&reader, &view) == ERR_SUCCESS);
+    assert(view.remaining > 0);
+    assert(memcmp(view.data, data + block * EXT_BLOCK_LEN, view.length) == 0);
+
+    assert(receive_block_payload(fds[1], payload, view.remaining) == ERR_SUCCESS);
+    assert(memcmp(payload, data + block * EXT_BLOCK_LEN + view.length, view.remaining) == 0);
+  }
+  assert(view.descriptor & DESCPTR_EOF);
+
+  int ret;
+  thrd_join(thread, &ret);
+  assert(ret == 0);
+
+  // the peer is gone before the payload is complete
+  close(fds[0]);
+  assert(receive_block_payload(fds[1], payload, 1) != ERR_SUCCESS);
+
+  // cleanup
+  stream_reader_destroy(&reader);
+  free(payload);
+  free(data);
+  close(fds[1]);
+}
+
+void mixed_blocks_test(uint32_t block_size) {
+  // given
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  const uint32_t length = 5 * block_size + 123;
+  uint8_t *data = malloc(length);
+  assert(data);
+  fill_pattern(data, length);
+
+  struct sender sender = {.sockfd = fds[0], .data = data, .length = length, .block_size = block_size};
+  thrd_t thread;
+
+  // when
+  assert(thrd_create(&thread, send_blocks, &sender) == thrd_success);
+
+  struct stream_reader reader;
+  assert(stream_reader_init(&reader, fds[1], 0, STREAM_READER_LEN));
+  reader.max_length = block_size;
+
+  // then
+  assert(read_blocks(&reader, data) == length);
+
+  int ret;
+  thrd_join(thread, &ret);
+  assert(ret == 0);
+
+  // cleanup
+  stream_reader_destroy(&reader);
+  free(data);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void max_length_test(void) {
+  // given
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  uint8_t data[2 * DATA_BLOCK_MAX_LEN] = {0};
+  struct stream_writer writer;
+  stream_writer_init(&writer, fds[0], 0);
+  assert(stream_writer_block(&writer, DESCPTR_EOF, data, sizeof data) == ERR_SUCCESS);
+  assert(stream_writer_flush(&writer) == ERR_SUCCESS);
+
+  // when
+  struct stream_reader reader;
+  assert(stream_reader_init(&reader, fds[1], 0, STREAM_READER_LEN));
+
+  // then. a reader which didn't negotiate a larger block size rejects the block
+  struct data_view view;
+  assert(stream_reader_next_data(&reader, &view) == ERR_INVALID_LEN);
+
+  // cleanup
+  stream_reader_destroy(&reader);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void send_file_data_test(uint32_t block_size) {
+  // given
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  const uint32_t length = 3 * block_size + 17;
+  uint8_t *data = malloc(length);
+  assert(data);
+  fill_pattern(data, length);
+
+  FILE *fp = tmpfile();
+  assert(fp);
+  assert(fwrite(data, 1, length, fp) == length);
+  assert(fflush(fp) == 0);
+
+  struct sender sender = {.sockfd = fds[0], .fd = fileno(fp), .length = length, .block_size = block_size};
+  thrd_t thread;
+
+  // when
+  assert(thrd_create(&thread, send_file, &sender) == thrd_success);
+
+  struct stream_reader reader;
+  assert(stream_reader_init(&reader, fds[1], 0, STREAM_READER_LEN));
+  reader.max_length = block_size;
+
+  // then
+  uint8_t descriptor;
+  assert(recv(fds[1], &descriptor, sizeof descriptor, MSG_PEEK) == sizeof descriptor);
+  assert(block_size > DATA_BLOCK_MAX_LEN ? descriptor & DESCPTR_EXT_LEN : !(descriptor & DESCPTR_EXT_LEN));
+  assert(read_blocks(&reader, data) == length);
+
+  int ret;
+  thrd_join(thread, &ret);
+  assert(ret == 0);
+
+  // cleanup
+  stream_reader_destroy(&reader);
+  fclose(fp);
+  free(data);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void send_file_part_test(uint32_t block_size) {
+  // given
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  const uint32_t length = 3 * block_size + 17;
+  uint8_t *data = malloc(length);
+  assert(data);
+  fill_pattern(data, length);
+
+  FILE *fp = tmpfile();
+  assert(fp);
+  assert(fwrite(data, 1, length, fp) == length);
+  assert(fflush(fp) == 0);
+
+  struct sender sender = {.sockfd = fds[0], .fd = fileno(fp), .length = length, .block_size = block_size};
+  thrd_t thread;
+
+  // when
+  assert(thrd_create(&thread, send_file_parts, &sender) == thrd_success);
+
+  struct stream_reader reader;
+  assert(stream_reader_init(&reader, fds[1], 0, STREAM_READER_LEN));
+  reader.max_length = block_size;
+
+  // then. the parts are a single series of blocks, with DESCPTR_EOF on the last one only
+  assert(read_blocks(&reader, data) == length);
+
+  int ret;
+  thrd_join(thread, &ret);
+  assert(ret == 0);
+
+  // nothing follows the last block
+  uint8_t descriptor;
+  assert(!stream_reader_has_data(&reader));
+  assert(recv(fds[1], &descriptor, sizeof descriptor, MSG_DONTWAIT) == -1);
+
+  // cleanup
+  stream_reader_destroy(&reader);
+  fclose(fp);
+  free(data);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void frame_file_data_test(uint32_t block_size, uint32_t length) {
+  // given
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  uint8_t *data = malloc(length + 1);
+  assert(data);
+  fill_pattern(data, length);
+
+  FILE *fp = tmpfile();
+  assert(fp);
+  assert(fwrite(data, 1, length, fp) == length);
+  assert(fflush(fp) == 0);
+
+  size_t framed_len = framed_file_length(length, block_size);
+  uint8_t *framed = malloc(framed_len);
+  assert(framed);
+
+  // when
+  assert(frame_file_data(framed, fileno(fp), 0, length, block_size) == (ssize_t)framed_len);
+
+  struct sender sender = {.sockfd = fds[0], .fd = fileno(fp), .length = length, .block_size = block_size};
+  thrd_t thread;
+  assert(thrd_create(&thread, send_file, &sender) == thrd_success);
+
+  // then. the framed file is byte for byte what send_file_data() sends
+  uint8_t *sent = malloc(framed_len);
+  assert(sent);
+  for (size_t recieved = 0; recieved < framed_len;) {
+    ssize_t ret = recv(fds[1], sent + recieved, framed_len - recieved, 0);
+    assert(ret > 0);
+    recieved += ret;
+  }
+  assert(memcmp(framed, sent, framed_len) == 0);
+
+  int ret;
+  thrd_join(thread, &ret);
+  assert(ret == 0);
+
+  uint8_t descriptor;
+  assert(recv(fds[1], &descriptor, sizeof descriptor, MSG_DONTWAIT) == -1);
+
+  // and it's read back as the file once sent
+  struct sender framed_sender = {.sockfd = fds[0], .data = framed, .length = framed_len};
+  assert(thrd_create(&thread, send_framed, &framed_sender) == thrd_success);
+
+  struct stream_reader reader;
+  assert(stream_reader_init(&reader, fds[1], 0, STREAM_READER_LEN));
+  reader.max_length = block_size;
+  assert(read_blocks(&reader, data) == length);
+
+  thrd_join(thread, &ret);
+  assert(ret == 0);
+
+  // a file shorter than the requested count isn't framed
+  if (length) assert(frame_file_data(framed, fileno(fp), 1, length, block_size) == -1);
+
+  // cleanup
+  stream_reader_destroy(&reader);
+  fclose(fp);
+  free(sent);
+  free(framed);
+  free(data);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void request_parser_test(const char *const str) {
+  // given
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  struct request request = {.length = strlen(str)};
+  memcpy(request.request, str, request.length);
+  assert(send_request(&request, fds[0], 0) == ERR_SUCCESS);
+
+  uint8_t buf[REQUEST_MAX_LEN + sizeof(uint16_t)];
+  ssize_t len = recv(fds[1], buf, sizeof buf, 0);
+  assert(len == (ssize_t)(request.length + sizeof(uint16_t)));
+
+  // when. the request arrives one byte at a time
+  struct request_parser parser;
+  request_parser_reset(&parser);
+
+  enum parser_status status = PARSER_INCOMPLETE;
+  for (ssize_t i = 0; i < len; i++) {
+    size_t consumed = 0;
+    status = request_parser_feed(&parser, buf + i, 1, &consumed);
+    assert(consumed == 1);
+    assert(i == len - 1 ? status == PARSER_COMPLETE : status == PARSER_INCOMPLETE);
+  }
+
+  // then
+  assert(parser.request.length == request.length);
+  assert(memcmp(parser.request.request, str, request.length) == 0);
+
+  // cleanup
+  close(fds[0]);
+  close(fds[1]);
+}
+
+/* writes a request the way send_request() sends it (length + body) into buf. returns the number of bytes written */
+static size_t frame_request(uint8_t *buf, const char *str, uint16_t length) {
+  buf[0] = (uint8_t)(length >> 8);
+  buf[1] = (uint8_t)length;
+  memset(buf + sizeof length, 'x', length);
+  memcpy(buf + sizeof length, str, strlen(str) < length ? strlen(str) : length);
+  return sizeof length + length;
+}
+
+/* feeds buf into the parser in chunks of up to chunk bytes and collects the requests it completes into requests,
+ * separated by '|' (a rejected request is collected as '!'). returns the number of requests collected */
+static size_t feed_requests(struct request_parser *parser,
+                            const uint8_t *buf,
+                            size_t len,
+                            size_t chunk,
+                            char *requests) {
+  size_t count = 0;
+  *requests = 0;
+  for (size_t pos = 0; pos < len;) {
+    size_t feed = len - pos < chunk ? len - pos : chunk;
+    size_t fed = 0;
+    while (fed < feed) {
+      size_t consumed = 0;
+      enum parser_status status = request_parser_feed(parser, buf + pos + fed, feed - fed, &consumed);
+      fed += consumed;
+
+      if (status == PARSER_INCOMPLETE) assert(fed == feed);
+      if (status == PARSER_COMPLETE) {
+        strcat(requests, (char *)parser->request.request);
+        strcat(requests, "|");
+        request_parser_reset(parser);
+        count++;
+      }
+      if (status == PARSER_INVALID) {
+        strcat(requests, "!|");
+        count++;
+      }
+    }
+    pos += feed;
+  }
+
+  return count;
+}
+
+void request_parser_split_test(void) {
+  // given
+  uint8_t buf[64];
+  size_t len = frame_request(buf, "stor some/file", strlen("stor some/file"));
+
+  // when. the request is split in two at every possible point
+  for (size_t split = 1; split < len; split++) {
+    struct request_parser parser;
+    request_parser_reset(&parser);
+
+    size_t consumed = 0;
+    assert(request_parser_feed(&parser, buf, split, &consumed) == PARSER_INCOMPLETE);
+    assert(consumed == split);
+    assert(request_parser_feed(&parser, buf + split, len - split, &consumed) == PARSER_COMPLETE);
+    assert(consumed == len - split);
+
+    // then
+    assert(strcmp((char *)parser.request.request, "stor some/file") == 0);
+  }
+}
+
+void request_parser_pipeline_test(void) {
+  // given. several requests, an empty one among them, back to back
+  uint8_t buf[256];
+  size_t len = 0;
+  len += frame_request(buf + len, "pasv", 4);
+  len += frame_request(buf + len, "", 0);
+  len += frame_request(buf + len, "retr a", 6);
+  len += frame_request(buf + len, "quit", 4);
+
+  for (size_t chunk = 1; chunk <= len; chunk++) {
+    struct request_parser parser;
+    request_parser_reset(&parser);
+    char requests[64];
+
+    // when. a single feed stops at the end of every request
+    size_t count = feed_requests(&parser, buf, len, chunk, requests);
+
+    // then
+    assert(count == 4);
+    assert(strcmp(requests, "pasv||retr a|quit|") == 0);
+    assert(parser.state == PARSE_LENGTH && parser.recieved == 0);
+  }
+}
+
+void request_parser_boundary_test(void) {
+  // given
+  uint8_t buf[64];
+  size_t len = frame_request(buf, "pwd", 3);
+  len += frame_request(buf + len, "cwd a", 5);
+
+  struct request_parser parser;
+  request_parser_reset(&parser);
+  size_t consumed = 0;
+
+  // when. the feed ends right after the length of the first request
+  assert(request_parser_feed(&parser, buf, sizeof(uint16_t), &consumed) == PARSER_INCOMPLETE);
+  assert(consumed == sizeof(uint16_t));
+  assert(parser.state == PARSE_BODY);
+
+  // then. the next feed ends right after the first request
+  assert(request_parser_feed(&parser, buf + 2, 3, &consumed) == PARSER_COMPLETE);
+  assert(consumed == 3);
+  assert(strcmp((char *)parser.request.request, "pwd") == 0);
+
+  // and the second request is parsed from a fresh start
+  request_parser_reset(&parser);
+  assert(request_parser_feed(&parser, buf + 5, len - 5, &consumed) == PARSER_COMPLETE);
+  assert(consumed == len - 5);
+  assert(strcmp((char *)parser.request.request, "cwd a") == 0);
+}
+
+void request_parser_too_long_test(void) {
+  // given. the longest request, one which is a byte too long, a very long one and a request which follows them
+  static uint8_t buf[2 * UINT16_MAX];
+  size_t len = 0;
+  len += frame_request(buf + len, "mkd a", REQUEST_MAX_LEN - 2);
+  len += frame_request(buf + len, "mkd b", REQUEST_MAX_LEN - 1);
+  len += frame_request(buf + len, "stor c", UINT16_MAX);
+  len += frame_request(buf + len, "pwd", 3);
+
+  size_t chunks[] = {1, 7, REQUEST_MAX_LEN, len};
+  for (size_t i = 0; i < sizeof chunks / sizeof *chunks; i++) {
+    struct request_parser parser;
+    request_parser_reset(&parser);
+    static char requests[2 * REQUEST_MAX_LEN];
+
+    // when
+    size_t count = feed_requests(&parser, buf, len, chunks[i], requests);
+
+    // then. the requests which are too long are rejected and the parser resyncs on the request which follows them
+    assert(count == 4);
+    assert(strncmp(requests, "mkd a", 5) == 0);
+    assert(strcmp(requests + REQUEST_MAX_LEN - 2, "|!|!|pwd|") == 0);
+  }
+}
+
+void reply_test(uint16_t code, const char *const str) {
+  // given
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  struct reply reply = {.code = code, .length = strlen(str)};
+  memcpy(reply.reply, str, reply.length);
+
+  // when
+  assert(send_reply(&reply, fds[0], 0) == ERR_SUCCESS);
+  assert(send_reply(&reply, fds[0], 0) == ERR_SUCCESS);
+
+  // then. both replies are recieved, the second one out of the reader buffer
+  struct stream_reader reader;
+  assert(stream_reader_init(&reader, fds[1], 0, STREAM_READER_MIN_LEN));
+
+  for (int i = 0; i < 2; i++) {
+    struct reply recieved;
+    assert(stream_reader_next_reply(&reader, &recieved) == ERR_SUCCESS);
+    assert(recieved.code == code);
+    assert(recieved.length == reply.length);
+    assert(strcmp((char *)recieved.reply, str) == 0);
+  }
+  assert(!stream_reader_has_reply(&reader));
+
+  // cleanup
+  stream_reader_destroy(&reader);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+int main(void) {
+  standard_blocks_test();
+  extended_block_test(STREAM_READER_LEN);
+  extended_block_test(EXT_BLOCK_LEN + sizeof(uint8_t) + sizeof(uint32_t));
+  block_payload_test();
+  mixed_blocks_test(DATA_BLOCK_MAX_LEN);
+  mixed_blocks_test(64 * 1024);
+  mixed_blocks_test(256 * 1024);
+  max_length_test();
+  send_file_data_test(DATA_BLOCK_MAX_LEN);
+  send_file_data_test(64 * 1024);
+  send_file_part_test(DATA_BLOCK_MAX_LEN);
+  send_file_part_test(64 * 1024);
+  frame_file_data_test(DATA_BLOCK_MAX_LEN, 3 * DATA_BLOCK_MAX_LEN + 17);
+  frame_file_data_test(64 * 1024, 2 * 64 * 1024);
+  frame_file_data_test(64 * 1024, 64 * 1024 + DATA_BLOCK_MAX_LEN);
+  frame_file_data_test(64 * 1024, 0);
+  request_parser_test("retr some/file");
+  request_parser_split_test();
+  request_parser_pipeline_test();
+  request_parser_boundary_test();
+  request_parser_too_long_test();
+  reply_test(RPLY_CMD_OK, "[200] command okay");
+}
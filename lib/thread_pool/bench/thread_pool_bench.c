@@ -0,0 +1,223 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "include/thread_pool.h"
+#include "list.h"
+
+/* compares the work stealing thread_pool against the thread_pool it replaced (a single list guarded by a single lock,
+ * which wakes up every thread on every task). the tasks are tiny, so the numbers mostly reflect the scheduling
+ * overhead */
+
+#define THREADS_NUM 8
+#define TASKS_NUM (1 << 18)
+#define SESSIONS_NUM 64
+#define FAN_OUT 16
+#define SPIN 64
+
+/* the previous thread_pool, kept here for reference */
+struct legacy_pool {
+  thrd_t *threads;
+  uint8_t num_of_threads;
+  atomic_bool terminate;
+
+  struct list *tasks;
+  mtx_t tasks_mtx;
+  cnd_t tasks_cnd;
+};
+
+static int legacy_thread_func(void *arg) {
+  struct legacy_pool *pool = arg;
+
+  while (!atomic_load(&pool->terminate)) {
+    mtx_lock(&pool->tasks_mtx);
+    while (list_size(pool->tasks) == 0) {
+      cnd_wait(&pool->tasks_cnd, &pool->tasks_mtx);
+
+      if (atomic_load(&pool->terminate)) {
+        mtx_unlock(&pool->tasks_mtx);
+        return 0;
+      }
+    }
+
+    struct task *task = list_remove_first(pool->tasks);
+    mtx_unlock(&pool->tasks_mtx);
+
+    if (task) {
+      if (task->handle_task) task->handle_task(task->args);
+      free(task);
+    }
+  }
+
+  return 0;
+}
+
+static struct legacy_pool *legacy_pool_init(uint8_t num_of_threads) {
+  struct legacy_pool *pool = calloc(1, sizeof *pool);
+  if (!pool) return NULL;
+
+  pool->num_of_threads = num_of_threads;
+  pool->threads = calloc(num_of_threads, sizeof *pool->threads);
+  pool->tasks = list_init();
+  if (!pool->threads || !pool->tasks) goto cleanup_lbl;
+
+  if (mtx_init(&pool->tasks_mtx, mtx_plain) != thrd_success) goto cleanup_lbl;
+
+  if (cnd_init(&pool->tasks_cnd) != thrd_success) {
+    mtx_destroy(&pool->tasks_mtx);
+    goto cleanup_lbl;
+  }
+
+  atomic_init(&pool->terminate, false);
+  for (uint8_t i = 0; i < num_of_threads; i++) {
+    thrd_create(&pool->threads[i], legacy_thread_func, pool);  // assumes never fails
+  }
+
+  return pool;
+
+cleanup_lbl:
+  list_destroy(pool->tasks, NULL);
+  free(pool->threads);
+  free(pool);
+  return NULL;
+}
+
+static void legacy_pool_destroy(struct legacy_pool *pool) {
+  atomic_store(&pool->terminate, true);
+
+  mtx_lock(&pool->tasks_mtx);
+  cnd_broadcast(&pool->tasks_cnd);
+  mtx_unlock(&pool->tasks_mtx);
+
+  for (uint8_t i = 0; i < pool->num_of_threads; i++) {
+    thrd_join(pool->threads[i], NULL);
+  }
+
+  list_destroy(pool->tasks, NULL);
+  mtx_destroy(&pool->tasks_mtx);
+  cnd_destroy(&pool->tasks_cnd);
+  free(pool->threads);
+  free(pool);
+}
+
+static bool legacy_pool_add_task(struct legacy_pool *pool, struct task *task) {
+  mtx_lock(&pool->tasks_mtx);
+  bool ret = list_append(pool->tasks, task, sizeof *task);
+  if (ret) cnd_broadcast(&pool->tasks_cnd);
+  mtx_unlock(&pool->tasks_mtx);
+  return ret;
+}
+
+/* the benchmark itself */
+enum pool_type {
+  POOL_LEGACY,
+  POOL_STEALING,
+  POOL_STEALING_HINT,
+};
+
+struct bench {
+  enum pool_type type;
+  struct legacy_pool *legacy;
+  struct thread_pool *stealing;
+
+  atomic_size_t done;
+};
+
+static void submit(struct bench *bench, struct task *task, size_t hint) {
+  bool ret;
+  switch (bench->type) {
+    case POOL_LEGACY:
+      ret = legacy_pool_add_task(bench->legacy, task);
+      break;
+    case POOL_STEALING:
+      ret = thread_pool_add_task(bench->stealing, task);
+      break;
+    case POOL_STEALING_HINT:
+      ret = thread_pool_add_task_hint(bench->stealing, task, hint);
+      break;
+    default:
+      ret = false;
+  }
+
+  if (!ret) {
+    fprintf(stderr, "failed to add a task\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static int leaf_task(void *arg) {
+  struct bench *bench = arg;
+
+  // a bit of work so the task isn't entirely free
+  volatile unsigned sink = 0;
+  for (unsigned i = 0; i < SPIN; i++) {
+    sink += i;
+  }
+
+  atomic_fetch_add_explicit(&bench->done, 1, memory_order_relaxed);
+  return 0;
+}
+
+/* like a request which is parsed and then handed over to a handler. the children are submitted from the worker */
+static int fan_out_task(void *arg) {
+  struct bench *bench = arg;
+
+  for (int i = 0; i < FAN_OUT - 1; i++) {
+    submit(bench, &(struct task){.args = bench, .handle_task = leaf_task}, 0);
+  }
+  return leaf_task(arg);
+}
+
+static double now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *name, enum pool_type type, bool fan_out) {
+  struct bench bench = {.type = type};
+  atomic_init(&bench.done, 0);
+
+  if (type == POOL_LEGACY) {
+    bench.legacy = legacy_pool_init(THREADS_NUM);
+  } else {
+    bench.stealing = thread_pool_init(THREADS_NUM, NULL);
+  }
+
+  if (!bench.legacy && !bench.stealing) {
+    fprintf(stderr, "failed to create a thread pool\n");
+    exit(EXIT_FAILURE);
+  }
+
+  size_t roots = fan_out ? TASKS_NUM / FAN_OUT : TASKS_NUM;
+  double start = now();
+  for (size_t i = 0; i < roots; i++) {
+    struct task task = {.args = &bench, .handle_task = fan_out ? fan_out_task : leaf_task};
+    submit(&bench, &task, i % SESSIONS_NUM);
+  }
+
+  while (atomic_load(&bench.done) < TASKS_NUM) {
+    thrd_yield();
+  }
+  double elapsed = now() - start;
+
+  if (type == POOL_LEGACY) {
+    legacy_pool_destroy(bench.legacy);
+  } else {
+    thread_pool_destroy(bench.stealing);
+  }
+
+  printf("%-32s %10.3f ms %12.0f tasks/s\n", name, elapsed * 1e3, TASKS_NUM / elapsed);
+}
+
+int main(void) {
+  printf("%d threads, %d tasks\n", THREADS_NUM, TASKS_NUM);
+
+  run("legacy", POOL_LEGACY, false);
+  run("work stealing (round-robin)", POOL_STEALING, false);
+  run("work stealing (session hint)", POOL_STEALING_HINT, false);
+
+  run("legacy fan-out", POOL_LEGACY, true);
+  run("work stealing fan-out", POOL_STEALING, true);
+}
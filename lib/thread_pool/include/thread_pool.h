@@ -1,11 +1,13 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <threads.h>
 
-/* a thread_pool object. contains an array of threads, mutexes and condition
- * variables */
+/* a thread_pool object. a work stealing scheduler: every thread owns a lock-free queue of tasks, takes tasks from its
+ * own queue first and steals from the other threads queues once it runs out. idle threads sleep and are woken one at a
+ * time as tasks arrive */
 struct thread_pool;
 
 /* represent a task which a thread may handle. the thread handle a task by
@@ -25,5 +27,10 @@ struct thread_pool *thread_pool_init(uint8_t num_of_threads, void (*destroy_task
 /* destroys a thread_pool object */
 void thread_pool_destroy(struct thread_pool *thread_pool);
 
-/* adds a task to the thread_pool to handle asynchronously */
-bool thread_pool_add_task(struct thread_pool *thread_pool, struct task *task);
\ No newline at end of file
+/* adds a task to the thread_pool to handle asynchronously. a task added by one of the thread_pool threads goes to that
+ * thread queue. other tasks are spread between the threads round-robin. returns true on success, false otherwise */
+bool thread_pool_add_task(struct thread_pool *thread_pool, struct task *task);
+
+/* adds a task to the queue of the thread picked by hint (e.g. a session fd), so related tasks tend to run on the same
+ * thread. idle threads may still steal it. returns true on success, false otherwise */
+bool thread_pool_add_task_hint(struct thread_pool *thread_pool, struct task *task, size_t hint);
\ No newline at end of file
@@ -1,59 +1,178 @@
 #include "include/thread_pool.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "thread_pool_impl.h"
 
-static int thread_func_wrapper(void *arg) {
-  struct thread_args *thread_args = arg;
+// the thread_pool thread the calling thread is. NULL for any other thread
+static _Thread_local struct thread *current_thread;
 
-  // as long as the thread shouldn't terminate
-  while (!atomic_load(&thread_args->self->terminate)) {
-    mtx_lock(thread_args->tasks_mtx);  // assumes never fails
-    // there're no tasks
-    while (list_size(thread_args->tasks) == 0) {
-      cnd_wait(thread_args->tasks_cnd, thread_args->tasks_mtx);
-
-      if (atomic_load(&thread_args->self->terminate)) {
-        mtx_unlock(thread_args->tasks_mtx);
-        goto end_lbl;
+static void queue_init(struct queue *queue) {
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+  for (size_t i = 0; i < THREAD_POOL_QUEUE_LEN; i++) {
+    atomic_init(&queue->cells[i].sequence, i);
+  }
+}
+
+/* puts a copy of task in the queue. returns false if the queue is full */
+static bool queue_push(struct queue *queue, const struct task *task) {
+  size_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  for (;;) {
+    struct cell *cell = &queue->cells[pos & (THREAD_POOL_QUEUE_LEN - 1)];
+    size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+    if (diff == 0) {  // the cell is free. claim it
+      if (atomic_compare_exchange_weak_explicit(&queue->tail,
+                                                &pos,
+                                                pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        cell->task = *task;
+        atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+        return true;
       }
+    } else if (diff < 0) {  // the cell still holds a task from the previous lap. the queue is full
+      return false;
+    } else {  // another producer claimed the cell
+      pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
     }
+  }
+}
 
-    struct task *task = list_remove_first(thread_args->tasks);
+/* takes the oldest task out of the queue. returns false if the queue is empty */
+static bool queue_pop(struct queue *queue, struct task *task) {
+  size_t pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  for (;;) {
+    struct cell *cell = &queue->cells[pos & (THREAD_POOL_QUEUE_LEN - 1)];
+    size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+
+    if (diff == 0) {  // the cell holds a task. claim it
+      if (atomic_compare_exchange_weak_explicit(&queue->head,
+                                                &pos,
+                                                pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        *task = cell->task;
+        atomic_store_explicit(&cell->sequence, pos + THREAD_POOL_QUEUE_LEN, memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {  // the cell wasn't written yet. the queue is empty
+      return false;
+    } else {  // another consumer claimed the cell
+      pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    }
+  }
+}
 
-    mtx_unlock(thread_args->tasks_mtx);  // assumes never fails
+/* takes a task for self: from its own queue, then from the other threads queues, then from the overflow list. returns
+ * false if there are no tasks */
+static bool take_task(struct thread *self, struct task *task) {
+  struct thread_pool *thread_pool = self->thread_pool;
+
+  bool taken = queue_pop(&self->queue, task);
+  for (uint8_t i = 1; !taken && i < thread_pool->num_of_threads; i++) {
+    taken = queue_pop(&thread_pool->threads[(self->index + i) % thread_pool->num_of_threads].queue, task);
+  }
 
-    // handle the task
-    // as long as task is valid the thread shouldn't stop
+  if (!taken) {
+    mtx_lock(&thread_pool->overflow_mtx);
+    struct task *overflow = list_remove_first(thread_pool->overflow);
+    mtx_unlock(&thread_pool->overflow_mtx);
 
-    if (task) {
-      if (task->handle_task) task->handle_task(task->args);
-      if (thread_args->destroy_task) thread_args->destroy_task(task);
-      free(task);
+    if (overflow) {
+      *task = *overflow;
+      free(overflow);
+      taken = true;
     }
   }
 
-end_lbl:
-  free(thread_args);
+  if (taken) atomic_fetch_sub(&thread_pool->pending, 1);
+  return taken;
+}
+
+static int thread_func_wrapper(void *arg) {
+  struct thread *self = arg;
+  struct thread_pool *thread_pool = self->thread_pool;
+  current_thread = self;
+
+  // as long as the thread shouldn't terminate
+  unsigned idle = 0;
+  while (!atomic_load(&thread_pool->terminate)) {
+    struct task task;
+    if (take_task(self, &task)) {
+      idle = 0;
+      if (task.handle_task) task.handle_task(task.args);
+      if (thread_pool->destroy_task) thread_pool->destroy_task(&task);
+      continue;
+    }
+
+    // there're no tasks. yield for a while before going to sleep, since waking a thread up costs the submitter a
+    // syscall
+    if (idle++ < THREAD_POOL_SPINS) {
+      thrd_yield();
+      continue;
+    }
+    idle = 0;
+
+    // sleep until a task arrives
+    mtx_lock(&thread_pool->sleep_mtx);  // assumes never fails
+    atomic_fetch_add(&thread_pool->sleeping, 1);
+    while (!atomic_load(&thread_pool->pending) && !atomic_load(&thread_pool->terminate)) {
+      cnd_wait(&thread_pool->sleep_cnd, &thread_pool->sleep_mtx);
+    }
+    atomic_fetch_sub(&thread_pool->sleeping, 1);
+    mtx_unlock(&thread_pool->sleep_mtx);  // assumes never fails
+  }
 
   return 0;
 }
 
-static void cleanup(struct thread_pool *thread_pool, bool tasks_mtx, bool tasks_cnd) {
+/* destroys every task which was never handled */
+static void drain(struct thread_pool *thread_pool) {
+  for (uint8_t i = 0; i < thread_pool->num_of_threads; i++) {
+    struct task task;
+    while (queue_pop(&thread_pool->threads[i].queue, &task)) {
+      if (thread_pool->destroy_task) thread_pool->destroy_task(&task);
+    }
+  }
+}
+
+static void cleanup(struct thread_pool *thread_pool, bool overflow_mtx, bool sleep_mtx, bool sleep_cnd) {
   if (!thread_pool) return;
 
-  if (thread_pool->threads) free(thread_pool->threads);
+  if (thread_pool->threads) {
+    drain(thread_pool);
+    free(thread_pool->threads);
+  }
+
+  if (thread_pool->overflow) list_destroy(thread_pool->overflow, thread_pool->destroy_task);
 
-  if (thread_pool->tasks) list_destroy(thread_pool->tasks, thread_pool->destroy_task);
+  if (overflow_mtx) mtx_destroy(&thread_pool->overflow_mtx);
 
-  if (tasks_mtx) mtx_destroy(&thread_pool->tasks_mtx);
+  if (sleep_mtx) mtx_destroy(&thread_pool->sleep_mtx);
 
-  if (tasks_cnd) cnd_destroy(&thread_pool->tasks_cnd);
+  if (sleep_cnd) cnd_destroy(&thread_pool->sleep_cnd);
 
   free(thread_pool);
 }
 
+/* wakes up all threads and waits for the first num_of_threads of them to exit */
+static void stop_threads(struct thread_pool *thread_pool, uint8_t num_of_threads) {
+  atomic_store(&thread_pool->terminate, true);
+
+  mtx_lock(&thread_pool->sleep_mtx);
+  cnd_broadcast(&thread_pool->sleep_cnd);
+  mtx_unlock(&thread_pool->sleep_mtx);
+
+  for (uint8_t i = 0; i < num_of_threads; i++) {
+    thrd_join(thread_pool->threads[i].thread, NULL);
+  }
+}
+
 struct thread_pool *thread_pool_init(uint8_t num_of_threads, void (*destroy_task)(void *task)) {
   if (num_of_threads == 0) return NULL;
 
@@ -61,52 +180,57 @@ struct thread_pool *thread_pool_init(uint8_t num_of_threads, void (*destroy_task
   if (!thread_pool) return NULL;
 
   thread_pool->num_of_threads = num_of_threads;
+  thread_pool->destroy_task = destroy_task;
+  atomic_init(&thread_pool->terminate, false);
+  atomic_init(&thread_pool->next_thread, 0);
+  atomic_init(&thread_pool->pending, 0);
+  atomic_init(&thread_pool->sleeping, 0);
 
-  // init threads
-  thread_pool->threads = calloc(num_of_threads, sizeof *thread_pool->threads);
+  // init threads. their queues are cache line aligned
+  thread_pool->threads = aligned_alloc(_Alignof(struct thread), num_of_threads * sizeof *thread_pool->threads);
   if (!thread_pool->threads) {
-    cleanup(thread_pool, false, false);
+    cleanup(thread_pool, false, false, false);
     return NULL;
   }
 
-  // init tasks
-  thread_pool->tasks = list_init();
-  if (!thread_pool->tasks) {
-    cleanup(thread_pool, false, false);
+  memset(thread_pool->threads, 0, num_of_threads * sizeof *thread_pool->threads);
+  for (uint8_t i = 0; i < num_of_threads; i++) {
+    queue_init(&thread_pool->threads[i].queue);
+    thread_pool->threads[i].index = i;
+    thread_pool->threads[i].thread_pool = thread_pool;
+  }
+
+  // init the overflow list
+  thread_pool->overflow = list_init();
+  if (!thread_pool->overflow) {
+    cleanup(thread_pool, false, false, false);
     return NULL;
   }
 
-  // init mutex
-  if (mtx_init(&thread_pool->tasks_mtx, mtx_plain) != thrd_success) {
-    cleanup(thread_pool, true, false);
+  // init mutexes
+  if (mtx_init(&thread_pool->overflow_mtx, mtx_plain) != thrd_success) {
+    cleanup(thread_pool, false, false, false);
     return NULL;
   }
 
-  // init condition variable
-  if (cnd_init(&thread_pool->tasks_cnd) != thrd_success) {
-    cleanup(thread_pool, true, true);
+  if (mtx_init(&thread_pool->sleep_mtx, mtx_plain) != thrd_success) {
+    cleanup(thread_pool, true, false, false);
     return NULL;
   }
 
-  thread_pool->destroy_task = destroy_task;
+  // init condition variable
+  if (cnd_init(&thread_pool->sleep_cnd) != thrd_success) {
+    cleanup(thread_pool, true, true, false);
+    return NULL;
+  }
 
   // creates the threads
   for (uint8_t i = 0; i < num_of_threads; i++) {
-    struct thread_args *thread_args = calloc(1, sizeof *thread_args);
-    if (!thread_args) cleanup(thread_pool, true, true);
-
-    thread_args->tasks = thread_pool->tasks;
-    thread_args->tasks_mtx = &thread_pool->tasks_mtx;
-    thread_args->tasks_cnd = &thread_pool->tasks_cnd;
-    thread_args->self = &thread_pool->threads[i];
-    thread_args->destroy_task = thread_pool->destroy_task;
-
-    atomic_init(&thread_pool->threads[i].terminate, false);
-
-    /* the thread takes owership of thread_args. its his responsibility to free
-     * it at the end*/
-    thrd_create(&thread_pool->threads[i].thread, thread_func_wrapper,
-                thread_args);  // assumes never fails
+    if (thrd_create(&thread_pool->threads[i].thread, thread_func_wrapper, &thread_pool->threads[i]) != thrd_success) {
+      stop_threads(thread_pool, i);
+      cleanup(thread_pool, true, true, true);
+      return NULL;
+    }
   }
 
   return thread_pool;
@@ -115,20 +239,42 @@ struct thread_pool *thread_pool_init(uint8_t num_of_threads, void (*destroy_task
 void thread_pool_destroy(struct thread_pool *thread_pool) {
   if (!thread_pool) return;
 
-  // signal all threads to terminate
-  for (uint8_t i = 0; i < thread_pool->num_of_threads; i++) {
-    atomic_store(&thread_pool->threads[i].terminate, true);
+  // signal all threads to terminate and wait on all threads to exit
+  stop_threads(thread_pool, thread_pool->num_of_threads);
+
+  cleanup(thread_pool, true, true, true);
+}
+
+/* puts task in the queue of thread. spills over to the other threads queues, and to the overflow list, if the queue is
+ * full */
+static bool submit(struct thread_pool *thread_pool, struct thread *thread, struct task *task) {
+  // counted before the task becomes visible, so a thread that takes it never sees pending drop below zero
+  atomic_fetch_add(&thread_pool->pending, 1);
+
+  bool ret = queue_push(&thread->queue, task);
+  for (uint8_t i = 1; !ret && i < thread_pool->num_of_threads; i++) {
+    ret = queue_push(&thread_pool->threads[(thread->index + i) % thread_pool->num_of_threads].queue, task);
   }
 
-  // wakeup all threads
-  cnd_broadcast(&thread_pool->tasks_cnd);
+  if (!ret) {
+    mtx_lock(&thread_pool->overflow_mtx);
+    ret = list_append(thread_pool->overflow, task, sizeof *task);
+    mtx_unlock(&thread_pool->overflow_mtx);
+  }
 
-  // wait on all threads to exit
-  for (uint8_t i = 0; i < thread_pool->num_of_threads; i++) {
-    thrd_join(thread_pool->threads[i].thread, NULL);
+  if (!ret) {
+    atomic_fetch_sub(&thread_pool->pending, 1);
+    return false;
   }
 
-  cleanup(thread_pool, true, true);
+  // wake up a single thread, and only if one is asleep
+  if (atomic_load(&thread_pool->sleeping)) {
+    mtx_lock(&thread_pool->sleep_mtx);
+    cnd_signal(&thread_pool->sleep_cnd);
+    mtx_unlock(&thread_pool->sleep_mtx);
+  }
+
+  return true;
 }
 
 bool thread_pool_add_task(struct thread_pool *thread_pool, struct task *task) {
@@ -136,16 +282,19 @@ bool thread_pool_add_task(struct thread_pool *thread_pool, struct task *task) {
 
   if (!task) return false;
 
-  if (mtx_lock(&thread_pool->tasks_mtx) == thrd_error) { return false; }
+  // a task added by a thread of this thread_pool stays local. anything else is spread round-robin
+  struct thread *thread = current_thread;
+  if (!thread || thread->thread_pool != thread_pool) {
+    thread = &thread_pool->threads[atomic_fetch_add(&thread_pool->next_thread, 1) % thread_pool->num_of_threads];
+  }
 
-  bool ret = list_append(thread_pool->tasks, task, sizeof *task);
+  return submit(thread_pool, thread, task);
+}
 
-  // wakeup all threads
-  if (ret) cnd_broadcast(&thread_pool->tasks_cnd);
+bool thread_pool_add_task_hint(struct thread_pool *thread_pool, struct task *task, size_t hint) {
+  if (!thread_pool) return false;
 
-  while (mtx_unlock(&thread_pool->tasks_mtx) == thrd_error) {
-    continue;
-  }
+  if (!task) return false;
 
-  return ret;
-}
\ No newline at end of file
+  return submit(thread_pool, &thread_pool->threads[hint % thread_pool->num_of_threads], task);
+}
@@ -1,16 +1,44 @@
 #pragma once
 
 #include <stdatomic.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <threads.h>
 
+#include "include/thread_pool.h"
 #include "list.h"
 
+// the number of tasks every worker queue holds. must be a power of 2
+#define THREAD_POOL_QUEUE_LEN 1024
+
+// the number of times an idle thread looks for tasks (yielding in between) before it goes to sleep
+#define THREAD_POOL_SPINS 32
+
+/* a cell of a worker queue. cell::sequence tells whether the cell is free to be written to or holds a task which is
+ * ready to be taken */
+struct cell {
+  atomic_size_t sequence;
+  struct task task;
+};
+
+/* a bounded lock-free multi producer multi consumer queue (Dmitry Vyukov's design). every worker owns one: tasks are
+ * pushed into it by whoever submits them, the worker takes tasks from it and idle workers steal from it */
+struct queue {
+  // head and tail are on different cache lines so producers and consumers don't contend over them
+  _Alignas(64) atomic_size_t head;  // the next cell to take a task from
+  _Alignas(64) atomic_size_t tail;  // the next cell to put a task in
+  _Alignas(64) struct cell cells[THREAD_POOL_QUEUE_LEN];
+};
+
 /* used internally to represent a thread */
 struct thread {
   thrd_t thread;
 
-  atomic_bool terminate;  // indicate the thread to terminate
+  struct queue queue;
+
+  // the index of the thread in thread_pool::threads
+  uint8_t index;
+  struct thread_pool *thread_pool;
 };
 
 struct thread_pool {
@@ -18,17 +46,22 @@ struct thread_pool {
   uint8_t num_of_threads;
 
   void (*destroy_task)(void *task);
-  struct list *tasks;  // treated as a queue. FIFO
-  mtx_t tasks_mtx;
-  cnd_t tasks_cnd;
-};
 
-/* used internally to pass the thread the resources it needs */
-struct thread_args {
-  struct thread *self;
-  struct list *tasks;
-  mtx_t *tasks_mtx;
-  cnd_t *tasks_cnd;
+  atomic_bool terminate;  // indicate the threads to terminate
 
-  void (*destroy_task)(void *task);
+  // used to spread tasks which don't come from a worker and carry no hint between the workers
+  atomic_uint next_thread;
+
+  /* the number of tasks waiting in the queues and the overflow list. a worker goes to sleep only once there are none.
+   * pending is written before sleeping is read (and vice versa), so a task is never left behind while all the workers
+   * sleep */
+  atomic_size_t pending;
+  atomic_uint sleeping;
+
+  // tasks which didn't fit in any worker queue. rarely used, so a plain locked list is good enough
+  struct list *overflow;
+  mtx_t overflow_mtx;
+
+  mtx_t sleep_mtx;
+  cnd_t sleep_cnd;
 };
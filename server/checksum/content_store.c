@@ -0,0 +1,263 @@
+#include "content_store.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>   // open(), openat(), linkat()
+#include <limits.h>  // PATH_MAX
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <threads.h>
+#include <unistd.h>  // pread(), unlinkat(), close()
+#include "sha256.h"
+
+#define READ_CHUNK_LEN (1024 * 1024)
+#define PREFIX_LEN 2  // objects are spread between directories named after the first hex digits of their sha-256
+#define OBJECT_NAME_LEN (PREFIX_LEN + 1 + SHA256_HEX_LEN)
+
+struct content_store {
+  int objects_fd;  // the directory of the store
+  struct logger *logger;
+};
+
+/* formats the path of the object of hex, relative to the directory of the store */
+static void object_name(const char *hex, char name[OBJECT_NAME_LEN + 1]) {
+  snprintf(name, OBJECT_NAME_LEN + 1, "%.*s/%s", PREFIX_LEN, hex, hex);
+}
+
+static bool is_hex_digest(const char *hex) {
+  size_t len = strspn(hex, "0123456789abcdef");
+  return len == SHA256_HEX_LEN && !hex[len];
+}
+
+/* reads the file open as fd through and formats its sha-256 into hex. returns true on success, false otherwise */
+static bool hash_file(int fd, char hex[SHA256_HEX_LEN + 1]) {
+  uint8_t *buf = malloc(READ_CHUNK_LEN);
+  if (!buf) return false;
+
+  (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  struct sha256 ctx;
+  sha256_init(&ctx);
+  for (off_t offset = 0;;) {
+    ssize_t len = pread(fd, buf, READ_CHUNK_LEN, offset);
+    if (len == -1 && errno == EINTR) continue;
+    if (len == -1) {
+      int err = errno;
+      free(buf);
+      errno = err;
+      return false;
+    }
+    if (len == 0) break;
+
+    sha256_update(&ctx, buf, (size_t)len);
+    offset += len;
+  }
+  free(buf);
+
+  uint8_t digest[SHA256_LEN];
+  sha256_final(&ctx, digest);
+  sha256_hex(digest, hex);
+  return true;
+}
+
+/* atomically replaces the file at path (if there's one) with a link to the object name. the link is made under a
+ * hidden temporary name next to path first, and renamed over it */
+static bool replace_with_link(struct content_store *store, const char *name, const char *path) {
+  const char *base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+
+  char tmp[PATH_MAX];
+  int len = snprintf(tmp, sizeof tmp, "%.*s.%s.%lu.link", (int)(base - path), path, base, thrd_current());
+  if (len < 0 || (size_t)len >= sizeof tmp) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+
+  (void)unlink(tmp);  // left behind by a crash
+  if (linkat(store->objects_fd, name, AT_FDCWD, tmp, 0) == -1) return false;
+
+  bool success = rename(tmp, path) == 0;
+  int err = errno;
+
+  // renaming a link over another link of the same file does nothing, and leaves both of them
+  (void)unlink(tmp);
+
+  errno = err;
+  return success;
+}
+
+/* removes the objects no file links to anymore. returns the number of objects removed */
+static size_t sweep(struct content_store *store) {
+  int fd = dup(store->objects_fd);
+  if (fd == -1) return 0;
+
+  DIR *objects = fdopendir(fd);
+  if (!objects) {
+    close(fd);
+    return 0;
+  }
+
+  size_t removed = 0;
+  for (struct dirent *prefix = readdir(objects); prefix; prefix = readdir(objects)) {
+    if (*prefix->d_name == '.') continue;
+
+    int prefix_fd = openat(store->objects_fd, prefix->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (prefix_fd == -1) continue;
+
+    DIR *dir = fdopendir(prefix_fd);
+    if (!dir) {
+      close(prefix_fd);
+      continue;
+    }
+
+    for (struct dirent *entry = readdir(dir); entry; entry = readdir(dir)) {
+      if (*entry->d_name == '.') continue;
+
+      struct stat statbuf;
+      if (fstatat(prefix_fd, entry->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(statbuf.st_mode) &&
+          statbuf.st_nlink == 1 && unlinkat(prefix_fd, entry->d_name, 0) == 0) {
+        removed++;
+      }
+    }
+    closedir(dir);
+  }
+  closedir(objects);
+
+  return removed;
+}
+
+struct content_store *content_store_init(struct logger *logger) {
+  struct content_store *store = calloc(1, sizeof *store);
+  if (!store) return NULL;
+
+  store->logger = logger;
+
+  if (mkdir(CONTENT_STORE_DIR, S_IRUSR | S_IWUSR | S_IXUSR) == -1 && errno != EEXIST) {
+    free(store);
+    return NULL;
+  }
+
+  store->objects_fd = open(CONTENT_STORE_DIR, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (store->objects_fd == -1) {
+    free(store);
+    return NULL;
+  }
+
+  size_t removed = sweep(store);
+  logger_log(logger, INFO, "[%lu] [%s] removed [%zu] unused objects", thrd_current(), __func__, removed);
+
+  return store;
+}
+
+void content_store_destroy(struct content_store *store) {
+  if (!store) return;
+
+  close(store->objects_fd);
+  free(store);
+}
+
+bool content_store_add(struct content_store *store, const char *path, bool *deduplicated) {
+  if (!store || !path || !deduplicated) {
+    errno = EINVAL;
+    return false;
+  }
+  *deduplicated = false;
+
+  int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1) return false;
+
+  struct stat statbuf;
+  char hex[SHA256_HEX_LEN + 1];
+  if (fstat(fd, &statbuf) == -1 || !S_ISREG(statbuf.st_mode) || !hash_file(fd, hex)) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return false;
+  }
+
+  // every link of the object shares it. lets the last one of them find the object once it's deleted
+  if (fsetxattr(fd, SHA256_XATTR, hex, SHA256_HEX_LEN, 0) == -1) {
+    logger_log(store->logger,
+               WARN,
+               "[%lu] [%s] failed to tag [%s]. its object won't be removed along with it",
+               thrd_current(),
+               __func__,
+               path);
+  }
+  close(fd);
+
+  char name[OBJECT_NAME_LEN + 1];
+  object_name(hex, name);
+  name[PREFIX_LEN] = '\0';
+  if (mkdirat(store->objects_fd, name, S_IRUSR | S_IWUSR | S_IXUSR) == -1 && errno != EEXIST) return false;
+  name[PREFIX_LEN] = '/';
+
+  // a new content: the file becomes its object
+  if (linkat(AT_FDCWD, path, store->objects_fd, name, 0) == 0) return true;
+  if (errno != EEXIST) return false;
+
+  // the content is stored already. sha-256 doesn't collide, but a size which doesn't match is a corrupted object
+  struct stat object;
+  if (fstatat(store->objects_fd, name, &object, AT_SYMLINK_NOFOLLOW) == -1) return false;
+  if (object.st_dev == statbuf.st_dev && object.st_ino == statbuf.st_ino) return true;
+  if (!S_ISREG(object.st_mode) || object.st_size != statbuf.st_size) {
+    logger_log(store->logger,
+               ERROR,
+               "[%lu] [%s] the object [%s] doesn't match its content",
+               thrd_current(),
+               __func__,
+               name);
+    errno = EEXIST;
+    return false;
+  }
+
+  if (!replace_with_link(store, name, path)) return false;
+
+  *deduplicated = true;
+  return true;
+}
+
+bool content_store_link(struct content_store *store, const char *hex, off_t size, const char *path) {
+  if (!store || !hex || !path || !is_hex_digest(hex)) {
+    errno = EINVAL;
+    return false;
+  }
+
+  char name[OBJECT_NAME_LEN + 1];
+  object_name(hex, name);
+
+  struct stat object;
+  if (fstatat(store->objects_fd, name, &object, AT_SYMLINK_NOFOLLOW) == -1) return false;
+  if (!S_ISREG(object.st_mode) || object.st_size != size) {
+    errno = ENOENT;
+    return false;
+  }
+
+  return replace_with_link(store, name, path);
+}
+
+void content_store_release(struct content_store *store, const char *path) {
+  if (!store || !path) return;
+
+  // the file and the object are the only links left
+  struct stat statbuf;
+  if (lstat(path, &statbuf) == -1 || !S_ISREG(statbuf.st_mode) || statbuf.st_nlink != 2) return;
+
+  char hex[SHA256_HEX_LEN + 1];
+  ssize_t len = getxattr(path, SHA256_XATTR, hex, SHA256_HEX_LEN);
+  if (len != SHA256_HEX_LEN) return;
+  hex[len] = '\0';
+  if (!is_hex_digest(hex)) return;
+
+  char name[OBJECT_NAME_LEN + 1];
+  object_name(hex, name);
+
+  struct stat object;
+  if (fstatat(store->objects_fd, name, &object, AT_SYMLINK_NOFOLLOW) == 0 && object.st_dev == statbuf.st_dev &&
+      object.st_ino == statbuf.st_ino) {
+    (void)unlinkat(store->objects_fd, name, 0);
+  }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <sys/types.h>  // off_t
+#include "logger.h"
+
+/* a deduplicating store of whole files, kept under .objects/ in the server root directory. every content the store
+ * holds is an object named after its sha-256 (.objects/<2 first hex digits>/<64 hex digits>), and every file of the
+ * same content is a hard link to its object, so identical uploads take the space of a single one. the server never
+ * modifies a file in place (an upload is written into a new file which is renamed into place), so an object never
+ * changes under its name. a file of the store shares the modification time of the first upload of its content.
+ *
+ * the sha-256 of a stored file is kept in an extended attribute of its inode (user.ftp.sha256), which all of its links
+ * share. an object is removed along with the last file which links to it, and objects of files which were replaced
+ * (rather than deleted) are removed when the server starts. mt-safe */
+struct content_store;
+
+#define CONTENT_STORE_DIR ".objects"
+#define SHA256_XATTR "user.ftp.sha256"
+
+/* opens the store under the current directory (creating it if needed) and removes the objects no file links to.
+ * returns a pointer to a heap allocated store on success, NULL on failure */
+struct content_store *content_store_init(struct logger *logger);
+
+void content_store_destroy(struct content_store *store);
+
+/* stores the content of the regular file at path (a complete upload, before it's renamed into place). if the store
+ * holds the same content already the file is replaced by a link to it and *deduplicated is set. otherwise the file
+ * becomes the object of its content. returns true on success, false on failure (the file is left as it was) */
+bool content_store_add(struct content_store *store, const char *path, bool *deduplicated);
+
+/* links the object whose sha-256 is hex (SHA256_HEX_LEN hex digits) and whose size is size into path, replacing the
+ * file at path if there's one. returns true on success, false on failure (errno is set accordingly. ENOENT if the
+ * store holds no such content) */
+bool content_store_link(struct content_store *store, const char *hex, off_t size, const char *path);
+
+/* removes the object of the file at path if path is the last file which links to it. must be called right before
+ * path is unlinked */
+void content_store_release(struct content_store *store, const char *path);
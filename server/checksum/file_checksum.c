@@ -0,0 +1,113 @@
+#include "file_checksum.h"
+#include <errno.h>
+#include <fcntl.h>  // posix_fadvise()
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>  // pread()
+#include "crc32c.h"
+
+#define READ_CHUNK_LEN (1024 * 1024)
+#define XATTR_LEN 96
+
+/* formats the key of the cached checksum of a file: '<size> <mtime seconds>.<mtime nanoseconds> '. returns its length */
+static int format_key(const struct stat *statbuf, char *buf, size_t len) {
+  return snprintf(buf,
+                  len,
+                  "%jd %jd.%09ld ",
+                  (intmax_t)statbuf->st_size,
+                  (intmax_t)statbuf->st_mtim.tv_sec,
+                  statbuf->st_mtim.tv_nsec);
+}
+
+/* looks up the cached checksum of the file. returns true if there's one and it was computed for the file as it is now */
+static bool get_cached(int fd, const struct stat *statbuf, uint32_t *crc) {
+  char key[XATTR_LEN];
+  int key_len = format_key(statbuf, key, sizeof key);
+
+  char value[XATTR_LEN];
+  ssize_t len = fgetxattr(fd, CHECKSUM_XATTR, value, sizeof value - 1);
+  if (len <= key_len || memcmp(value, key, (size_t)key_len) != 0) return false;
+  value[len] = '\0';
+
+  char *endptr = NULL;
+  unsigned long tmp = strtoul(value + key_len, &endptr, 16);
+  if (endptr == value + key_len || *endptr || tmp > UINT32_MAX) return false;
+
+  *crc = (uint32_t)tmp;
+  return true;
+}
+
+static void set_cached(int fd, const struct stat *statbuf, uint32_t crc) {
+  char value[XATTR_LEN];
+  int key_len = format_key(statbuf, value, sizeof value);
+  int len = key_len + snprintf(value + key_len, sizeof value - (size_t)key_len, "%08" PRIx32, crc);
+
+  // a file system without extended attributes (or a file the server may not modify) just isn't cached
+  (void)fsetxattr(fd, CHECKSUM_XATTR, value, (size_t)len, 0);
+}
+
+bool file_checksum(int fd, const atomic_bool *cancel, uint32_t *crc, bool *cached) {
+  if (fd < 0 || !crc) {
+    errno = EINVAL;
+    return false;
+  }
+
+  struct stat before;
+  if (fstat(fd, &before) == -1) return false;
+  if (!S_ISREG(before.st_mode)) {
+    errno = EINVAL;
+    return false;
+  }
+
+  if (get_cached(fd, &before, crc)) {
+    if (cached) *cached = true;
+    return true;
+  }
+
+  uint8_t *buf = malloc(READ_CHUNK_LEN);
+  if (!buf) return false;
+
+  (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  uint32_t result = 0;
+  for (off_t offset = 0;;) {
+    if (cancel && atomic_load(cancel)) {
+      free(buf);
+      errno = ECANCELED;
+      return false;
+    }
+
+    ssize_t len = pread(fd, buf, READ_CHUNK_LEN, offset);
+    if (len == -1 && errno == EINTR) continue;
+    if (len == -1) {
+      int err = errno;
+      free(buf);
+      errno = err;
+      return false;
+    }
+    if (len == 0) break;
+
+    result = crc32c(result, buf, (size_t)len);
+    offset += len;
+  }
+  free(buf);
+
+  // the file changed while it was read. what was read may be a mix of the old and the new content
+  struct stat after;
+  if (fstat(fd, &after) == -1) return false;
+  if (after.st_size != before.st_size || after.st_mtim.tv_sec != before.st_mtim.tv_sec ||
+      after.st_mtim.tv_nsec != before.st_mtim.tv_nsec) {
+    errno = EBUSY;
+    return false;
+  }
+
+  set_cached(fd, &before, result);
+
+  *crc = result;
+  if (cached) *cached = false;
+  return true;
+}
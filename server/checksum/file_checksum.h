@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* the crc32c of whole files, cached in an extended attribute of the file itself (user.ftp.crc32c). the attribute holds
+ * the size and the modification time the file had when its checksum was computed, and the checksum is trusted only as
+ * long as both still match. the cache is best effort: a file on a file system without extended attributes is simply
+ * read through every time */
+
+#define CHECKSUM_XATTR "user.ftp.crc32c"
+
+/* returns in *crc the crc32c of the regular file open as fd. a valid cached checksum is returned as is, otherwise the
+ * file is read through with large pread() calls and its checksum is cached. *cached (may be NULL) tells which of the two
+ * happened. the read gives up once *cancel is set (cancel may be NULL). returns true on success, false on failure
+ * (errno is set accordingly. EBUSY if the file was modified while it was being read) */
+bool file_checksum(int fd, const atomic_bool *cancel, uint32_t *crc, bool *cached);
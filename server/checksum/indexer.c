@@ -0,0 +1,225 @@
+#include "indexer.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>   // openat(), posix_fadvise()
+#include <limits.h>  // PATH_MAX
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>  // setpriority()
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>  // syscall(), close()
+#include "file_checksum.h"
+
+// see ioprio_set(2). glibc has no wrapper for it
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+#define LOWEST_NICE 19
+
+struct indexer {
+  mtx_t mtx;
+  cnd_t cnd;  // signaled when the indexer is stopped
+
+  atomic_bool stopped;  // also cancels the checksum being computed
+
+  char *root;
+  unsigned interval;
+
+  thrd_t thread;
+  struct logger *logger;
+};
+
+/* a directory waiting to be indexed. the path is relative to the root of the indexer */
+struct dir {
+  struct dir *next;
+  char path[];
+};
+
+/* the counts of a single pass over the tree */
+struct pass {
+  size_t files;
+  size_t computed;
+};
+
+static bool push_dir(struct dir **dirs, const char *parent, const char *name) {
+  size_t len = strlen(parent) + 1 + strlen(name);
+  if (len + 1 > PATH_MAX) return false;
+
+  struct dir *dir = malloc(sizeof *dir + len + 1);
+  if (!dir) return false;
+
+  snprintf(dir->path, len + 1, "%s/%s", parent, name);
+  dir->next = *dirs;
+  *dirs = dir;
+  return true;
+}
+
+/* lowers the priority of the calling thread. the io priority and the nice value of a thread are its own on linux */
+static void set_idle_priority(struct indexer *indexer) {
+  pid_t tid = (pid_t)syscall(SYS_gettid);
+
+  if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) == -1) {
+    logger_log(indexer->logger, WARN, "[%lu] [%s] failed to set the idle io priority", thrd_current(), __func__);
+  }
+  if (setpriority(PRIO_PROCESS, (id_t)tid, LOWEST_NICE) == -1) {
+    logger_log(indexer->logger, WARN, "[%lu] [%s] failed to set the cpu priority", thrd_current(), __func__);
+  }
+}
+
+/* checksums the file name in the directory dirfd, unless its cached checksum is valid */
+static void index_file(struct indexer *indexer, int dirfd, const char *name, struct pass *pass) {
+  // O_NONBLOCK: opening a fifo mustn't wait for a writer. file_checksum() refuses anything but a regular file anyway
+  int fd = openat(dirfd, name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+  if (fd == -1) return;
+
+  uint32_t crc;
+  bool cached = false;
+  if (file_checksum(fd, &indexer->stopped, &crc, &cached)) {
+    pass->files++;
+    if (!cached) {
+      pass->computed++;
+
+      // the indexer reads files nobody asked for. don't let them push the files clients use out of the page cache
+      (void)posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+  }
+  close(fd);
+}
+
+/* indexes the files of the directory path, and queues its sub directories onto dirs */
+static void index_dir(struct indexer *indexer, const char *path, struct dir **dirs, struct pass *pass) {
+  int dirfd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (dirfd == -1) return;
+
+  DIR *dir = fdopendir(dirfd);
+  if (!dir) {
+    close(dirfd);
+    return;
+  }
+
+  for (struct dirent *entry = readdir(dir); entry && !atomic_load(&indexer->stopped); entry = readdir(dir)) {
+    if (*entry->d_name == '.') continue;  // '.', '..' and hidden entries
+
+    unsigned char type = entry->d_type;
+    if (type == DT_UNKNOWN) {
+      struct stat statbuf;
+      if (fstatat(dirfd, entry->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) == -1) continue;
+      type = S_ISDIR(statbuf.st_mode) ? DT_DIR : S_ISREG(statbuf.st_mode) ? DT_REG : DT_UNKNOWN;
+    }
+
+    if (type == DT_DIR) {
+      if (!push_dir(dirs, path, entry->d_name)) {
+        logger_log(indexer->logger,
+                   WARN,
+                   "[%lu] [%s] skips the directory [%s/%s]",
+                   thrd_current(),
+                   __func__,
+                   path,
+                   entry->d_name);
+      }
+    } else if (type == DT_REG) {
+      index_file(indexer, dirfd, entry->d_name, pass);
+    }
+  }
+
+  closedir(dir);
+}
+
+/* a single pass over the tree. depth first, so the queue of directories stays short */
+static void index_tree(struct indexer *indexer, struct pass *pass) {
+  struct dir *dirs = malloc(sizeof *dirs + strlen(indexer->root) + 1);
+  if (!dirs) return;
+  strcpy(dirs->path, indexer->root);
+  dirs->next = NULL;
+
+  while (dirs) {
+    struct dir *dir = dirs;
+    dirs = dir->next;
+
+    if (!atomic_load(&indexer->stopped)) index_dir(indexer, dir->path, &dirs, pass);
+    free(dir);
+  }
+}
+
+static int run(void *arg) {
+  struct indexer *indexer = arg;
+  set_idle_priority(indexer);
+
+  while (!atomic_load(&indexer->stopped)) {
+    struct pass pass = {0};
+    index_tree(indexer, &pass);
+
+    logger_log(indexer->logger,
+               INFO,
+               "[%lu] [%s] indexed [%zu] files. computed [%zu] checksums",
+               thrd_current(),
+               __func__,
+               pass.files,
+               pass.computed);
+
+    // sleep until the next pass, or until the indexer is stopped
+    struct timespec deadline;
+    timespec_get(&deadline, TIME_UTC);
+    deadline.tv_sec += indexer->interval;
+
+    mtx_lock(&indexer->mtx);  // assume never fails
+    while (!atomic_load(&indexer->stopped)) {
+      if (cnd_timedwait(&indexer->cnd, &indexer->mtx, &deadline) == thrd_timedout) break;
+    }
+    mtx_unlock(&indexer->mtx);  // assume never fails
+  }
+
+  return 0;
+}
+
+struct indexer *indexer_start(const char *root, unsigned interval, struct logger *logger) {
+  if (!root || !interval) return NULL;
+
+  struct indexer *indexer = calloc(1, sizeof *indexer);
+  if (!indexer) return NULL;
+
+  indexer->root = strdup(root);
+  if (!indexer->root) goto root_cleanup;
+
+  indexer->interval = interval;
+  indexer->logger = logger;
+  atomic_init(&indexer->stopped, false);
+
+  if (mtx_init(&indexer->mtx, mtx_plain) != thrd_success) goto root_cleanup;
+  if (cnd_init(&indexer->cnd) != thrd_success) goto mtx_cleanup;
+  if (thrd_create(&indexer->thread, run, indexer) != thrd_success) goto cnd_cleanup;
+
+  return indexer;
+
+cnd_cleanup:
+  cnd_destroy(&indexer->cnd);
+mtx_cleanup:
+  mtx_destroy(&indexer->mtx);
+root_cleanup:
+  free(indexer->root);
+  free(indexer);
+  return NULL;
+}
+
+void indexer_stop(struct indexer *indexer) {
+  if (!indexer) return;
+
+  mtx_lock(&indexer->mtx);  // assume never fails
+  atomic_store(&indexer->stopped, true);
+  cnd_signal(&indexer->cnd);
+  mtx_unlock(&indexer->mtx);  // assume never fails
+
+  thrd_join(indexer->thread, NULL);
+
+  cnd_destroy(&indexer->cnd);
+  mtx_destroy(&indexer->mtx);
+  free(indexer->root);
+  free(indexer);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "logger.h"
+
+/* a background thread which fills the checksum cache (see file_checksum.h) ahead of time, so checksum requests are
+ * answered without reading the files they name. every interval seconds it walks the tree under its root and checksums
+ * the files whose cached checksum is missing or stale. hidden entries (e.g. the uploads in progress) and symbolic links
+ * are skipped. the thread runs at the idle io priority (which only the bfq scheduler honors) and the lowest cpu
+ * priority, so it only uses the disk and cpu when nothing else does */
+struct indexer;
+
+/* starts indexing the tree under root, the first time right away. the thread inherits the signal mask of the calling
+ * thread. returns a pointer to a heap allocated indexer on success, NULL on failure */
+struct indexer *indexer_start(const char *root, unsigned interval, struct logger *logger);
+
+/* stops the indexer (abandoning the file it reads, if any), waits for its thread to exit and destroys it */
+void indexer_stop(struct indexer *indexer);
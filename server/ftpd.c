@@ -7,23 +7,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>     // strlen()
-#include <sys/epoll.h>  // epoll
-#include <sys/eventfd.h>
+#include <strings.h>    // strcasecmp()
 #include <sys/stat.h>  // mkdir()
-#include <unistd.h>    // close(), read()
-#include "handlers/get_request.h"
-#include "handlers/greet.h"
-#include "handlers/util.h"
+#include <unistd.h>    // chdir(), sysconf()
+#include "checksum/content_store.h"
+#include "checksum/indexer.h"
 #include "hash_table.h"
+#include "listing/listing_cache.h"
 #include "logger.h"
 #include "misc/util.h"
 #include "properties_loader.h"
-#include "session/session.h"
+#include "reactor/reactor.h"
 #include "thread_pool.h"
-#include "vector.h"
-#include "vector_s.h"
+#include "transfer/file_cache.h"
+#include "transfer/io_policy.h"
 
 #define LOG_FILE "log_file"
+#define LOG_MODE "log_mode"
+#define LOG_OVERFLOW "log_overflow"
 #define NUM_OF_THREADS "threads_number"
 #define DEFAULT_NUM_OF_THREADS 20
 #define CONTROL_PORT "control_port"
@@ -31,11 +32,20 @@
 #define CONN_Q_SIZE "connection_queue_size"
 #define DEFAULT_QUEUE_SIZE 128
 #define ROOT_DIR "root_directory"
-
-struct server_fds {
-  int listen_sockfd;
-  int event_fd;
-};
+#define NUM_OF_REACTORS "reactors_number"
+#define LISTING_CACHE_SIZE "listing_cache_size"
+#define DEFAULT_LISTING_CACHE_SIZE 16  // MiB
+#define CHECKSUM_INDEX_INTERVAL "checksum_index_interval"
+#define DEFAULT_CHECKSUM_INDEX_INTERVAL 3600  // seconds
+#define DEDUPLICATION "deduplication"
+#define READAHEAD_SIZE "readahead_size"
+#define DEFAULT_READAHEAD_SIZE 16  // MiB
+#define DROP_BEHIND_SIZE "drop_behind_size"
+#define DEFAULT_DROP_BEHIND_SIZE 64  // MiB
+#define DIRECT_IO_SIZE "direct_io_size"
+#define DEFAULT_DIRECT_IO_SIZE 0  // MiB
+#define FILE_CACHE_SIZE "file_cache_size"
+#define DEFAULT_FILE_CACHE_SIZE 64  // MiB
 
 static atomic_bool terminate;
 
@@ -52,6 +62,16 @@ int main(int argc, char *argv[]) {
 
   atomic_init(&terminate, false);
 
+  struct thread_pool *thread_pool = NULL;
+  struct listing_cache *listing_cache = NULL;
+  struct indexer *indexer = NULL;
+  struct content_store *content_store = NULL;
+  struct io_policy *io_policy = NULL;
+  struct file_cache *file_cache = NULL;
+  struct reactor *reactors = NULL;
+  size_t reactors_count = 0;  // the number of initialized reactors
+  size_t running_count = 0;   // the number of started reactors
+
   // load properties
   struct hash_table *properties = get_properties(argv[1]);
   if (!properties) {
@@ -60,8 +80,24 @@ int main(int argc, char *argv[]) {
   }
   fprintf(stdout, "[%s] properties initialized successfully\n", __func__);
 
-  // init logger
-  struct logger *logger = logger_init(table_get(properties, LOG_FILE, strlen(LOG_FILE)));
+  // init logger. synchronous unless configured otherwise
+  const char *log_mode = table_get(properties, LOG_MODE, strlen(LOG_MODE));
+  const char *log_overflow = table_get(properties, LOG_OVERFLOW, strlen(LOG_OVERFLOW));
+  if ((log_mode && strcasecmp(log_mode, "sync") != 0 && strcasecmp(log_mode, "async") != 0) ||
+      (log_overflow && strcasecmp(log_overflow, "drop") != 0 && strcasecmp(log_overflow, "block") != 0)) {
+    fprintf(stderr, "[%s] invalid [%s] or [%s]\n", __func__, LOG_MODE, LOG_OVERFLOW);
+
+    goto properties_cleanup;
+  }
+
+  struct logger *logger = NULL;
+  if (log_mode && strcasecmp(log_mode, "async") == 0) {
+    enum overflow overflow = log_overflow && strcasecmp(log_overflow, "block") == 0 ? OVERFLOW_BLOCK : OVERFLOW_DROP;
+    logger = logger_init_async(table_get(properties, LOG_FILE, strlen(LOG_FILE)), overflow);
+  } else {
+    logger = logger_init(table_get(properties, LOG_FILE, strlen(LOG_FILE)));
+  }
+
   if (!logger) {
     fprintf(stderr, "[%s] failed to init logger\n", __func__);
 
@@ -151,7 +187,7 @@ int main(int argc, char *argv[]) {
   }
 
   // create threads
-  struct thread_pool *thread_pool = thread_pool_init(num_of_threads, destroy_task);
+  thread_pool = thread_pool_init(num_of_threads, destroy_task);
   if (!thread_pool) {
     logger_log(logger, ERROR, "[%s] failed to init thread pool", __func__);
 
@@ -160,16 +196,6 @@ int main(int argc, char *argv[]) {
 
   logger_log(logger, INFO, "[%s] thread pool created successfully", __func__);
 
-  // unblock SIGINT for (only) the main thread
-  sigset_t sigset;
-  sigemptyset(&sigset);
-  sigaddset(&sigset, SIGINT);
-  if (pthread_sigmask(SIG_UNBLOCK, &sigset, NULL) != 0) {
-    logger_log(logger, ERROR, "[%s] failed to establish a signal mask", __func__);
-
-    goto thread_pool_cleanup;
-  }
-
   // load connection queue size (the number of connection the socket will accept and queue. after that - connections
   // will be refused)
   char *endptr;
@@ -185,326 +211,252 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  // holds the fd for the server
-  struct server_fds server_fds = {0};
+  // get the listing cache size (in MiB). 0 disables the cache
+  long listing_cache_size = DEFAULT_LISTING_CACHE_SIZE;
+  char *listing_cache_size_str = table_get(properties, LISTING_CACHE_SIZE, strlen(LISTING_CACHE_SIZE));
+  if (listing_cache_size_str) {
+    listing_cache_size = strtol(listing_cache_size_str, &endptr, 10);
+    if (listing_cache_size_str == endptr || listing_cache_size < 0 || listing_cache_size > INT_MAX) {
+      logger_log(logger, ERROR, "[%s] invalid [%s]: [%s]", __func__, LISTING_CACHE_SIZE, listing_cache_size_str);
 
-  // create a control socket
-  server_fds.listen_sockfd = get_passive_socket(logger,
-                                                NULL,
-                                                table_get(properties, CONTROL_PORT, strlen(CONTROL_PORT)),
-                                                (int)q_size,
-                                                AI_PASSIVE);
-  if (server_fds.listen_sockfd == -1) {
-    logger_log(logger, ERROR, "[%s] failed to retrieve a listen socket", __func__);
+      goto thread_pool_cleanup;
+    }
+  }
 
-    goto thread_pool_cleanup;
+  // the watcher thread inherits the signal mask of main, i.e. SIGINT is blocked for it
+  if (listing_cache_size) {
+    listing_cache = listing_cache_init((size_t)listing_cache_size * 1024 * 1024, logger);
+    if (!listing_cache) {
+      logger_log(logger, ERROR, "[%s] failed to init the listing cache", __func__);
+
+      goto thread_pool_cleanup;
+    }
+
+    logger_log(logger, INFO, "[%s] listing cache created successfully", __func__);
   }
 
-  /* create an event fd. the fd will be used as a way to communicate between the threads and main. when opening a
-   * passive socket the thread who open it will write to event fd. the server will then iterate through all sessions and
-   * add the new socket to pollfds */
-  server_fds.event_fd = eventfd(0, EFD_NONBLOCK);
-  if (server_fds.event_fd == -1) {
-    logger_log(logger, ERROR, "[%s] failed to retrieve an event fd", __func__);
-    close(server_fds.listen_sockfd);
+  // get the interval (in seconds) between the passes of the checksum indexer. 0 disables the indexer
+  long index_interval = DEFAULT_CHECKSUM_INDEX_INTERVAL;
+  char *index_interval_str = table_get(properties, CHECKSUM_INDEX_INTERVAL, strlen(CHECKSUM_INDEX_INTERVAL));
+  if (index_interval_str) {
+    index_interval = strtol(index_interval_str, &endptr, 10);
+    if (index_interval_str == endptr || index_interval < 0 || index_interval > INT_MAX) {
+      logger_log(logger, ERROR, "[%s] invalid [%s]: [%s]", __func__, CHECKSUM_INDEX_INTERVAL, index_interval_str);
 
-    goto thread_pool_cleanup;
+      goto thread_pool_cleanup;
+    }
   }
 
-  logger_log(logger, INFO, "[%s] server fds obtained successfully", __func__);
+  // the indexer thread inherits the signal mask of main, i.e. SIGINT is blocked for it
+  if (index_interval) {
+    indexer = indexer_start(".", (unsigned)index_interval, logger);
+    if (!indexer) {
+      logger_log(logger, ERROR, "[%s] failed to start the checksum indexer", __func__);
+
+      goto thread_pool_cleanup;
+    }
 
-  // create a vector of sessions
-  struct vector_s *sessions = vector_s_init(sizeof(struct session), cmpr_sessions, destroy_session);
-  if (!sessions) {
-    logger_log(logger, ERROR, "[%s] failed to init session vector", __func__);
-    close(server_fds.listen_sockfd);
-    close(server_fds.event_fd);
+    logger_log(logger, INFO, "[%s] checksum indexer started successfully", __func__);
+  }
+
+  // deduplicate uploads. off by default
+  const char *deduplication = table_get(properties, DEDUPLICATION, strlen(DEDUPLICATION));
+  if (deduplication && strcasecmp(deduplication, "on") != 0 && strcasecmp(deduplication, "off") != 0) {
+    logger_log(logger, ERROR, "[%s] invalid [%s]: [%s]", __func__, DEDUPLICATION, deduplication);
 
     goto thread_pool_cleanup;
   }
 
-  logger_log(logger, INFO, "[%s] sessions initialized successfully", __func__);
+  if (deduplication && strcasecmp(deduplication, "on") == 0) {
+    content_store = content_store_init(logger);
+    if (!content_store) {
+      logger_log(logger, ERROR, "[%s] failed to open the content store", __func__);
 
-  struct vector *epoll_events = vector_init(sizeof(struct epoll_event));
-  if (!epoll_events) {
-    logger_log(logger, ERROR, "[%s] falied to init epoll_events vector", __func__);
-    close(server_fds.listen_sockfd);
-    close(server_fds.event_fd);
+      goto thread_pool_cleanup;
+    }
 
-    goto sessions_cleanup;
+    logger_log(logger, INFO, "[%s] content store opened successfully", __func__);
   }
 
-  logger_log(logger, INFO, "[%s] epoll_events initialized successfully", __func__);
-  vector_resize(epoll_events, num_of_threads);
+  // get the largest read ahead window of a download (in MiB). 0 leaves read ahead to the kernel
+  long readahead_size = DEFAULT_READAHEAD_SIZE;
+  char *readahead_size_str = table_get(properties, READAHEAD_SIZE, strlen(READAHEAD_SIZE));
+  if (readahead_size_str) {
+    readahead_size = strtol(readahead_size_str, &endptr, 10);
+    if (readahead_size_str == endptr || readahead_size < 0 || readahead_size > INT_MAX) {
+      logger_log(logger, ERROR, "[%s] invalid [%s]: [%s]", __func__, READAHEAD_SIZE, readahead_size_str);
 
-  int epollfd = epoll_create1(0);
-  if (epollfd == -1) {
-    logger_log(logger, ERROR, "[%s] failed to create an epoll instance", __func__);
-    close(server_fds.listen_sockfd);
-    close(server_fds.event_fd);
+      goto thread_pool_cleanup;
+    }
+  }
+
+  // get the size (in MiB) from which transfers drop their pages behind. 0 disables drop behind
+  long drop_behind_size = DEFAULT_DROP_BEHIND_SIZE;
+  char *drop_behind_size_str = table_get(properties, DROP_BEHIND_SIZE, strlen(DROP_BEHIND_SIZE));
+  if (drop_behind_size_str) {
+    drop_behind_size = strtol(drop_behind_size_str, &endptr, 10);
+    if (drop_behind_size_str == endptr || drop_behind_size < 0 || drop_behind_size > INT_MAX) {
+      logger_log(logger, ERROR, "[%s] invalid [%s]: [%s]", __func__, DROP_BEHIND_SIZE, drop_behind_size_str);
 
-    goto sessions_cleanup;
+      goto thread_pool_cleanup;
+    }
   }
 
-  if (register_fd(logger, epollfd, server_fds.listen_sockfd, EPOLLIN) != 0) {
-    logger_log(logger, ERROR, "[%s] falied to add server listen socket to the epoll instance", __func__);
-    close(server_fds.listen_sockfd);
-    close(server_fds.event_fd);
-    close(epollfd);
+  // get the size (in MiB) from which uploads write with O_DIRECT. 0 disables direct io
+  long direct_io_size = DEFAULT_DIRECT_IO_SIZE;
+  char *direct_io_size_str = table_get(properties, DIRECT_IO_SIZE, strlen(DIRECT_IO_SIZE));
+  if (direct_io_size_str) {
+    direct_io_size = strtol(direct_io_size_str, &endptr, 10);
+    if (direct_io_size_str == endptr || direct_io_size < 0 || direct_io_size > INT_MAX) {
+      logger_log(logger, ERROR, "[%s] invalid [%s]: [%s]", __func__, DIRECT_IO_SIZE, direct_io_size_str);
 
-    goto epoll_events_cleanup;
+      goto thread_pool_cleanup;
+    }
   }
 
-  if (register_fd(logger, epollfd, server_fds.event_fd, EPOLLIN) != 0) {
-    logger_log(logger, ERROR, "[%s] falied to add server event socket to the epoll instance", __func__);
-    close(server_fds.listen_sockfd);
-    close(server_fds.event_fd);
-    close(epollfd);
+  if (readahead_size || drop_behind_size || direct_io_size) {
+    // every thread may run an upload. each of them gets a direct io buffer
+    io_policy = io_policy_init((off_t)readahead_size * 1024 * 1024,
+                               (off_t)drop_behind_size * 1024 * 1024,
+                               (off_t)direct_io_size * 1024 * 1024,
+                               num_of_threads);
+    if (!io_policy) {
+      logger_log(logger, ERROR, "[%s] failed to create the io policy", __func__);
 
-    goto epoll_events_cleanup;
+      goto thread_pool_cleanup;
+    }
+
+    logger_log(logger, INFO, "[%s] io policy created successfully", __func__);
   }
 
-  // for ppoll
-  sigset_t ppoll_sigset;
-  if (sigemptyset(&ppoll_sigset) != 0) {
-    logger_log(logger, ERROR, "[%s] falied to init sigset_t for ppoll", __func__);
-    close(server_fds.listen_sockfd);
-    close(server_fds.event_fd);
-    close(epollfd);
+  // get the file cache size (in MiB). 0 disables the cache
+  long file_cache_size = DEFAULT_FILE_CACHE_SIZE;
+  char *file_cache_size_str = table_get(properties, FILE_CACHE_SIZE, strlen(FILE_CACHE_SIZE));
+  if (file_cache_size_str) {
+    file_cache_size = strtol(file_cache_size_str, &endptr, 10);
+    if (file_cache_size_str == endptr || file_cache_size < 0 || file_cache_size > INT_MAX) {
+      logger_log(logger, ERROR, "[%s] invalid [%s]: [%s]", __func__, FILE_CACHE_SIZE, file_cache_size_str);
 
-    goto epoll_events_cleanup;
+      goto thread_pool_cleanup;
+    }
   }
 
-  // main server loop
-  logger_log(logger, INFO, "[%s] started listening on fd [%d]", __func__, server_fds.listen_sockfd);
-  while (!atomic_load(&terminate)) {
-    int events_count = epoll_pwait(epollfd,
-                                   (struct epoll_event *)vector_data(epoll_events),
-                                   vector_size(epoll_events),
-                                   -1,
-                                   &ppoll_sigset);
-    int err = errno;
-    if (events_count == -1) {
-      logger_log(logger, ERROR, "[%s] epoll error [%s] [event_count: %d]", __func__, strerr_safe(err), events_count);
-      continue;
+  if (file_cache_size) {
+    file_cache = file_cache_init((size_t)file_cache_size * 1024 * 1024);
+    if (!file_cache) {
+      logger_log(logger, ERROR, "[%s] failed to init the file cache", __func__);
+
+      goto thread_pool_cleanup;
     }
 
-    if (events_count == 0) continue;
-
-    // search for an event
-    for (size_t i = 0; events_count > 0 && i < vector_size(epoll_events); i++) {
-      struct epoll_event *current = vector_at(epoll_events, i);
-      if (!current->events) continue;
-
-      // used to accept() new connections / get the ip:port of a socket
-      struct sockaddr_storage remote_addr = {0};
-      socklen_t remote_addrlen = sizeof remote_addr;
-
-      events_count--;
-
-      if (current->events & EPOLLIN) {                       // this fp is ready to poll data from
-        if (current->data.fd == server_fds.listen_sockfd) {  // the main 'listening' socket
-          int remote_fd = accept(current->data.fd, (struct sockaddr *)&remote_addr, &remote_addrlen);
-          if (remote_fd == -1) {
-            logger_log(logger, ERROR, "[%s] accept() failue on main listening socket", __func__);
-            continue;
-          }
-
-          register_fd(logger, epollfd, remote_fd, EPOLLIN | EPOLLONESHOT);
-
-          struct session session = {0};
-
-          if (!construct_session(&session, remote_fd, (struct sockaddr *)&remote_addr, remote_addrlen)) {
-            logger_log(logger, ERROR, "[%s] falied to construct a session for fd [%d]", __func__, remote_fd);
-            continue;
-          }
-
-          add_session(sessions, logger, &session);
-          logger_log(logger,
-                     INFO,
-                     "[%s] recieved a connection from [%s:%s]",
-                     __func__,
-                     session.context.ip,
-                     session.context.port);
-
-          struct args *args = malloc(sizeof *args);
-          if (!args) {
-            logger_log(logger,
-                       ERROR,
-                       "[%s] memory allocation failure for thread args for [%s:%s]",
-                       __func__,
-                       session.context.ip,
-                       session.context.port);
-            continue;
-          }
-
-          args->event_fd = server_fds.event_fd;
-          args->logger = logger;
-          args->remote_fd = remote_fd;
-          args->server_data_port = data_port;
-          args->sessions = sessions;
-
-          thread_pool_add_task(thread_pool, &(struct task){.args = args, .handle_task = greet});
-        } else if (current->data.fd == server_fds.event_fd) {  // event fd
-          uint64_t discard = 0;
-          ssize_t ret = read(current->data.fd, &discard, sizeof discard);  // consume the value in event_fd
-          if (ret == -1) { logger_log(logger, INFO, "[%s] failed to consume the value of event_fd", __func__); }
-
-          size_t size = vector_s_size(sessions);
-          for (size_t i = 0; i < size; i++) {
-            struct session *tmp = vector_s_at(sessions, i);
-            if (!tmp) continue;
-
-            if (tmp->data_sock_type == PASSIVE && tmp->fds.listen_sockfd > 0) {
-              register_fd(logger, epollfd, tmp->fds.listen_sockfd, EPOLLIN);
-            }
-
-            free(tmp);
-          }
-
-        } else {  // any other socket
-          /* could be either a control socket or a session::fds::listen_sockfd socket. if its a control socket: get a
-           * request. otherwise: accept, update the session::data_fd. invalidate session::fds::listen_sockfd
-           * afterwards(and remove it from pollfds)*/
-          struct session *session = vector_s_find(sessions, &(struct session){.fds.control_fd = current->data.fd});
-          if (!session) {
-            logger_log(logger, ERROR, "[%s] couldn't find sockfd [%d]", __func__, current->data.fd);
-            continue;
-          }
-
-          if (current->data.fd == session->fds.control_fd) {  // session::fds::control_fd
-            // consruct the args for get_request
-            struct args *args = malloc(sizeof *args);
-            if (!args) {
-              logger_log(logger,
-                         ERROR,
-                         "[%s] memory allocation failure for thread args for [%s:%s]",
-                         __func__,
-                         session->context.ip,
-                         session->context.port);
-              continue;
-            }
-
-            args->epollfd = epollfd;
-            args->event_fd = server_fds.event_fd;
-            args->logger = logger;
-            args->remote_fd = session->fds.control_fd;
-            args->server_data_port = data_port;
-            args->sessions = sessions;
-            args->thread_pool = thread_pool;
-
-            thread_pool_add_task(thread_pool, &(struct task){.args = args, .handle_task = get_request});
-          } else {  // session::fds::listen_sockfd. will only happened as a result of a PASV command
-            int data_fd = accept(current->data.fd, (struct sockaddr *)&remote_addr, &remote_addrlen);
-            if (data_fd == -1) {
-              logger_log(logger,
-                         ERROR,
-                         "[%s] accept() failue for session [%s:%s]",
-                         __func__,
-                         session->context.ip,
-                         session->context.port);
-              continue;
-            }
-
-            // stop monitor session::fds::listen_sockfd
-            unregister_fd(logger, epollfd, current->data.fd, EPOLLIN);
-            // close session::fds::listen_sockfd
-            close(current->data.fd);
-
-            // replace the old session
-            // the new passive data_fd. session::fds::data_fd is guaranteed to be closed and invalidated
-            session->fds.data_fd = data_fd;
-            session->fds.listen_sockfd = -1;  // invalidate session::fds::listen_sockfd
-
-            if (!update_session(sessions, logger, session)) {
-              logger_log(logger,
-                         ERROR,
-                         "[%s] fatal error: failed to update a session for [%s:%s]",
-                         __func__,
-                         session->context.ip,
-                         session->context.port);
-              // cleanup(properties, logger, thread_pool, sessions, epoll_events);
-              close(server_fds.listen_sockfd);
-              close(server_fds.event_fd);
-              close(epollfd);
-              // return 1;
-              goto epoll_events_cleanup;
-            }
-
-            logger_log(logger,
-                       INFO,
-                       "[%s] established data connection for session [%s:%s]",
-                       __func__,
-                       session->context.ip,
-                       session->context.port);
-          }  // session::fds::listen_sockfd
-          free(session);
-        }                                       // any other socket
-      } else if (current->events & EPOLLHUP) {  // this fp has been closed
-        // get the corresponding session which the fd 'tied' to
-        struct session *session = vector_s_find(sessions, &current->data.fd);
-        if (!session) {
-          logger_log(logger, ERROR, "[%s] failed to find the session for fd [%d]", __func__, current->data.fd);
-          continue;
-        }
-
-        unregister_fd(logger, epollfd, current->data.fd, EPOLLIN);
-
-        // the client closed its control_fd - close the entire session
-        if (current->data.fd == session->fds.control_fd) { close_session(sessions, current->data.fd); }
-
-        logger_log(logger,
-                   INFO,
-                   "[%s] the a connection [%s:%s] was closed",
-                   __func__,
-                   session->context.ip,
-                   session->context.port);
-
-        free(session);
-      } else if (current->events & EPOLLERR) {  // (POLLERR / POLLNVAL)
-        // get the corresponding session to which the fd 'tied' to
-        struct session *session = vector_s_find(sessions, &current->data.fd);
-        if (!session) {
-          logger_log(logger, ERROR, "[%s] failed to fined the session for fd [%d]", __func__, current->data.fd);
-          continue;
-        }
-        logger_log(logger,
-                   INFO,
-                   "[%s] the a connection [%s:%s] encountered an error",
-                   __func__,
-                   session->context.ip,
-                   session->context.port);
-
-        unregister_fd(logger, epollfd, current->data.fd, EPOLLIN);
-        close_session(sessions, current->data.fd);
-
-        free(session);
-      } else {
-        logger_log(logger, INFO, "[%s] events: [%d]", __func__, current->events);
-      }
-    }  // events loop
-  }    // main server loop
-
-  logger_log(logger, INFO, "[%s] shutting down. closing server fds", __func__);
-  close(server_fds.listen_sockfd);
-  close(server_fds.event_fd);
-  close(epollfd);
-
-epoll_events_cleanup:
-  if (epoll_events) {
-    vector_destroy(epoll_events, NULL);
-    logger_log(logger, INFO, "[%s] epoll_events destroyed successfully", __func__);
-  }
-sessions_cleanup:
-  if (sessions) {
-    vector_s_destroy(sessions);
-    logger_log(logger, INFO, "[%s] sessions destroyed successfully", __func__);
+    logger_log(logger, INFO, "[%s] file cache created successfully", __func__);
+  }
+
+  // get the number of reactors. defaults to one reactor per online cpu
+  long num_of_reactors = sysconf(_SC_NPROCESSORS_ONLN);
+  if (num_of_reactors < 1) num_of_reactors = 1;
+  if (num_of_reactors > UINT8_MAX) num_of_reactors = UINT8_MAX;
+
+  char *num_of_reactors_str = table_get(properties, NUM_OF_REACTORS, strlen(NUM_OF_REACTORS));
+  if (num_of_reactors_str) {
+    num_of_reactors = strtol(num_of_reactors_str, &endptr, 10);
+    if (num_of_reactors_str == endptr || num_of_reactors < 1 || num_of_reactors > UINT8_MAX) {
+      logger_log(logger, ERROR, "[%s] invalid [%s]: [%s]", __func__, NUM_OF_REACTORS, num_of_reactors_str);
+
+      goto thread_pool_cleanup;
+    }
+  }
+
+  reactors = calloc(num_of_reactors, sizeof *reactors);
+  if (!reactors) {
+    logger_log(logger, ERROR, "[%s] failed to allocate the reactors", __func__);
+
+    goto thread_pool_cleanup;
+  }
+
+  // create the reactors. each one of them opens its own SO_REUSEPORT listen socket on the control port
+  const char *control_port = table_get(properties, CONTROL_PORT, strlen(CONTROL_PORT));
+  for (; reactors_count < (size_t)num_of_reactors; reactors_count++) {
+    if (!reactor_init(&reactors[reactors_count],
+                      logger,
+                      thread_pool,
+                      listing_cache,
+                      content_store,
+                      io_policy,
+                      file_cache,
+                      control_port,
+                      data_port,
+                      (int)q_size)) {
+      logger_log(logger, ERROR, "[%s] failed to init reactor [%zu]", __func__, reactors_count);
+
+      goto reactors_cleanup;
+    }
+  }
+
+  logger_log(logger, INFO, "[%s] [%zu] reactors initialized successfully", __func__, reactors_count);
+
+  // the reactors threads inherit the signal mask of main, i.e. SIGINT is blocked for all of them
+  for (; running_count < reactors_count; running_count++) {
+    if (!reactor_start(&reactors[running_count])) {
+      logger_log(logger, ERROR, "[%s] failed to start reactor [%zu]", __func__, running_count);
+
+      goto reactors_cleanup;
+    }
+  }
+
+  // wait for SIGINT. the signal is unblocked for main only while it's suspended
+  sigset_t suspend_sigset;
+  sigemptyset(&suspend_sigset);
+  while (!atomic_load(&terminate)) {
+    sigsuspend(&suspend_sigset);
+  }
+
+  logger_log(logger, INFO, "[%s] shutting down. stopping the reactors", __func__);
+
+reactors_cleanup:
+  for (size_t i = 0; i < running_count; i++) {
+    reactor_stop(&reactors[i]);
+  }
+
+  // tasks which are still running use the sessions of the reactors. the thread pool must be gone before the reactors
+  if (thread_pool) {
+    thread_pool_destroy(thread_pool);
+    thread_pool = NULL;
+    logger_log(logger, INFO, "[%s] thread_pool destroyed successfully", __func__);
+  }
+
+  for (size_t i = 0; i < reactors_count; i++) {
+    reactor_destroy(&reactors[i]);
+  }
+  if (reactors) {
+    free(reactors);
+    logger_log(logger, INFO, "[%s] reactors destroyed successfully", __func__);
   }
 thread_pool_cleanup:
   if (thread_pool) {
     thread_pool_destroy(thread_pool);
     logger_log(logger, INFO, "[%s] thread_pool destroyed successfully", __func__);
   }
+  if (listing_cache) {
+    listing_cache_destroy(listing_cache);
+    logger_log(logger, INFO, "[%s] listing cache destroyed successfully", __func__);
+  }
+  if (indexer) {
+    indexer_stop(indexer);
+    logger_log(logger, INFO, "[%s] checksum indexer stopped successfully", __func__);
+  }
+  if (content_store) {
+    content_store_destroy(content_store);
+    logger_log(logger, INFO, "[%s] content store closed successfully", __func__);
+  }
+  if (io_policy) {
+    io_policy_destroy(io_policy);
+    logger_log(logger, INFO, "[%s] io policy destroyed successfully", __func__);
+  }
+  if (file_cache) {
+    file_cache_destroy(file_cache);
+    logger_log(logger, INFO, "[%s] file cache destroyed successfully", __func__);
+  }
 logger_cleanup:
   if (logger) {
     logger_destroy(logger);
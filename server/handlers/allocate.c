@@ -0,0 +1,128 @@
+#include "allocate.h"
+#include <stdint.h>
+#include <sys/statvfs.h>
+#include "misc/util.h"
+#include "transfer/allocation.h"
+#include "util.h"
+
+/* returns true if the file system of the current directory of session has at least size bytes free (or if that can't
+ * be told) */
+static bool has_room(struct session *session, off_t size) {
+  struct string *path = get_path(session);
+  if (!path) return true;
+
+  struct statvfs statbuf;
+  bool room = statvfs(string_c_str(path), &statbuf) == -1 ||
+              (uintmax_t)statbuf.f_bavail * statbuf.f_frsize >= (uintmax_t)size;
+  string_destroy(path);
+
+  return room;
+}
+
+int allocate_storage(void *arg) {
+  if (!arg) return 1;
+  struct args *args = arg;
+
+  // find the session
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to find the session for fd [%d]",
+               thrd_current(),
+               __func__,
+               args->remote_fd);
+    send_reply_wrapper(args->remote_fd,
+                       args->logger,
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       "[%d] %s",
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    return 1;
+  }
+
+  off_t size;
+  if (!parse_allocation(args->req_args.request_args, &size)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] invalid size [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               args->req_args.request_args);
+
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 "[%d] %s",
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  // there's no point in sending a file the server has no room for. the STOR which follows is refused as well
+  if (size && !has_room(&session, size)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] no room for [%jd] bytes",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               (intmax_t)size);
+
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_NOT_ENOUGH_SPACE,
+                                                 "[%d] %s",
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_NOT_ENOUGH_SPACE,
+                                                 str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_NOT_ENOUGH_SPACE));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  // update the session
+  session.allocation_size = size;
+
+  bool update = update_session(args->sessions, args->logger, &session);
+  if (!update) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to update the session for [%s:%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port);
+
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                                                 "[%d] %s",
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                                                 str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                               args->logger,
+                                               RPLY_CMD_OK,
+                                               "[%d] %s. the next STOR allocates [%jd] bytes",
+                                               RPLY_CMD_OK,
+                                               str_reply_code(RPLY_CMD_OK),
+                                               (intmax_t)session.allocation_size);
+  handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+  logger_log(args->logger,
+             INFO,
+             "[%lu] [%s] [%s:%s] allocation size set to [%jd]",
+             thrd_current(),
+             __func__,
+             session.context.ip,
+             session.context.port,
+             (intmax_t)session.allocation_size);
+
+  return 0;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+/* sets the size of the file the next STOR of the session uploads ('allo <size> [r <record size>]', the record size is
+ * ignored). the STOR allocates the file ahead to that size, so its data lands in contiguous extents, and a file system
+ * without room for it fails the STOR before the transfer starts. replies 452 right away if the file system of the
+ * current directory doesn't have that many bytes free. 'allo 0' clears the size. the size applies to the next STOR
+ * only */
+int allocate_storage(void *arg);
@@ -0,0 +1,168 @@
+#include "checksum.h"
+#include <errno.h>
+#include <fcntl.h>  // open()
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>  // close()
+#include "checksum/file_checksum.h"
+#include "misc/util.h"
+#include "util.h"
+
+int checksum(void *arg) {
+  if (!arg) return 1;
+  struct args *args = arg;
+
+  // find the session
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to find the session for fd [%d]",
+               thrd_current(),
+               __func__,
+               args->remote_fd);
+    send_reply_wrapper(args->remote_fd,
+                       args->logger,
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       "[%d] %s",
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    return 1;
+  }
+
+  // validate the file path
+  const char *file_name = args->req_args.request_args;
+  if (!validate_path(file_name, args->logger)) {
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 "[%d] %s",
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  // get file path
+  struct string *path = get_path(&session);
+  if (!path) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] get_path() failure",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port);
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 "[%d] %s",
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  // path too long
+  if (string_length(path) + 1 + strlen(file_name) + 1 > MAX_PATH_LEN - 1) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] path too long",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port);
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_CMD_SYNTAX_ERR,
+                                                 "[%d] %s",
+                                                 RPLY_CMD_SYNTAX_ERR,
+                                                 str_reply_code(RPLY_CMD_SYNTAX_ERR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+    string_destroy(path);
+    return 1;
+  }
+
+  string_concat(path, "/");
+  string_concat(path, file_name);
+
+  // open the file. O_NONBLOCK: opening a fifo mustn't wait for a writer
+  int fd = open(string_c_str(path), O_RDONLY | O_NONBLOCK);
+  if (fd == -1) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] invalid path or file doesn't exists [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               string_c_str(path));
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE,
+                                                 "[%d] %s",
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE,
+                                                 str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+    string_destroy(path);
+    return 1;
+  }
+
+  uint32_t crc;
+  bool cached = false;
+  if (!file_checksum(fd, NULL, &crc, &cached)) {
+    int err = errno;
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] failed to checksum [%s]. reason [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               string_c_str(path),
+               strerr_safe(err));
+
+    // a directory (or any other non regular file) has no checksum. a file which is being written may be asked again
+    enum reply_codes reply_code = err == EINVAL  ? RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE
+                                  : err == EBUSY ? RPLY_FILE_ACTION_NOT_TAKEN_FILE_BUSY
+                                                 : RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR;
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 reply_code,
+                                                 "[%d] %s",
+                                                 reply_code,
+                                                 str_reply_code(reply_code));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+    close(fd);
+    string_destroy(path);
+    return 1;
+  }
+  close(fd);
+
+  logger_log(args->logger,
+             INFO,
+             "[%lu] [%s] [%s:%s] the checksum of [%s] is [%08" PRIx32 "] (%s)",
+             thrd_current(),
+             __func__,
+             session.context.ip,
+             session.context.port,
+             string_c_str(path),
+             crc,
+             cached ? "cached" : "computed");
+
+  enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                               args->logger,
+                                               RPLY_FILE_ACTION_COMPLETE,
+                                               "[%d] [%s] crc32c [%08" PRIx32 "]",
+                                               RPLY_FILE_ACTION_COMPLETE,
+                                               file_name,
+                                               crc);
+  handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+  string_destroy(path);
+  return 0;
+}
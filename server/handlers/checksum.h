@@ -0,0 +1,6 @@
+#pragma once
+
+/* replies with the crc32c of a file ('hash <file_path>' or 'xcrc <file_path>'), so a client can verify a transfer
+ * without fetching the file again. the checksum is computed on the server and cached along with the file (see
+ * checksum/file_checksum.h), so asking again for an unmodified file doesn't read it */
+int checksum(void *arg);
@@ -12,15 +12,13 @@ int delete_file(void *arg) {
   struct args *args = arg;
 
   // find the session
-  struct session *tmp_session = vector_s_find(args->sessions, &(struct session){.fds.control_fd = args->remote_fd});
-  if (!tmp_session) {
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
     logger_log(args->logger,
                ERROR,
-               "[%lu] [%s] [%s:%s] failed to find the session for fd [%d]",
+               "[%lu] [%s] failed to find the session for fd [%d]",
                thrd_current(),
                __func__,
-               tmp_session->context.ip,
-               tmp_session->context.port,
                args->remote_fd);
     send_reply_wrapper(args->remote_fd,
                        args->logger,
@@ -30,9 +28,6 @@ int delete_file(void *arg) {
                        str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
     return 1;
   }
-  struct session session = {0};
-  memcpy(&session, tmp_session, sizeof session);
-  free(tmp_session);
 
   // validate file path
   if (!validate_path(args->req_args.request_args, args->logger)) {
@@ -93,7 +88,8 @@ int delete_file(void *arg) {
   string_concat(path, "/");
   string_concat(path, args->req_args.request_args);
 
-  // delete the file
+  // delete the file. the object of a deduplicated file goes along with the last file which links to it
+  content_store_release(args->content_store, string_c_str(path));
   int ret = unlink(string_c_str(path));
   if (ret != 0) {
     int err = errno;
@@ -1,22 +1,28 @@
 #include "get_request.h"
-#include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/epoll.h>  // epoll()
-#include <unistd.h>     // write(), close()
+#include <unistd.h>  // write(), close()
+#include "allocate.h"
+#include "checksum.h"
 #include "cwd_ftp.h"
 #include "delete.h"
+#include "have.h"
 #include "list.h"
 #include "misc/util.h"
 #include "mkd_ftp.h"
+#include "mode.h"
+#include "multipart.h"
+#include "opts.h"
 #include "passive.h"
 #include "payload.h"
 #include "port.h"
 #include "pwd_ftp.h"
 #include "quit.h"
+#include "rest.h"
 #include "retrieve.h"
 #include "rmd_ftp.h"
+#include "status.h"
 #include "store.h"
 #include "util.h"
 
@@ -35,7 +41,22 @@ static handler handlers[] = {[REQ_UNKNOWN] = NULL,
                              [REQ_DELE] = delete_file,
                              [REQ_RETR] = retrieve_file,
                              [REQ_STOR] = store_file,
-                             [REQ_QUIT] = quit};
+                             [REQ_QUIT] = quit,
+                             [REQ_OPTS] = options,
+                             [REQ_MLSD] = mlsd,
+                             [REQ_MLST] = mlst,
+                             [REQ_REST] = restart,
+                             [REQ_RANG] = retrieve_range,
+                             [REQ_MPIN] = multipart_init,
+                             [REQ_MPPT] = multipart_part,
+                             [REQ_MPLS] = multipart_list,
+                             [REQ_MPCM] = multipart_commit,
+                             [REQ_MODE] = transfer_mode,
+                             [REQ_HASH] = checksum,
+                             [REQ_XCRC] = checksum,
+                             [REQ_HAVE] = have_content,
+                             [REQ_STAT] = server_status,
+                             [REQ_ALLO] = allocate_storage};
 
 static bool parse_command(struct request *request, struct request_args *request_args) {
   if (!request->length) return false;
@@ -75,6 +96,36 @@ static bool parse_command(struct request *request, struct request_args *request_
         request_args->type = REQ_STOR;
       } else if (memcmp(req_ptr, "quit", cmd_len) == 0) {
         request_args->type = REQ_QUIT;
+      } else if (memcmp(req_ptr, "opts", cmd_len) == 0) {
+        request_args->type = REQ_OPTS;
+      } else if (memcmp(req_ptr, "mlsd", cmd_len) == 0) {
+        request_args->type = REQ_MLSD;
+      } else if (memcmp(req_ptr, "mlst", cmd_len) == 0) {
+        request_args->type = REQ_MLST;
+      } else if (memcmp(req_ptr, "rest", cmd_len) == 0) {
+        request_args->type = REQ_REST;
+      } else if (memcmp(req_ptr, "rang", cmd_len) == 0) {
+        request_args->type = REQ_RANG;
+      } else if (memcmp(req_ptr, "mpin", cmd_len) == 0) {
+        request_args->type = REQ_MPIN;
+      } else if (memcmp(req_ptr, "mppt", cmd_len) == 0) {
+        request_args->type = REQ_MPPT;
+      } else if (memcmp(req_ptr, "mpls", cmd_len) == 0) {
+        request_args->type = REQ_MPLS;
+      } else if (memcmp(req_ptr, "mpcm", cmd_len) == 0) {
+        request_args->type = REQ_MPCM;
+      } else if (memcmp(req_ptr, "mode", cmd_len) == 0) {
+        request_args->type = REQ_MODE;
+      } else if (memcmp(req_ptr, "hash", cmd_len) == 0) {
+        request_args->type = REQ_HASH;
+      } else if (memcmp(req_ptr, "xcrc", cmd_len) == 0) {
+        request_args->type = REQ_XCRC;
+      } else if (memcmp(req_ptr, "have", cmd_len) == 0) {
+        request_args->type = REQ_HAVE;
+      } else if (memcmp(req_ptr, "stat", cmd_len) == 0) {
+        request_args->type = REQ_STAT;
+      } else if (memcmp(req_ptr, "allo", cmd_len) == 0) {
+        request_args->type = REQ_ALLO;
       } else {
         return false;
       }
@@ -110,14 +161,6 @@ static void add_task(struct args *args, struct session *session, struct request_
                                             RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
                                             str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
     handle_reply_err(args->logger, args->sessions, session, args->epollfd, err);
-
-    // assume never fails. potential bug if it does
-    if (err != ERR_SOCKET_TRANSMISSION_ERR) {
-      epoll_ctl(args->epollfd,
-                EPOLL_CTL_MOD,
-                args->remote_fd,
-                &(struct epoll_event){.events = EPOLLIN | EPOLLONESHOT, .data.fd = args->remote_fd});
-    }
     return;
   }
 
@@ -127,6 +170,12 @@ static void add_task(struct args *args, struct session *session, struct request_
   task_args->event_fd = args->event_fd;
   task_args->logger = args->logger;
   task_args->sessions = args->sessions;
+  task_args->listeners = args->listeners;
+  task_args->thread_pool = args->thread_pool;
+  task_args->listing_cache = args->listing_cache;
+  task_args->content_store = args->content_store;
+  task_args->io_policy = args->io_policy;
+  task_args->file_cache = args->file_cache;
   memcpy(&task_args->req_args, req_args, sizeof task_args->req_args);
 
   // add the task
@@ -134,23 +183,6 @@ static void add_task(struct args *args, struct session *session, struct request_
   task.args = task_args;
   task.handle_task = handler;
 
-  if (epoll_ctl(args->epollfd,
-                EPOLL_CTL_MOD,
-                args->remote_fd,
-                &(struct epoll_event){.events = EPOLLIN | EPOLLONESHOT, .data.fd = args->remote_fd}) == -1) {
-    int err = errno;
-    logger_log(args->logger,
-               ERROR,
-               "[%lu] [%s] failed to re-arm session [%s:%s] control_fd. reason [%s]. triggering a quit task",
-               thrd_current(),
-               __func__,
-               session->context.ip,
-               session->context.port,
-               strerr_safe(err));
-    req_args->type = REQ_QUIT;
-    task.handle_task = quit;
-  }
-
   thread_pool_add_task(args->thread_pool, &task);
   logger_log(args->logger,
              INFO,
@@ -165,8 +197,8 @@ int get_request(void *arg) {
   struct args *args = arg;
 
   // find the session
-  struct session *tmp_session = vector_s_find(args->sessions, &(struct session){.fds.control_fd = args->remote_fd});
-  if (!tmp_session) {
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
     logger_log(args->logger,
                ERROR,
                "[%lu] [%s] failed to find the session for fd [%d]",
@@ -179,48 +211,12 @@ int get_request(void *arg) {
                        "[%d] %s",
                        RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
                        str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
-
-    // possible bug. if the session can't be found args->remote_fd will never re-arm
     return 1;
   }
 
-  struct session session;
-  memcpy(&session, tmp_session, sizeof session);
-  free(tmp_session);
-
-  // get a request
-  struct request request = {0};
-  int ret = recieve_request(&request, session.fds.control_fd, 0);
-
-  if (ret != ERR_SUCCESS) {
-    int err = errno;
-
-    logger_log(args->logger,
-               ERROR,
-               "[%lu] [%s] [%s:%s] failed to recieve a request. reason [%s] errno [%d:%s]",
-               thrd_current(),
-               __func__,
-               session.context.ip,
-               session.context.port,
-               str_err_code(ret),
-               err,
-               strerr_safe(err));
-    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
-                                                 args->logger,
-                                                 RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
-                                                 "[%d] %s",
-                                                 RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
-                                                 str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
-    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
-
-    if (err_code != ERR_SOCKET_TRANSMISSION_ERR) {
-      epoll_ctl(args->epollfd,
-                EPOLL_CTL_MOD,
-                args->remote_fd,
-                &(struct epoll_event){.events = EPOLLIN | EPOLLONESHOT, .data.fd = args->remote_fd});
-    }
-    return 1;
-  }
+  // the reactor assembled the request. parse_command() modifies it in place
+  struct request request;
+  memcpy(&request, &args->request, sizeof request);
 
   logger_log(args->logger,
              INFO,
@@ -251,18 +247,13 @@ int get_request(void *arg) {
                                             RPLY_CMD_SYNTAX_ERR,
                                             str_reply_code(RPLY_CMD_SYNTAX_ERR));
     handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err);
-
-    if (err != ERR_SOCKET_TRANSMISSION_ERR) {
-      epoll_ctl(args->epollfd,
-                EPOLL_CTL_MOD,
-                args->remote_fd,
-                &(struct epoll_event){.events = EPOLLIN | EPOLLONESHOT, .data.fd = args->remote_fd});
-    }
     return 1;
   }
 
   // open a default (active) data connection
-  if ((req_args.type == REQ_LIST || req_args.type == REQ_RETR || req_args.type == REQ_STOR) &&
+  if ((req_args.type == REQ_LIST || req_args.type == REQ_MLSD || req_args.type == REQ_RETR ||
+       req_args.type == REQ_RANG || req_args.type == REQ_STOR || req_args.type == REQ_MPPT ||
+       req_args.type == REQ_MPLS) &&
       session.fds.data_fd == -1) {
     if (session.data_sock_type == PASSIVE) {
       logger_log(args->logger,
@@ -279,13 +270,6 @@ int get_request(void *arg) {
                                               RPLY_DATA_CONN_CLOSED,
                                               str_reply_code(RPLY_DATA_CONN_CLOSED));
       handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err);
-
-      if (err != ERR_SOCKET_TRANSMISSION_ERR) {
-        epoll_ctl(args->epollfd,
-                  EPOLL_CTL_MOD,
-                  args->remote_fd,
-                  &(struct epoll_event){.events = EPOLLIN | EPOLLONESHOT, .data.fd = args->remote_fd});
-      }
       return 1;
     }
 
@@ -320,13 +304,6 @@ int get_request(void *arg) {
                                               RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
                                               str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
       handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err);
-
-      if (err != ERR_SOCKET_TRANSMISSION_ERR) {
-        epoll_ctl(args->epollfd,
-                  EPOLL_CTL_MOD,
-                  args->remote_fd,
-                  &(struct epoll_event){.events = EPOLLIN | EPOLLONESHOT, .data.fd = args->remote_fd});
-      }
       return 1;
     }
   }
@@ -9,15 +9,13 @@ int greet(void *arg) {
   struct args *args = arg;
 
   // find the session
-  struct session *tmp_session = vector_s_find(args->sessions, &(struct session){.fds.control_fd = args->remote_fd});
-  if (!tmp_session) {
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
     logger_log(args->logger,
                ERROR,
-               "[%lu] [%s] [%s:%s] failed to find session [%d]",
+               "[%lu] [%s] failed to find session [%d]",
                thrd_current(),
                __func__,
-               tmp_session->context.ip,
-               tmp_session->context.port,
                args->remote_fd);
     send_reply_wrapper(args->remote_fd,
                        args->logger,
@@ -35,7 +33,6 @@ int greet(void *arg) {
                                           "[%d] %s",
                                           RPLY_SERVICE_READY,
                                           str_reply_code(RPLY_SERVICE_READY));
-  handle_reply_err(args->logger, args->sessions, tmp_session, args->epollfd, err);
-  free(tmp_session);
+  handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err);
   return 0;
 }
@@ -0,0 +1,169 @@
+#include "have.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include "misc/util.h"
+#include "sha256.h"
+#include "util.h"
+
+/* parses the arguments of 'have <sha-256> <size> <file_path>'. returns a pointer to the file path within arg on
+ * success, NULL otherwise */
+static const char *parse_have(const char *arg, char hex[SHA256_HEX_LEN + 1], off_t *size) {
+  size_t hex_len = strcspn(arg, " ");
+  if (hex_len != SHA256_HEX_LEN) return NULL;
+
+  memcpy(hex, arg, hex_len);
+  hex[hex_len] = '\0';
+
+  return parse_number(trim_str(arg + hex_len), size);
+}
+
+int have_content(void *arg) {
+  if (!arg) return 1;
+  struct args *args = arg;
+
+  // find the session
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to find the session for fd [%d]",
+               thrd_current(),
+               __func__,
+               args->remote_fd);
+    send_reply_wrapper(args->remote_fd,
+                       args->logger,
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       "[%d] %s",
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    return 1;
+  }
+
+  char hex[SHA256_HEX_LEN + 1];
+  off_t size = 0;
+  const char *file_name = parse_have(trim_str(args->req_args.request_args), hex, &size);
+  if (!file_name || !validate_path(file_name, args->logger)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] invalid request arguments",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port);
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 "[%d] %s",
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  // without a content store the server never holds a content. the client sends the file instead
+  if (!args->content_store) {
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE,
+                                                 "[%d] %s",
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE,
+                                                 str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  // get file path
+  struct string *path = get_path(&session);
+  if (!path) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] get_path() failure",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port);
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 "[%d] %s",
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  // path too long
+  if (string_length(path) + 1 + strlen(file_name) + 1 > MAX_PATH_LEN - 1) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] path too long",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port);
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_CMD_SYNTAX_ERR,
+                                                 "[%d] %s",
+                                                 RPLY_CMD_SYNTAX_ERR,
+                                                 str_reply_code(RPLY_CMD_SYNTAX_ERR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+    string_destroy(path);
+    return 1;
+  }
+
+  string_concat(path, "/");
+  string_concat(path, file_name);
+
+  if (!content_store_link(args->content_store, hex, size, string_c_str(path))) {
+    int err = errno;
+    logger_log(args->logger,
+               err == ENOENT ? INFO : ERROR,
+               "[%lu] [%s] [%s:%s] can't link [%s] into [%s]. reason [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               hex,
+               string_c_str(path),
+               strerr_safe(err));
+
+    // the content isn't stored (or the path can't be linked into). either way the client has to send the file
+    enum reply_codes reply_code =
+        err == ENOENT ? RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE : RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR;
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 reply_code,
+                                                 "[%d] %s",
+                                                 reply_code,
+                                                 str_reply_code(reply_code));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+    string_destroy(path);
+    return 1;
+  }
+
+  logger_log(args->logger,
+             INFO,
+             "[%lu] [%s] [%s:%s] the content [%s] linked into [%s]",
+             thrd_current(),
+             __func__,
+             session.context.ip,
+             session.context.port,
+             hex,
+             string_c_str(path));
+
+  enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                               args->logger,
+                                               RPLY_FILE_ACTION_COMPLETE,
+                                               "[%d] [%s] %s",
+                                               RPLY_FILE_ACTION_COMPLETE,
+                                               file_name,
+                                               str_reply_code(RPLY_FILE_ACTION_COMPLETE));
+  handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+  string_destroy(path);
+  return 0;
+}
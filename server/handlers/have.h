@@ -0,0 +1,7 @@
+#pragma once
+
+/* asks the server whether it holds a content already ('have <sha-256> <size> <file_path>', the sha-256 as 64 hex
+ * digits), so a client can skip an upload the server doesn't need. if the content store (see
+ * checksum/content_store.h) holds it the file is linked into place, as if it was uploaded, and the reply is 250.
+ * otherwise (or if uploads aren't deduplicated) the reply is 550 and the client should send the file with STOR */
+int have_content(void *arg);
@@ -1,191 +1,264 @@
 #include "list.h"
+#include <ctype.h>  // tolower()
 #include <errno.h>
-#include <fcntl.h>  // fctrl
-#include <poll.h>
+#include <inttypes.h>  // PRId64
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>  // stat()
-#include <sys/wait.h>  // waitpid
-#include <unistd.h>    // fork, pipe, dup
+#include "listing/listing_cache.h"
+#include "listing/walk.h"
 #include "misc/util.h"
 #include "util.h"
 
 #define ERR_SIZE 128
+#define FACTS_LEN 1024
+#define WALKERS_NUM 4
+#define WALK_BUFFER_LEN (1024 * 1024)
+#define PAGE_MAX_LIMIT (64 * 1024)
+#define CURSOR_LEN 64
 
-enum pipe_end {
-  PIPE_READ = 0,
-  PIPE_WRITE = 1,
+/* the options of a LIST (or an MLSD): -r lists the whole tree. -p <limit> lists a single page of up to limit entries,
+ * starting at the cursor given with -c <cursor> (or at the start of the directory) */
+struct list_options {
+  bool recursive;
+  size_t limit;  // 0 if the listing isn't paged
+  int64_t cursor;
 };
 
-static bool send_dir_content(struct logger *logger,
-                             struct vector_s *sessions,
+/* parses the options which precede the path argument. requests arrive lower cased. returns the path argument, or
+ * NULL if the options are invalid */
+static const char *parse_options(const char *arg, enum listing_format format, struct list_options *options) {
+  *options = (struct list_options){0};
+  bool has_cursor = false;
+
+  arg = trim_str(arg);
+  while (arg[0] == '-' && arg[1] && (!arg[2] || arg[2] == ' ')) {
+    char option = (char)tolower((unsigned char)arg[1]);
+    arg = trim_str(arg + 2);
+
+    if (option == 'r') {
+      options->recursive = true;
+      continue;
+    }
+
+    if (option != 'p' && option != 'c') return NULL;
+
+    char *end = NULL;
+    errno = 0;
+    long long value = strtoll(arg, &end, 10);
+    if (errno || end == arg || (*end && *end != ' ') || value < 0) return NULL;
+    arg = trim_str(end);
+
+    if (option == 'p') {
+      if (!value || value > PAGE_MAX_LIMIT) return NULL;
+      options->limit = (size_t)value;
+    } else {
+      options->cursor = value;
+      has_cursor = true;
+    }
+  }
+
+  // a tree isn't paged, and only LIST lists trees
+  if (options->recursive && (options->limit || format != LISTING_LS)) return NULL;
+  if (has_cursor && !options->limit) return NULL;
+
+  return arg;
+}
+
+/* queues a block of a listing. the block is compressed if the session is in compressed mode (compressor isn't NULL) */
+static int queue_block(struct stream_writer *writer,
+                       struct block_compressor *compressor,
+                       uint8_t descriptor,
+                       const void *data,
+                       uint32_t length) {
+  if (compressor) return stream_writer_compressed_block(writer, compressor, descriptor, data, length);
+  return stream_writer_block(writer, descriptor, data, length);
+}
+
+/* initializes the compressor of a listing if the session is in compressed mode. returns the compressor (NULL if the
+ * session isn't in compressed mode) and sets *success to false on failure */
+static struct block_compressor *init_compressor(struct args *args,
+                                                struct session *session,
+                                                struct block_compressor *compressor,
+                                                bool *success) {
+  *success = true;
+  if (session->transfer_mode != COMPRESSED) return NULL;
+
+  if (!block_compressor_init(compressor, DATA_BLOCK_MAX_LEN)) {
+    logger_log(args->logger, ERROR, "[%lu] [%s] memory allocation failure", thrd_current(), __func__);
+    *success = false;
+  }
+  return compressor;
+}
+
+/* sends the directory listing in data blocks. the blocks are sent straight out of the (possibly cached) listing. a page
+ * is rendered on its own and is never cached. next_cursor is set to the cursor of the following page (-1 if there's
+ * none) */
+static bool send_dir_content(struct args *args,
                              struct session *session,
-                             int epollfd,
-                             char *dir_path) {
+                             const char *dir_path,
+                             enum listing_format format,
+                             const struct list_options *options,
+                             int64_t *next_cursor) {
   char err_buf[ERR_SIZE];
 
-  int pipefd[2];
-  int pipe_ret = pipe(pipefd);
-  if (pipe_ret != 0) {
+  *next_cursor = -1;
+  struct rendered_listing *listing =
+      options->limit ? listing_render_page(dir_path, format, options->cursor, options->limit, next_cursor)
+                     : listing_cache_get(args->listing_cache, dir_path, format);
+  if (!listing) {
     int err = errno;
     strerror_r(err, err_buf, sizeof err_buf);
-    logger_log(logger,
+    logger_log(args->logger,
                ERROR,
-               "[%lu] [%s] failed to initialize a pipe. reason: [%s]",
+               "[%lu] [%s] failed to list [%s]. reason: [%s]",
                thrd_current(),
                __func__,
+               dir_path,
                err_buf);
     return false;
   }
-  fcntl(pipefd[PIPE_READ], F_SETFL, O_NONBLOCK);
-
-  /* fork a child process. the child process will invoke ls -lh for the dir specified and will write all dir content
-   * into a pipe. the parent will then read from said pipe and send it to the client */
-  pid_t pid = fork();
-  switch (pid) {
-    case -1:
-      return false;
-    case 0: {
-      int dup_ret = dup2(pipefd[PIPE_WRITE], STDOUT_FILENO);
-      if (dup_ret == -1) {
-        int err = errno;
-        strerror_r(err, err_buf, sizeof err_buf);
-        logger_log(logger, ERROR, "[%lu] [%s] dup2 failure. reason: [%s]", thrd_current(), __func__, err_buf);
-        return false;
-      }
-
-      execlp("ls", "ls", "-lh", dir_path, (char *)NULL);
-    } break;
-    default: {
-      int events = 0;
-      struct pollfd pollfd = {.fd = pipefd[PIPE_READ], .events = POLLIN};
-      while (1) {
-        events = poll(&pollfd, 1, -1);
-        if (events == 1 && pollfd.revents & POLLIN) break;
-      }
-
-      bool done = false;
-      struct data_block data;
-      do {
-        ssize_t bytes_read = read(pipefd[PIPE_READ], data.data, DATA_BLOCK_MAX_LEN - 2);
-
-        /* an 'empty indicator'. since the pipe is set to nonblocking mode, if its empty - an attempt to read() from it
-         * will return with -1 & EAGAIN / EWOULDBLOCK */
-        uint8_t byte;
-        if (read(pipefd[PIPE_READ], &byte, 1) > 0) {
-          data.data[bytes_read] = byte;
-          bytes_read++;
-        }
-
-        // the pipe is empty
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-          data.descriptor = DESCPTR_EOF;
-          done = true;
-        }
-
-        data.data[bytes_read] = 0;
-        data.length = (uint32_t)bytes_read;
-
-        enum err_codes send_ret = send_data(&data, session->fds.data_fd, 0);
-        handle_reply_err(logger, sessions, session, epollfd, send_ret);
-        if (send_ret != ERR_SUCCESS) return false;
-
-      } while (!done);
-
-      waitpid(pid, NULL, WUNTRACED);
-    } break;
+
+  struct block_compressor compressor_buf;
+  bool success;
+  struct block_compressor *compressor = init_compressor(args, session, &compressor_buf, &success);
+  if (!success) {
+    block_compressor_destroy(compressor);
+    listing_release(listing);
+    return false;
+  }
+
+  struct stream_writer writer;
+  stream_writer_init(&writer, session->fds.data_fd, 0);
+
+  // an empty directory is sent as a single empty block
+  int ret = ERR_SUCCESS;
+  size_t offset = 0;
+  do {
+    size_t remains = listing->len - offset;
+    uint32_t block_len = remains > DATA_BLOCK_MAX_LEN ? DATA_BLOCK_MAX_LEN : (uint32_t)remains;
+    uint8_t descriptor = offset + block_len == listing->len ? DESCPTR_EOF : 0;
+
+    ret = queue_block(&writer, compressor, descriptor, listing->data + offset, block_len);
+    offset += block_len;
+  } while (ret == ERR_SUCCESS && offset < listing->len);
+
+  if (ret == ERR_SUCCESS) ret = stream_writer_flush(&writer);
+  block_compressor_destroy(compressor);
+  listing_release(listing);
+
+  if (ret != ERR_SUCCESS) {
+    handle_reply_err(args->logger, args->sessions, session, args->epollfd, ret);
+    return false;
   }
 
-  close(pipefd[PIPE_READ]);
-  close(pipefd[PIPE_WRITE]);
   return true;
 }
 
-int list(void *arg) {
-  if (!arg) return 1;
-  struct args *args = arg;
+/* sends the recursive listing of the tree under dir_path in data blocks, as the walkers produce it. the tree is
+ * never cached */
+static bool send_tree_content(struct args *args, struct session *session, const char *dir_path) {
+  char err_buf[ERR_SIZE];
 
-  // find the session
-  struct session *tmp_session = vector_s_find(args->sessions, &(struct session){.fds.control_fd = args->remote_fd});
-  if (!tmp_session) {
+  struct walk *walk = walk_start(dir_path, WALKERS_NUM, WALK_BUFFER_LEN);
+  if (!walk) {
+    int err = errno;
+    strerror_r(err, err_buf, sizeof err_buf);
     logger_log(args->logger,
                ERROR,
-               "[%lu] [%s] [%s:%s] failed to find the session for fd [%d]",
+               "[%lu] [%s] failed to walk [%s]. reason: [%s]",
                thrd_current(),
                __func__,
-               tmp_session->context.ip,
-               tmp_session->context.port,
-               args->remote_fd);
-    send_reply_wrapper(args->remote_fd,
-                       args->logger,
-                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
-                       "[%d] %s",
-                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
-                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
-    return 1;
+               dir_path,
+               err_buf);
+    return false;
   }
-  struct session session = {0};
-  memcpy(&session, tmp_session, sizeof session);
-  free(tmp_session);
 
-  // check if there's a valid session::fds::data_fd
-  if (session.fds.data_fd == -1) {
-    logger_log(args->logger,
-               ERROR,
-               "[%lu] [%s] [%s:%s] invalid data_sockfd",
-               thrd_current(),
-               __func__,
-               session.context.ip,
-               session.context.port);
-    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
-                                                 args->logger,
-                                                 RPLY_DATA_CONN_CLOSED,
-                                                 "[%d] %s",
-                                                 RPLY_DATA_CONN_CLOSED,
-                                                 str_reply_code(RPLY_DATA_CONN_CLOSED));
-    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
-    return 1;
+  struct block_compressor compressor_buf;
+  bool success;
+  struct block_compressor *compressor = init_compressor(args, session, &compressor_buf, &success);
+  if (!success) {
+    block_compressor_destroy(compressor);
+    walk_stop(walk);
+    return false;
   }
 
-  // get the directory path
-  const char *dir_name = args->req_args.request_args;
+  struct stream_writer writer;
+  stream_writer_init(&writer, session->fds.data_fd, 0);
+
+  // the end of the tree is only known once the walk is done, so it's marked by an empty block
+  int ret = ERR_SUCCESS;
+  for (struct walk_chunk *chunk; ret == ERR_SUCCESS && (chunk = walk_next(walk));) {
+    for (size_t offset = 0; ret == ERR_SUCCESS && offset < chunk->len;) {
+      size_t remains = chunk->len - offset;
+      uint32_t block_len = remains > DATA_BLOCK_MAX_LEN ? DATA_BLOCK_MAX_LEN : (uint32_t)remains;
+
+      ret = queue_block(&writer, compressor, 0, chunk->data + offset, block_len);
+      offset += block_len;
+    }
+
+    // the blocks point into the chunk (and into the compressor). both are reused once they were sent
+    if (ret == ERR_SUCCESS) ret = stream_writer_flush(&writer);
+    if (ret == ERR_SUCCESS) block_compressor_reset(compressor);
+    free(chunk);
+  }
+
+  // stops the walk early if the client is gone
+  walk_stop(walk);
+
+  if (ret == ERR_SUCCESS) ret = stream_writer_block(&writer, DESCPTR_EOF, NULL, 0);
+  if (ret == ERR_SUCCESS) ret = stream_writer_flush(&writer);
+  block_compressor_destroy(compressor);
+
+  if (ret != ERR_SUCCESS) {
+    handle_reply_err(args->logger, args->sessions, session, args->epollfd, ret);
+    return false;
+  }
+
+  return true;
+}
+
+/* resolves the path argument dir_name against the session current directory. an empty argument resolves to the
+ * current directory itself. replies to the client on failure. returns a heap allocated path on success, NULL
+ * otherwise */
+static struct string *resolve_path(struct args *args, struct session *session, const char *dir_name) {
+  // validate the path argument
   if (*dir_name && !validate_path(dir_name, args->logger)) {
-    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+    enum err_codes err_code = send_reply_wrapper(session->fds.control_fd,
                                                  args->logger,
                                                  RPLY_CMD_ARGS_SYNTAX_ERR,
                                                  "[%d] %s",
                                                  RPLY_CMD_ARGS_SYNTAX_ERR,
                                                  str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
-    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
 
-    return 1;
+    return NULL;
   }
 
   // get the directory path
-  struct string *path = get_path(&session);
+  struct string *path = get_path(session);
   if (!path) {
     logger_log(args->logger,
                ERROR,
                "[%lu] [%s] [%s:%s] get_path() failure",
                thrd_current(),
                __func__,
-               session.context.ip,
-               session.context.port);
-    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+               session->context.ip,
+               session->context.port);
+    enum err_codes err_code = send_reply_wrapper(session->fds.control_fd,
                                                  args->logger,
                                                  RPLY_CMD_ARGS_SYNTAX_ERR,
                                                  "[%d] %s",
                                                  RPLY_CMD_ARGS_SYNTAX_ERR,
                                                  str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
-    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
 
-    return 1;
+    return NULL;
   }
 
-  // dir_name isn't empty - copy it into path. otherwise list will show current directory of the session
+  // dir_name isn't empty - copy it into path. otherwise the current directory of the session is used
   if (*dir_name) {
-    size_t args_len = strlen(args->req_args.request_args);
+    size_t args_len = strlen(dir_name);
 
     // path too long
     if (string_length(path) + 1 + args_len + 1 > MAX_PATH_LEN - 1) {
@@ -194,24 +267,94 @@ int list(void *arg) {
                  "[%lu] [%s] [%s:%s] path too long",
                  thrd_current(),
                  __func__,
-                 session.context.ip,
-                 session.context.port);
-      enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                 session->context.ip,
+                 session->context.port);
+      enum err_codes err_code = send_reply_wrapper(session->fds.control_fd,
                                                    args->logger,
                                                    RPLY_FILE_ACTION_NOT_TAKEN_INVALID_FILENAME,
                                                    "[%d] %s",
                                                    RPLY_FILE_ACTION_NOT_TAKEN_INVALID_FILENAME,
                                                    str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_INVALID_FILENAME));
-      handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+      handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
 
       string_destroy(path);
-      return 1;
+      return NULL;
     }
 
     string_concat(path, "/");
     string_concat(path, dir_name);
   }
 
+  return path;
+}
+
+/* lists a directory in format over the data connection. a LIST -R lists the whole tree under the directory */
+static int list_dir(void *arg, enum listing_format format) {
+  if (!arg) return 1;
+  struct args *args = arg;
+
+  // find the session
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to find the session for fd [%d]",
+               thrd_current(),
+               __func__,
+               args->remote_fd);
+    send_reply_wrapper(args->remote_fd,
+                       args->logger,
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       "[%d] %s",
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    return 1;
+  }
+
+  // check if there's a valid session::fds::data_fd
+  if (session.fds.data_fd == -1) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] invalid data_sockfd",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port);
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_DATA_CONN_CLOSED,
+                                                 "[%d] %s",
+                                                 RPLY_DATA_CONN_CLOSED,
+                                                 str_reply_code(RPLY_DATA_CONN_CLOSED));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  struct list_options options;
+  const char *dir_name = parse_options(args->req_args.request_args, format, &options);
+  if (!dir_name) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] invalid options [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               args->req_args.request_args);
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 "[%d] %s",
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+    return 1;
+  }
+
+  struct string *path = resolve_path(args, &session, dir_name);
+  if (!path) return 1;
+
   if (!is_directory(string_c_str(path))) {
     enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
                                                  args->logger,
@@ -225,7 +368,10 @@ int list(void *arg) {
     return 1;
   }
 
-  bool success = send_dir_content(args->logger, args->sessions, &session, args->epollfd, string_c_str(path));
+  int64_t next_cursor = -1;
+  bool success = options.recursive
+                     ? send_tree_content(args, &session, string_c_str(path))
+                     : send_dir_content(args, &session, string_c_str(path), format, &options, &next_cursor);
   if (!success) {
     logger_log(args->logger,
                ERROR,
@@ -241,6 +387,9 @@ int list(void *arg) {
                                                  RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
                                                  str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
     handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+    string_destroy(path);
+    return 1;
   }
 
   logger_log(args->logger,
@@ -250,14 +399,86 @@ int list(void *arg) {
              __func__,
              session.context.ip,
              session.context.port);
+
+  // a page tells the client where the next one starts
+  char cursor[CURSOR_LEN] = "";
+  if (options.limit && next_cursor == -1) {
+    snprintf(cursor, sizeof cursor, ". cursor [end]");
+  } else if (options.limit) {
+    snprintf(cursor, sizeof cursor, ". cursor [%" PRId64 "]", next_cursor);
+  }
+
   enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
                                                args->logger,
                                                RPLY_FILE_ACTION_COMPLETE,
-                                               "[%d] %s",
+                                               "[%d] %s%s",
                                                RPLY_FILE_ACTION_COMPLETE,
-                                               str_reply_code(RPLY_FILE_ACTION_COMPLETE));
+                                               str_reply_code(RPLY_FILE_ACTION_COMPLETE),
+                                               cursor);
   handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
 
   string_destroy(path);
   return 0;
-}
\ No newline at end of file
+}
+
+int list(void *arg) {
+  return list_dir(arg, LISTING_LS);
+}
+
+int mlsd(void *arg) {
+  return list_dir(arg, LISTING_MLSD);
+}
+
+int mlst(void *arg) {
+  if (!arg) return 1;
+  struct args *args = arg;
+
+  // find the session
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to find the session for fd [%d]",
+               thrd_current(),
+               __func__,
+               args->remote_fd);
+    send_reply_wrapper(args->remote_fd,
+                       args->logger,
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       "[%d] %s",
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    return 1;
+  }
+
+  struct string *path = resolve_path(args, &session, args->req_args.request_args);
+  if (!path) return 1;
+
+  // the facts are sent over the control connection, named the way the client named the entry
+  const char *name = *args->req_args.request_args ? args->req_args.request_args : ".";
+  char facts[FACTS_LEN];
+  if (listing_facts(string_c_str(path), name, facts, sizeof facts) == -1) {
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE,
+                                                 "[%d] %s",
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE,
+                                                 str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+    string_destroy(path);
+    return 1;
+  }
+
+  enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                               args->logger,
+                                               RPLY_FILE_ACTION_COMPLETE,
+                                               "[%d] %s\n %s",
+                                               RPLY_FILE_ACTION_COMPLETE,
+                                               str_reply_code(RPLY_FILE_ACTION_COMPLETE),
+                                               facts);
+  handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+  string_destroy(path);
+  return 0;
+}
@@ -3,4 +3,11 @@
 /* returns a stream of file names found in session::context::session_root_dir/session::context::curr_dir/directory_path.
  * if directory_path is NULL (i.e. the client sent LIST followed by a null terminator, directory_path will be set to "."
  * [current directory]) */
-int list(void *arg);
\ No newline at end of file
+int list(void *arg);
+/* like list(), but the entries are sent in the MLSD format (see listing.h): one line of facts per entry, with exact
+ * sizes and modification times, terminated by CRLF */
+int mlsd(void *arg);
+
+/* replies with the MLSD facts of a single file or directory over the control connection. no data connection is used.
+ * if the path is empty the facts of the current directory are sent */
+int mlst(void *arg);
@@ -12,15 +12,13 @@ int make_directory(void *arg) {
   struct args *args = arg;
 
   // find the session
-  struct session *tmp_session = vector_s_find(args->sessions, &(struct session){.fds.control_fd = args->remote_fd});
-  if (!tmp_session) {
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
     logger_log(args->logger,
                ERROR,
-               "[%lu] [%s] [%s:%s] failed to find the session for fd [%d]",
+               "[%lu] [%s] failed to find the session for fd [%d]",
                thrd_current(),
                __func__,
-               tmp_session->context.ip,
-               tmp_session->context.port,
                args->remote_fd);
     send_reply_wrapper(args->remote_fd,
                        args->logger,
@@ -30,9 +28,6 @@ int make_directory(void *arg) {
                        str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
     return 1;
   }
-  struct session session = {0};
-  memcpy(&session, tmp_session, sizeof session);
-  free(tmp_session);
 
   // get the desired directory path
   const char *new_dir_name = args->req_args.request_args;
@@ -0,0 +1,101 @@
+#include "mode.h"
+#include <string.h>
+#include "misc/util.h"
+#include "util.h"
+
+/* parses the argument of 'mode <b|z>'. returns true if it names a supported mode */
+static bool parse_mode(const char *arg, struct session *session) {
+  if (strcmp(arg, "b") == 0) {
+    session->transfer_mode = BLOCK;
+  } else if (strcmp(arg, "z") == 0) {
+    session->transfer_mode = COMPRESSED;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+int transfer_mode(void *arg) {
+  if (!arg) return 1;
+  struct args *args = arg;
+
+  // find the session
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to find the session for fd [%d]",
+               thrd_current(),
+               __func__,
+               args->remote_fd);
+    send_reply_wrapper(args->remote_fd,
+                       args->logger,
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       "[%d] %s",
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    return 1;
+  }
+
+  if (!parse_mode(trim_str(args->req_args.request_args), &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] invalid mode [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               args->req_args.request_args);
+
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 "[%d] %s. mode must be either b or z",
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  // update the session
+  bool update = update_session(args->sessions, args->logger, &session);
+  if (!update) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to update the session for [%s:%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port);
+
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                                                 "[%d] %s",
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                                                 str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  const char *mode = session.transfer_mode == COMPRESSED ? "z" : "b";
+  enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                               args->logger,
+                                               RPLY_CMD_OK,
+                                               "[%d] %s. mode [%s]",
+                                               RPLY_CMD_OK,
+                                               str_reply_code(RPLY_CMD_OK),
+                                               mode);
+  handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+  logger_log(args->logger,
+             INFO,
+             "[%lu] [%s] [%s:%s] transfer mode set to [%s]",
+             thrd_current(),
+             __func__,
+             session.context.ip,
+             session.context.port,
+             mode);
+
+  return 0;
+}
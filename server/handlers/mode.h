@@ -0,0 +1,8 @@
+#pragma once
+
+/* sets the transfer mode of the session ('mode <b|z>'). in block mode ('b', the default) data blocks are sent 'as is'.
+ * in compressed mode ('z') the blocks of RETR, RANG, LIST and MLSD which shrink are sent compressed and marked with
+ * DESCPTR_COMPRESSED, while blocks which look incompressible (e.g. media or archives) are sent 'as is' without
+ * spending time on them. a STOR (or MPPT) may then send compressed blocks as well. the mode applies to all later
+ * transfers of the session */
+int transfer_mode(void *arg);
@@ -0,0 +1,588 @@
+#include "multipart.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>     // open()
+#include <inttypes.h>  // PRIx64
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>  // getrandom()
+#include <sys/stat.h>    // mkdir(), stat()
+#include <unistd.h>      // close(), unlink(), rmdir(), truncate()
+#include "misc/util.h"
+#include "util.h"
+
+#define UPLOADS_DIR ".uploads"
+#define UPLOAD_ID_LEN 16  // 64 random bits, in hex
+#define PART_RECORD_LEN 64
+
+struct part {
+  off_t number;
+  off_t offset;
+  off_t length;
+  size_t seq;  // the order in which the part was recorded
+};
+
+/* sends a '[code] <description>' reply */
+static void reply(struct args *args, struct session *session, enum reply_codes code) {
+  enum err_codes err_code =
+      send_reply_wrapper(session->fds.control_fd, args->logger, code, "[%d] %s", code, str_reply_code(code));
+  handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
+}
+
+/* parses an upload id off the start of str into id (which holds at least UPLOAD_ID_LEN + 1 chars). returns a pointer
+ * to what follows the id on success, NULL otherwise */
+static const char *parse_upload_id(const char *str, char *id) {
+  size_t len = strspn(str, "0123456789abcdef");  // requests are lower cased
+  if (len != UPLOAD_ID_LEN || (str[len] && !isspace((unsigned char)str[len]))) return NULL;
+
+  memcpy(id, str, len);
+  id[len] = 0;
+  return trim_str(str + len);
+}
+
+/* writes the path of a file of an upload (or the path of the upload directory if name is NULL) into buf. returns true
+ * on success, false if the path doesn't fit */
+static bool upload_path(struct session *session, const char *id, const char *name, char *buf, size_t size) {
+  int len = name ? snprintf(buf, size, "%s/" UPLOADS_DIR "/%s/%s", string_c_str(session->context.root_dir), id, name)
+                 : snprintf(buf, size, "%s/" UPLOADS_DIR "/%s", string_c_str(session->context.root_dir), id);
+  return len > 0 && (size_t)len < size;
+}
+
+/* removes an upload along with whatever is left of it */
+static void remove_upload(struct session *session, const char *id) {
+  char path[MAX_PATH_LEN];
+  const char *names[] = {"data", "target", "parts"};
+  for (size_t i = 0; i < sizeof names / sizeof *names; i++) {
+    if (upload_path(session, id, names[i], path, sizeof path)) unlink(path);
+  }
+  if (upload_path(session, id, NULL, path, sizeof path)) rmdir(path);
+}
+
+/* creates a file of an upload holding len bytes of content. returns true on success, false otherwise */
+static bool create_upload_file(const char *path, const char *content, size_t len) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+  if (fd == -1) return false;
+
+  bool success = write(fd, content, len) == (ssize_t)len;
+  close(fd);
+  return success;
+}
+
+/* records a part which was stored whole. returns true on success, false otherwise */
+static bool record_part(const char *path, off_t number, off_t offset, off_t length) {
+  char record[PART_RECORD_LEN];
+  int len = snprintf(record, sizeof record, "%jd %jd %jd\n", (intmax_t)number, (intmax_t)offset, (intmax_t)length);
+
+  int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0666);
+  if (fd == -1) return false;
+
+  // a single append, so the records of parts stored at the same time never interleave
+  bool success = write(fd, record, len) == len;
+  close(fd);
+  return success;
+}
+
+static int cmpr_parts(const void *part, const void *other) {
+  const struct part *a = part;
+  const struct part *b = other;
+  if (a->number != b->number) return a->number < b->number ? -1 : 1;
+  return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+static int cmpr_offsets(const void *part, const void *other) {
+  const struct part *a = part;
+  const struct part *b = other;
+  return a->offset < b->offset ? -1 : a->offset > b->offset;
+}
+
+/* reads the parts recorded in path, ordered by part. a part which was recorded more than once is taken as it was
+ * recorded last. *parts is heap allocated (NULL if no part was recorded). returns true on success, false otherwise */
+static bool read_parts(const char *path, struct part **parts, size_t *count) {
+  *parts = NULL;
+  *count = 0;
+
+  FILE *fp = fopen(path, "r");
+  if (!fp) return errno == ENOENT;  // nothing was stored yet
+
+  size_t capacity = 0;
+  intmax_t number, offset, length;
+  while (fscanf(fp, "%jd %jd %jd", &number, &offset, &length) == 3) {
+    if (*count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      struct part *tmp = realloc(*parts, capacity * sizeof *tmp);
+      if (!tmp) {
+        free(*parts);
+        *parts = NULL;
+        fclose(fp);
+        return false;
+      }
+      *parts = tmp;
+    }
+
+    (*parts)[*count] = (struct part){.number = number, .offset = offset, .length = length, .seq = *count};
+    (*count)++;
+  }
+  fclose(fp);
+
+  if (!*count) return true;
+
+  // keep the last record of every part
+  qsort(*parts, *count, sizeof **parts, cmpr_parts);
+  size_t kept = 0;
+  for (size_t i = 0; i < *count; i++) {
+    if (i + 1 < *count && (*parts)[i + 1].number == (*parts)[i].number) continue;
+    (*parts)[kept++] = (*parts)[i];
+  }
+  *count = kept;
+
+  return true;
+}
+
+int multipart_init(void *arg) {
+  if (!arg) return 1;
+  struct args *args = arg;
+
+  // find the session
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to find the session for fd [%d]",
+               thrd_current(),
+               __func__,
+               args->remote_fd);
+    send_reply_wrapper(args->remote_fd,
+                       args->logger,
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       "[%d] %s",
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    return 1;
+  }
+
+  const char *file_path = args->req_args.request_args;
+  if (!validate_path(file_path, args->logger) || file_path[strlen(file_path) - 1] == '/') {
+    reply(args, &session, RPLY_CMD_ARGS_SYNTAX_ERR);
+    return 1;
+  }
+
+  // the path the file is committed into. relative to the server root directory, just like the one of a STOR
+  char target[MAX_PATH_LEN];
+  int target_len = snprintf(target,
+                            sizeof target,
+                            "%s/%s/%s",
+                            string_c_str(session.context.root_dir),
+                            string_length(session.context.curr_dir) ? string_c_str(session.context.curr_dir) : ".",
+                            file_path);
+  if (target_len < 0 || (size_t)target_len >= sizeof target) {
+    reply(args, &session, RPLY_CMD_ARGS_SYNTAX_ERR);
+    return 1;
+  }
+
+  // the file must be committed into an existing directory
+  char *dir_end = strrchr(target, '/');
+  *dir_end = 0;
+  bool valid_dir = is_directory(target);
+  *dir_end = '/';
+  if (!valid_dir) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] no directory for [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               target);
+    reply(args, &session, RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE);
+    return 1;
+  }
+
+  uint64_t random = 0;
+  char id[UPLOAD_ID_LEN + 1];
+  bool success = getrandom(&random, sizeof random, 0) == sizeof random;
+  snprintf(id, sizeof id, "%016" PRIx64, random);
+
+  char path[MAX_PATH_LEN];
+  if (success) {
+    snprintf(path, sizeof path, "%s/" UPLOADS_DIR, string_c_str(session.context.root_dir));
+    success = (mkdir(path, S_IRWXU) == 0 || errno == EEXIST) && upload_path(&session, id, NULL, path, sizeof path) &&
+              mkdir(path, S_IRWXU) == 0;
+  }
+  if (success) {
+    success = upload_path(&session, id, "target", path, sizeof path) &&
+              create_upload_file(path, target, (size_t)target_len) &&
+              upload_path(&session, id, "data", path, sizeof path) && create_upload_file(path, NULL, 0);
+    if (!success) remove_upload(&session, id);
+  }
+
+  if (!success) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] failed to start an upload of [%s]. reason [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               target,
+               strerr_safe(errno));
+    reply(args, &session, RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR);
+    return 1;
+  }
+
+  logger_log(args->logger,
+             INFO,
+             "[%lu] [%s] [%s:%s] upload [%s] of [%s] started",
+             thrd_current(),
+             __func__,
+             session.context.ip,
+             session.context.port,
+             id,
+             target);
+  enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                               args->logger,
+                                               RPLY_CMD_OK,
+                                               "[%d] %s. upload [%s]",
+                                               RPLY_CMD_OK,
+                                               str_reply_code(RPLY_CMD_OK),
+                                               id);
+  handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+  return 0;
+}
+
+int multipart_part(void *arg) {
+  if (!arg) return 1;
+  struct args *args = arg;
+
+  // find the session
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to find the session for fd [%d]",
+               thrd_current(),
+               __func__,
+               args->remote_fd);
+    send_reply_wrapper(args->remote_fd,
+                       args->logger,
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       "[%d] %s",
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    return 1;
+  }
+
+  // check the session has a valid data connection
+  if (session.fds.data_fd == -1) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] invalid data_sockfd",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port);
+    reply(args, &session, RPLY_DATA_CONN_CLOSED);
+    return 1;
+  }
+
+  // mppt <upload id> <part> <offset>
+  char id[UPLOAD_ID_LEN + 1];
+  off_t number = 0;
+  off_t offset = 0;
+  const char *rest = parse_upload_id(args->req_args.request_args, id);
+  if (rest) rest = parse_number(rest, &number);
+  if (rest) rest = parse_number(rest, &offset);
+  if (!rest || *rest) {
+    reply(args, &session, RPLY_CMD_ARGS_SYNTAX_ERR);
+    return 1;
+  }
+
+  char path[MAX_PATH_LEN];
+  int fd = upload_path(&session, id, "data", path, sizeof path) ? open(path, O_WRONLY) : -1;
+  if (fd == -1) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] no upload [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               id);
+    reply(args, &session, RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE);
+    return 1;
+  }
+
+  reply(args, &session, RPLY_DATA_CONN_OPEN_STARTING_TRANSFER);
+
+  // the part is written at its own offsets, so any number of parts may be written at once
+  off_t end = offset;
+  bool compressed = session.transfer_mode == COMPRESSED;
+  struct io_stream stream;
+  io_stream_write_init(&stream, args->io_policy, fd, offset);
+  bool success = receive_blocks(session.fds.data_fd, fd, session.block_size, compressed, &stream, &end);
+  io_stream_end(&stream, end);
+  close(fd);
+
+  // a part which wasn't stored whole isn't recorded. the client sends it again
+  if (success) success = upload_path(&session, id, "parts", path, sizeof path);
+  if (success) success = record_part(path, number, offset, end - offset);
+  if (!success) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] failed to store part [%jd] of upload [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               (intmax_t)number,
+               id);
+    reply(args, &session, RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR);
+    return 1;
+  }
+
+  enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                               args->logger,
+                                               RPLY_FILE_ACTION_COMPLETE,
+                                               "[%d] %s. part [%jd] [%jd] bytes",
+                                               RPLY_FILE_ACTION_COMPLETE,
+                                               str_reply_code(RPLY_FILE_ACTION_COMPLETE),
+                                               (intmax_t)number,
+                                               (intmax_t)(end - offset));
+  handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+  return 0;
+}
+
+int multipart_list(void *arg) {
+  if (!arg) return 1;
+  struct args *args = arg;
+
+  // find the session
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to find the session for fd [%d]",
+               thrd_current(),
+               __func__,
+               args->remote_fd);
+    send_reply_wrapper(args->remote_fd,
+                       args->logger,
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       "[%d] %s",
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    return 1;
+  }
+
+  // check the session has a valid data connection
+  if (session.fds.data_fd == -1) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] invalid data_sockfd",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port);
+    reply(args, &session, RPLY_DATA_CONN_CLOSED);
+    return 1;
+  }
+
+  char id[UPLOAD_ID_LEN + 1];
+  const char *rest = parse_upload_id(args->req_args.request_args, id);
+  if (!rest || *rest) {
+    reply(args, &session, RPLY_CMD_ARGS_SYNTAX_ERR);
+    return 1;
+  }
+
+  char path[MAX_PATH_LEN];
+  struct stat statbuf;
+  if (!upload_path(&session, id, "data", path, sizeof path) || stat(path, &statbuf) == -1) {
+    reply(args, &session, RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE);
+    return 1;
+  }
+
+  struct part *parts = NULL;
+  size_t count = 0;
+  char *content = NULL;
+  bool success = upload_path(&session, id, "parts", path, sizeof path) && read_parts(path, &parts, &count) &&
+                 (content = malloc(count * PART_RECORD_LEN + 1));
+  if (!success) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] failed to read the parts of upload [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               id);
+    reply(args, &session, RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR);
+    free(parts);
+    return 1;
+  }
+
+  size_t len = 0;
+  for (size_t i = 0; i < count; i++) {
+    len += (size_t)snprintf(content + len,
+                            PART_RECORD_LEN + 1,
+                            "%jd %jd %jd\n",
+                            (intmax_t)parts[i].number,
+                            (intmax_t)parts[i].offset,
+                            (intmax_t)parts[i].length);
+  }
+  free(parts);
+
+  reply(args, &session, RPLY_DATA_CONN_OPEN_STARTING_TRANSFER);
+
+  // no parts are sent as a single empty block
+  struct stream_writer writer;
+  stream_writer_init(&writer, session.fds.data_fd, 0);
+
+  int ret = ERR_SUCCESS;
+  size_t offset = 0;
+  do {
+    size_t remains = len - offset;
+    uint32_t block_len = remains > DATA_BLOCK_MAX_LEN ? DATA_BLOCK_MAX_LEN : (uint32_t)remains;
+    uint8_t descriptor = offset + block_len == len ? DESCPTR_EOF : 0;
+
+    ret = stream_writer_block(&writer, descriptor, (uint8_t *)content + offset, block_len);
+    offset += block_len;
+  } while (ret == ERR_SUCCESS && offset < len);
+
+  if (ret == ERR_SUCCESS) ret = stream_writer_flush(&writer);
+  free(content);
+
+  if (ret != ERR_SUCCESS) {
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, ret);
+    reply(args, &session, RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR);
+    return 1;
+  }
+
+  reply(args, &session, RPLY_FILE_ACTION_COMPLETE);
+  return 0;
+}
+
+int multipart_commit(void *arg) {
+  if (!arg) return 1;
+  struct args *args = arg;
+
+  // find the session
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to find the session for fd [%d]",
+               thrd_current(),
+               __func__,
+               args->remote_fd);
+    send_reply_wrapper(args->remote_fd,
+                       args->logger,
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       "[%d] %s",
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    return 1;
+  }
+
+  // mpcm <upload id> <size>
+  char id[UPLOAD_ID_LEN + 1];
+  off_t size = 0;
+  const char *rest = parse_upload_id(args->req_args.request_args, id);
+  if (rest) rest = parse_number(rest, &size);
+  if (!rest || *rest) {
+    reply(args, &session, RPLY_CMD_ARGS_SYNTAX_ERR);
+    return 1;
+  }
+
+  // the path the file is committed into
+  char target[MAX_PATH_LEN] = {0};
+  char path[MAX_PATH_LEN];
+  int fd = upload_path(&session, id, "target", path, sizeof path) ? open(path, O_RDONLY) : -1;
+  ssize_t target_len = fd != -1 ? read(fd, target, sizeof target - 1) : -1;
+  if (fd != -1) close(fd);
+  if (target_len <= 0) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] no upload [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               id);
+    reply(args, &session, RPLY_FILE_ACTION_NOT_TAKEN_FILE_UNAVAILABLE);
+    return 1;
+  }
+
+  struct part *parts = NULL;
+  size_t count = 0;
+  if (!upload_path(&session, id, "parts", path, sizeof path) || !read_parts(path, &parts, &count)) {
+    reply(args, &session, RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR);
+    return 1;
+  }
+
+  /* the length of the run of parts from the start of the file, each starting right where the one before it ended. parts
+   * which overlap were written over one another, so they end the run as well */
+  if (count) qsort(parts, count, sizeof *parts, cmpr_offsets);
+  off_t covered = 0;
+  size_t run = 0;
+  for (; run < count && parts[run].offset == covered; run++) {
+    covered += parts[run].length;
+  }
+  free(parts);
+
+  // every part must be a part of the file
+  if (covered != size || run != count) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] upload [%s] covers [%jd] bytes out of [%jd]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               id,
+               (intmax_t)covered,
+               (intmax_t)size);
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                                                 "[%d] %s. parts cover [%jd] bytes",
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                                                 str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR),
+                                                 (intmax_t)covered);
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  // a part which was sent again might have been shorter than the one it replaced. then rename the file into place
+  // (or a link to a stored copy of its content)
+  bool success = upload_path(&session, id, "data", path, sizeof path) && truncate(path, size) == 0;
+  if (success) deduplicate_upload(args, &session, path);
+  success = success && rename(path, target) == 0;
+  if (!success) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] failed to commit upload [%s] into [%s]. reason [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               id,
+               target,
+               strerr_safe(errno));
+    reply(args, &session, RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR);
+    return 1;
+  }
+  remove_upload(&session, id);
+
+  logger_log(args->logger,
+             INFO,
+             "[%lu] [%s] [%s:%s] upload [%s] committed into [%s]",
+             thrd_current(),
+             __func__,
+             session.context.ip,
+             session.context.port,
+             id,
+             target);
+  reply(args, &session, RPLY_FILE_ACTION_COMPLETE);
+  return 0;
+}
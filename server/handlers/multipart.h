@@ -0,0 +1,26 @@
+#pragma once
+
+/* a multipart upload. a client starts an upload of a file, sends its parts over any number of data connections (of
+ * any number of sessions, at once or over time) and commits it. the upload is kept under .uploads/<upload id>/ in the
+ * server root directory:
+ * data - the file being uploaded. every part is written at its own offset
+ * target - the path the file is committed into
+ * parts - a '<part> <offset> <length>' line for every part stored. a part which is sent again replaces the earlier one
+ * the upload lives on disk only, so it survives the session which started it. parts are written straight into the file,
+ * so they must not overlap: a part sent again must be sent at the same offset */
+
+/* starts an upload of a file ('mpin <file_path>'). replies with the upload id */
+int multipart_init(void *arg);
+
+/* receives a part of an upload over the data connection ('mppt <upload id> <part> <offset>'). the part is recorded
+ * once it's been stored whole */
+int multipart_part(void *arg);
+
+/* sends the parts stored so far over the data connection ('mpls <upload id>'), a '<part> <offset> <length>' line
+ * each, ordered by part */
+int multipart_list(void *arg);
+
+/* commits an upload ('mpcm <upload id> <size>'). the stored parts must cover exactly the first size bytes of the file,
+ * without gaps or overlaps. the file is renamed into place (atomically replacing a file of the same path) and the upload
+ * is removed */
+int multipart_commit(void *arg);
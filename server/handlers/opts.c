@@ -0,0 +1,112 @@
+#include "opts.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "misc/util.h"
+#include "util.h"
+
+#define OPT_BLKSIZE "blksize"
+
+/* parses the argument of 'blksize <n>'. returns true if n is a valid block size */
+static bool parse_block_size(const char *arg, uint32_t *block_size) {
+  size_t opt_len = strlen(OPT_BLKSIZE);
+  if (strncmp(arg, OPT_BLKSIZE, opt_len) != 0 || arg[opt_len] != ' ') return false;
+
+  char *end = NULL;
+  errno = 0;
+  unsigned long size = strtoul(arg + opt_len + 1, &end, 10);
+  if (errno || end == arg + opt_len + 1 || *end) return false;
+  if (size < DATA_BLOCK_MAX_LEN || size > DATA_BLOCK_EXT_MAX_LEN) return false;
+
+  *block_size = (uint32_t)size;
+  return true;
+}
+
+int options(void *arg) {
+  if (!arg) return 1;
+  struct args *args = arg;
+
+  // find the session
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to find the session for fd [%d]",
+               thrd_current(),
+               __func__,
+               args->remote_fd);
+    send_reply_wrapper(args->remote_fd,
+                       args->logger,
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       "[%d] %s",
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    return 1;
+  }
+
+  uint32_t block_size;
+  if (!parse_block_size(args->req_args.request_args, &block_size)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] invalid option [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               args->req_args.request_args);
+
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 "[%d] %s. block size must be between %d and %d",
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR),
+                                                 DATA_BLOCK_MAX_LEN,
+                                                 DATA_BLOCK_EXT_MAX_LEN);
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  // update the session
+  session.block_size = block_size;
+
+  bool update = update_session(args->sessions, args->logger, &session);
+  if (!update) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to update the session for [%s:%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port);
+
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                                                 "[%d] %s",
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                                                 str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                               args->logger,
+                                               RPLY_CMD_OK,
+                                               "[%d] %s. block size [%u]",
+                                               RPLY_CMD_OK,
+                                               str_reply_code(RPLY_CMD_OK),
+                                               session.block_size);
+  handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+  logger_log(args->logger,
+             INFO,
+             "[%lu] [%s] [%s:%s] block size set to [%u]",
+             thrd_current(),
+             __func__,
+             session.context.ip,
+             session.context.port,
+             session.block_size);
+
+  return 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+/* sets an option for the session. the only option supported is 'blksize <n>' which negotiates the size of the data
+ * blocks used by later transfers. n must be between DATA_BLOCK_MAX_LEN and DATA_BLOCK_EXT_MAX_LEN. blocks larger than
+ * DATA_BLOCK_MAX_LEN are framed with DESCPTR_EXT_LEN. sessions which never send this command keep the standard framing */
+int options(void *arg);
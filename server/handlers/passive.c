@@ -1,8 +1,8 @@
 #include "passive.h"
-#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>  // close() write()
+#include <sys/epoll.h>
+#include <unistd.h>  // close()
 #include "misc/util.h"
 #include "util.h"
 
@@ -11,15 +11,13 @@ int passive(void *arg) {
   struct args *args = arg;
 
   // find the session
-  struct session *tmp_session = vector_s_find(args->sessions, &(struct session){.fds.control_fd = args->remote_fd});
-  if (!tmp_session) {
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
     logger_log(args->logger,
                ERROR,
-               "[%lu] [%s] [%s:%s] failed to find the session for fd [%d]",
+               "[%lu] [%s] failed to find the session for fd [%d]",
                thrd_current(),
                __func__,
-               tmp_session->context.ip,
-               tmp_session->context.port,
                args->remote_fd);
     send_reply_wrapper(args->remote_fd,
                        args->logger,
@@ -30,14 +28,10 @@ int passive(void *arg) {
     return 1;
   }
 
-  struct session session = {0};
-  memcpy(&session, tmp_session, sizeof session);
-  free(tmp_session);
-
   struct list *ips = get_local_ip();
   int pasv_fd = -1;
   for (size_t i = 0; i < list_size(ips); i++) {
-    pasv_fd = get_passive_socket(args->logger, (const char *)list_at(ips, i), NULL, 1, AI_PASSIVE);
+    pasv_fd = get_passive_socket(args->logger, (const char *)list_at(ips, i), NULL, 1, AI_PASSIVE, false);
 
     if (pasv_fd != -1) break;  // successfuly got a passive socket
   }
@@ -68,6 +62,7 @@ int passive(void *arg) {
       close(session.fds.data_fd);
       break;
     case PASSIVE:
+      table_s_remove(args->listeners, &session.fds.listen_sockfd, NULL);
       close(session.fds.listen_sockfd);
       break;
   }
@@ -77,6 +72,7 @@ int passive(void *arg) {
   session.fds.listen_sockfd = pasv_fd;
 
   bool update = update_session(args->sessions, args->logger, &session);
+  if (update) update = table_s_put(args->listeners, &pasv_fd, &session.fds.control_fd);
   if (!update) {
     logger_log(args->logger,
                ERROR,
@@ -96,17 +92,15 @@ int passive(void *arg) {
     return 1;
   }
 
-  // signify the main thread to update its pollfds
-  uint64_t discard = 1;
-  ssize_t ret = write(args->event_fd, &discard, sizeof discard);  // write the value into event_fd
-
-  if (ret == -1) {
+  /* let the reactor monitor the new socket. epoll_ctl() is thread safe and the reactor finds the session through the
+   * listeners table, so there's no need to wake it up */
+  if (register_fd(args->logger, args->epollfd, pasv_fd, EPOLLIN) != 0) {
     logger_log(args->logger,
                ERROR,
-               "[%lu] [%s] failed to write to event_fd [%d]",
+               "[%lu] [%s] failed to monitor the passive socket [%d]",
                thrd_current(),
                __func__,
-               args->event_fd);
+               pasv_fd);
 
     enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
                                                  args->logger,
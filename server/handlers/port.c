@@ -10,15 +10,13 @@ int port(void *arg) {
   struct args *args = arg;
 
   // find the session
-  struct session *tmp_session = vector_s_find(args->sessions, &(struct session){.fds.control_fd = args->remote_fd});
-  if (!tmp_session) {
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
     logger_log(args->logger,
                ERROR,
-               "[%lu] [%s] [%s:%s] failed to find the session for fd [%d]",
+               "[%lu] [%s] failed to find the session for fd [%d]",
                thrd_current(),
                __func__,
-               tmp_session->context.ip,
-               tmp_session->context.port,
                args->remote_fd);
     send_reply_wrapper(args->remote_fd,
                        args->logger,
@@ -29,10 +27,6 @@ int port(void *arg) {
     return 1;
   }
 
-  struct session session = {0};
-  memcpy(&session, tmp_session, sizeof session);
-  free(tmp_session);
-
   // get the ip & port from the request. the request should hold them in the following format: ip,port where ip can be
   // in either ipv4 or ipv6
 
@@ -43,8 +37,8 @@ int port(void *arg) {
                "[%lu] [%s] [%s:%s] invalid request [%s]",
                thrd_current(),
                __func__,
-               tmp_session->context.ip,
-               tmp_session->context.port,
+               session.context.ip,
+               session.context.port,
                args->req_args.request_args);
     enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
                                                  args->logger,
@@ -70,8 +64,8 @@ int port(void *arg) {
                "[%lu] [%s] failed to open an active data socket for [%s:%s]",
                thrd_current(),
                __func__,
-               tmp_session->context.ip,
-               tmp_session->context.port);
+               session.context.ip,
+               session.context.port);
 
     enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
                                                  args->logger,
@@ -103,8 +97,8 @@ int port(void *arg) {
                "[%lu] [%s] failed to update the session for [%s:%s]",
                thrd_current(),
                __func__,
-               tmp_session->context.ip,
-               tmp_session->context.port);
+               session.context.ip,
+               session.context.port);
     enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
                                                  args->logger,
                                                  RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
@@ -121,8 +115,8 @@ int port(void *arg) {
              "[%lu] [%s] the session [%s:%s] has been successfuly updated to ACTIVE",
              thrd_current(),
              __func__,
-             tmp_session->context.ip,
-             tmp_session->context.port);
+             session.context.ip,
+             session.context.port);
   enum err_codes err_code =
     send_reply_wrapper(args->remote_fd, args->logger, RPLY_CMD_OK, "[%d] %s", RPLY_CMD_OK, str_reply_code(RPLY_CMD_OK));
   handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
@@ -9,15 +9,13 @@ int print_working_directory(void *arg) {
   struct args *args = arg;
 
   // find the session
-  struct session *session = vector_s_find(args->sessions, &(struct session){.fds.control_fd = args->remote_fd});
-  if (!session) {
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
     logger_log(args->logger,
                ERROR,
-               "[%lu] [%s] [%s:%s] failed to find the session for fd [%d]",
+               "[%lu] [%s] failed to find the session for fd [%d]",
                thrd_current(),
                __func__,
-               session->context.ip,
-               session->context.port,
                args->remote_fd);
     send_reply_wrapper(args->remote_fd,
                        args->logger,
@@ -28,23 +26,21 @@ int print_working_directory(void *arg) {
     return 1;
   }
 
-  enum err_codes err_code = send_reply_wrapper(session->fds.control_fd,
+  enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
                                                args->logger,
                                                RPLY_PATHNAME_CREATED,
                                                "[%d]. [%s/]",
                                                RPLY_PATHNAME_CREATED,
-                                               session->context.curr_dir);
-  handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
+                                               session.context.curr_dir);
+  handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
 
   logger_log(args->logger,
              INFO,
              "[%lu] [%s] [%s:%s] executed successfuly",
              thrd_current(),
              __func__,
-             session->context.ip,
-             session->context.port);
-
-  free(session);
+             session.context.ip,
+             session.context.port);
 
   return 0;
 }
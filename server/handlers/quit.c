@@ -8,8 +8,8 @@ int quit(void *arg) {
   if (!arg) return 1;
   struct args *args = arg;
 
-  struct session *session = vector_s_find(args->sessions, &(struct session){.fds.control_fd = args->remote_fd});
-  if (!session) {
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
     logger_log(args->logger,
                ERROR,
                "[%lu] [%s] failed to close session with scokfd [%d], session doesn't exists",
@@ -31,14 +31,14 @@ int quit(void *arg) {
              "[%lu] [%s] closing session [%s:%s]",
              thrd_current(),
              __func__,
-             session->context.ip,
-             session->context.port);
+             session.context.ip,
+             session.context.port);
 
-  unregister_fd(args->logger, args->epollfd, session->fds.control_fd, EPOLLIN);
-  if (session->data_sock_type == PASSIVE && session->fds.listen_sockfd != -1) {
-    unregister_fd(args->logger, args->epollfd, session->fds.listen_sockfd, EPOLLIN);
+  unregister_fd(args->logger, args->epollfd, session.fds.control_fd, EPOLLIN);
+  if (session.data_sock_type == PASSIVE && session.fds.listen_sockfd != -1) {
+    unregister_fd(args->logger, args->epollfd, session.fds.listen_sockfd, EPOLLIN);
+    table_s_remove(args->listeners, &session.fds.listen_sockfd, NULL);
   }
-  free(session);
 
   enum err_codes err_code = send_reply_wrapper(args->remote_fd,
                                                args->logger,
@@ -46,7 +46,7 @@ int quit(void *arg) {
                                                "[%d] %s",
                                                RPLY_CLOSING_CTRL_CONN,
                                                str_reply_code(RPLY_CLOSING_CTRL_CONN));
-  handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
+  handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
 
   close_session(args->sessions, args->remote_fd);
   return 0;
@@ -0,0 +1,104 @@
+#include "rest.h"
+#include <errno.h>
+#include <inttypes.h>  // strtoimax()
+#include <stdlib.h>
+#include "misc/util.h"
+#include "util.h"
+
+/* parses the argument of 'rest <offset>'. returns true if offset is a valid offset */
+static bool parse_offset(const char *arg, off_t *offset) {
+  char *end = NULL;
+  errno = 0;
+  intmax_t value = strtoimax(arg, &end, 10);
+  if (errno || end == arg || *trim_str(end) || value < 0) return false;
+
+  *offset = (off_t)value;
+  return (intmax_t)*offset == value;
+}
+
+int restart(void *arg) {
+  if (!arg) return 1;
+  struct args *args = arg;
+
+  // find the session
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to find the session for fd [%d]",
+               thrd_current(),
+               __func__,
+               args->remote_fd);
+    send_reply_wrapper(args->remote_fd,
+                       args->logger,
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       "[%d] %s",
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    return 1;
+  }
+
+  off_t offset;
+  if (!parse_offset(args->req_args.request_args, &offset)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] invalid offset [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               args->req_args.request_args);
+
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 "[%d] %s",
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  // update the session
+  session.restart_offset = offset;
+
+  bool update = update_session(args->sessions, args->logger, &session);
+  if (!update) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to update the session for [%s:%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port);
+
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                                                 "[%d] %s",
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                                                 str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                               args->logger,
+                                               RPLY_FILE_ACTION_PENDING,
+                                               "[%d] %s. restarting at [%jd]",
+                                               RPLY_FILE_ACTION_PENDING,
+                                               str_reply_code(RPLY_FILE_ACTION_PENDING),
+                                               (intmax_t)session.restart_offset);
+  handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+  logger_log(args->logger,
+             INFO,
+             "[%lu] [%s] [%s:%s] restart offset set to [%jd]",
+             thrd_current(),
+             __func__,
+             session.context.ip,
+             session.context.port,
+             (intmax_t)session.restart_offset);
+
+  return 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+/* sets the offset the next RETR or STOR of the session starts at ('rest <offset>'). a RETR sends the file from the
+ * offset on, a STOR appends to the partial file an interrupted STOR of the same file left behind. the offset applies to
+ * the next transfer only */
+int restart(void *arg);
@@ -1,92 +1,73 @@
 #include "retrieve.h"
+#include <fcntl.h>  // open()
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>  // stat
+#include <unistd.h>    // close()
 #include "misc/util.h"
 #include "util.h"
 
-int retrieve_file(void *arg) {
-  if (!arg) return 1;
-  struct args *args = arg;
-
-  // find the session
-  struct session *tmp_session = vector_s_find(args->sessions, &(struct session){.fds.control_fd = args->remote_fd});
-  if (!tmp_session) {
-    logger_log(args->logger,
-               ERROR,
-               "[%lu] [%s] [%s:%s] failed to find the session for fd [%d]",
-               thrd_current(),
-               __func__,
-               tmp_session->context.ip,
-               tmp_session->context.port,
-               args->remote_fd);
-    send_reply_wrapper(args->remote_fd,
-                       args->logger,
-                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
-                       "[%d] %s",
-                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
-                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
-    return 1;
-  }
-  struct session session = {0};
-  memcpy(&session, tmp_session, sizeof session);
-  free(tmp_session);
-
+/* sends the bytes [offset, offset + length) of the file file_name (relative to the current directory of the session)
+ * over the data connection. a length of -1 sends the file up to its end, a range which reaches past the end of the file
+ * is cut short. replies to the client on its control connection either way. returns 1 if the request was refused, 0
+ * otherwise */
+static int send_file(struct args *args, struct session *session, const char *file_name, off_t offset, off_t length) {
   // check the session has a valid data connection
-  if (session.fds.data_fd == -1) {
+  if (session->fds.data_fd == -1) {
     logger_log(args->logger,
                ERROR,
                "[%lu] [%s] [%s:%s] invalid data_sockfd",
                thrd_current(),
                __func__,
-               session.context.ip,
-               session.context.port);
-    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+               session->context.ip,
+               session->context.port);
+    enum err_codes err_code = send_reply_wrapper(session->fds.control_fd,
                                                  args->logger,
                                                  RPLY_DATA_CONN_CLOSED,
                                                  "[%d] %s",
                                                  RPLY_DATA_CONN_CLOSED,
                                                  str_reply_code(RPLY_DATA_CONN_CLOSED));
-    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
     return 1;
   }
 
   // validate the file path
-  if (!validate_path(args->req_args.request_args, args->logger)) {
-    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+  if (!validate_path(file_name, args->logger)) {
+    enum err_codes err_code = send_reply_wrapper(session->fds.control_fd,
                                                  args->logger,
                                                  RPLY_CMD_ARGS_SYNTAX_ERR,
                                                  "[%d] %s",
                                                  RPLY_CMD_ARGS_SYNTAX_ERR,
                                                  str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
-    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
 
     return 1;
   }
 
   // get file path
-  struct string *path = get_path(&session);
+  struct string *path = get_path(session);
   if (!path) {
     logger_log(args->logger,
                ERROR,
                "[%lu] [%s] [%s:%s] get_path() failure",
                thrd_current(),
                __func__,
-               session.context.ip,
-               session.context.port);
-    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+               session->context.ip,
+               session->context.port);
+    enum err_codes err_code = send_reply_wrapper(session->fds.control_fd,
                                                  args->logger,
                                                  RPLY_CMD_ARGS_SYNTAX_ERR,
                                                  "[%d] %s",
                                                  RPLY_CMD_ARGS_SYNTAX_ERR,
                                                  str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
-    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
 
     return 1;
   }
 
-  size_t args_len = strlen(args->req_args.request_args);
+  size_t args_len = strlen(file_name);
 
   // path too long
   if (string_length(path) + 1 + args_len + 1 > MAX_PATH_LEN - 1) {
@@ -95,72 +76,107 @@ int retrieve_file(void *arg) {
                "[%lu] [%s] [%s:%s] path too long",
                thrd_current(),
                __func__,
-               session.context.ip,
-               session.context.port);
-    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+               session->context.ip,
+               session->context.port);
+    enum err_codes err_code = send_reply_wrapper(session->fds.control_fd,
                                                  args->logger,
                                                  RPLY_CMD_SYNTAX_ERR,
                                                  "[%d] %s",
                                                  RPLY_CMD_SYNTAX_ERR,
                                                  str_reply_code(RPLY_CMD_SYNTAX_ERR));
-    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
 
     string_destroy(path);
     return 1;
   }
 
   string_concat(path, "/");
-  string_concat(path, args->req_args.request_args);
+  string_concat(path, file_name);
 
   // open the file
-  FILE *fp = fopen(string_c_str(path), "r");
-  int fp_fd = fileno(fp);
-  if (!fp || fp_fd == -1) {
+  int fd = open(string_c_str(path), O_RDONLY);
+  if (fd == -1) {
     logger_log(args->logger,
                ERROR,
                "[%lu] [%s] [%s:%s] invalid path or file doesn't exists [%s]",
                thrd_current(),
                __func__,
-               session.context.ip,
-               session.context.port,
+               session->context.ip,
+               session->context.port,
                string_c_str(path));
-    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+    enum err_codes err_code = send_reply_wrapper(session->fds.control_fd,
                                                  args->logger,
                                                  RPLY_CMD_ARGS_SYNTAX_ERR,
                                                  "[%d] %s",
                                                  RPLY_CMD_ARGS_SYNTAX_ERR,
                                                  str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
-    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
 
     string_destroy(path);
     return 1;
   }
 
   struct stat statbuf = {0};
-  int ret = fstat(fp_fd, &statbuf);
-  if (ret == -1) {
+  int ret = fstat(fd, &statbuf);
+  if (ret == -1 || !S_ISREG(statbuf.st_mode)) {
     logger_log(args->logger,
                WARN,
                "[%lu] [%s] [%s:%s] invalid file descriptor [%s]",
                thrd_current(),
                __func__,
-               session.context.ip,
-               session.context.port,
+               session->context.ip,
+               session->context.port,
                string_c_str(path));
-    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+    enum err_codes err_code = send_reply_wrapper(session->fds.control_fd,
                                                  args->logger,
                                                  RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
                                                  "[%d] %s",
                                                  RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
                                                  str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
-    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
 
+    close(fd);
     string_destroy(path);
     return 1;
   }
 
-  struct file_size file_size = get_file_size(statbuf.st_size);
-  enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+  if (offset > statbuf.st_size) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] offset [%jd] past the end of [%s]",
+               thrd_current(),
+               __func__,
+               session->context.ip,
+               session->context.port,
+               (intmax_t)offset,
+               string_c_str(path));
+    enum err_codes err_code = send_reply_wrapper(session->fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_INVALID_REST,
+                                                 "[%d] %s. file size [%jd]",
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_INVALID_REST,
+                                                 str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_INVALID_REST),
+                                                 (intmax_t)statbuf.st_size);
+    handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
+
+    close(fd);
+    string_destroy(path);
+    return 1;
+  }
+
+  if (length == -1 || length > statbuf.st_size - offset) length = statbuf.st_size - offset;
+
+  // a small file which is sent whole and uncompressed is served out of the file cache. a miss reads the file into the
+  // cache right away, so the download is sent out of the cache either way (unless the file can't be cached)
+  bool compressed = session->transfer_mode == COMPRESSED;
+  struct cached_file *cached = NULL;
+  if (!compressed && !offset && length == statbuf.st_size) {
+    cached = file_cache_get(args->file_cache, string_c_str(path), &statbuf, session->block_size);
+    if (!cached) cached = file_cache_add(args->file_cache, string_c_str(path), fd, &statbuf, session->block_size);
+  }
+
+  struct file_size file_size = get_file_size(length);
+  enum err_codes err_code = send_reply_wrapper(session->fds.control_fd,
                                                args->logger,
                                                RPLY_DATA_CONN_OPEN_STARTING_TRANSFER,
                                                "[%d] %s. %Lf%s",
@@ -168,35 +184,43 @@ int retrieve_file(void *arg) {
                                                str_reply_code(RPLY_DATA_CONN_OPEN_STARTING_TRANSFER),
                                                file_size.size,
                                                file_size.units);
-  handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
-
-  // read the file and send it
-  struct data_block data = {0};
-  bool successful_transfer = true;
-  bool done = false;
-  do {
-    size_t bytes_read = fread(data.data, sizeof *data.data, DATA_BLOCK_MAX_LEN, fp);
-    data.length = (uint16_t)bytes_read;
-
-    if (bytes_read < DATA_BLOCK_MAX_LEN) {
-      if (ferror(fp)) {  // encountered an error
-        successful_transfer = false;
-        break;
-      }
-      if (feof(fp)) {  // reached the end of file
-        data.descriptor = DESCPTR_EOF;
-        done = true;
-      }
-    }
+  handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
+
+  bool successful_transfer = false;
+  if (cached) {
+    // the blocks are framed already. they're sent 'as is', without reading the file
+    successful_transfer = send_framed_data(session->fds.data_fd, cached->blocks, cached->len, 0) == ERR_SUCCESS;
+    cached_file_release(cached);
+  } else {
+    // the kernel moves the content straight from the page cache into the data socket. every transfer reads the file at
+    // its own offsets, so any number of them may read the same file at once. in compressed mode the content has to
+    // pass through the compressor instead
+    struct block_compressor compressor;
+    successful_transfer = !compressed || block_compressor_init(&compressor, session->block_size);
 
-    // failed to send a data block
-    if (send_data(&data, session.fds.data_fd, 0) != ERR_SUCCESS) {
-      successful_transfer = false;
-      break;
+    // the file is sent a part at a time, so the io policy reads ahead of the data connection and drops behind it
+    struct io_stream stream;
+    io_stream_read_init(&stream, args->io_policy, fd, offset, length, session->block_size);
+
+    off_t end = offset + length;
+    off_t sent = offset;
+    while (successful_transfer) {
+      off_t part = io_stream_next_part(&stream, sent);
+      bool eof = sent + part == end;
+
+      int ret = compressed
+                    ? send_compressed_file_part(session->fds.data_fd, fd, sent, part, &compressor, eof, 0)
+                    : send_file_part(session->fds.data_fd, fd, sent, part, session->block_size, eof, 0);
+      successful_transfer = ret == ERR_SUCCESS;
+      sent += successful_transfer ? part : 0;
+
+      if (eof) break;
     }
+    io_stream_end(&stream, sent);
 
-  } while (!done);
-  fclose(fp);
+    if (compressed) block_compressor_destroy(&compressor);
+  }
+  close(fd);
 
   // send feedback
   if (successful_transfer) {
@@ -205,32 +229,109 @@ int retrieve_file(void *arg) {
                "[%lu] [%s] [%s:%s] the file [%s] successfully transfered",
                thrd_current(),
                __func__,
-               session.context.ip,
-               session.context.port,
-               string_c_str(path) + string_length(session.context.root_dir) + 1);
-    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+               session->context.ip,
+               session->context.port,
+               string_c_str(path) + string_length(session->context.root_dir) + 1);
+    enum err_codes err_code = send_reply_wrapper(session->fds.control_fd,
                                                  args->logger,
                                                  RPLY_FILE_ACTION_COMPLETE,
                                                  "[%d] %s",
                                                  RPLY_FILE_ACTION_COMPLETE,
                                                  str_reply_code(RPLY_FILE_ACTION_COMPLETE));
-    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
   } else {
     logger_log(args->logger,
                ERROR,
                "[%lu] [%s] [%s:%s] process error",
                thrd_current(),
                __func__,
-               session.context.ip,
-               session.context.port);
-    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+               session->context.ip,
+               session->context.port);
+    enum err_codes err_code = send_reply_wrapper(session->fds.control_fd,
                                                  args->logger,
                                                  RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
                                                  "[%d] %s",
                                                  RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
                                                  str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
-    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    handle_reply_err(args->logger, args->sessions, session, args->epollfd, err_code);
   }
   string_destroy(path);
   return 0;
 }
+
+int retrieve_file(void *arg) {
+  if (!arg) return 1;
+  struct args *args = arg;
+
+  // find the session
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to find the session for fd [%d]",
+               thrd_current(),
+               __func__,
+               args->remote_fd);
+    send_reply_wrapper(args->remote_fd,
+                       args->logger,
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       "[%d] %s",
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    return 1;
+  }
+
+  // a REST applies to this transfer only, whether it succeeds or not
+  off_t offset = take_restart_offset(args->sessions, args->logger, &session);
+
+  return send_file(args, &session, args->req_args.request_args, offset, -1);
+}
+
+int retrieve_range(void *arg) {
+  if (!arg) return 1;
+  struct args *args = arg;
+
+  // find the session
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to find the session for fd [%d]",
+               thrd_current(),
+               __func__,
+               args->remote_fd);
+    send_reply_wrapper(args->remote_fd,
+                       args->logger,
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       "[%d] %s",
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    return 1;
+  }
+
+  // rang <offset> <length> <path>
+  off_t offset = 0;
+  off_t length = 0;
+  const char *file_name = parse_number(args->req_args.request_args, &offset);
+  if (file_name) file_name = parse_number(file_name, &length);
+  if (!file_name || !*file_name || !length) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] invalid range [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               args->req_args.request_args);
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 "[%d] %s",
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  return send_file(args, &session, file_name, offset, length);
+}
@@ -2,4 +2,8 @@
 
 /* requests a file to be sent. file path is calculated as
  * session::context::session_root_dir/session::context::curr_dir/file_path */
-int retrieve_file(void *arg);
\ No newline at end of file
+int retrieve_file(void *arg);
+
+/* requests a byte range of a file to be sent: 'rang <offset> <length> <file_path>'. the range is cut short at the end of
+ * the file. a client may fetch disjoint ranges of the same file over several sessions at once */
+int retrieve_range(void *arg);
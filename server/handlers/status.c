@@ -0,0 +1,90 @@
+#include "status.h"
+#include <stdint.h>
+#include "misc/util.h"
+#include "util.h"
+
+int server_status(void *arg) {
+  if (!arg) return 1;
+  struct args *args = arg;
+
+  // find the session
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] failed to find the session for fd [%d]",
+               thrd_current(),
+               __func__,
+               args->remote_fd);
+    send_reply_wrapper(args->remote_fd,
+                       args->logger,
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       "[%d] %s",
+                       RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
+                       str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+    return 1;
+  }
+
+  // the status of a file isn't supported. LIST and MLST tell it
+  if (*args->req_args.request_args) {
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 "[%d] %s",
+                                                 RPLY_CMD_ARGS_SYNTAX_ERR,
+                                                 str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    return 1;
+  }
+
+  struct io_policy_stats io_stats;
+  io_policy_stats(args->io_policy, &io_stats);
+
+  struct file_cache_stats cache_stats;
+  file_cache_stats(args->file_cache, &cache_stats);
+
+  enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                               args->logger,
+                                               RPLY_SYSTEM_STATUS,
+                                               "[%d] %s\n"
+                                               " io policy: read ahead up to [%jd] bytes. drop behind from [%jd] bytes\n"
+                                               " downloads [%ju] uploads [%ju]\n"
+                                               " read ahead [%ju] bytes in [%ju] windows\n"
+                                               " written back [%ju] bytes\n"
+                                               " dropped behind [%ju] bytes\n"
+                                               " direct io from [%jd] bytes: [%ju] uploads wrote [%ju] bytes\n"
+                                               " file cache: [%zu] of [%zu] bytes in [%zu] files up to [%zu] bytes\n"
+                                               " hits [%ju] misses [%ju] evictions [%ju] invalidations [%ju]",
+                                               RPLY_SYSTEM_STATUS,
+                                               str_reply_code(RPLY_SYSTEM_STATUS),
+                                               (intmax_t)io_stats.readahead_size,
+                                               (intmax_t)io_stats.drop_behind_size,
+                                               io_stats.reads,
+                                               io_stats.writes,
+                                               io_stats.read_ahead,
+                                               io_stats.windows,
+                                               io_stats.written_back,
+                                               io_stats.dropped,
+                                               (intmax_t)io_stats.direct_io_size,
+                                               io_stats.direct,
+                                               io_stats.direct_written,
+                                               cache_stats.used,
+                                               cache_stats.budget,
+                                               cache_stats.files,
+                                               cache_stats.max_file_size,
+                                               cache_stats.hits,
+                                               cache_stats.misses,
+                                               cache_stats.evictions,
+                                               cache_stats.invalidations);
+  handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+  logger_log(args->logger,
+             INFO,
+             "[%lu] [%s] [%s:%s] executed successfuly",
+             thrd_current(),
+             __func__,
+             session.context.ip,
+             session.context.port);
+
+  return 0;
+}
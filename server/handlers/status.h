@@ -0,0 +1,5 @@
+#pragma once
+
+/* replies with the status of the server ('stat'): the counters of the io policy (see transfer/io_policy.h). the reply
+ * is sent over the control connection, a line per counter */
+int server_status(void *arg);
@@ -1,10 +1,15 @@
 #include "store.h"
+#include <errno.h>
+#include <fcntl.h>  // open()
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>  // unlink()
+#include <sys/stat.h>  // fstat()
+#include <unistd.h>    // unlink(), close(), ftruncate()
 #include "misc/util.h"
 #include "str.h"
+#include "transfer/allocation.h"
 #include "util.h"
 
 int store_file(void *arg) {
@@ -12,15 +17,13 @@ int store_file(void *arg) {
   struct args *args = arg;
 
   // find the session
-  struct session *tmp_session = vector_s_find(args->sessions, &(struct session){.fds.control_fd = args->remote_fd});
-  if (!tmp_session) {
+  struct session session;
+  if (!get_session(args->sessions, args->remote_fd, &session)) {
     logger_log(args->logger,
                ERROR,
-               "[%lu] [%s] [%s:%s] failed to find the session for fd [%d]",
+               "[%lu] [%s] failed to find the session for fd [%d]",
                thrd_current(),
                __func__,
-               tmp_session->context.ip,
-               tmp_session->context.port,
                args->remote_fd);
     send_reply_wrapper(args->remote_fd,
                        args->logger,
@@ -30,9 +33,15 @@ int store_file(void *arg) {
                        str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
     return 1;
   }
-  struct session session = {0};
-  memcpy(&session, tmp_session, sizeof session);
-  free(tmp_session);
+
+  // a REST (and an ALLO) applies to this transfer only, whether it succeeds or not
+  off_t offset = take_restart_offset(args->sessions, args->logger, &session);
+  off_t allocation_size = take_allocation_size(args->sessions, args->logger, &session);
+
+  // a size hint on the STOR itself takes the place of an ALLO
+  off_t size_hint = 0;
+  const char *path = parse_size_hint(args->req_args.request_args, &size_hint);
+  if (size_hint) allocation_size = size_hint;
 
   // check the session has a valid data connection
   if (session.fds.data_fd == -1) {
@@ -54,7 +63,7 @@ int store_file(void *arg) {
   }
 
   // validate file path
-  if (!validate_path(args->req_args.request_args, args->logger)) {
+  if (!validate_path(path, args->logger)) {
     enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
                                                  args->logger,
                                                  RPLY_CMD_ARGS_SYNTAX_ERR,
@@ -67,11 +76,11 @@ int store_file(void *arg) {
   }
 
   // get file name
-  const char *file_name = args->req_args.request_args;
-  if (strchr(args->req_args.request_args, '/')) {
+  const char *file_name = path;
+  if (strchr(path, '/')) {
     // the end of the sting
-    const char *end_ptr = strchr(args->req_args.request_args, 0);
-    for (; end_ptr > args->req_args.request_args; end_ptr--) {
+    const char *end_ptr = strchr(path, 0);
+    for (; end_ptr > path; end_ptr--) {
       if (*end_ptr == '/') {
         file_name = end_ptr + 1;
         break;
@@ -87,7 +96,7 @@ int store_file(void *arg) {
                __func__,
                session.context.ip,
                session.context.port,
-               args->req_args.request_args);
+               path);
     enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
                                                  args->logger,
                                                  RPLY_CMD_ARGS_SYNTAX_ERR,
@@ -95,10 +104,9 @@ int store_file(void *arg) {
                                                  RPLY_CMD_ARGS_SYNTAX_ERR,
                                                  str_reply_code(RPLY_CMD_ARGS_SYNTAX_ERR));
     handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
-  }
 
-  // get the size of the file path. file name is unique and 'hidden'
-  int tmp_len = snprintf(NULL, 0, ".%lu%s", thrd_current(), file_name);
+    return 1;
+  }
 
   // the length of the file named recieved from the client
   int final_path_len = snprintf(NULL,
@@ -106,9 +114,9 @@ int store_file(void *arg) {
                                 "%s/%s/%s",
                                 string_c_str(session.context.root_dir),
                                 string_length(session.context.curr_dir) ? string_c_str(session.context.curr_dir) : ".",
-                                args->req_args.request_args);
+                                path);
 
-  if (tmp_len < 0 || final_path_len < 0) {
+  if (final_path_len < 0) {
     logger_log(args->logger,
                ERROR,
                "[%lu] [%s] [%s:%s] snprintf error",
@@ -123,8 +131,15 @@ int store_file(void *arg) {
                                                  RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
                                                  str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
     handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+    return 1;
   }
 
+  /* the data is written into a 'hidden' partial file next to the final one, named after the file and the client. it's
+   * renamed into place once the whole file arrived. an interrupted transfer leaves it behind, so the client can resume
+   * it with REST */
+  int tmp_len = final_path_len + snprintf(NULL, 0, "/.%s.%s.part", file_name, session.context.ip);
+
   // get the file path
   char *tmp_file = calloc(tmp_len + 1, 1);
   char *final_file = calloc(final_path_len + 1, 1);
@@ -143,22 +158,30 @@ int store_file(void *arg) {
                                                  RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
                                                  str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
     handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
-    if (tmp_file) free(tmp_file);
+    free(tmp_file);
+    free(final_file);
 
     return 1;
   }
 
-  snprintf(tmp_file, tmp_len + 1, ".%lu%s", thrd_current(), file_name);
   snprintf(final_file,
-           final_path_len,
+           final_path_len + 1,
            "%s/%s/%s",
            string_c_str(session.context.root_dir),
            string_length(session.context.curr_dir) ? string_c_str(session.context.curr_dir) : ".",
-           args->req_args.request_args);
+           path);
+  const char *dir_end = strrchr(final_file, '/');
+  snprintf(tmp_file,
+           tmp_len + 1,
+           "%.*s/.%s.%s.part",
+           (int)(dir_end - final_file),
+           final_file,
+           file_name,
+           session.context.ip);
 
-  // create a file with a prefix of .
-  FILE *fp = fopen(tmp_file, "w");
-  if (!fp) {
+  // a fresh transfer starts a new partial file. a restarted one appends to the partial file left behind
+  int fd = open(tmp_file, offset ? O_WRONLY : O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd == -1 && !(offset && errno == ENOENT)) {
     logger_log(args->logger,
                ERROR,
                "[%lu] [%s] [%s:%s] invalid path or file failed to open [%s]",
@@ -180,6 +203,75 @@ int store_file(void *arg) {
     return 1;
   }
 
+  // the client can only resume from within what was stored. anything stored past the offset is overwritten
+  struct stat statbuf = {0};
+  if (offset && (fd == -1 || fstat(fd, &statbuf) == -1 || statbuf.st_size < offset || ftruncate(fd, offset) == -1)) {
+    logger_log(args->logger,
+               ERROR,
+               "[%lu] [%s] [%s:%s] can't restart [%s] at [%jd]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               tmp_file,
+               (intmax_t)offset);
+    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                 args->logger,
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_INVALID_REST,
+                                                 "[%d] %s. [%jd] bytes stored",
+                                                 RPLY_FILE_ACTION_NOT_TAKEN_INVALID_REST,
+                                                 str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_INVALID_REST),
+                                                 (intmax_t)statbuf.st_size);
+    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+    if (fd != -1) close(fd);
+    free(tmp_file);
+    free(final_file);
+
+    return 1;
+  }
+
+  // allocate the size the client announced ahead. a file system without room for it fails the upload before the
+  // transfer starts rather than halfway through
+  int err = allocate_ahead(fd, offset, allocation_size);
+  if (err) {
+    if (err == ENOSPC) {
+      logger_log(args->logger,
+                 ERROR,
+                 "[%lu] [%s] [%s:%s] no room for [%jd] bytes of [%s]",
+                 thrd_current(),
+                 __func__,
+                 session.context.ip,
+                 session.context.port,
+                 (intmax_t)allocation_size,
+                 tmp_file);
+      enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
+                                                   args->logger,
+                                                   RPLY_FILE_ACTION_NOT_TAKEN_NOT_ENOUGH_SPACE,
+                                                   "[%d] %s",
+                                                   RPLY_FILE_ACTION_NOT_TAKEN_NOT_ENOUGH_SPACE,
+                                                   str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_NOT_ENOUGH_SPACE));
+      handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+      // the partial file is kept, as with any failed transfer, so the client can resume at the offset it had reached
+      close(fd);
+      free(tmp_file);
+      free(final_file);
+
+      return 1;
+    }
+
+    // e.g. a file system which can't allocate ahead. the file is stored as it arrives
+    logger_log(args->logger,
+               WARN,
+               "[%lu] [%s] [%s:%s] failed to allocate [%s] ahead. reason [%s]",
+               thrd_current(),
+               __func__,
+               session.context.ip,
+               session.context.port,
+               tmp_file,
+               strerr_safe(err));
+  }
+
   enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
                                                args->logger,
                                                RPLY_DATA_CONN_OPEN_STARTING_TRANSFER,
@@ -189,79 +281,54 @@ int store_file(void *arg) {
   handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
 
   // write into the file
-  // read the file and send it
-  struct data_block data = {0};
-  bool successful_transfer = true;
-  bool done = false;
-  do {
-    // failed to recv a data block
-    if (receive_data(&data, session.fds.data_fd, 0) != ERR_SUCCESS) {
-      successful_transfer = false;
-      break;
-    }
-
-    size_t bytes_written = fwrite(data.data, sizeof *data.data, data.length, fp);
-    if (data.descriptor == DESCPTR_EOF) { done = true; }
+  bool compressed = session.transfer_mode == COMPRESSED;
+  struct io_stream stream;
+  io_stream_write_init(&stream, args->io_policy, fd, offset);
+  bool successful_transfer =
+      receive_blocks(session.fds.data_fd, fd, session.block_size, compressed, &stream, &offset);
+  io_stream_end(&stream, offset);
 
-    if (bytes_written < (size_t)data.length) {
-      if (ferror(fp)) {  // encountered an error
-        successful_transfer = false;
-        break;
-      }
-    }
-  } while (!done);
-  fclose(fp);
+  // fewer bytes arrived than were allocated. the blocks allocated past the end of the file are released
+  release_allocation(fd, offset, allocation_size);
+  close(fd);
 
-  // rename the file
-  if (rename(tmp_file, final_file) != 0) {
+  // the partial file is kept, so the client can resume the transfer at the offset it reached
+  if (!successful_transfer) {
     logger_log(args->logger,
                ERROR,
-               "[%lu] [%s] [%s:%s] rename() failure [%s]",
+               "[%lu] [%s] [%s:%s] process error. [%jd] bytes stored",
                thrd_current(),
                __func__,
                session.context.ip,
                session.context.port,
-               tmp_file);
+               (intmax_t)offset);
     enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
                                                  args->logger,
                                                  RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
-                                                 "[%d] %s",
+                                                 "[%d] %s. [%jd] bytes stored",
                                                  RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
-                                                 str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
+                                                 str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR),
+                                                 (intmax_t)offset);
     handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
 
-    unlink(tmp_file);
     free(tmp_file);
     free(final_file);
-
     return 1;
   }
 
-  // send feedback
-  if (successful_transfer) {
+  // a content the server holds already is linked into place instead of being kept twice
+  bool deduplicated = deduplicate_upload(args, &session, tmp_file);
+
+  // rename the file
+  if (rename(tmp_file, final_file) != 0) {
     logger_log(args->logger,
                ERROR,
-               "[%lu] [%s] [%s:%s] the file [%s] successfully transfered",
+               "[%lu] [%s] [%s:%s] rename() failure [%s]",
                thrd_current(),
                __func__,
                session.context.ip,
                session.context.port,
-               final_file + string_length(session.context.root_dir) + 1);
-    enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
-                                                 args->logger,
-                                                 RPLY_FILE_ACTION_COMPLETE,
-                                                 "[%d] %s",
-                                                 RPLY_FILE_ACTION_COMPLETE,
-                                                 str_reply_code(RPLY_FILE_ACTION_COMPLETE));
-    handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
-  } else {
-    logger_log(args->logger,
-               ERROR,
-               "[%lu] [%s] [%s:%s] process error",
-               thrd_current(),
-               __func__,
-               session.context.ip,
-               session.context.port);
+               tmp_file);
     enum err_codes err_code = send_reply_wrapper(session.fds.control_fd,
                                                  args->logger,
                                                  RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
@@ -269,7 +336,34 @@ int store_file(void *arg) {
                                                  RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR,
                                                  str_reply_code(RPLY_FILE_ACTION_NOT_TAKEN_PROCESS_ERROR));
     handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
+    unlink(tmp_file);
+    free(tmp_file);
+    free(final_file);
+
+    return 1;
   }
+
+  // the file was uploaded again with the same content. both are links of the same object, which rename() leaves be
+  if (deduplicated) unlink(tmp_file);
+
+  // send feedback
+  logger_log(args->logger,
+             INFO,
+             "[%lu] [%s] [%s:%s] the file [%s] successfully transfered",
+             thrd_current(),
+             __func__,
+             session.context.ip,
+             session.context.port,
+             final_file + string_length(session.context.root_dir) + 1);
+  err_code = send_reply_wrapper(session.fds.control_fd,
+                                args->logger,
+                                RPLY_FILE_ACTION_COMPLETE,
+                                "[%d] %s",
+                                RPLY_FILE_ACTION_COMPLETE,
+                                str_reply_code(RPLY_FILE_ACTION_COMPLETE));
+  handle_reply_err(args->logger, args->sessions, &session, args->epollfd, err_code);
+
   free(tmp_file);
   free(final_file);
   return 0;
@@ -1,5 +1,6 @@
 #pragma once
 
-/* requests a file to be stored. the file will be stored in
- * session::context::session_root_dir/session::context::curr_dir/file_path */
+/* requests a file to be stored ('stor [-s <size>] <file_path>'). the file will be stored in
+ * session::context::session_root_dir/session::context::curr_dir/file_path. a size hint has the file allocated ahead,
+ * as an ALLO before the STOR does (see allocate.h) */
 int store_file(void *arg);
\ No newline at end of file
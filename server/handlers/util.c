@@ -1,15 +1,36 @@
 #include "util.h"
 #include <ctype.h>
 #include <errno.h>
+#include <inttypes.h>  // strtoimax()
 #include <netdb.h>
 #include <stdarg.h>  // vsnprintf()
 #include <stdio.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <stdlib.h>
 #include <sys/stat.h>  // stat()
-#include <unistd.h>    // getcwd()
+#include <sys/uio.h>   // pwritev()
+#include <unistd.h>    // getcwd(), pipe(), close()
 #include "misc/util.h"
 
+#define RECEIVE_MAX_IOV 64
+#define DATA_BLOCK_EXT_HEADER_LEN (sizeof(uint8_t) + sizeof(uint32_t))  // descriptor + 32 bit length
+
+static tss_t worker_pipe_key;
+static once_flag worker_pipe_once = ONCE_FLAG_INIT;
+static bool worker_pipe_key_valid;
+
+static void destroy_worker_pipe(void *pipefd) {
+  int *fds = pipefd;
+  close(fds[0]);
+  close(fds[1]);
+  free(fds);
+}
+
+static void init_worker_pipe_key(void) {
+  worker_pipe_key_valid = tss_create(&worker_pipe_key, destroy_worker_pipe) == thrd_success;
+}
+
 char *tolower_str(char *str, size_t len) {
   if (!str || !len) return NULL;
 
@@ -64,7 +85,7 @@ enum err_codes send_reply_wrapper(int sockfd,
 }
 
 void handle_reply_err(struct logger *logger,
-                      struct vector_s *sessions,
+                      struct hash_table_s *sessions,
                       struct session *session,
                       int epollfd,
                       enum err_codes err) {
@@ -120,6 +141,20 @@ const char *trim_str(const char *str) {
   return ptr;
 }
 
+const char *parse_number(const char *str, off_t *number) {
+  if (!str || !number) return NULL;
+
+  char *end = NULL;
+  errno = 0;
+  intmax_t value = strtoimax(str, &end, 10);
+  if (errno || end == str || value < 0 || (*end && !isspace((unsigned char)*end))) return NULL;
+
+  *number = (off_t)value;
+  if ((intmax_t)*number != value) return NULL;
+
+  return trim_str(end);
+}
+
 bool validate_path(const char *path, struct logger *logger) {
   if (!path) return false;
 
@@ -198,3 +233,219 @@ struct string *get_path(struct session *session) {
 
   return path;
 }
+
+off_t take_restart_offset(struct hash_table_s *sessions, struct logger *logger, struct session *session) {
+  if (!session) return 0;
+
+  off_t offset = session->restart_offset;
+  if (!offset) return 0;
+
+  session->restart_offset = 0;
+  if (!update_session(sessions, logger, session)) {
+    logger_log(logger,
+               ERROR,
+               "[%lu] [%s] failed to reset the restart offset of [%s:%s]",
+               thrd_current(),
+               __func__,
+               session->context.ip,
+               session->context.port);
+  }
+
+  return offset;
+}
+
+off_t take_allocation_size(struct hash_table_s *sessions, struct logger *logger, struct session *session) {
+  if (!session) return 0;
+
+  off_t size = session->allocation_size;
+  if (!size) return 0;
+
+  session->allocation_size = 0;
+  if (!update_session(sessions, logger, session)) {
+    logger_log(logger,
+               ERROR,
+               "[%lu] [%s] failed to reset the allocation size of [%s:%s]",
+               thrd_current(),
+               __func__,
+               session->context.ip,
+               session->context.port);
+  }
+
+  return size;
+}
+
+const int *get_worker_pipe(void) {
+  call_once(&worker_pipe_once, init_worker_pipe_key);
+  if (!worker_pipe_key_valid) return NULL;
+
+  int *pipefd = tss_get(worker_pipe_key);
+  if (pipefd) return pipefd;
+
+  pipefd = malloc(2 * sizeof *pipefd);
+  if (!pipefd) return NULL;
+
+  if (pipe(pipefd) == -1) {
+    free(pipefd);
+    return NULL;
+  }
+
+  if (tss_set(worker_pipe_key, pipefd) != thrd_success) {
+    destroy_worker_pipe(pipefd);
+    return NULL;
+  }
+  return pipefd;
+}
+
+void reset_worker_pipe(void) {
+  call_once(&worker_pipe_once, init_worker_pipe_key);
+  if (!worker_pipe_key_valid) return;
+
+  int *pipefd = tss_get(worker_pipe_key);
+  if (!pipefd) return;
+
+  tss_set(worker_pipe_key, NULL);
+  destroy_worker_pipe(pipefd);
+}
+
+/* writes iov_count buffers into fd at *offset. handles partial writes. advances *offset by the number of bytes written.
+ * returns true on success, false otherwise */
+static bool write_blocks(int fd, struct iovec *iov, int iov_count, off_t *offset) {
+  while (iov_count) {
+    ssize_t written = pwritev(fd, iov, iov_count, *offset);
+    if (written == -1) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    *offset += written;
+
+    // skip what was written. the first buffer left might have been written partially
+    while (iov_count && (size_t)written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      iov_count--;
+    }
+    if (iov_count) {
+      iov->iov_base = (uint8_t *)iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+  return true;
+}
+
+bool receive_blocks(int data_fd,
+                    int fd,
+                    uint32_t block_size,
+                    bool compressed,
+                    struct io_stream *stream,
+                    off_t *offset) {
+  // a compressed block is always shorter than the block size. in compressed mode the reader buffer holds a whole block,
+  // so compressed blocks are never cut short
+  size_t capacity = STREAM_READER_LEN;
+  if (compressed && capacity < block_size + DATA_BLOCK_EXT_HEADER_LEN) capacity = block_size + DATA_BLOCK_EXT_HEADER_LEN;
+
+  // compressed blocks are decompressed into a buffer of their own, which holds at least a block
+  size_t inflated_capacity = STREAM_READER_LEN < block_size ? block_size : STREAM_READER_LEN;
+  uint8_t *inflated = compressed ? malloc(inflated_capacity) : NULL;
+
+  // the data connection is read through a stream reader: every block already buffered is written with a single
+  // pwritev() straight out of the reader buffer (or out of the decompression buffer)
+  struct stream_reader reader;
+  bool success = (!compressed || inflated) && stream_reader_init(&reader, data_fd, 0, capacity);
+  if (!success) {
+    free(inflated);
+    return false;
+  }
+  reader.max_length = block_size;  // blocks which don't fit in the buffer are spliced straight into the file
+
+  bool done = false;
+  while (!done) {
+    struct iovec iov[RECEIVE_MAX_IOV];
+    int iov_count = 0;
+    size_t inflated_len = 0;
+    struct data_view view = {0};
+    do {
+      // failed to recv a data block
+      if (stream_reader_next_data(&reader, &view) != ERR_SUCCESS) {
+        success = false;
+        break;
+      }
+
+      if (view.descriptor & DESCPTR_COMPRESSED) {
+        // only a session in compressed mode may send compressed blocks
+        ssize_t len = compressed ? data_view_decompress(&view, inflated + inflated_len, block_size) : -1;
+        if (len == -1) {
+          success = false;
+          break;
+        }
+
+        if (len) iov[iov_count++] = (struct iovec){.iov_base = inflated + inflated_len, .iov_len = (size_t)len};
+        inflated_len += (size_t)len;
+      } else if (view.length) {
+        iov[iov_count++] = (struct iovec){.iov_base = (void *)view.data, .iov_len = view.length};
+      }
+      if (view.descriptor & DESCPTR_EOF) { done = true; }
+    } while (!done && !view.remaining && iov_count < RECEIVE_MAX_IOV &&
+             inflated_capacity - inflated_len >= block_size && stream_reader_has_data(&reader));
+
+    // a large upload collects its blocks into the buffer of a direct writer
+    struct direct_writer *writer = io_stream_direct_writer(stream);
+    if (!success || !(writer ? direct_writer_writev(writer, iov, iov_count, offset)
+                             : write_blocks(fd, iov, iov_count, offset))) {
+      success = false;
+      break;
+    }
+    io_stream_written(stream, *offset);
+
+    // a block too large for the reader buffer. recv the rest of it into the buffer of the writer, or splice it from
+    // the socket into the file
+    if (view.remaining) {
+      writer = io_stream_direct_writer(stream);
+      if (writer) {
+        success = direct_writer_receive(writer, data_fd, view.remaining, offset);
+      } else {
+        const int *pipefd = get_worker_pipe();
+        success = pipefd && receive_file_data(data_fd, fd, pipefd, offset, view.remaining) == ERR_SUCCESS;
+        if (!success) reset_worker_pipe();  // the pipe might hold leftovers of the failed block
+      }
+      if (!success) break;
+      io_stream_written(stream, *offset);
+    }
+  }
+  // whatever the writer holds back is written either way, so *offset tells how much was stored
+  if (!io_stream_flush(stream, offset)) success = false;
+  stream_reader_destroy(&reader);
+  free(inflated);
+
+  return success;
+}
+
+bool deduplicate_upload(struct args *args, struct session *session, const char *path) {
+  if (!args || !session || !path || !args->content_store) return false;
+
+  bool deduplicated = false;
+  if (!content_store_add(args->content_store, path, &deduplicated)) {
+    int err = errno;
+    logger_log(args->logger,
+               WARN,
+               "[%lu] [%s] [%s:%s] failed to deduplicate [%s]. reason [%s]",
+               thrd_current(),
+               __func__,
+               session->context.ip,
+               session->context.port,
+               path,
+               strerr_safe(err));
+    return false;
+  }
+
+  logger_log(args->logger,
+             INFO,
+             "[%lu] [%s] [%s:%s] [%s] %s",
+             thrd_current(),
+             __func__,
+             session->context.ip,
+             session->context.port,
+             path,
+             deduplicated ? "linked to a stored copy of its content" : "stored as a new content");
+
+  return deduplicated;
+}
@@ -1,12 +1,16 @@
 #pragma once
 #include <netdb.h>
 #include <sys/types.h>  // off_t
+#include "checksum/content_store.h"
+#include "hash_table_s.h"
+#include "listing/listing_cache.h"
 #include "logger.h"
 #include "payload.h"
 #include "session/session.h"
 #include "str.h"
 #include "thread_pool.h"
-#include "vector_s.h"
+#include "transfer/file_cache.h"
+#include "transfer/io_policy.h"
 
 #define KiB 1024.0
 #define MiB (1024 * KiB)
@@ -22,12 +26,21 @@ struct args {
   int remote_fd;
   int event_fd;
   const char *server_data_port;
-  struct vector_s *sessions;
+  struct hash_table_s *sessions;  // control fd -> struct session
+
+  /* session::fds::listen_sockfd -> session::fds::control_fd. lets the reactor find the session a passive data
+   * connection belongs to */
+  struct hash_table_s *listeners;
   struct logger *logger;
+  struct thread_pool *thread_pool;
+  struct listing_cache *listing_cache;  // may be NULL if listings aren't cached
+  struct content_store *content_store;  // may be NULL if uploads aren't deduplicated
+  struct io_policy *io_policy;          // may be NULL if transfers take no page cache hints
+  struct file_cache *file_cache;        // may be NULL if files aren't cached
 
   union {
     struct request_args req_args;
-    struct thread_pool *thread_pool;
+    struct request request;  // a complete request assembled by the reactor. used by get_request
   };
 };
 
@@ -42,6 +55,10 @@ bool is_directory(const char *const path);
 
 const char *trim_str(const char *str);
 
+/* parses a non negative decimal number off the start of str. the number must be followed by a space or by the end of
+ * str. returns a pointer to what follows the number (and the spaces after it) on success, NULL otherwise */
+const char *parse_number(const char *str, off_t *number);
+
 enum err_codes send_reply_wrapper(int sockfd, struct logger *logger, enum reply_codes reply_code, const char *fmt, ...);
 
 char *tolower_str(char *str, size_t len);
@@ -50,8 +67,42 @@ struct file_size get_file_size(off_t size_in_bytes);
 
 struct string *get_path(struct session *session);
 
+/* returns the offset the session set with REST (0 if none was set) and resets it in the sessions table, so it applies
+ * to a single transfer only */
+off_t take_restart_offset(struct hash_table_s *sessions, struct logger *logger, struct session *session);
+
+/* returns the size the session set with ALLO (0 if none was set) and resets it in the sessions table, so it applies to
+ * a single STOR only */
+off_t take_allocation_size(struct hash_table_s *sessions, struct logger *logger, struct session *session);
+
 void handle_reply_err(struct logger *logger,
-                      struct vector_s *sessions,
+                      struct hash_table_s *sessions,
                       struct session *session,
                       int epollfd,
-                      enum err_codes err);
\ No newline at end of file
+                      enum err_codes err);
+
+/* returns the calling thread pipe, used to splice() data blocks from a socket into a file. the pipe is created on first
+ * use and closed when the thread exits. returns NULL on failure */
+const int *get_worker_pipe(void);
+
+/* closes the calling thread pipe. used when a transfer failed and the pipe might hold leftovers. the next call to
+ * get_worker_pipe() creates a new one */
+void reset_worker_pipe(void);
+
+/* reads data blocks off data_fd up to (and including) the EOF block, and writes them into fd from *offset on. advances
+ * *offset by the number of bytes written, so on failure it tells how much was stored. block_size is the block size
+ * negotiated by the session. compressed blocks are accepted (and decompressed) only if compressed is set, i.e. the
+ * session is in compressed mode. every write is reported to stream (which may be NULL), and goes through its direct
+ * writer once it has one. returns true on success, false otherwise */
+bool receive_blocks(int data_fd,
+                    int fd,
+                    uint32_t block_size,
+                    bool compressed,
+                    struct io_stream *stream,
+                    off_t *offset);
+
+/* hands a complete upload at path over to the content store of args, if uploads are deduplicated. must be called
+ * before the upload is renamed into place. a failure is logged and only costs the space the upload takes. returns true
+ * if path was replaced by a link to a stored copy of its content. renaming such a link over another link of the same
+ * content does nothing, so the caller has to remove path once it renamed it */
+bool deduplicate_upload(struct args *args, struct session *session, const char *path);
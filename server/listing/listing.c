@@ -0,0 +1,530 @@
+#include "listing.h"
+
+#include <errno.h>
+#include <fcntl.h>  // open(), O_DIRECTORY
+#include <grp.h>    // getgrgid_r()
+#include <limits.h>  // PATH_MAX
+#include <pwd.h>     // getpwuid_r()
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>     // fstatat()
+#include <sys/syscall.h>  // SYS_getdents64
+#include <time.h>
+#include <unistd.h>  // syscall(), readlinkat(), close()
+
+#define DENTS_LEN (32 * 1024)
+#define RENDER_INIT_LEN (16 * 1024)
+#define NAME_LEN 64
+#define SIZE_LEN 16
+#define MODE_LEN 11
+#define TIME_LEN 32
+#define PW_BUF_LEN 1024
+#define SIX_MONTHS (60L * 60 * 24 * 365 / 2)
+
+/* the record getdents64() fills its buffer with */
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+struct entry {
+  char *name;
+  char *link;  // the target of a symbolic link. NULL for anything else
+  struct stat stat;
+
+  char owner[NAME_LEN];
+  char group[NAME_LEN];
+  char size[SIZE_LEN];
+};
+
+struct listing {
+  enum listing_format format;
+  struct entry *entries;
+  size_t count;
+  size_t next;  // the next entry to be formatted
+
+  // the cursor of the next page. -1 once the end of the directory was reached
+  int64_t next_cursor;
+
+  // the widths of the aligned columns
+  int nlink_width;
+  int owner_width;
+  int group_width;
+  int size_width;
+
+  time_t now;
+};
+
+/* formats a size the way ls -h does: rounded up, with a single decimal digit below 10 */
+static void format_size(off_t size, char *buf, size_t len) {
+  static const char units[] = "KMGTPE";
+  if (size < 1024) {
+    snprintf(buf, len, "%jd", (intmax_t)size);
+    return;
+  }
+
+  uintmax_t bytes = (uintmax_t)size;
+  uintmax_t div = 1024;
+  size_t unit = 0;
+  while (bytes / div >= 1024 && unit < sizeof units - 2) {
+    div *= 1024;
+    unit++;
+  }
+
+  uintmax_t tenths = bytes / div * 10 + ((bytes % div) * 10 + div - 1) / div;
+  if (tenths < 100) {
+    snprintf(buf, len, "%ju.%ju%c", tenths / 10, tenths % 10, units[unit]);
+    return;
+  }
+
+  uintmax_t whole = bytes / div + (bytes % div != 0);
+  if (whole >= 1024 && unit < sizeof units - 2) {
+    snprintf(buf, len, "1.0%c", units[unit + 1]);
+    return;
+  }
+  snprintf(buf, len, "%ju%c", whole, units[unit]);
+}
+
+static void format_mode(mode_t mode, char *buf) {
+  buf[0] = S_ISDIR(mode)    ? 'd'
+           : S_ISLNK(mode)  ? 'l'
+           : S_ISCHR(mode)  ? 'c'
+           : S_ISBLK(mode)  ? 'b'
+           : S_ISFIFO(mode) ? 'p'
+           : S_ISSOCK(mode) ? 's'
+                            : '-';
+
+  static const char rwx[] = "rwxrwxrwx";
+  for (int i = 0; i < 9; i++) {
+    buf[i + 1] = mode & (1 << (8 - i)) ? rwx[i] : '-';
+  }
+
+  if (mode & S_ISUID) buf[3] = buf[3] == 'x' ? 's' : 'S';
+  if (mode & S_ISGID) buf[6] = buf[6] == 'x' ? 's' : 'S';
+  if (mode & S_ISVTX) buf[9] = buf[9] == 'x' ? 't' : 'T';
+  buf[MODE_LEN - 1] = 0;
+}
+
+static void format_time(time_t mtime, time_t now, char *buf, size_t len) {
+  struct tm tm = {0};
+  if (!localtime_r(&mtime, &tm)) {
+    snprintf(buf, len, "?");
+    return;
+  }
+
+  // like ls: the time of day for recent files, the year for old (or future) ones
+  bool recent = mtime <= now && now - mtime < SIX_MONTHS;
+  strftime(buf, len, recent ? "%b %e %H:%M" : "%b %e  %Y", &tm);
+}
+
+/* the name of the owner of an entry. the last lookup is reused since most entries share an owner */
+static void format_owner(uid_t uid, char *buf, size_t len, uid_t *last_uid, const char **last_name) {
+  if (*last_name && *last_uid == uid) {
+    snprintf(buf, len, "%s", *last_name);
+    return;
+  }
+
+  struct passwd pwd;
+  struct passwd *result = NULL;
+  char tmp[PW_BUF_LEN];
+  if (getpwuid_r(uid, &pwd, tmp, sizeof tmp, &result) == 0 && result) {
+    snprintf(buf, len, "%s", pwd.pw_name);
+  } else {
+    snprintf(buf, len, "%ju", (uintmax_t)uid);
+  }
+
+  *last_uid = uid;
+  *last_name = buf;
+}
+
+static void format_group(gid_t gid, char *buf, size_t len, gid_t *last_gid, const char **last_name) {
+  if (*last_name && *last_gid == gid) {
+    snprintf(buf, len, "%s", *last_name);
+    return;
+  }
+
+  struct group grp;
+  struct group *result = NULL;
+  char tmp[PW_BUF_LEN];
+  if (getgrgid_r(gid, &grp, tmp, sizeof tmp, &result) == 0 && result) {
+    snprintf(buf, len, "%s", grp.gr_name);
+  } else {
+    snprintf(buf, len, "%ju", (uintmax_t)gid);
+  }
+
+  *last_gid = gid;
+  *last_name = buf;
+}
+
+/* the facts of an MLSD line. the value of type and the layout of modify and unique are what other servers (proftpd,
+ * pure-ftpd) use, so existing parsers handle them */
+static int format_facts(const struct stat *stat, const char *name, char *buf, size_t size) {
+  const char *type = S_ISDIR(stat->st_mode)   ? "dir"
+                     : S_ISREG(stat->st_mode) ? "file"
+                     : S_ISLNK(stat->st_mode) ? "OS.unix=symlink"
+                                              : "OS.unix=special";
+
+  char modify[TIME_LEN] = "19700101000000";
+  struct tm tm = {0};
+  if (gmtime_r(&stat->st_mtim.tv_sec, &tm)) strftime(modify, sizeof modify, "%Y%m%d%H%M%S", &tm);
+
+  return snprintf(buf,
+                  size,
+                  "type=%s;size=%jd;modify=%s.%03ld;unique=%jxU%jx;UNIX.mode=%04o; %s",
+                  type,
+                  (intmax_t)stat->st_size,
+                  modify,
+                  stat->st_mtim.tv_nsec / 1000000,
+                  (uintmax_t)stat->st_dev,
+                  (uintmax_t)stat->st_ino,
+                  (unsigned)(stat->st_mode & 07777),
+                  name);
+}
+
+static int width(uintmax_t num) {
+  int digits = 1;
+  for (; num >= 10; num /= 10) {
+    digits++;
+  }
+  return digits;
+}
+
+static int cmpr_entries(const void *a, const void *b) {
+  const struct entry *entry_a = a;
+  const struct entry *entry_b = b;
+  return strcmp(entry_a->name, entry_b->name);
+}
+
+/* reads the names of the (non hidden) entries of dirfd, up to limit of them (0 for all of them). once limit entries
+ * were read, listing::next_cursor is set to the position past the last one, unless there are no more entries left.
+ * returns true on success, false otherwise */
+static bool read_names(struct listing *listing, int dirfd, size_t limit) {
+  char *dents = malloc(DENTS_LEN);
+  if (!dents) return false;
+
+  listing->next_cursor = -1;
+  int64_t cursor = -1;
+
+  size_t capacity = 0;
+  for (;;) {
+    long nread = syscall(SYS_getdents64, dirfd, dents, DENTS_LEN);
+    if (nread == -1) goto cleanup;
+    if (nread == 0) break;
+
+    for (long pos = 0; pos < nread;) {
+      struct linux_dirent64 *dent = (struct linux_dirent64 *)(dents + pos);
+      pos += dent->d_reclen;
+
+      // hidden entries (including . and ..)
+      if (dent->d_name[0] == '.') continue;
+
+      // the page is full and there's at least one more entry after it
+      if (limit && listing->count == limit) {
+        listing->next_cursor = cursor;
+        goto done;
+      }
+      cursor = dent->d_off;
+
+      if (listing->count == capacity) {
+        size_t new_capacity = capacity ? capacity * 2 : 64;
+        struct entry *tmp = realloc(listing->entries, new_capacity * sizeof *tmp);
+        if (!tmp) goto cleanup;
+
+        listing->entries = tmp;
+        capacity = new_capacity;
+      }
+
+      struct entry *entry = &listing->entries[listing->count];
+      *entry = (struct entry){.name = strdup(dent->d_name)};
+      if (!entry->name) goto cleanup;
+      listing->count++;
+    }
+  }
+
+done:
+  free(dents);
+  return true;
+
+cleanup:
+  free(dents);
+  return false;
+}
+
+/* stats every entry, drops the ones which vanished in the meantime and computes the columns widths. an MLSD listing
+ * shows neither names nor link targets and isn't aligned, so only the stat is taken for it */
+static void stat_entries(struct listing *listing, int dirfd) {
+  uid_t last_uid = 0;
+  gid_t last_gid = 0;
+  const char *last_owner = NULL;
+  const char *last_group = NULL;
+
+  size_t kept = 0;
+  for (size_t i = 0; i < listing->count; i++) {
+    struct entry entry = listing->entries[i];
+
+    if (fstatat(dirfd, entry.name, &entry.stat, AT_SYMLINK_NOFOLLOW) == -1) {
+      free(entry.name);
+      continue;
+    }
+
+    if (listing->format == LISTING_MLSD) {
+      listing->entries[kept++] = entry;
+      continue;
+    }
+
+    // a link whose target can't be read is listed without it
+    if (S_ISLNK(entry.stat.st_mode)) {
+      char target[PATH_MAX];
+      ssize_t len = readlinkat(dirfd, entry.name, target, sizeof target - 1);
+      if (len >= 0) {
+        target[len] = 0;
+        entry.link = strdup(target);
+      }
+    }
+
+    struct entry *kept_entry = &listing->entries[kept++];
+    *kept_entry = entry;
+    format_owner(entry.stat.st_uid, kept_entry->owner, sizeof kept_entry->owner, &last_uid, &last_owner);
+    format_group(entry.stat.st_gid, kept_entry->group, sizeof kept_entry->group, &last_gid, &last_group);
+    format_size(entry.stat.st_size, kept_entry->size, sizeof kept_entry->size);
+
+    int nlink_width = width((uintmax_t)entry.stat.st_nlink);
+    int owner_width = (int)strlen(kept_entry->owner);
+    int group_width = (int)strlen(kept_entry->group);
+    int size_width = (int)strlen(kept_entry->size);
+    if (nlink_width > listing->nlink_width) listing->nlink_width = nlink_width;
+    if (owner_width > listing->owner_width) listing->owner_width = owner_width;
+    if (group_width > listing->group_width) listing->group_width = group_width;
+    if (size_width > listing->size_width) listing->size_width = size_width;
+  }
+
+  listing->count = kept;
+}
+
+static struct listing *open_listing(int dirfd,
+                                    const char *path,
+                                    int flags,
+                                    enum listing_format format,
+                                    int64_t cursor,
+                                    size_t limit) {
+  if (!path) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  struct listing *listing = calloc(1, sizeof *listing);
+  if (!listing) return NULL;
+  listing->format = format;
+
+  int fd = openat(dirfd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC | flags);
+  if (fd == -1) goto cleanup;
+
+  if (cursor && lseek(fd, (off_t)cursor, SEEK_SET) == -1) goto cleanup;
+
+  if (!read_names(listing, fd, limit)) goto cleanup;
+
+  if (listing->count) qsort(listing->entries, listing->count, sizeof *listing->entries, cmpr_entries);
+
+  stat_entries(listing, fd);
+
+  close(fd);
+  listing->now = time(NULL);
+  return listing;
+
+cleanup:;
+  int err = errno;
+  if (fd != -1) close(fd);
+  listing_close(listing);
+  errno = err;
+  return NULL;
+}
+
+struct listing *listing_open(const char *path, enum listing_format format) {
+  return open_listing(AT_FDCWD, path, 0, format, 0, 0);
+}
+
+struct listing *listing_openat(int dirfd, const char *path, enum listing_format format) {
+  return open_listing(dirfd, path, O_NOFOLLOW, format, 0, 0);
+}
+
+struct listing *listing_open_page(const char *path, enum listing_format format, int64_t cursor, size_t limit) {
+  if (cursor < 0 || !limit) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  return open_listing(AT_FDCWD, path, 0, format, cursor, limit);
+}
+
+int64_t listing_next_cursor(const struct listing *listing) {
+  return listing ? listing->next_cursor : -1;
+}
+
+void listing_close(struct listing *listing) {
+  if (!listing) return;
+
+  for (size_t i = 0; i < listing->count; i++) {
+    free(listing->entries[i].name);
+    free(listing->entries[i].link);
+  }
+  free(listing->entries);
+  free(listing);
+}
+
+bool listing_done(const struct listing *listing) {
+  return !listing || listing->next == listing->count;
+}
+
+ssize_t listing_read(struct listing *listing, char *buf, size_t size) {
+  if (!listing || !buf) return -1;
+
+  size_t written = 0;
+  for (; listing->next < listing->count; listing->next++) {
+    struct entry *entry = &listing->entries[listing->next];
+
+    if (listing->format == LISTING_MLSD) {
+      int len = format_facts(&entry->stat, entry->name, buf + written, size - written);
+
+      // the line with its CRLF doesn't fit. it'll be the first line of the next call
+      if (len < 0 || (size_t)len + 2 >= size - written) {
+        if (written == 0) return -1;
+        break;
+      }
+
+      memcpy(buf + written + len, "\r\n", 2);
+      written += (size_t)len + 2;
+      continue;
+    }
+
+    char mode[MODE_LEN];
+    char mtime[TIME_LEN];
+    format_mode(entry->stat.st_mode, mode);
+    format_time(entry->stat.st_mtime, listing->now, mtime, sizeof mtime);
+
+    int len = snprintf(buf + written,
+                       size - written,
+                       "%s %*ju %-*s %-*s %*s %s %s%s%s\n",
+                       mode,
+                       listing->nlink_width,
+                       (uintmax_t)entry->stat.st_nlink,
+                       listing->owner_width,
+                       entry->owner,
+                       listing->group_width,
+                       entry->group,
+                       listing->size_width,
+                       entry->size,
+                       mtime,
+                       entry->name,
+                       entry->link ? " -> " : "",
+                       entry->link ? entry->link : "");
+    if (len < 0) return -1;
+
+    // the line doesn't fit. it'll be the first line of the next call
+    if ((size_t)len >= size - written) {
+      if (written == 0) return -1;
+      break;
+    }
+
+    written += (size_t)len;
+  }
+
+  return (ssize_t)written;
+}
+
+const char *listing_next_dir(const struct listing *listing, size_t *pos) {
+  if (!listing || !pos) return NULL;
+
+  for (; *pos < listing->count; (*pos)++) {
+    const struct entry *entry = &listing->entries[*pos];
+    if (S_ISDIR(entry->stat.st_mode)) return listing->entries[(*pos)++].name;
+  }
+
+  return NULL;
+}
+
+/* renders the lines of listing into a single buffer. returns the rendered listing on success, NULL on failure */
+static struct rendered_listing *render(struct listing *listing) {
+  size_t capacity = RENDER_INIT_LEN;
+  struct rendered_listing *rendered = malloc(sizeof *rendered + capacity);
+  if (!rendered) goto cleanup;
+
+  rendered->len = 0;
+  while (!listing_done(listing)) {
+    ssize_t len = listing_read(listing, rendered->data + rendered->len, capacity - rendered->len);
+    if (len > 0) {
+      rendered->len += (size_t)len;
+      continue;
+    }
+
+    // the next line doesn't fit
+    capacity *= 2;
+    struct rendered_listing *tmp = realloc(rendered, sizeof *tmp + capacity);
+    if (!tmp) goto cleanup;
+    rendered = tmp;
+  }
+
+  atomic_init(&rendered->refs, 1);
+  return rendered;
+
+cleanup:
+  free(rendered);
+  errno = ENOMEM;
+  return NULL;
+}
+
+struct rendered_listing *listing_render(const char *path, enum listing_format format) {
+  struct listing *listing = listing_open(path, format);
+  if (!listing) return NULL;
+
+  struct rendered_listing *rendered = render(listing);
+  listing_close(listing);
+  return rendered;
+}
+
+struct rendered_listing *listing_render_page(const char *path,
+                                             enum listing_format format,
+                                             int64_t cursor,
+                                             size_t limit,
+                                             int64_t *next_cursor) {
+  if (!next_cursor) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  struct listing *listing = listing_open_page(path, format, cursor, limit);
+  if (!listing) return NULL;
+
+  struct rendered_listing *rendered = render(listing);
+  *next_cursor = listing_next_cursor(listing);
+  listing_close(listing);
+  return rendered;
+}
+
+void listing_release(struct rendered_listing *rendered) {
+  if (!rendered) return;
+
+  if (atomic_fetch_sub(&rendered->refs, 1) == 1) free(rendered);
+}
+
+int listing_facts(const char *path, const char *name, char *buf, size_t size) {
+  if (!path || !name || !buf) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  struct stat stat;
+  if (fstatat(AT_FDCWD, path, &stat, AT_SYMLINK_NOFOLLOW) == -1) return -1;
+
+  int len = format_facts(&stat, name, buf, size);
+  if (len < 0 || (size_t)len >= size) {
+    errno = ERANGE;
+    return -1;
+  }
+
+  return len;
+}
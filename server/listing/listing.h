@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>  // ssize_t
+
+/* an in-process replacement for ls -lh. the directory is read with getdents64(), its entries are stat-ed with fstatat()
+ * and formatted one per line, sorted by name and aligned in columns the way ls -lh formats them. hidden entries are
+ * skipped. the listing is a snapshot of the directory at the time it was opened */
+struct listing;
+
+/* the format of the lines of a listing. LISTING_LS lines are formatted like ls -lh lines. LISTING_MLSD lines are
+ * formatted like the lines of an rfc 3659 MLSD listing: a fixed set of facts in a fixed order, terminated by CRLF:
+ * type=file;size=1234;modify=20240101120000.000;unique=803U1a2b;UNIX.mode=0644; name
+ * the size is exact (in bytes) and the modification time is in UTC with a milliseconds precision. no names are
+ * resolved and no columns are aligned, so such a listing is cheaper to produce and trivial to parse */
+enum listing_format {
+  LISTING_LS,
+  LISTING_MLSD,
+};
+
+/* reads the directory at path. returns a pointer to a heap allocated listing on success, NULL on failure (errno is set
+ * accordingly) */
+struct listing *listing_open(const char *path, enum listing_format format);
+
+/* like listing_open(), but reads a single page of at most limit entries, starting at cursor: 0 for the start of the
+ * directory, or the cursor of the previous page (see listing_next_cursor()). only the entries of the page are held
+ * in memory, so they're sorted within the page, while the pages follow the order in which the file system returns the
+ * entries. the cursor is a position in the directory stream (the d_off getdents64() reports) rather than an index,
+ * so on file systems with stable directory offsets (ext4, xfs, btrfs, tmpfs) entries which are added or removed
+ * between the pages don't shift the pages which follow */
+struct listing *listing_open_page(const char *path, enum listing_format format, int64_t cursor, size_t limit);
+
+/* returns the cursor of the page which follows the listing, or -1 if the listing reached the end of the directory */
+int64_t listing_next_cursor(const struct listing *listing);
+
+/* like listing_open(), but a relative path is resolved against the directory dirfd (or the current directory if dirfd
+ * is AT_FDCWD), and a symbolic link at path isn't followed */
+struct listing *listing_openat(int dirfd, const char *path, enum listing_format format);
+
+/* destroys the listing */
+void listing_close(struct listing *listing);
+
+/* returns true once all the lines of the listing were read */
+bool listing_done(const struct listing *listing);
+
+/* formats as many whole lines as fit into buf. returns the number of bytes written (0 once the listing is done), or -1
+ * if the next line alone doesn't fit into size bytes */
+ssize_t listing_read(struct listing *listing, char *buf, size_t size);
+
+/* iterates over the names of the directories of the listing (symbolic links to directories excluded). *pos should be
+ * 0 on the first call. returns the name of the next directory, or NULL once there are none left */
+const char *listing_next_dir(const struct listing *listing, size_t *pos);
+
+/* all the lines of a listing in a single buffer. reference counted, so a listing can be shared between a cache and the
+ * threads sending it */
+struct rendered_listing {
+  atomic_size_t refs;
+  size_t len;
+  char data[];
+};
+
+/* lists the directory at path into a single buffer. returns a rendered listing with a single reference on success,
+ * NULL on failure (errno is set accordingly) */
+struct rendered_listing *listing_render(const char *path, enum listing_format format);
+
+/* like listing_render(), but renders a single page (see listing_open_page()). next_cursor is set to the cursor of the
+ * following page, or to -1 if the page reached the end of the directory */
+struct rendered_listing *listing_render_page(const char *path,
+                                             enum listing_format format,
+                                             int64_t cursor,
+                                             size_t limit,
+                                             int64_t *next_cursor);
+
+/* drops a reference to a rendered listing. the listing is freed once the last reference is dropped */
+void listing_release(struct rendered_listing *rendered);
+
+/* formats the MLSD facts of the entry at path (a symbolic link isn't followed) followed by a space and name, without a
+ * terminating CRLF. returns the length of the string on success, -1 on failure (errno is set accordingly. ERANGE if
+ * the facts don't fit into size bytes) */
+int listing_facts(const char *path, const char *name, char *buf, size_t size);
@@ -0,0 +1,344 @@
+#include "listing_cache.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <threads.h>
+#include <unistd.h>
+#include "hash_table.h"
+
+#define WATCH_MASK                                                                                                    \
+  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | \
+   IN_ONLYDIR)
+#define EVENTS_LEN (64 * 1024)
+
+struct cache_entry {
+  char *key;  // see make_key()
+  int wd;  // the inotify watch of the directory. entries of the same directory share it
+
+  // NULL while the listing is being rendered
+  struct rendered_listing *listing;
+
+  // the directory changed. a listing which is being rendered right now won't be cached
+  bool stale;
+
+  // the lru list. the most recently used entry is the head
+  struct cache_entry *prev;
+  struct cache_entry *next;
+};
+
+struct listing_cache {
+  mtx_t mtx;
+
+  struct hash_table *entries;  // key -> struct cache_entry *
+  struct cache_entry *head;
+  struct cache_entry *tail;
+
+  size_t size;  // the total size of the cached listings
+  size_t max_size;
+
+  int inotify_fd;
+  int event_fd;  // writing to it wakes the watcher up when it should terminate
+  thrd_t watcher;
+
+  struct logger *logger;
+};
+
+static int cmpr_keys(const void *key, const void *other) {
+  return strcmp(key, other);
+}
+
+/* the key of a listing: its format followed by path without repeated and trailing slashes, so every listing of a
+ * directory has a single key. returns a heap allocated key on success, NULL on failure */
+static char *make_key(const char *path, enum listing_format format) {
+  size_t len = strlen(path);
+  char *key = malloc(len + 2);
+  if (!key) return NULL;
+
+  key[0] = format == LISTING_MLSD ? 'M' : 'L';
+  size_t pos = 1;
+  for (size_t i = 0; i < len; i++) {
+    if (path[i] == '/' && pos > 1 && key[pos - 1] == '/') continue;
+    key[pos++] = path[i];
+  }
+  if (pos > 2 && key[pos - 1] == '/') pos--;
+  key[pos] = 0;
+
+  return key;
+}
+
+/* the directory path of a key */
+static const char *key_path(const char *key) {
+  return key + 1;
+}
+
+static void lru_unlink(struct listing_cache *cache, struct cache_entry *entry) {
+  if (entry->prev) {
+    entry->prev->next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+
+  if (entry->next) {
+    entry->next->prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+
+  entry->prev = entry->next = NULL;
+}
+
+static void lru_push_front(struct listing_cache *cache, struct cache_entry *entry) {
+  entry->prev = NULL;
+  entry->next = cache->head;
+  if (cache->head) cache->head->prev = entry;
+  cache->head = entry;
+  if (!cache->tail) cache->tail = entry;
+}
+
+static struct cache_entry *find_entry(struct listing_cache *cache, const char *key) {
+  struct cache_entry **entry = table_get(cache->entries, key, strlen(key) + 1);
+  return entry ? *entry : NULL;
+}
+
+/* creates an entry for key and starts watching its directory. the entry takes ownership of key. returns the entry on
+ * success, NULL otherwise (key isn't taken in such case). the cache lock must be held */
+static struct cache_entry *add_entry(struct listing_cache *cache, char *key) {
+  struct cache_entry *entry = calloc(1, sizeof *entry);
+  if (!entry) return NULL;
+
+  entry->wd = inotify_add_watch(cache->inotify_fd, key_path(key), WATCH_MASK);
+  if (entry->wd == -1) {
+    free(entry);
+    return NULL;
+  }
+
+  size_t size = table_size(cache->entries);
+  table_put(cache->entries, key, strlen(key) + 1, &entry, sizeof entry);
+  if (table_size(cache->entries) == size) {
+    inotify_rm_watch(cache->inotify_fd, entry->wd);
+    free(entry);
+    return NULL;
+  }
+
+  entry->key = key;
+  lru_push_front(cache, entry);
+  return entry;
+}
+
+/* drops an entry. stops watching its directory unless another entry shares the watch. the cache lock must be held */
+static void remove_entry(struct listing_cache *cache, struct cache_entry *entry) {
+  lru_unlink(cache, entry);
+  free(table_remove(cache->entries, entry->key, strlen(entry->key) + 1));
+
+  if (entry->listing) {
+    cache->size -= entry->listing->len;
+    listing_release(entry->listing);
+  }
+
+  bool shared = false;
+  for (struct cache_entry *curr = cache->head; curr && !shared; curr = curr->next) {
+    shared = curr->wd == entry->wd;
+  }
+  if (!shared) inotify_rm_watch(cache->inotify_fd, entry->wd);  // fails harmlessly if the watch is gone already
+
+  free(entry->key);
+  free(entry);
+}
+
+/* evicts the least recently used listings until the cache is within its bounds. entries which are still being
+ * rendered aren't counted and aren't evicted. the cache lock must be held */
+static void evict(struct listing_cache *cache) {
+  struct cache_entry *entry = cache->tail;
+  while (cache->size > cache->max_size && entry) {
+    struct cache_entry *prev = entry->prev;
+    if (entry->listing) remove_entry(cache, entry);
+    entry = prev;
+  }
+}
+
+/* marks the entries of the parent directory of entry (in every format) as stale, since the parent listing shows the
+ * size and modification time of the directory of entry. the cache lock must be held */
+static void mark_parent(struct listing_cache *cache, struct cache_entry *entry) {
+  char *slash = strrchr(entry->key, '/');
+  if (!slash || slash == key_path(entry->key)) return;
+
+  char format = entry->key[0];
+  *slash = 0;
+  for (size_t i = 0; i < 2; i++) {
+    entry->key[0] = "LM"[i];
+    struct cache_entry *parent = find_entry(cache, entry->key);
+    if (parent) parent->stale = true;
+  }
+  entry->key[0] = format;
+  *slash = '/';
+}
+
+/* drops the listings marked as stale. listings which are still being rendered stay marked, so they won't be cached.
+ * the cache lock must be held */
+static void drop_stale(struct listing_cache *cache) {
+  for (struct cache_entry *entry = cache->head; entry;) {
+    struct cache_entry *next = entry->next;
+    if (entry->stale && entry->listing) remove_entry(cache, entry);
+    entry = next;
+  }
+}
+
+/* invalidates the listings of the directory watched by wd. wd -1 invalidates every listing. the cache lock must be
+ * held */
+static void invalidate(struct listing_cache *cache, int wd) {
+  for (struct cache_entry *entry = cache->head; entry; entry = entry->next) {
+    if (wd != -1 && entry->wd != wd) continue;
+
+    entry->stale = true;
+    mark_parent(cache, entry);
+  }
+
+  drop_stale(cache);
+}
+
+static int watch(void *arg) {
+  struct listing_cache *cache = arg;
+  _Alignas(struct inotify_event) char events[EVENTS_LEN];
+
+  struct pollfd fds[] = {{.fd = cache->inotify_fd, .events = POLLIN}, {.fd = cache->event_fd, .events = POLLIN}};
+  for (;;) {
+    if (poll(fds, sizeof fds / sizeof *fds, -1) == -1) {
+      if (errno == EINTR) continue;
+
+      logger_log(cache->logger, ERROR, "[%lu] [%s] poll() failure. stops watching", thrd_current(), __func__);
+      break;
+    }
+
+    if (fds[1].revents & POLLIN) break;
+
+    ssize_t len = read(cache->inotify_fd, events, sizeof events);
+    if (len <= 0) continue;
+
+    mtx_lock(&cache->mtx);  // assume never fails
+    int last_wd = -2;
+    for (char *ptr = events; ptr < events + len;) {
+      struct inotify_event *event = (struct inotify_event *)ptr;
+      ptr += sizeof *event + event->len;
+
+      // a directory which changes usually produces a burst of events
+      if (event->wd == last_wd) continue;
+      last_wd = event->wd;
+
+      // the queue overflowed and events were lost
+      invalidate(cache, event->mask & IN_Q_OVERFLOW ? -1 : event->wd);
+    }
+    mtx_unlock(&cache->mtx);  // assume never fails
+  }
+
+  return 0;
+}
+
+struct listing_cache *listing_cache_init(size_t max_size, struct logger *logger) {
+  struct listing_cache *cache = calloc(1, sizeof *cache);
+  if (!cache) return NULL;
+
+  cache->max_size = max_size;
+  cache->logger = logger;
+  cache->inotify_fd = -1;
+  cache->event_fd = -1;
+
+  if (mtx_init(&cache->mtx, mtx_plain) != thrd_success) {
+    free(cache);
+    return NULL;
+  }
+
+  cache->entries = table_init(cmpr_keys, NULL, NULL);
+  if (!cache->entries) goto cleanup;
+
+  cache->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (cache->inotify_fd == -1) goto cleanup;
+
+  cache->event_fd = eventfd(0, EFD_CLOEXEC);
+  if (cache->event_fd == -1) goto cleanup;
+
+  if (thrd_create(&cache->watcher, watch, cache) != thrd_success) goto cleanup;
+
+  return cache;
+
+cleanup:
+  if (cache->event_fd != -1) close(cache->event_fd);
+  if (cache->inotify_fd != -1) close(cache->inotify_fd);
+  table_destroy(cache->entries);
+  mtx_destroy(&cache->mtx);
+  free(cache);
+  return NULL;
+}
+
+void listing_cache_destroy(struct listing_cache *cache) {
+  if (!cache) return;
+
+  // wake the watcher up and wait for it to exit
+  uint64_t wakeup = 1;
+  if (write(cache->event_fd, &wakeup, sizeof wakeup) == -1) {
+    logger_log(cache->logger, ERROR, "[%lu] [%s] failed to wake up the watcher", thrd_current(), __func__);
+  }
+  thrd_join(cache->watcher, NULL);
+
+  while (cache->head) {
+    remove_entry(cache, cache->head);
+  }
+
+  close(cache->event_fd);
+  close(cache->inotify_fd);
+  table_destroy(cache->entries);
+  mtx_destroy(&cache->mtx);
+  free(cache);
+}
+
+struct rendered_listing *listing_cache_get(struct listing_cache *cache, const char *path, enum listing_format format) {
+  if (!cache) return listing_render(path, format);
+
+  char *key = make_key(path, format);
+  if (!key) return NULL;
+
+  mtx_lock(&cache->mtx);  // assume never fails
+  struct cache_entry *entry = find_entry(cache, key);
+  if (entry && entry->listing) {
+    struct rendered_listing *listing = entry->listing;
+    atomic_fetch_add(&listing->refs, 1);
+
+    lru_unlink(cache, entry);
+    lru_push_front(cache, entry);
+    mtx_unlock(&cache->mtx);  // assume never fails
+
+    free(key);
+    return listing;
+  }
+
+  /* a miss. render the listing outside of the lock and cache it afterwards. the directory is watched before it's read,
+   * so a change in the meantime marks the entry as stale. if another thread is rendering the same directory right now
+   * its listing is rendered separately rather than waited for */
+  struct cache_entry *own = entry ? NULL : add_entry(cache, key);
+  mtx_unlock(&cache->mtx);  // assume never fails
+  if (!own) free(key);
+
+  struct rendered_listing *listing = listing_render(path, format);
+  int err = errno;
+
+  if (own) {
+    mtx_lock(&cache->mtx);  // assume never fails
+    if (listing && !own->stale && listing->len <= cache->max_size) {
+      atomic_fetch_add(&listing->refs, 1);
+      own->listing = listing;
+      cache->size += listing->len;
+      evict(cache);
+    } else {
+      remove_entry(cache, own);
+    }
+    mtx_unlock(&cache->mtx);  // assume never fails
+  }
+
+  errno = err;
+  return listing;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include "listing.h"
+#include "logger.h"
+
+/* a server wide cache of rendered directory listings, keyed by the directory path and the listing format. bounded by the total size of the
+ * listings it holds, evicting the least recently used ones once it's full. every cached directory is watched with
+ * inotify: a background thread drops the listing of a directory (and the listing of its parent, which shows its size
+ * and modification time) as soon as an entry in it is created, deleted, moved, modified or has its attributes
+ * changed. mt-safe */
+struct listing_cache;
+
+/* creates a cache holding up to max_size bytes of listings and starts its watcher thread. the thread inherits the
+ * signal mask of the calling thread. returns a pointer to a heap allocated cache on success, NULL on failure */
+struct listing_cache *listing_cache_init(size_t max_size, struct logger *logger);
+
+/* stops the watcher thread and destroys the cache. listings handed out earlier stay valid until released */
+void listing_cache_destroy(struct listing_cache *cache);
+
+/* returns the listing of the directory at path in format: the cached one if there is one, a freshly rendered one otherwise (which
+ * is then cached). cache may be NULL, in which case the listing is always rendered. the caller owns a reference to the
+ * returned listing and must release it with listing_release(). returns NULL on failure (errno is set accordingly) */
+struct rendered_listing *listing_cache_get(struct listing_cache *cache, const char *path, enum listing_format format);
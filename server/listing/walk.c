@@ -0,0 +1,280 @@
+#include "walk.h"
+
+#include <errno.h>
+#include <fcntl.h>   // open(), O_DIRECTORY
+#include <limits.h>  // PATH_MAX
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>  // close()
+#include "listing.h"
+
+#define CHUNK_INIT_LEN (16 * 1024)
+
+/* a directory waiting to be listed. the path is relative to the root of the walk */
+struct dir {
+  struct dir *next;
+  char path[];
+};
+
+struct walk {
+  int rootfd;
+
+  mtx_t mtx;
+  cnd_t dirs_cnd;    // a directory was queued (or the walk is over)
+  cnd_t chunks_cnd;  // a chunk was queued (or the walk is over)
+  cnd_t space_cnd;   // a chunk was taken by the reader (or the walk was stopped)
+
+  // the directories waiting to be listed. a stack, so the walk goes depth first and the queue stays short
+  struct dir *dirs;
+
+  // the number of directories which are either queued or being listed. the walk is done once it drops to 0
+  size_t pending;
+
+  struct walk_chunk *head;
+  struct walk_chunk *tail;
+  size_t buffered;
+  size_t max_buffered;
+
+  bool stopped;
+
+  thrd_t *walkers;
+  size_t walkers_num;
+};
+
+/* queues a directory to be listed. the walk lock must be held. returns true on success, false otherwise */
+static bool push_dir(struct walk *walk, const char *parent, const char *name) {
+  size_t len = name ? strlen(parent) + 1 + strlen(name) : strlen(parent);
+  if (len + 1 > PATH_MAX) return false;
+
+  struct dir *dir = malloc(sizeof *dir + len + 1);
+  if (!dir) return false;
+
+  if (name) {
+    snprintf(dir->path, len + 1, "%s/%s", parent, name);
+  } else {
+    memcpy(dir->path, parent, len + 1);
+  }
+
+  dir->next = walk->dirs;
+  walk->dirs = dir;
+  walk->pending++;
+  cnd_signal(&walk->dirs_cnd);
+  return true;
+}
+
+/* doubles the capacity of a chunk. returns the chunk on success, NULL on failure (the chunk is freed in such case) */
+static struct walk_chunk *grow_chunk(struct walk_chunk *chunk, size_t *capacity) {
+  *capacity *= 2;
+  struct walk_chunk *tmp = realloc(chunk, sizeof *tmp + *capacity);
+  if (!tmp) free(chunk);
+  return tmp;
+}
+
+/* renders the listing of a single directory into a chunk. returns the chunk on success, NULL on failure */
+static struct walk_chunk *render_chunk(const char *path, struct listing *listing) {
+  size_t capacity = CHUNK_INIT_LEN;
+  struct walk_chunk *chunk = malloc(sizeof *chunk + capacity);
+  if (!chunk) return NULL;
+
+  // path is at most PATH_MAX long, which always fits
+  chunk->next = NULL;
+  chunk->len = (size_t)snprintf(chunk->data, capacity, "%s:\n", path);
+
+  while (!listing_done(listing)) {
+    ssize_t len = listing_read(listing, chunk->data + chunk->len, capacity - chunk->len);
+    if (len > 0) {
+      chunk->len += (size_t)len;
+      continue;
+    }
+
+    // the next line doesn't fit
+    chunk = grow_chunk(chunk, &capacity);
+    if (!chunk) return NULL;
+  }
+
+  // the empty line which separates the directories
+  if (chunk->len == capacity) {
+    chunk = grow_chunk(chunk, &capacity);
+    if (!chunk) return NULL;
+  }
+  chunk->data[chunk->len++] = '\n';
+
+  return chunk;
+}
+
+/* hands a chunk over to the reader. waits for the reader to take earlier chunks if too many bytes are waiting. the walk
+ * lock must be held */
+static void push_chunk(struct walk *walk, struct walk_chunk *chunk) {
+  while (!walk->stopped && walk->head && walk->buffered + chunk->len > walk->max_buffered) {
+    cnd_wait(&walk->space_cnd, &walk->mtx);
+  }
+
+  if (walk->stopped) {
+    free(chunk);
+    return;
+  }
+
+  if (walk->tail) {
+    walk->tail->next = chunk;
+  } else {
+    walk->head = chunk;
+  }
+  walk->tail = chunk;
+  walk->buffered += chunk->len;
+  cnd_signal(&walk->chunks_cnd);
+}
+
+static int walker(void *arg) {
+  struct walk *walk = arg;
+
+  mtx_lock(&walk->mtx);  // assume never fails
+  for (;;) {
+    while (!walk->stopped && walk->pending && !walk->dirs) {
+      cnd_wait(&walk->dirs_cnd, &walk->mtx);
+    }
+    if (walk->stopped || !walk->pending) break;
+
+    struct dir *dir = walk->dirs;
+    walk->dirs = dir->next;
+    mtx_unlock(&walk->mtx);  // assume never fails
+
+    // list the directory outside of the lock. a directory which vanished or can't be read is skipped
+    struct listing *listing = listing_openat(walk->rootfd, dir->path, LISTING_LS);
+    struct walk_chunk *chunk = listing ? render_chunk(dir->path, listing) : NULL;
+
+    mtx_lock(&walk->mtx);  // assume never fails
+    if (listing) {
+      size_t pos = 0;
+      for (const char *name; (name = listing_next_dir(listing, &pos));) {
+        push_dir(walk, dir->path, name);
+      }
+    }
+    if (chunk) push_chunk(walk, chunk);
+
+    listing_close(listing);
+    free(dir);
+
+    // the last directory was listed. wake up everyone waiting for more
+    if (--walk->pending == 0) {
+      cnd_broadcast(&walk->dirs_cnd);
+      cnd_broadcast(&walk->chunks_cnd);
+    }
+  }
+  mtx_unlock(&walk->mtx);  // assume never fails
+
+  return 0;
+}
+
+struct walk *walk_start(const char *path, size_t walkers, size_t max_buffered) {
+  if (!path || !walkers) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  struct walk *walk = calloc(1, sizeof *walk);
+  if (!walk) return NULL;
+
+  walk->max_buffered = max_buffered;
+  walk->rootfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (walk->rootfd == -1) goto cleanup;
+
+  walk->walkers = calloc(walkers, sizeof *walk->walkers);
+  if (!walk->walkers) goto cleanup;
+
+  if (mtx_init(&walk->mtx, mtx_plain) != thrd_success) goto cleanup;
+  if (cnd_init(&walk->dirs_cnd) != thrd_success) goto cleanup_mtx;
+  if (cnd_init(&walk->chunks_cnd) != thrd_success) goto cleanup_dirs_cnd;
+  if (cnd_init(&walk->space_cnd) != thrd_success) goto cleanup_chunks_cnd;
+
+  if (!push_dir(walk, ".", NULL)) {
+    errno = ENOMEM;
+    goto cleanup_space_cnd;
+  }
+
+  for (; walk->walkers_num < walkers; walk->walkers_num++) {
+    if (thrd_create(&walk->walkers[walk->walkers_num], walker, walk) != thrd_success) break;
+  }
+
+  // a walk can do with fewer walkers, as long as there's one
+  if (!walk->walkers_num) {
+    free(walk->dirs);
+    errno = EAGAIN;
+    goto cleanup_space_cnd;
+  }
+
+  return walk;
+
+cleanup_space_cnd:
+  cnd_destroy(&walk->space_cnd);
+cleanup_chunks_cnd:
+  cnd_destroy(&walk->chunks_cnd);
+cleanup_dirs_cnd:
+  cnd_destroy(&walk->dirs_cnd);
+cleanup_mtx:
+  mtx_destroy(&walk->mtx);
+cleanup:;
+  int err = errno;
+  if (walk->rootfd != -1) close(walk->rootfd);
+  free(walk->walkers);
+  free(walk);
+  errno = err;
+  return NULL;
+}
+
+struct walk_chunk *walk_next(struct walk *walk) {
+  if (!walk) return NULL;
+
+  mtx_lock(&walk->mtx);  // assume never fails
+  while (!walk->head && walk->pending) {
+    cnd_wait(&walk->chunks_cnd, &walk->mtx);
+  }
+
+  struct walk_chunk *chunk = walk->head;
+  if (chunk) {
+    walk->head = chunk->next;
+    if (!walk->head) walk->tail = NULL;
+    walk->buffered -= chunk->len;
+    chunk->next = NULL;
+    cnd_broadcast(&walk->space_cnd);
+  }
+  mtx_unlock(&walk->mtx);  // assume never fails
+
+  return chunk;
+}
+
+void walk_stop(struct walk *walk) {
+  if (!walk) return;
+
+  mtx_lock(&walk->mtx);  // assume never fails
+  walk->stopped = true;
+  cnd_broadcast(&walk->dirs_cnd);
+  cnd_broadcast(&walk->space_cnd);
+  mtx_unlock(&walk->mtx);  // assume never fails
+
+  for (size_t i = 0; i < walk->walkers_num; i++) {
+    thrd_join(walk->walkers[i], NULL);
+  }
+
+  while (walk->dirs) {
+    struct dir *next = walk->dirs->next;
+    free(walk->dirs);
+    walk->dirs = next;
+  }
+
+  while (walk->head) {
+    struct walk_chunk *next = walk->head->next;
+    free(walk->head);
+    walk->head = next;
+  }
+
+  cnd_destroy(&walk->space_cnd);
+  cnd_destroy(&walk->chunks_cnd);
+  cnd_destroy(&walk->dirs_cnd);
+  mtx_destroy(&walk->mtx);
+  close(walk->rootfd);
+  free(walk->walkers);
+  free(walk);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+
+/* a recursive listing of a directory tree (like ls -lhR). the tree is walked by several threads at once, each of them
+ * listing a single directory at a time (with getdents64() on a descriptor opened with openat(), see listing.h). the
+ * listing of every directory is handed over as a single chunk, in the order the directories were listed rather than in
+ * a sorted one:
+ * ./sub/inner:
+ * <the lines of the directory, formatted like ls -lh lines>
+ * <an empty line>
+ * the listed directory itself is named '.'. hidden directories and symbolic links aren't descended into, and
+ * directories which can't be listed are skipped. the chunks waiting for the reader are bounded in size: once the bound
+ * is reached the walkers wait for the reader to catch up */
+struct walk;
+
+/* a chunk of the recursive listing */
+struct walk_chunk {
+  struct walk_chunk *next;
+  size_t len;
+  char data[];
+};
+
+/* starts walking the tree under path with walkers threads. at most max_buffered bytes of chunks are waited upon at
+ * any time (a single chunk larger than that is let through on its own). the threads inherit the signal mask of the
+ * calling thread. returns a pointer to a heap allocated walk on success, NULL on failure (errno is set accordingly) */
+struct walk *walk_start(const char *path, size_t walkers, size_t max_buffered);
+
+/* returns the next chunk of the listing, waiting for one to be produced if there's none yet. the caller owns the chunk
+ * and must free() it. returns NULL once the whole tree was listed */
+struct walk_chunk *walk_next(struct walk *walk);
+
+/* stops the walkers (if the walk isn't done yet), waits for them to exit and destroys the walk */
+void walk_stop(struct walk *walk);
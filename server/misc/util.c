@@ -40,7 +40,12 @@ struct addrinfo *get_addr_info(const char *host, const char *serv, int flags) {
   return info;
 }
 
-int get_passive_socket(struct logger *logger, const char *host, const char *serv, int conn_q_size, int flags) {
+int get_passive_socket(struct logger *logger,
+                       const char *host,
+                       const char *serv,
+                       int conn_q_size,
+                       int flags,
+                       bool reuse_port) {
   if (!host && !serv) return -1;
 
   struct addrinfo *info = get_addr_info(host, serv, flags);
@@ -58,6 +63,10 @@ int get_passive_socket(struct logger *logger, const char *host, const char *serv
 
     int val = 1;
     if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof val) == -1) continue;
+    if (reuse_port && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof val) == -1) {
+      close(sockfd);
+      continue;
+    }
 
     if (bind(sockfd, available->ai_addr, available->ai_addrlen) == -1) {
       close(sockfd);
@@ -221,6 +230,10 @@ bool construct_session(struct session *session, int remote_fd, struct sockaddr *
   session->fds.data_fd = -1;
   session->data_sock_type = ACTIVE;
   session->fds.listen_sockfd = -1;
+  session->block_size = DATA_BLOCK_MAX_LEN;
+  session->transfer_mode = BLOCK;
+  session->restart_offset = 0;
+  session->allocation_size = 0;
 
   // reserved for future implementation of a login system
   session->context = (struct context){.logged_in = false};
@@ -241,7 +254,7 @@ bool construct_session(struct session *session, int remote_fd, struct sockaddr *
   return true;
 }
 
-void add_session(struct vector_s *sessions, struct logger *logger, struct session *session) {
+void add_session(struct hash_table_s *sessions, struct logger *logger, struct session *session) {
   if (!sessions) return;
 
   if (session->fds.control_fd < 0) {
@@ -249,50 +262,37 @@ void add_session(struct vector_s *sessions, struct logger *logger, struct sessio
     return;
   }
 
-  vector_s_push(sessions, session);
+  if (!table_s_put(sessions, &session->fds.control_fd, session) && logger) {
+    logger_log(logger, ERROR, "[%s] failed to add session [%d]", __func__, session->fds.control_fd);
+  }
 }
 
-bool update_session(struct vector_s *sessions, struct logger *logger, struct session *update) {
-  struct session *session = vector_s_find(sessions, &update->fds.control_fd);
-  if (!session) {
-    logger_log(logger, ERROR, "[%s] couldn't find sockfd [%d]", __func__, update->fds.control_fd);
-    return false;
-  }
+bool get_session(struct hash_table_s *sessions, int fd, struct session *session) {
+  if (!sessions || !session) return false;
 
-  struct session *old = vector_s_replace(sessions, session, update);
-  if (!old) {
-    logger_log(logger, ERROR, "[%s] couldn't replace session [%d]", __func__, update->fds.control_fd);
+  return table_s_get(sessions, &fd, session);
+}
+
+bool update_session(struct hash_table_s *sessions, struct logger *logger, struct session *update) {
+  if (!table_s_replace(sessions, &update->fds.control_fd, update)) {
+    logger_log(logger, ERROR, "[%s] couldn't find sockfd [%d]", __func__, update->fds.control_fd);
     return false;
   }
-  free(old);
-  free(session);
   return true;
 }
 
-int cmpr_sessions(const void *a, const void *b) {
-  const struct session *s_a = a;
-  const struct session *s_b = b;
-
-  /* searches for the session by either fds. ignores a::data_fd alltogether. i.e. looks for a session whos either
-   * b::control_fd OR b::data_fd equal to a::control_fd*/
-  if (s_a->fds.control_fd == s_b->fds.control_fd || s_a->fds.listen_sockfd == s_b->fds.control_fd) return 0;
-  if (s_a->fds.control_fd > s_b->fds.control_fd) return 1;
-  return -1;
-}
-
-void close_session(struct vector_s *sessions, int fd) {
+void close_session(struct hash_table_s *sessions, int fd) {
   if (!sessions) return;
 
-  struct session *session = vector_s_remove(sessions, &(struct session){.fds.control_fd = fd});
-  if (!session) return;
+  struct session session;
+  if (!table_s_remove(sessions, &fd, &session)) return;
 
-  if (session->fds.control_fd > 0) close(session->fds.control_fd);
-  if (session->fds.data_fd > 0) close(session->fds.data_fd);
-  if (session->fds.listen_sockfd > 0) close(session->fds.listen_sockfd);
+  if (session.fds.control_fd > 0) close(session.fds.control_fd);
+  if (session.fds.data_fd > 0) close(session.fds.data_fd);
+  if (session.fds.listen_sockfd > 0) close(session.fds.listen_sockfd);
 
-  if (session->context.curr_dir) string_destroy(session->context.curr_dir);
-  if (session->context.root_dir) string_destroy(session->context.root_dir);
-  free(session);
+  if (session.context.curr_dir) string_destroy(session.context.curr_dir);
+  if (session.context.root_dir) string_destroy(session.context.root_dir);
 }
 
 void get_ip_and_port(int sockfd, char *ip, size_t ip_size, char *port, size_t port_size) {
@@ -4,18 +4,25 @@
 #include <stddef.h>
 #include <sys/socket.h>
 #include "hash_table.h"
+#include "hash_table_s.h"
 #include "list.h"
 #include "logger.h"
 #include "payload.h"
 #include "session/session.h"
 #include "thread_pool.h"
 #include "vector.h"
-#include "vector_s.h"
 
 struct addrinfo *get_addr_info(const char *host, const char *serv, int flags);
 
-/* opens a 'passive' socket with listen(). returns the socket fd on success, -1 on failure */
-int get_passive_socket(struct logger *logger, const char *host, const char *serv, int conn_q_size, int flags);
+/* opens a 'passive' socket with listen(). if reuse_port is true the socket is opened with SO_REUSEPORT, which lets
+ * several sockets listen on the same port (the kernel load balances incoming connections between them). returns the
+ * socket fd on success, -1 on failure */
+int get_passive_socket(struct logger *logger,
+                       const char *host,
+                       const char *serv,
+                       int conn_q_size,
+                       int flags,
+                       bool reuse_port);
 
 /* opens an 'active' socket with connect(). returns the socket fd on success, -1 on failure */
 int get_active_socket(struct logger *logger,
@@ -37,17 +44,17 @@ int unregister_fd(struct logger *logger, int epollfd, int fd, int events);
  * returns true on success, false otherwise */
 bool construct_session(struct session *session, int remote_fd, struct sockaddr *remote, socklen_t remote_len);
 
-/* adds a pair of control_sockfd, data_sockfd to the vector of these pairs used by the threads */
-void add_session(struct vector_s *sessions, struct logger *logger, struct session *session);
+/* adds a session to the sessions table. sessions are keyed by their session::fds::control_fd */
+void add_session(struct hash_table_s *sessions, struct logger *logger, struct session *session);
 
-/* updates a session returns true on success, falue on failure */
-bool update_session(struct vector_s *sessions, struct logger *logger, struct session *update);
+/* copies the session whose control fd is fd into session. returns true on success, false if there's no such session */
+bool get_session(struct hash_table_s *sessions, int fd, struct session *session);
 
-/* compr between control_sockfd, data_sockfd pair. used to initialize the vector of these pairs */
-int cmpr_sessions(const void *a, const void *b);
+/* updates a session returns true on success, falue on failure */
+bool update_session(struct hash_table_s *sessions, struct logger *logger, struct session *update);
 
-/* removes a pair of control_sockfd, data_sockfd and closes both sockfds */
-void close_session(struct vector_s *sessions, int fd);
+/* removes the session whose control fd is fd, closes all of its fds and destroys it */
+void close_session(struct hash_table_s *sessions, int fd);
 
 void destroy_task(void *task);
 
@@ -0,0 +1,470 @@
+#include "reactor.h"
+#include <errno.h>
+#include <fcntl.h>  // fcntl()
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>     // memcpy()
+#include <sys/epoll.h>  // epoll
+#include <sys/eventfd.h>
+#include <sys/socket.h>  // accept(), recv()
+#include <unistd.h>  // close(), read(), write()
+#include "handlers/get_request.h"
+#include "handlers/greet.h"
+#include "handlers/util.h"
+#include "misc/util.h"
+#include "session/session.h"
+
+static int cmpr_fds(const void *a, const void *b) {
+  const int *fd_a = a;
+  const int *fd_b = b;
+
+  return (*fd_a > *fd_b) - (*fd_a < *fd_b);
+}
+
+bool reactor_init(struct reactor *reactor,
+                  struct logger *logger,
+                  struct thread_pool *thread_pool,
+                  struct listing_cache *listing_cache,
+                  struct content_store *content_store,
+                  struct io_policy *io_policy,
+                  struct file_cache *file_cache,
+                  const char *control_port,
+                  const char *server_data_port,
+                  int conn_q_size) {
+  if (!reactor || !logger || !thread_pool) return false;
+
+  *reactor = (struct reactor){.epollfd = -1,
+                              .listen_sockfd = -1,
+                              .event_fd = -1,
+                              .thread_pool = thread_pool,
+                              .listing_cache = listing_cache,
+                              .content_store = content_store,
+                              .io_policy = io_policy,
+                              .file_cache = file_cache,
+                              .logger = logger,
+                              .server_data_port = server_data_port};
+  atomic_init(&reactor->terminate, false);
+
+  // every reactor gets its own listen socket on the same port
+  reactor->listen_sockfd = get_passive_socket(logger, NULL, control_port, conn_q_size, AI_PASSIVE, true);
+  if (reactor->listen_sockfd == -1) {
+    logger_log(logger, ERROR, "[%s] failed to retrieve a listen socket", __func__);
+    goto reactor_cleanup;
+  }
+
+  reactor->event_fd = eventfd(0, EFD_NONBLOCK);
+  if (reactor->event_fd == -1) {
+    logger_log(logger, ERROR, "[%s] failed to retrieve an event fd", __func__);
+    goto reactor_cleanup;
+  }
+
+  reactor->sessions = table_s_init(sizeof(int), sizeof(struct session), destroy_session);
+  if (!reactor->sessions) {
+    logger_log(logger, ERROR, "[%s] failed to init the sessions table", __func__);
+    goto reactor_cleanup;
+  }
+
+  reactor->listeners = table_s_init(sizeof(int), sizeof(int), NULL);
+  if (!reactor->listeners) {
+    logger_log(logger, ERROR, "[%s] failed to init the listeners table", __func__);
+    goto reactor_cleanup;
+  }
+
+  reactor->epoll_events = vector_init(sizeof(struct epoll_event));
+  if (!reactor->epoll_events) {
+    logger_log(logger, ERROR, "[%s] falied to init epoll_events vector", __func__);
+    goto reactor_cleanup;
+  }
+  vector_resize(reactor->epoll_events, REACTOR_MAX_EVENTS);
+
+  reactor->parsers = table_init(cmpr_fds, NULL, NULL);
+  if (!reactor->parsers) {
+    logger_log(logger, ERROR, "[%s] failed to init the parsers table", __func__);
+    goto reactor_cleanup;
+  }
+
+  reactor->epollfd = epoll_create1(0);
+  if (reactor->epollfd == -1) {
+    logger_log(logger, ERROR, "[%s] failed to create an epoll instance", __func__);
+    goto reactor_cleanup;
+  }
+
+  if (register_fd(logger, reactor->epollfd, reactor->listen_sockfd, EPOLLIN) != 0) {
+    logger_log(logger, ERROR, "[%s] falied to add the listen socket to the epoll instance", __func__);
+    goto reactor_cleanup;
+  }
+
+  if (register_fd(logger, reactor->epollfd, reactor->event_fd, EPOLLIN) != 0) {
+    logger_log(logger, ERROR, "[%s] falied to add the event fd to the epoll instance", __func__);
+    goto reactor_cleanup;
+  }
+
+  return true;
+
+reactor_cleanup:
+  reactor_destroy(reactor);
+  return false;
+}
+
+void reactor_destroy(struct reactor *reactor) {
+  if (!reactor) return;
+
+  if (reactor->listen_sockfd != -1) close(reactor->listen_sockfd);
+  if (reactor->event_fd != -1) close(reactor->event_fd);
+  if (reactor->epollfd != -1) close(reactor->epollfd);
+  reactor->listen_sockfd = reactor->event_fd = reactor->epollfd = -1;
+
+  if (reactor->epoll_events) vector_destroy(reactor->epoll_events, NULL);
+  if (reactor->sessions) table_s_destroy(reactor->sessions);
+  if (reactor->listeners) table_s_destroy(reactor->listeners);
+  if (reactor->parsers) table_destroy(reactor->parsers);
+  reactor->epoll_events = NULL;
+  reactor->sessions = NULL;
+  reactor->listeners = NULL;
+  reactor->parsers = NULL;
+}
+
+/* accepts a new connection on the reactor listen socket, creates a session for it and greets the client */
+static void accept_connection(struct reactor *reactor) {
+  struct logger *logger = reactor->logger;
+
+  struct sockaddr_storage remote_addr = {0};
+  socklen_t remote_addrlen = sizeof remote_addr;
+
+  int remote_fd = accept(reactor->listen_sockfd, (struct sockaddr *)&remote_addr, &remote_addrlen);
+  if (remote_fd == -1) {
+    logger_log(logger, ERROR, "[%s] accept() failue on listening socket [%d]", __func__, reactor->listen_sockfd);
+    return;
+  }
+
+  // control sockets are non-blocking. the reactor drains them without ever blocking on a slow client
+  int fd_flags = fcntl(remote_fd, F_GETFL);
+  if (fd_flags == -1 || fcntl(remote_fd, F_SETFL, fd_flags | O_NONBLOCK) == -1) {
+    logger_log(logger, ERROR, "[%s] failed to set fd [%d] as non-blocking", __func__, remote_fd);
+    close(remote_fd);
+    return;
+  }
+
+  // a previous connection might have left a parser behind for the same fd
+  struct request_parser parser;
+  request_parser_reset(&parser);
+  free(table_put(reactor->parsers, &remote_fd, sizeof remote_fd, &parser, sizeof parser));
+  if (!table_get(reactor->parsers, &remote_fd, sizeof remote_fd)) {
+    logger_log(logger, ERROR, "[%s] failed to create a request parser for fd [%d]", __func__, remote_fd);
+    close(remote_fd);
+    return;
+  }
+
+  register_fd(logger, reactor->epollfd, remote_fd, EPOLLIN | EPOLLRDHUP | EPOLLET);
+
+  struct session session = {0};
+
+  if (!construct_session(&session, remote_fd, (struct sockaddr *)&remote_addr, remote_addrlen)) {
+    logger_log(logger, ERROR, "[%s] falied to construct a session for fd [%d]", __func__, remote_fd);
+    return;
+  }
+
+  add_session(reactor->sessions, logger, &session);
+  logger_log(logger,
+             INFO,
+             "[%s] recieved a connection from [%s:%s]",
+             __func__,
+             session.context.ip,
+             session.context.port);
+
+  struct args *args = malloc(sizeof *args);
+  if (!args) {
+    logger_log(logger,
+               ERROR,
+               "[%s] memory allocation failure for thread args for [%s:%s]",
+               __func__,
+               session.context.ip,
+               session.context.port);
+    return;
+  }
+
+  args->epollfd = reactor->epollfd;
+  args->event_fd = reactor->event_fd;
+  args->logger = logger;
+  args->remote_fd = remote_fd;
+  args->server_data_port = reactor->server_data_port;
+  args->sessions = reactor->sessions;
+  args->listeners = reactor->listeners;
+  args->thread_pool = reactor->thread_pool;
+  args->listing_cache = reactor->listing_cache;
+  args->content_store = reactor->content_store;
+  args->io_policy = reactor->io_policy;
+  args->file_cache = reactor->file_cache;
+
+  // tasks of a session are hinted by its control fd, so they tend to run on the same thread
+  thread_pool_add_task_hint(reactor->thread_pool, &(struct task){.args = args, .handle_task = greet}, remote_fd);
+}
+
+/* finds the session fd belongs to. fd is either a session::fds::control_fd or a session::fds::listen_sockfd. returns
+ * true on success, false otherwise */
+static bool find_session(struct reactor *reactor, int fd, struct session *session) {
+  if (get_session(reactor->sessions, fd, session)) return true;
+
+  int control_fd;
+  if (!table_s_get(reactor->listeners, &fd, &control_fd)) return false;
+
+  // the mapping might outlive its listen socket (e.g. the session was closed in the meantime)
+  return get_session(reactor->sessions, control_fd, session) && session->fds.listen_sockfd == fd;
+}
+
+/* handles a closed (EPOLLHUP) or a failed (EPOLLERR) fd. if the fd is a session control fd the entire session is closed
+ */
+static void handle_closed_fd(struct reactor *reactor, int fd, bool error) {
+  struct logger *logger = reactor->logger;
+
+  // get the corresponding session which the fd 'tied' to
+  struct session session;
+  if (!find_session(reactor, fd, &session)) {
+    logger_log(logger, ERROR, "[%s] failed to find the session for fd [%d]", __func__, fd);
+    return;
+  }
+
+  logger_log(logger,
+             INFO,
+             error ? "[%s] the a connection [%s:%s] encountered an error" : "[%s] the a connection [%s:%s] was closed",
+             __func__,
+             session.context.ip,
+             session.context.port);
+
+  unregister_fd(logger, reactor->epollfd, fd, EPOLLIN);
+  if (fd == session.fds.listen_sockfd) table_s_remove(reactor->listeners, &fd, NULL);
+
+  // the client closed its control_fd (or it failed) - close the entire session
+  if (error || fd == session.fds.control_fd) {
+    free(table_remove(reactor->parsers, &session.fds.control_fd, sizeof session.fds.control_fd));
+    close_session(reactor->sessions, session.fds.control_fd);
+  }
+}
+
+/* hands a complete request over to the thread pool */
+static void dispatch_request(struct reactor *reactor, struct session *session, struct request *request) {
+  struct args *args = malloc(sizeof *args);
+  if (!args) {
+    logger_log(reactor->logger,
+               ERROR,
+               "[%s] memory allocation failure for thread args for [%s:%s]",
+               __func__,
+               session->context.ip,
+               session->context.port);
+    return;
+  }
+
+  args->epollfd = reactor->epollfd;
+  args->event_fd = reactor->event_fd;
+  args->logger = reactor->logger;
+  args->remote_fd = session->fds.control_fd;
+  args->server_data_port = reactor->server_data_port;
+  args->sessions = reactor->sessions;
+  args->listeners = reactor->listeners;
+  args->thread_pool = reactor->thread_pool;
+  args->listing_cache = reactor->listing_cache;
+  args->content_store = reactor->content_store;
+  args->io_policy = reactor->io_policy;
+  args->file_cache = reactor->file_cache;
+  memcpy(&args->request, request, sizeof args->request);
+
+  thread_pool_add_task_hint(reactor->thread_pool,
+                            &(struct task){.args = args, .handle_task = get_request},
+                            session->fds.control_fd);
+}
+
+/* drains a session::fds::control_fd. control sockets are edge-triggered, so the socket must be read until it would
+ * block. every complete request is dispatched to the thread pool, partial ones are kept in the session parser until
+ * the rest of their bytes arrive */
+static void read_requests(struct reactor *reactor, struct session *session) {
+  struct logger *logger = reactor->logger;
+  int fd = session->fds.control_fd;
+
+  struct request_parser *parser = table_get(reactor->parsers, &fd, sizeof fd);
+  if (!parser) {
+    logger_log(logger, ERROR, "[%s] no request parser for [%s:%s]", __func__, session->context.ip, session->context.port);
+    handle_closed_fd(reactor, fd, true);
+    return;
+  }
+
+  uint8_t buf[REQUEST_MAX_LEN];
+  for (;;) {
+    ssize_t recieved = recv(fd, buf, sizeof buf, 0);
+    if (recieved == -1) {
+      int err = errno;
+      if (err == EINTR) continue;
+      if (err == EAGAIN || err == EWOULDBLOCK) return;  // drained
+
+      logger_log(logger,
+                 ERROR,
+                 "[%s] recv() failure for [%s:%s]. reason [%s]",
+                 __func__,
+                 session->context.ip,
+                 session->context.port,
+                 strerr_safe(err));
+      handle_closed_fd(reactor, fd, true);
+      return;
+    }
+
+    if (recieved == 0) {  // the client closed its control connection
+      handle_closed_fd(reactor, fd, false);
+      return;
+    }
+
+    for (size_t pos = 0; pos < (size_t)recieved;) {
+      size_t consumed = 0;
+      enum parser_status status = request_parser_feed(parser, buf + pos, recieved - pos, &consumed);
+      pos += consumed;
+
+      /* the parser skips the body of the request. an empty request is dispatched instead, which get_request() rejects,
+       * so the client is replied to in the order of its requests */
+      if (status == PARSER_INVALID) {
+        logger_log(logger,
+                   ERROR,
+                   "[%s] [%s:%s] invalid request length [%hu]. skipping the request",
+                   __func__,
+                   session->context.ip,
+                   session->context.port,
+                   parser->request.length);
+        dispatch_request(reactor, session, &(struct request){.length = 0});
+      }
+
+      if (status == PARSER_COMPLETE) {
+        dispatch_request(reactor, session, &parser->request);
+        request_parser_reset(parser);
+      }
+    }
+  }
+}
+
+/* handles a readable session fd. could be either a control socket or a session::fds::listen_sockfd socket. if its a
+ * control socket: get a request. otherwise: accept, update the session::data_fd. invalidate session::fds::listen_sockfd
+ * afterwards (and remove it from the epoll instance) */
+static void handle_session_fd(struct reactor *reactor, int fd) {
+  struct logger *logger = reactor->logger;
+
+  struct session session;
+  if (!find_session(reactor, fd, &session)) {
+    logger_log(logger, ERROR, "[%s] couldn't find sockfd [%d]", __func__, fd);
+    return;
+  }
+
+  if (fd == session.fds.control_fd) {  // session::fds::control_fd
+    read_requests(reactor, &session);
+  } else {  // session::fds::listen_sockfd. will only happened as a result of a PASV command
+    struct sockaddr_storage remote_addr = {0};
+    socklen_t remote_addrlen = sizeof remote_addr;
+
+    int data_fd = accept(fd, (struct sockaddr *)&remote_addr, &remote_addrlen);
+    if (data_fd == -1) {
+      logger_log(logger,
+                 ERROR,
+                 "[%s] accept() failue for session [%s:%s]",
+                 __func__,
+                 session.context.ip,
+                 session.context.port);
+      return;
+    }
+
+    // stop monitor session::fds::listen_sockfd
+    unregister_fd(logger, reactor->epollfd, fd, EPOLLIN);
+    // close session::fds::listen_sockfd
+    table_s_remove(reactor->listeners, &fd, NULL);
+    close(fd);
+
+    // replace the old session
+    // the new passive data_fd. session::fds::data_fd is guaranteed to be closed and invalidated
+    session.fds.data_fd = data_fd;
+    session.fds.listen_sockfd = -1;  // invalidate session::fds::listen_sockfd
+
+    if (!update_session(reactor->sessions, logger, &session)) {
+      logger_log(logger,
+                 ERROR,
+                 "[%s] failed to update a session for [%s:%s]. dropping its data connection",
+                 __func__,
+                 session.context.ip,
+                 session.context.port);
+      close(data_fd);
+      return;
+    }
+
+    logger_log(logger,
+               INFO,
+               "[%s] established data connection for session [%s:%s]",
+               __func__,
+               session.context.ip,
+               session.context.port);
+  }
+}
+
+static int reactor_loop(void *arg) {
+  struct reactor *reactor = arg;
+  struct logger *logger = reactor->logger;
+
+  logger_log(logger,
+             INFO,
+             "[%lu] [%s] started listening on fd [%d]",
+             thrd_current(),
+             __func__,
+             reactor->listen_sockfd);
+  while (!atomic_load(&reactor->terminate)) {
+    int events_count = epoll_wait(reactor->epollfd,
+                                  (struct epoll_event *)vector_data(reactor->epoll_events),
+                                  vector_size(reactor->epoll_events),
+                                  -1);
+    int err = errno;
+    if (events_count == -1) {
+      if (err != EINTR) {
+        logger_log(logger, ERROR, "[%s] epoll error [%s] [event_count: %d]", __func__, strerr_safe(err), events_count);
+      }
+      continue;
+    }
+
+    for (int i = 0; i < events_count; i++) {
+      struct epoll_event *current = vector_at(reactor->epoll_events, i);
+      if (!current->events) continue;
+
+      if (current->events & EPOLLIN) {                        // this fd is ready to poll data from
+        if (current->data.fd == reactor->listen_sockfd) {     // the reactor 'listening' socket
+          accept_connection(reactor);
+        } else if (current->data.fd == reactor->event_fd) {  // event fd. only used to wake the reactor up
+          uint64_t discard = 0;
+          if (read(reactor->event_fd, &discard, sizeof discard) == -1) {
+            logger_log(logger, INFO, "[%s] failed to consume the value of event_fd", __func__);
+          }
+        } else {  // any other socket
+          handle_session_fd(reactor, current->data.fd);
+        }
+      } else if (current->events & EPOLLHUP) {  // this fd has been closed
+        handle_closed_fd(reactor, current->data.fd, false);
+      } else if (current->events & EPOLLERR) {  // (POLLERR / POLLNVAL)
+        handle_closed_fd(reactor, current->data.fd, true);
+      } else {
+        logger_log(logger, INFO, "[%s] events: [%d]", __func__, current->events);
+      }
+    }  // events loop
+  }    // reactor loop
+
+  logger_log(logger, INFO, "[%lu] [%s] reactor on fd [%d] stopped", thrd_current(), __func__, reactor->listen_sockfd);
+  return 0;
+}
+
+bool reactor_start(struct reactor *reactor) {
+  if (!reactor) return false;
+
+  return thrd_create(&reactor->thread, reactor_loop, reactor) == thrd_success;
+}
+
+void reactor_stop(struct reactor *reactor) {
+  if (!reactor) return;
+
+  atomic_store(&reactor->terminate, true);
+
+  // wake the reactor up in case it's blocked in epoll_wait()
+  uint64_t wakeup = 1;
+  if (write(reactor->event_fd, &wakeup, sizeof wakeup) == -1) {
+    logger_log(reactor->logger, ERROR, "[%s] failed to wake up reactor [%d]", __func__, reactor->listen_sockfd);
+  }
+
+  thrd_join(reactor->thread, NULL);
+}
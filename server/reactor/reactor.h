@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <threads.h>
+#include "checksum/content_store.h"
+#include "hash_table.h"
+#include "hash_table_s.h"
+#include "listing/listing_cache.h"
+#include "logger.h"
+#include "thread_pool.h"
+#include "transfer/file_cache.h"
+#include "transfer/io_policy.h"
+#include "vector.h"
+
+#define REACTOR_MAX_EVENTS 64
+
+/* a reactor is a single event loop running on its own thread. every reactor owns an epoll instance, a SO_REUSEPORT
+ * listen socket bound to the control port, an event fd and the sessions accepted on its listen socket. the kernel
+ * spreads incoming connections between the reactors listen sockets, so accepting and dispatching scale with the number
+ * of reactors. the thread pool and the logger are shared between all reactors */
+struct reactor {
+  thrd_t thread;
+  atomic_bool terminate;
+
+  int epollfd;
+  int listen_sockfd;
+
+  // writing to it wakes the reactor up when it should terminate
+  int event_fd;
+
+  /* control fd -> struct session. shared with the threads which handle the session requests. lookups, updates and
+   * removals are O(1) and never allocate */
+  struct hash_table_s *sessions;
+
+  /* session::fds::listen_sockfd -> session::fds::control_fd. a thread handling PASV adds the new listen socket here
+   * and to the reactor epoll instance, so the reactor finds the session once a data connection arrives */
+  struct hash_table_s *listeners;
+  struct vector *epoll_events;
+
+  /* control fd -> struct request_parser. control sockets are non-blocking and edge-triggered: the reactor drains them
+   * and assembles the requests itself, so only complete requests are handed to the thread pool. only the reactor thread
+   * touches this table */
+  struct hash_table *parsers;
+
+  struct thread_pool *thread_pool;
+  struct listing_cache *listing_cache;
+  struct content_store *content_store;
+  struct io_policy *io_policy;
+  struct file_cache *file_cache;
+  struct logger *logger;
+  const char *server_data_port;
+};
+
+/* initializes a reactor: opens its listen socket on control_port, its epoll instance and its event fd. the reactor
+ * doesn't start running until reactor_start() is called. returns true on success, false otherwise */
+bool reactor_init(struct reactor *reactor,
+                  struct logger *logger,
+                  struct thread_pool *thread_pool,
+                  struct listing_cache *listing_cache,
+                  struct content_store *content_store,
+                  struct io_policy *io_policy,
+                  struct file_cache *file_cache,
+                  const char *control_port,
+                  const char *server_data_port,
+                  int conn_q_size);
+
+/* starts the reactor event loop on a new thread. returns true on success, false otherwise */
+bool reactor_start(struct reactor *reactor);
+
+/* signals a running reactor to terminate and waits for its thread to exit */
+void reactor_stop(struct reactor *reactor);
+
+/* closes all fds owned by the reactor and destroys its sessions. the reactor must not be running */
+void reactor_destroy(struct reactor *reactor);
@@ -3,6 +3,8 @@
 #include <arpa/inet.h>  // INET6_ADDERLEN
 #include <netdb.h>      // NI_MAXSERV
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>  // off_t
 #include "str.h"
 
 #define MAX_PATH_LEN 4096
@@ -32,5 +34,17 @@ struct context {
 struct session {
   struct fds fds;
   enum { PASSIVE, ACTIVE } data_sock_type;
+
+  // the data block size negotiated with OPTS BLKSIZE. DATA_BLOCK_MAX_LEN unless the client asked for larger blocks
+  uint32_t block_size;
+
+  // the transfer mode set with MODE. in COMPRESSED mode the data blocks which shrink are sent compressed
+  enum { BLOCK, COMPRESSED } transfer_mode;
+
+  // the offset set with REST. the next RETR or STOR starts at it (and resets it)
+  off_t restart_offset;
+
+  // the size set with ALLO. the next STOR allocates the file ahead to it (and resets it)
+  off_t allocation_size;
   struct context context;
 };
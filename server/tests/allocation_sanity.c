@@ -0,0 +1,221 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "transfer/allocation.h"
+
+#define ALLOCATION_SIZE (1024 * 1024)
+
+/* creates an unlinked file in the current directory. returns its fd */
+static int temp_file(void) {
+  char path[] = "./allocation_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd != -1);
+  unlink(path);
+  return fd;
+}
+
+static void write_pattern(int fd, off_t offset, size_t len) {
+  uint8_t *buf = malloc(len);
+  assert(buf);
+  for (size_t i = 0; i < len; i++) {
+    buf[i] = (uint8_t)(offset + i);
+  }
+  assert(pwrite(fd, buf, len, offset) == (ssize_t)len);
+  free(buf);
+}
+
+static void assert_pattern(int fd, off_t offset, size_t len) {
+  uint8_t *buf = malloc(len);
+  assert(buf);
+  assert(pread(fd, buf, len, offset) == (ssize_t)len);
+  for (size_t i = 0; i < len; i++) {
+    assert(buf[i] == (uint8_t)(offset + i));
+  }
+  free(buf);
+}
+
+static struct stat stat_fd(int fd) {
+  struct stat statbuf;
+  assert(fstat(fd, &statbuf) == 0);
+  return statbuf;
+}
+
+void parse_allocation_test(void) {
+  off_t size = -1;
+
+  // 'allo <size>'
+  assert(parse_allocation("1024", &size) && size == 1024);
+  assert(parse_allocation("0", &size) && size == 0);
+  assert(parse_allocation("  2048  ", &size) && size == 2048);
+  assert(parse_allocation("9223372036854775807", &size) && size == INT64_MAX);
+
+  // 'allo <size> r <record size>'. the record size is ignored
+  assert(parse_allocation("4096 r 512", &size) && size == 4096);
+  assert(parse_allocation("4096   r   512  ", &size) && size == 4096);
+
+  // negative or overflowing sizes
+  assert(!parse_allocation("-1", &size));
+  assert(!parse_allocation("99999999999999999999", &size));
+  assert(!parse_allocation("4096 r -1", &size));
+  assert(!parse_allocation("4096 r 99999999999999999999", &size));
+
+  // trailing garbage
+  assert(!parse_allocation("", &size));
+  assert(!parse_allocation("abc", &size));
+  assert(!parse_allocation("1024abc", &size));
+  assert(!parse_allocation("1024 abc", &size));
+  assert(!parse_allocation("1024 r", &size));
+  assert(!parse_allocation("1024 r abc", &size));
+  assert(!parse_allocation("1024 r 512 1", &size));
+  assert(!parse_allocation("1024 r512", &size));
+  assert(!parse_allocation("1024 s 512", &size));
+
+  assert(!parse_allocation(NULL, &size));
+}
+
+void parse_size_hint_test(void) {
+  off_t size = -1;
+
+  // no hint
+  const char *path = parse_size_hint("file.txt", &size);
+  assert(path && strcmp(path, "file.txt") == 0 && size == 0);
+
+  path = parse_size_hint("  dir/file.txt", &size);
+  assert(path && strcmp(path, "dir/file.txt") == 0 && size == 0);
+
+  // '-s' followed by a path. not a hint but the name of the file
+  path = parse_size_hint("-sfile.txt", &size);
+  assert(path && strcmp(path, "-sfile.txt") == 0 && size == 0);
+
+  // a hint
+  path = parse_size_hint("-s 1024 file.txt", &size);
+  assert(path && strcmp(path, "file.txt") == 0 && size == 1024);
+
+  path = parse_size_hint("  -s   1024   dir/a file.txt", &size);
+  assert(path && strcmp(path, "dir/a file.txt") == 0 && size == 1024);
+
+  // a hint without a path. the path is left for the caller to reject
+  path = parse_size_hint("-s 1024", &size);
+  assert(path && !*path && size == 1024);
+
+  // invalid hints
+  assert(!parse_size_hint("-s file.txt", &size));
+  assert(!parse_size_hint("-s -1 file.txt", &size));
+  assert(!parse_size_hint("-s 99999999999999999999 file.txt", &size));
+  assert(!parse_size_hint("-s 1024file.txt", &size));
+  assert(!parse_size_hint("-s ", &size));
+
+  assert(!parse_size_hint(NULL, &size));
+}
+
+void short_transfer_test(void) {
+  // given
+  int fd = temp_file();
+
+  // when. the file is allocated ahead, but fewer bytes arrive
+  int err = allocate_ahead(fd, 0, ALLOCATION_SIZE);
+  if (err) {
+    // a file system which can't allocate ahead
+    assert(err == EOPNOTSUPP);
+    close(fd);
+    return;
+  }
+
+  struct stat statbuf = stat_fd(fd);
+  assert(statbuf.st_size == 0);
+  assert((off_t)statbuf.st_blocks * 512 >= ALLOCATION_SIZE);
+
+  write_pattern(fd, 0, 3000);
+  release_allocation(fd, 3000, ALLOCATION_SIZE);
+
+  // then. the blocks past the end of the file are released, and the data is kept
+  statbuf = stat_fd(fd);
+  assert(statbuf.st_size == 3000);
+  assert((off_t)statbuf.st_blocks * 512 < ALLOCATION_SIZE / 2);
+  assert_pattern(fd, 0, 3000);
+
+  // cleanup
+  close(fd);
+}
+
+void resumed_transfer_test(void) {
+  // given. a partial file
+  int fd = temp_file();
+  write_pattern(fd, 0, 10 * 1000);
+
+  // when. the rest of it is allocated ahead, but again fewer bytes arrive
+  int err = allocate_ahead(fd, 10 * 1000, ALLOCATION_SIZE);
+  if (err) {
+    assert(err == EOPNOTSUPP);
+    close(fd);
+    return;
+  }
+
+  struct stat statbuf = stat_fd(fd);
+  assert(statbuf.st_size == 10 * 1000);
+  assert((off_t)statbuf.st_blocks * 512 >= ALLOCATION_SIZE);
+
+  write_pattern(fd, 10 * 1000, 5000);
+  release_allocation(fd, 15 * 1000, ALLOCATION_SIZE);
+
+  // then
+  statbuf = stat_fd(fd);
+  assert(statbuf.st_size == 15 * 1000);
+  assert((off_t)statbuf.st_blocks * 512 < ALLOCATION_SIZE / 2);
+  assert_pattern(fd, 0, 15 * 1000);
+
+  // cleanup
+  close(fd);
+}
+
+void no_allocation_test(void) {
+  // given. a file no size was announced for, or one smaller than what's already stored
+  int fd = temp_file();
+  write_pattern(fd, 0, 10 * 1000);
+
+  // when
+  assert(allocate_ahead(fd, 10 * 1000, 0) == 0);
+  assert(allocate_ahead(fd, 10 * 1000, 5000) == 0);
+  release_allocation(fd, 3000, 0);
+  release_allocation(fd, 3000, 3000);
+
+  // then. the file is left alone
+  assert(stat_fd(fd).st_size == 10 * 1000);
+  assert_pattern(fd, 0, 10 * 1000);
+
+  // cleanup
+  close(fd);
+}
+
+void no_room_test(void) {
+  // given. a partial file
+  int fd = temp_file();
+  write_pattern(fd, 0, 5000);
+
+  // when. the size announced is larger than any file the file system can hold
+  int err = allocate_ahead(fd, 5000, INT64_MAX / 2);
+
+  // then. the partial file is kept as it was
+  assert(err == ENOSPC || err == EOPNOTSUPP);
+  struct stat statbuf = stat_fd(fd);
+  assert(statbuf.st_size == 5000);
+  assert((off_t)statbuf.st_blocks * 512 < ALLOCATION_SIZE / 2);
+  assert_pattern(fd, 0, 5000);
+
+  // cleanup
+  close(fd);
+}
+
+int main(void) {
+  parse_allocation_test();
+  parse_size_hint_test();
+  short_transfer_test();
+  resumed_transfer_test();
+  no_allocation_test();
+  no_room_test();
+}
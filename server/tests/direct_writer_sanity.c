@@ -0,0 +1,424 @@
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <threads.h>
+#include <unistd.h>
+#include "transfer/buffer_pool.h"
+#include "transfer/direct_writer.h"
+#include "transfer/io_policy.h"
+
+#define POOL_BUFFER_LEN (4 * DIRECT_IO_ALIGN)
+
+/* the sending end of a socket. runs on its own thread so it can't block on a full socket buffer while the writer
+ * waits for it */
+struct sender {
+  int sockfd;
+  const uint8_t *data;
+  size_t length;
+};
+
+static void fill_pattern(uint8_t *buf, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    buf[i] = (uint8_t)(i * 31 + 7);
+  }
+}
+
+static int send_data(void *arg) {
+  struct sender *sender = arg;
+  for (size_t sent = 0; sent < sender->length;) {
+    ssize_t ret = send(sender->sockfd, sender->data + sent, sender->length - sent, 0);
+    if (ret == -1) return 1;
+    sent += ret;
+  }
+  return 0;
+}
+
+/* creates an unlinked file in dir. returns its fd, or -1 if dir isn't there */
+static int temp_file(const char *dir) {
+  char path[64];
+  snprintf(path, sizeof path, "%s/direct_writer_XXXXXX", dir);
+  int fd = mkstemp(path);
+  if (fd != -1) unlink(path);
+  return fd;
+}
+
+static off_t align_up(off_t offset) {
+  return (offset + DIRECT_IO_ALIGN - 1) / DIRECT_IO_ALIGN * DIRECT_IO_ALIGN;
+}
+
+/* asserts the bytes [offset, offset + len) of fd are data */
+static void assert_content(int fd, off_t offset, const uint8_t *data, size_t len) {
+  uint8_t *buf = malloc(len + 1);
+  assert(buf);
+  assert(pread(fd, buf, len, offset) == (ssize_t)len);
+  assert(memcmp(buf, data, len) == 0);
+  free(buf);
+}
+
+/* asserts the pool has its buffer back */
+static void assert_returned(struct buffer_pool *pool) {
+  void *buffer = buffer_pool_get(pool);
+  assert(buffer);
+  buffer_pool_put(pool, buffer);
+}
+
+void buffer_pool_test(void) {
+  // given
+  struct buffer_pool *pool = buffer_pool_init(POOL_BUFFER_LEN, DIRECT_IO_ALIGN, 2);
+  assert(pool);
+  assert(buffer_pool_buffer_size(pool) == POOL_BUFFER_LEN);
+
+  // when
+  void *first = buffer_pool_get(pool);
+  void *second = buffer_pool_get(pool);
+
+  // then. the buffers are aligned, and there are no more than max_buffers of them
+  assert(first && second && first != second);
+  assert((uintptr_t)first % DIRECT_IO_ALIGN == 0);
+  assert((uintptr_t)second % DIRECT_IO_ALIGN == 0);
+  assert(!buffer_pool_get(pool));
+
+  // a returned buffer is handed out again
+  buffer_pool_put(pool, first);
+  assert(buffer_pool_get(pool) == first);
+
+  // invalid pools
+  assert(!buffer_pool_init(POOL_BUFFER_LEN, 3000, 1));
+  assert(!buffer_pool_init(POOL_BUFFER_LEN, DIRECT_IO_ALIGN, 0));
+  assert(!buffer_pool_init(0, DIRECT_IO_ALIGN, 1));
+
+  // cleanup
+  buffer_pool_put(pool, first);
+  buffer_pool_put(pool, second);
+  buffer_pool_destroy(pool);
+}
+
+/* writes the chunks into a file in dir from offset on, and checks what the writer reports after every one of them */
+void writev_test(const char *dir, off_t offset, const size_t *chunks, size_t chunks_count) {
+  // given
+  size_t length = 0;
+  for (size_t i = 0; i < chunks_count; i++) {
+    length += chunks[i];
+  }
+
+  uint8_t *data = malloc(length + 1);
+  assert(data);
+  fill_pattern(data, length);
+
+  int fd = temp_file(dir);
+  if (fd == -1) {
+    free(data);
+    return;
+  }
+
+  struct buffer_pool *pool = buffer_pool_init(POOL_BUFFER_LEN, DIRECT_IO_ALIGN, 1);
+  assert(pool);
+
+  struct direct_writer writer;
+  if (!direct_writer_init(&writer, pool, fd, offset)) {
+    // the file system doesn't support O_DIRECT. the upload stays buffered, and the pool gets its buffer back
+    assert(errno == EINVAL);
+    assert_returned(pool);
+    printf("[%s] O_DIRECT isn't supported under [%s]\n", __func__, dir);
+
+    buffer_pool_destroy(pool);
+    close(fd);
+    free(data);
+    return;
+  }
+
+  // when. every chunk is split between two iovecs
+  off_t head_end = align_up(offset);
+  off_t reported = offset;
+  size_t pos = 0;
+  for (size_t i = 0; i < chunks_count; i++) {
+    struct iovec iov[] = {{.iov_base = data + pos, .iov_len = chunks[i] / 2},
+                          {.iov_base = data + pos + chunks[i] / 2, .iov_len = chunks[i] - chunks[i] / 2}};
+    assert(direct_writer_writev(&writer, iov, 2, &reported));
+    pos += chunks[i];
+
+    // then. the unaligned head is written at once, and the rest in whole buffers only
+    off_t end = offset + (off_t)pos;
+    off_t expected = end <= head_end ? end : head_end + (end - head_end) / POOL_BUFFER_LEN * POOL_BUFFER_LEN;
+    assert(reported == expected);
+    assert_content(fd, offset, data, (size_t)(reported - offset));
+  }
+
+  assert(direct_writer_finish(&writer, &reported));
+
+  // then. the aligned part went through O_DIRECT, and the file is byte for byte the data
+  off_t end = offset + (off_t)length;
+  assert(reported == end);
+  assert(writer.written == (uintmax_t)(end > head_end ? (end - head_end) / DIRECT_IO_ALIGN * DIRECT_IO_ALIGN : 0));
+
+  struct stat statbuf;
+  assert(fstat(fd, &statbuf) == 0);
+  assert(statbuf.st_size == end);
+  assert_content(fd, offset, data, length);
+  assert_returned(pool);
+
+  // cleanup
+  buffer_pool_destroy(pool);
+  close(fd);
+  free(data);
+}
+
+void receive_test(off_t offset) {
+  // given
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  const size_t length = 100 * 1000;
+  uint8_t *data = malloc(length);
+  assert(data);
+  fill_pattern(data, length);
+
+  int fd = temp_file(".");
+  assert(fd != -1);
+
+  struct buffer_pool *pool = buffer_pool_init(POOL_BUFFER_LEN, DIRECT_IO_ALIGN, 1);
+  assert(pool);
+
+  struct direct_writer writer;
+  if (!direct_writer_init(&writer, pool, fd, offset)) {
+    assert(errno == EINVAL);
+    buffer_pool_destroy(pool);
+    close(fd);
+    free(data);
+    close(fds[0]);
+    close(fds[1]);
+    return;
+  }
+
+  struct sender sender = {.sockfd = fds[0], .data = data, .length = length};
+  thrd_t thread;
+  assert(thrd_create(&thread, send_data, &sender) == thrd_success);
+
+  // when. the payload of three blocks is recieved straight into the buffer
+  off_t reported = offset;
+  assert(direct_writer_receive(&writer, fds[1], 3000, &reported));
+  assert(direct_writer_receive(&writer, fds[1], 50 * 1000, &reported));
+  assert(direct_writer_receive(&writer, fds[1], length - 53 * 1000, &reported));
+  assert(direct_writer_finish(&writer, &reported));
+
+  // then
+  int ret;
+  thrd_join(thread, &ret);
+  assert(ret == 0);
+
+  assert(reported == offset + (off_t)length);
+  assert_content(fd, offset, data, length);
+
+  // cleanup
+  buffer_pool_destroy(pool);
+  close(fd);
+  free(data);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void failed_write_test(void) {
+  // given. the file can't grow past 3 aligned blocks, so the first buffer is written short and then fails
+  const off_t offset = 100;
+  const size_t length = 10 * DIRECT_IO_ALIGN;
+  uint8_t *data = malloc(length);
+  assert(data);
+  fill_pattern(data, length);
+
+  int fd = temp_file(".");
+  assert(fd != -1);
+
+  struct buffer_pool *pool = buffer_pool_init(POOL_BUFFER_LEN, DIRECT_IO_ALIGN, 1);
+  assert(pool);
+
+  struct direct_writer writer;
+  if (!direct_writer_init(&writer, pool, fd, offset)) {
+    assert(errno == EINVAL);
+    buffer_pool_destroy(pool);
+    close(fd);
+    free(data);
+    return;
+  }
+
+  struct rlimit limit;
+  assert(getrlimit(RLIMIT_FSIZE, &limit) == 0);
+  struct rlimit small_limit = {.rlim_cur = 3 * DIRECT_IO_ALIGN, .rlim_max = limit.rlim_max};
+  signal(SIGXFSZ, SIG_IGN);
+  assert(setrlimit(RLIMIT_FSIZE, &small_limit) == 0);
+
+  // when
+  off_t reported = offset;
+  struct iovec iov = {.iov_base = data, .iov_len = length};
+  bool written = direct_writer_writev(&writer, &iov, 1, &reported);
+  bool finished = direct_writer_finish(&writer, &reported);
+
+  assert(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+  signal(SIGXFSZ, SIG_DFL);
+
+  // then. the offset stays at the end of what was written in full: the head
+  assert(!written);
+  assert(!finished);
+  assert(reported == DIRECT_IO_ALIGN);
+  assert_content(fd, offset, data, (size_t)(reported - offset));
+  assert_returned(pool);
+
+  // cleanup
+  buffer_pool_destroy(pool);
+  close(fd);
+  free(data);
+}
+
+void failed_head_test(void) {
+  // given. a file which can't be written through its buffered fd
+  int fd = temp_file(".");
+  assert(fd != -1);
+
+  char path[32];
+  snprintf(path, sizeof path, "/proc/self/fd/%d", fd);
+  FILE *fp = fopen(path, "r");
+  assert(fp);
+
+  struct buffer_pool *pool = buffer_pool_init(POOL_BUFFER_LEN, DIRECT_IO_ALIGN, 1);
+  assert(pool);
+
+  struct direct_writer writer;
+  if (!direct_writer_init(&writer, pool, fileno(fp), 100)) {
+    assert(errno == EINVAL);
+    buffer_pool_destroy(pool);
+    fclose(fp);
+    close(fd);
+    return;
+  }
+
+  // when
+  uint8_t data[200] = {0};
+  off_t reported = 100;
+  struct iovec iov = {.iov_base = data, .iov_len = sizeof data};
+
+  // then. nothing was written, and nothing is reported. nothing was buffered either, so there's nothing to finish
+  assert(!direct_writer_writev(&writer, &iov, 1, &reported));
+  assert(reported == 100);
+  assert(direct_writer_finish(&writer, &reported));
+  assert(reported == 100);
+  assert_returned(pool);
+
+  // cleanup
+  buffer_pool_destroy(pool);
+  fclose(fp);
+  close(fd);
+}
+
+void unsupported_test(void) {
+  // given. an fd which can't be reopened with O_DIRECT
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  struct buffer_pool *pool = buffer_pool_init(POOL_BUFFER_LEN, DIRECT_IO_ALIGN, 1);
+  assert(pool);
+
+  // when
+  struct direct_writer writer;
+  errno = 0;
+  bool started = direct_writer_init(&writer, pool, fds[0], 0);
+
+  // then. the open errno is kept and the buffer goes back to the pool
+  assert(!started);
+  assert(errno && errno != EBUSY);
+  assert(!writer.buffer);
+  assert_returned(pool);
+
+  // an exhausted pool fails with EBUSY
+  void *buffer = buffer_pool_get(pool);
+  assert(!direct_writer_init(&writer, pool, fds[0], 0));
+  assert(errno == EBUSY);
+  buffer_pool_put(pool, buffer);
+
+  // cleanup
+  buffer_pool_destroy(pool);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void io_stream_fallback_test(void) {
+  // given. a policy with a single direct io buffer
+  struct io_policy *policy = io_policy_init(0, 0, DIRECT_IO_ALIGN, 1);
+  assert(policy);
+
+  int first_fd = temp_file(".");
+  int second_fd = temp_file(".");
+  int fds[2];
+  assert(first_fd != -1 && second_fd != -1);
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  struct io_stream first;
+  struct io_stream second;
+  struct io_stream unsupported;
+  io_stream_write_init(&first, policy, first_fd, 0);
+  io_stream_write_init(&second, policy, second_fd, 0);
+  io_stream_write_init(&unsupported, policy, fds[0], 0);
+
+  // when. all of them grow large enough for O_DIRECT
+  io_stream_written(&first, DIRECT_IO_ALIGN);
+  io_stream_written(&second, DIRECT_IO_ALIGN);
+  io_stream_written(&unsupported, DIRECT_IO_ALIGN);
+
+  // then. the first one takes the buffer (if the file system supports O_DIRECT), the others stay buffered
+  bool direct = io_stream_direct_writer(&first);
+  assert(!io_stream_direct_writer(&second));
+  assert(!io_stream_direct_writer(&unsupported));
+
+  off_t offset = DIRECT_IO_ALIGN;
+  assert(io_stream_flush(&first, &offset));
+  assert(io_stream_flush(&second, &offset));
+  assert(offset == DIRECT_IO_ALIGN);
+  io_stream_end(&first, offset);
+  io_stream_end(&second, offset);
+  io_stream_end(&unsupported, offset);
+
+  struct io_policy_stats stats;
+  io_policy_stats(policy, &stats);
+  assert(stats.writes == 3);
+  assert(stats.direct == (direct ? 1 : 0));
+
+  // cleanup
+  io_policy_destroy(policy);
+  close(first_fd);
+  close(second_fd);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+int main(void) {
+  buffer_pool_test();
+
+  // an unaligned head, flushes of full buffers and an unaligned tail
+  size_t chunks[] = {1, DIRECT_IO_ALIGN - 1, 7000, 20 * 1000, 3, 40 * 1000};
+  writev_test(".", 100, chunks, sizeof chunks / sizeof *chunks);
+
+  // an aligned start, whole buffers only
+  size_t whole[] = {POOL_BUFFER_LEN, POOL_BUFFER_LEN};
+  writev_test(".", 0, whole, sizeof whole / sizeof *whole);
+
+  // data which ends within the head, or within the first aligned block
+  size_t small[] = {10};
+  writev_test(".", 100, small, sizeof small / sizeof *small);
+  writev_test(".", 3 * DIRECT_IO_ALIGN, small, sizeof small / sizeof *small);
+
+  // tmpfs may not support O_DIRECT
+  writev_test("/dev/shm", 100, chunks, sizeof chunks / sizeof *chunks);
+
+  receive_test(0);
+  receive_test(777);
+  failed_write_test();
+  failed_head_test();
+  unsupported_test();
+  io_stream_fallback_test();
+}
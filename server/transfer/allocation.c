@@ -0,0 +1,66 @@
+#define _GNU_SOURCE  // fallocate()
+#include "allocation.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>  // fallocate()
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>  // ftruncate()
+
+static const char *skip_spaces(const char *str) {
+  while (isspace((unsigned char)*str))
+    str++;
+  return str;
+}
+
+/* parses a non negative number followed by either a space or the end of str. returns a pointer to what follows the
+ * number (past any spaces) on success, NULL on failure */
+static const char *parse_size(const char *str, off_t *size) {
+  char *end = NULL;
+  errno = 0;
+  intmax_t value = strtoimax(str, &end, 10);
+  if (errno || end == str || value < 0 || (*end && !isspace((unsigned char)*end))) return NULL;
+
+  *size = (off_t)value;
+  if ((intmax_t)*size != value) return NULL;
+
+  return skip_spaces(end);
+}
+
+bool parse_allocation(const char *arg, off_t *size) {
+  if (!arg || !size) return false;
+
+  const char *rest = parse_size(arg, size);
+  if (!rest || !*rest) return rest != NULL;
+
+  // a record size is meaningless for the files the server stores
+  off_t record_size;
+  if (strncmp(rest, "r ", strlen("r ")) != 0) return false;
+  rest = parse_size(skip_spaces(rest + strlen("r ")), &record_size);
+  return rest && !*rest;
+}
+
+const char *parse_size_hint(const char *arg, off_t *size) {
+  if (!arg || !size) return NULL;
+
+  *size = 0;
+  arg = skip_spaces(arg);
+  if (strncmp(arg, "-s ", strlen("-s ")) != 0) return arg;
+
+  return parse_size(skip_spaces(arg + strlen("-s ")), size);
+}
+
+int allocate_ahead(int fd, off_t offset, off_t size) {
+  if (size <= offset || fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, size - offset) == 0) return 0;
+
+  int err = errno;
+  if (err != ENOSPC && err != EDQUOT && err != EFBIG) return err;
+
+  // release whatever was allocated before the file system ran out of room
+  release_allocation(fd, offset, size);
+  return ENOSPC;
+}
+
+void release_allocation(int fd, off_t offset, off_t size) {
+  if (size > offset) (void)ftruncate(fd, offset);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <sys/types.h>  // off_t
+
+/* the size a client announces ahead of an upload, either with 'allo <size> [r <record size>]' or with a hint on the
+ * upload itself ('stor -s <size> <file_path>'). the upload allocates its file ahead to that size, so the data lands in
+ * contiguous extents, and a file system without room for it fails the upload before the transfer starts */
+
+/* parses the arguments of 'allo <size> [r <record size>]' into *size. the record size is ignored. returns true if
+ * they're valid */
+bool parse_allocation(const char *arg, off_t *size);
+
+/* parses the size hint of 'stor [-s <size>] <file_path>' into *size (0 if there's no hint). returns a pointer to the
+ * file path within arg, NULL if the hint is invalid */
+const char *parse_size_hint(const char *arg, off_t *size);
+
+/* allocates the blocks of fd from offset up to size, past the end of the file (its size doesn't change, so a partial
+ * file still tells how much was stored). returns 0 on success, ENOSPC if the file system has no room for the upload
+ * (whatever was allocated is released then), or the errno of fallocate() if it can't allocate ahead */
+int allocate_ahead(int fd, off_t offset, off_t size);
+
+/* releases the blocks allocate_ahead() allocated past offset, which is where the upload ended. a transfer which fell
+ * short of size would otherwise keep them for as long as the file exists */
+void release_allocation(int fd, off_t offset, off_t size);
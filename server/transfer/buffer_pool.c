@@ -0,0 +1,80 @@
+#include "buffer_pool.h"
+#include <stdlib.h>  // posix_memalign()
+#include <threads.h>
+
+struct buffer_pool {
+  mtx_t mtx;
+  size_t buffer_size;
+  size_t alignment;
+  size_t max_buffers;
+  size_t allocated;
+
+  // the buffers which were returned, and can be handed out again
+  void **free;
+  size_t free_count;
+};
+
+struct buffer_pool *buffer_pool_init(size_t buffer_size, size_t alignment, size_t max_buffers) {
+  if (!buffer_size || !max_buffers || !alignment || (alignment & (alignment - 1))) return NULL;
+
+  struct buffer_pool *pool = calloc(1, sizeof *pool);
+  if (!pool) return NULL;
+
+  pool->free = calloc(max_buffers, sizeof *pool->free);
+  if (!pool->free) goto pool_cleanup;
+
+  if (mtx_init(&pool->mtx, mtx_plain) != thrd_success) goto free_cleanup;
+
+  pool->buffer_size = buffer_size;
+  pool->alignment = alignment;
+  pool->max_buffers = max_buffers;
+  return pool;
+
+free_cleanup:
+  free(pool->free);
+pool_cleanup:
+  free(pool);
+  return NULL;
+}
+
+void buffer_pool_destroy(struct buffer_pool *pool) {
+  if (!pool) return;
+
+  for (size_t i = 0; i < pool->free_count; i++) {
+    free(pool->free[i]);
+  }
+  mtx_destroy(&pool->mtx);
+  free(pool->free);
+  free(pool);
+}
+
+size_t buffer_pool_buffer_size(struct buffer_pool *pool) {
+  return pool ? pool->buffer_size : 0;
+}
+
+void *buffer_pool_get(struct buffer_pool *pool) {
+  if (!pool) return NULL;
+
+  void *buffer = NULL;
+  mtx_lock(&pool->mtx);
+  if (pool->free_count) {
+    buffer = pool->free[--pool->free_count];
+  } else if (pool->allocated < pool->max_buffers) {
+    if (posix_memalign(&buffer, pool->alignment, pool->buffer_size) == 0) {
+      pool->allocated++;
+    } else {
+      buffer = NULL;
+    }
+  }
+  mtx_unlock(&pool->mtx);
+
+  return buffer;
+}
+
+void buffer_pool_put(struct buffer_pool *pool, void *buffer) {
+  if (!pool || !buffer) return;
+
+  mtx_lock(&pool->mtx);
+  pool->free[pool->free_count++] = buffer;
+  mtx_unlock(&pool->mtx);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+
+/* a bounded pool of large buffers, aligned for O_DIRECT. the buffers are allocated as they're first needed and kept
+ * for reuse once they're returned, up to max_buffers of them. mt-safe */
+struct buffer_pool;
+
+/* creates a pool of up to max_buffers buffers of buffer_size bytes, aligned to alignment (a power of 2). returns a
+ * pointer to a heap allocated pool on success, NULL on failure */
+struct buffer_pool *buffer_pool_init(size_t buffer_size, size_t alignment, size_t max_buffers);
+
+/* frees the pool and its buffers. every buffer must have been returned to it */
+void buffer_pool_destroy(struct buffer_pool *pool);
+
+/* returns the size of the buffers of pool */
+size_t buffer_pool_buffer_size(struct buffer_pool *pool);
+
+/* takes a buffer out of pool. returns NULL if all of them are in use (or can't be allocated) */
+void *buffer_pool_get(struct buffer_pool *pool);
+
+/* returns a buffer taken out of pool */
+void buffer_pool_put(struct buffer_pool *pool, void *buffer);
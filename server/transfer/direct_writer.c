@@ -0,0 +1,162 @@
+#define _GNU_SOURCE  // O_DIRECT
+#include "direct_writer.h"
+#include <errno.h>
+#include <fcntl.h>  // open()
+#include <stdio.h>  // snprintf()
+#include <string.h>
+#include <unistd.h>  // pwrite(), close()
+#include "payload.h"
+
+#define FD_PATH_LEN 32
+
+/* writes len bytes of data into fd at offset. handles partial writes. returns true on success, false otherwise */
+static bool write_all(int fd, const uint8_t *data, size_t len, off_t offset) {
+  while (len) {
+    ssize_t written = pwrite(fd, data, len, offset);
+    if (written == -1 && errno == EINTR) continue;
+    if (written == -1) return false;
+    if (written == 0) {
+      errno = EIO;
+      return false;
+    }
+
+    data += written;
+    len -= (size_t)written;
+    offset += written;
+  }
+  return true;
+}
+
+/* writes the first len bytes of the buffer (a whole number of aligned blocks) with O_DIRECT, and moves whatever
+ * follows them to the start of the buffer */
+static bool flush(struct direct_writer *writer, size_t len, off_t *offset) {
+  if (!len) return true;
+  if (!write_all(writer->direct_fd, writer->buffer, len, writer->offset)) return false;
+
+  memmove(writer->buffer, writer->buffer + len, writer->used - len);
+  writer->used -= len;
+  writer->offset += (off_t)len;
+  writer->written += len;
+  *offset = writer->offset;
+  return true;
+}
+
+/* the number of bytes (up to len) before the first aligned offset, which are written through the page cache. 0 once
+ * the head is written */
+static size_t head_len(const struct direct_writer *writer, size_t len) {
+  size_t misalignment = writer->used ? 0 : (size_t)(writer->offset % DIRECT_IO_ALIGN);
+  if (!misalignment) return 0;
+
+  return DIRECT_IO_ALIGN - misalignment < len ? DIRECT_IO_ALIGN - misalignment : len;
+}
+
+/* writes the head bytes of data through the page cache */
+static bool write_head(struct direct_writer *writer, const uint8_t *data, size_t len, off_t *offset) {
+  if (!write_all(writer->fd, data, len, writer->offset)) return false;
+
+  writer->offset += (off_t)len;
+  *offset = writer->offset;
+  return true;
+}
+
+bool direct_writer_init(struct direct_writer *writer, struct buffer_pool *pool, int fd, off_t offset) {
+  if (!writer || !pool || fd < 0 || offset < 0) {
+    errno = EINVAL;
+    return false;
+  }
+
+  *writer = (struct direct_writer){.fd = fd, .direct_fd = -1, .pool = pool, .offset = offset};
+
+  writer->buffer = buffer_pool_get(pool);
+  if (!writer->buffer) {
+    errno = EBUSY;
+    return false;
+  }
+  writer->capacity = buffer_pool_buffer_size(pool) / DIRECT_IO_ALIGN * DIRECT_IO_ALIGN;
+
+  // a second open file description of the same file. fd stays as it is for the head and the tail. fails with EINVAL
+  // if the file system doesn't support O_DIRECT
+  char path[FD_PATH_LEN];
+  snprintf(path, sizeof path, "/proc/self/fd/%d", fd);
+  writer->direct_fd = open(path, O_WRONLY | O_DIRECT | O_CLOEXEC);
+  if (writer->direct_fd == -1) {
+    int err = errno;
+    buffer_pool_put(pool, writer->buffer);
+    writer->buffer = NULL;
+    errno = err;
+    return false;
+  }
+
+  return true;
+}
+
+bool direct_writer_writev(struct direct_writer *writer, const struct iovec *iov, int iov_count, off_t *offset) {
+  if (!writer || !writer->buffer || !offset || (!iov && iov_count)) return false;
+
+  for (int i = 0; i < iov_count; i++) {
+    const uint8_t *data = iov[i].iov_base;
+    size_t len = iov[i].iov_len;
+
+    while (len) {
+      size_t head = head_len(writer, len);
+      if (head) {
+        if (!write_head(writer, data, head, offset)) return false;
+        data += head;
+        len -= head;
+        continue;
+      }
+
+      size_t copy = writer->capacity - writer->used < len ? writer->capacity - writer->used : len;
+      memcpy(writer->buffer + writer->used, data, copy);
+      writer->used += copy;
+      data += copy;
+      len -= copy;
+
+      if (writer->used == writer->capacity && !flush(writer, writer->used, offset)) return false;
+    }
+  }
+  return true;
+}
+
+bool direct_writer_receive(struct direct_writer *writer, int sockfd, size_t length, off_t *offset) {
+  if (!writer || !writer->buffer || !offset) return false;
+
+  while (length) {
+    // the buffer is empty while the head is written, and holds it on its way from the socket to the page cache
+    size_t head = head_len(writer, length);
+    if (head) {
+      if (receive_block_payload(sockfd, writer->buffer, head) != ERR_SUCCESS) return false;
+      if (!write_head(writer, writer->buffer, head, offset)) return false;
+      length -= head;
+      continue;
+    }
+
+    size_t len = writer->capacity - writer->used < length ? writer->capacity - writer->used : length;
+    if (receive_block_payload(sockfd, writer->buffer + writer->used, len) != ERR_SUCCESS) return false;
+    writer->used += len;
+    length -= len;
+
+    if (writer->used == writer->capacity && !flush(writer, writer->used, offset)) return false;
+  }
+  return true;
+}
+
+bool direct_writer_finish(struct direct_writer *writer, off_t *offset) {
+  if (!writer || !writer->buffer || !offset) return false;
+
+  // the aligned part of the buffer goes straight to the disk, the tail through the page cache
+  bool success = flush(writer, writer->used / DIRECT_IO_ALIGN * DIRECT_IO_ALIGN, offset) &&
+                 write_all(writer->fd, writer->buffer, writer->used, writer->offset);
+  if (success) {
+    writer->offset += (off_t)writer->used;
+    writer->used = 0;
+  }
+  *offset = writer->offset;
+
+  close(writer->direct_fd);
+  buffer_pool_put(writer->pool, writer->buffer);
+  writer->direct_fd = -1;
+  writer->buffer = NULL;
+
+  return success;
+}
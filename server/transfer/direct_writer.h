@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>  // off_t
+#include <sys/uio.h>    // struct iovec
+#include "buffer_pool.h"
+
+#define DIRECT_IO_ALIGN 4096  // the alignment O_DIRECT asks of buffers, lengths and file offsets
+
+/* writes a file with O_DIRECT, i.e. straight from user space to the disk, bypassing the page cache. the data is
+ * collected into a large aligned buffer taken from a pool, which is written whenever it fills up. O_DIRECT can only
+ * write whole aligned blocks, so the head of the data (up to the first aligned offset) and its tail (past the last
+ * one) go through the page cache. used by a single thread */
+struct direct_writer {
+  int fd;         // the file, written through the page cache
+  int direct_fd;  // the same file, open with O_DIRECT
+  struct buffer_pool *pool;
+
+  uint8_t *buffer;
+  size_t capacity;
+  size_t used;
+  off_t offset;  // the file offset of buffer. aligned, once the head is written
+
+  uintmax_t written;  // bytes written with O_DIRECT
+};
+
+/* starts writing fd from offset on, with a buffer taken out of pool. fails if the pool has no buffer left, or if the
+ * file system of fd doesn't support O_DIRECT. returns true on success, false otherwise (and sets errno) */
+bool direct_writer_init(struct direct_writer *writer, struct buffer_pool *pool, int fd, off_t offset);
+
+/* appends the data of iov. every full buffer is written, and *offset is advanced to the end of what was written to the
+ * file. returns true on success, false otherwise */
+bool direct_writer_writev(struct direct_writer *writer, const struct iovec *iov, int iov_count, off_t *offset);
+
+/* appends length bytes recieved off sockfd straight into the buffer. see direct_writer_writev() */
+bool direct_writer_receive(struct direct_writer *writer, int sockfd, size_t length, off_t *offset);
+
+/* writes what's left in the buffer: its aligned part with O_DIRECT and the unaligned tail through the page cache. sets
+ * *offset to the end of what was written to the file, and returns the buffer to its pool. must be called once the data
+ * ends, whether the transfer succeeded or not. returns true on success, false otherwise */
+bool direct_writer_finish(struct direct_writer *writer, off_t *offset);
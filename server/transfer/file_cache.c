@@ -0,0 +1,385 @@
+#include "file_cache.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include "hash_table.h"
+#include "payload.h"
+
+#define MAX_FILE_SIZE (1024 * 1024)  // files are cached up to that size, or an eighth of the budget if it's smaller
+#define SMALL_QUEUE_SHARE 10         // percents of the budget the small queue holds before it's evicted from
+#define GHOSTS_LEN 1024              // the number of files evicted from the small queue which are remembered
+#define MAX_FREQ 3                   // downloads of a file are counted up to that many
+
+enum queue {
+  QUEUE_SMALL,
+  QUEUE_MAIN,
+};
+
+struct cache_entry {
+  char *key;  // see make_key()
+  uint64_t hash;
+
+  // the version of the file the blocks were read from. see same_version()
+  struct stat statbuf;
+
+  struct cached_file *file;
+
+  // downloads since the file entered its queue (or was last given another round in the main queue)
+  unsigned freq;
+
+  // the queue of the entry. the most recently added entry is the head
+  enum queue queue;
+  struct cache_entry *prev;
+  struct cache_entry *next;
+};
+
+struct fifo {
+  struct cache_entry *head;
+  struct cache_entry *tail;
+  size_t size;  // the total size of the blocks of the entries
+};
+
+struct file_cache {
+  mtx_t mtx;
+
+  struct hash_table *entries;  // key -> struct cache_entry *
+  struct fifo queues[2];       // indexed by enum queue
+
+  // the hashes of the keys evicted from the small queue most recently. a ring, 0 marks an empty slot
+  uint64_t ghosts[GHOSTS_LEN];
+  size_t next_ghost;
+
+  size_t budget;
+  size_t max_file_size;
+  size_t used;
+
+  uintmax_t hits;
+  uintmax_t misses;
+  uintmax_t evictions;
+  uintmax_t invalidations;
+};
+
+static int cmpr_keys(const void *key, const void *other) {
+  return strcmp(key, other);
+}
+
+/* the key of a file: the block size it's framed with followed by its path. returns a heap allocated key on success,
+ * NULL on failure */
+static char *make_key(const char *path, uint32_t block_size) {
+  int len = snprintf(NULL, 0, "%" PRIu32 " %s", block_size, path);
+  if (len < 0) return NULL;
+
+  char *key = malloc(len + 1);
+  if (!key) return NULL;
+
+  snprintf(key, len + 1, "%" PRIu32 " %s", block_size, path);
+  return key;
+}
+
+/* fnv-1a */
+static uint64_t hash_key(const char *key) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (const char *ptr = key; *ptr; ptr++) {
+    hash ^= (uint8_t)*ptr;
+    hash *= 0x100000001b3;
+  }
+  return hash ? hash : 1;
+}
+
+/* a file is the same version of another one if it's the same inode, with the same size and modification time */
+static bool same_version(const struct stat *statbuf, const struct stat *other) {
+  return statbuf->st_dev == other->st_dev && statbuf->st_ino == other->st_ino && statbuf->st_size == other->st_size &&
+         statbuf->st_mtim.tv_sec == other->st_mtim.tv_sec && statbuf->st_mtim.tv_nsec == other->st_mtim.tv_nsec;
+}
+
+static void fifo_unlink(struct file_cache *cache, struct cache_entry *entry) {
+  struct fifo *fifo = &cache->queues[entry->queue];
+  if (entry->prev) {
+    entry->prev->next = entry->next;
+  } else {
+    fifo->head = entry->next;
+  }
+
+  if (entry->next) {
+    entry->next->prev = entry->prev;
+  } else {
+    fifo->tail = entry->prev;
+  }
+
+  entry->prev = entry->next = NULL;
+  fifo->size -= entry->file->len;
+}
+
+static void fifo_push_front(struct file_cache *cache, struct cache_entry *entry, enum queue queue) {
+  struct fifo *fifo = &cache->queues[queue];
+  entry->queue = queue;
+  entry->prev = NULL;
+  entry->next = fifo->head;
+  if (fifo->head) fifo->head->prev = entry;
+  fifo->head = entry;
+  if (!fifo->tail) fifo->tail = entry;
+  fifo->size += entry->file->len;
+}
+
+/* returns true if hash is remembered as evicted from the small queue, and forgets it */
+static bool take_ghost(struct file_cache *cache, uint64_t hash) {
+  for (size_t i = 0; i < GHOSTS_LEN; i++) {
+    if (cache->ghosts[i] == hash) {
+      cache->ghosts[i] = 0;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void add_ghost(struct file_cache *cache, uint64_t hash) {
+  cache->ghosts[cache->next_ghost] = hash;
+  cache->next_ghost = (cache->next_ghost + 1) % GHOSTS_LEN;
+}
+
+static struct cache_entry *find_entry(struct file_cache *cache, const char *key) {
+  struct cache_entry **entry = table_get(cache->entries, key, strlen(key) + 1);
+  return entry ? *entry : NULL;
+}
+
+/* drops an entry. its file stays valid for the ones who hold a reference to it. the cache lock must be held */
+static void remove_entry(struct file_cache *cache, struct cache_entry *entry) {
+  fifo_unlink(cache, entry);
+  free(table_remove(cache->entries, entry->key, strlen(entry->key) + 1));
+
+  cache->used -= entry->file->len;
+  cached_file_release(entry->file);
+
+  free(entry->key);
+  free(entry);
+}
+
+/* evicts the tail of the small queue: a file which was downloaded while in the queue moves to the main queue, any
+ * other file is evicted and remembered. the cache lock must be held */
+static void evict_small(struct file_cache *cache) {
+  struct cache_entry *entry = cache->queues[QUEUE_SMALL].tail;
+  if (!entry->freq) {
+    add_ghost(cache, entry->hash);
+    remove_entry(cache, entry);
+    cache->evictions++;
+    return;
+  }
+
+  fifo_unlink(cache, entry);
+  entry->freq = 0;
+  fifo_push_front(cache, entry, QUEUE_MAIN);
+}
+
+/* evicts the tail of the main queue: a file which was downloaded since it last reached the tail gets another round,
+ * any other file is evicted. the cache lock must be held */
+static void evict_main(struct file_cache *cache) {
+  struct cache_entry *entry = cache->queues[QUEUE_MAIN].tail;
+  if (entry->freq) {
+    fifo_unlink(cache, entry);
+    entry->freq--;
+    fifo_push_front(cache, entry, QUEUE_MAIN);
+    return;
+  }
+
+  remove_entry(cache, entry);
+  cache->evictions++;
+}
+
+/* evicts files until the cache is within its budget. the small queue is evicted from while it holds more than its
+ * share of the budget (or the main queue is empty). the cache lock must be held */
+static void evict(struct file_cache *cache) {
+  size_t small_size = cache->budget / 100 * SMALL_QUEUE_SHARE;
+  while (cache->used > cache->budget) {
+    if (cache->queues[QUEUE_SMALL].size > small_size || !cache->queues[QUEUE_MAIN].tail) {
+      evict_small(cache);
+    } else {
+      evict_main(cache);
+    }
+  }
+}
+
+struct file_cache *file_cache_init(size_t budget) {
+  struct file_cache *cache = calloc(1, sizeof *cache);
+  if (!cache) return NULL;
+
+  cache->budget = budget;
+  cache->max_file_size = budget / 8 < MAX_FILE_SIZE ? budget / 8 : MAX_FILE_SIZE;
+
+  if (mtx_init(&cache->mtx, mtx_plain) != thrd_success) {
+    free(cache);
+    return NULL;
+  }
+
+  cache->entries = table_init(cmpr_keys, NULL, NULL);
+  if (!cache->entries) {
+    mtx_destroy(&cache->mtx);
+    free(cache);
+    return NULL;
+  }
+
+  return cache;
+}
+
+void file_cache_destroy(struct file_cache *cache) {
+  if (!cache) return;
+
+  for (size_t i = 0; i < sizeof cache->queues / sizeof *cache->queues; i++) {
+    while (cache->queues[i].head) {
+      remove_entry(cache, cache->queues[i].head);
+    }
+  }
+
+  table_destroy(cache->entries);
+  mtx_destroy(&cache->mtx);
+  free(cache);
+}
+
+void file_cache_stats(struct file_cache *cache, struct file_cache_stats *stats) {
+  if (!stats) return;
+
+  *stats = (struct file_cache_stats){0};
+  if (!cache) return;
+
+  mtx_lock(&cache->mtx);  // assume never fails
+  stats->budget = cache->budget;
+  stats->max_file_size = cache->max_file_size;
+  stats->used = cache->used;
+  stats->files = table_size(cache->entries);
+  stats->hits = cache->hits;
+  stats->misses = cache->misses;
+  stats->evictions = cache->evictions;
+  stats->invalidations = cache->invalidations;
+  mtx_unlock(&cache->mtx);  // assume never fails
+}
+
+struct cached_file *file_cache_get(struct file_cache *cache,
+                                   const char *path,
+                                   const struct stat *statbuf,
+                                   uint32_t block_size) {
+  if (!cache || !path || !statbuf) return NULL;
+  if (statbuf->st_size < 0 || (size_t)statbuf->st_size > cache->max_file_size) return NULL;
+
+  char *key = make_key(path, block_size);
+  if (!key) return NULL;
+
+  struct cached_file *file = NULL;
+
+  mtx_lock(&cache->mtx);  // assume never fails
+  struct cache_entry *entry = find_entry(cache, key);
+  if (entry && !same_version(&entry->statbuf, statbuf)) {
+    remove_entry(cache, entry);
+    cache->invalidations++;
+    entry = NULL;
+  }
+
+  if (entry) {
+    if (entry->freq < MAX_FREQ) entry->freq++;
+    file = entry->file;
+    atomic_fetch_add(&file->refs, 1);
+    cache->hits++;
+  } else {
+    cache->misses++;
+  }
+  mtx_unlock(&cache->mtx);  // assume never fails
+
+  free(key);
+  return file;
+}
+
+struct cached_file *file_cache_add(struct file_cache *cache,
+                                   const char *path,
+                                   int fd,
+                                   const struct stat *statbuf,
+                                   uint32_t block_size) {
+  if (!cache || !path || !statbuf) return NULL;
+  if (statbuf->st_size < 0 || (size_t)statbuf->st_size > cache->max_file_size) return NULL;
+
+  size_t len = framed_file_length(statbuf->st_size, block_size);
+  if (!len) return NULL;
+
+  struct cached_file *file = malloc(sizeof *file);
+  if (!file) return NULL;
+
+  file->len = len;
+  file->blocks = malloc(len);
+  if (!file->blocks) {
+    free(file);
+    return NULL;
+  }
+
+  // the file is read outside of the lock. a file which changed while it was read isn't cached
+  struct stat after;
+  if (frame_file_data(file->blocks, fd, 0, statbuf->st_size, block_size) != (ssize_t)len ||
+      fstat(fd, &after) == -1 || !same_version(statbuf, &after)) {
+    free(file->blocks);
+    free(file);
+    return NULL;
+  }
+
+  // a reference for the caller and one for the cache
+  atomic_init(&file->refs, 2);
+
+  char *key = make_key(path, block_size);
+  struct cache_entry *entry = calloc(1, sizeof *entry);
+  if (!key || !entry) goto cleanup;
+
+  *entry = (struct cache_entry){.key = key,
+                                .hash = hash_key(key),
+                                .statbuf = *statbuf,
+                                .file = file};
+
+  mtx_lock(&cache->mtx);  // assume never fails
+
+  // another download of the file might have cached it meanwhile
+  struct cache_entry *existing = find_entry(cache, key);
+  if (existing && same_version(&existing->statbuf, statbuf)) {
+    struct cached_file *cached = existing->file;
+    atomic_fetch_add(&cached->refs, 1);
+    mtx_unlock(&cache->mtx);  // assume never fails
+
+    free(entry);
+    free(key);
+    free(file->blocks);
+    free(file);
+    return cached;
+  }
+
+  if (existing) {
+    remove_entry(cache, existing);
+    cache->invalidations++;
+  }
+
+  size_t size = table_size(cache->entries);
+  table_put(cache->entries, key, strlen(key) + 1, &entry, sizeof entry);
+  if (table_size(cache->entries) == size) {
+    mtx_unlock(&cache->mtx);  // assume never fails
+    goto cleanup;
+  }
+
+  // a file which was evicted from the small queue recently is downloaded again. it skips the small queue
+  fifo_push_front(cache, entry, take_ghost(cache, entry->hash) ? QUEUE_MAIN : QUEUE_SMALL);
+  cache->used += len;
+  evict(cache);
+  mtx_unlock(&cache->mtx);  // assume never fails
+
+  return file;
+
+cleanup:
+  free(entry);
+  free(key);
+  free(file->blocks);
+  free(file);
+  return NULL;
+}
+
+void cached_file_release(struct cached_file *file) {
+  if (!file) return;
+  if (atomic_fetch_sub(&file->refs, 1) != 1) return;
+
+  free(file->blocks);
+  free(file);
+}
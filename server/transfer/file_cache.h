@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/* a server wide cache of small files, held as the data blocks a download sends (see frame_file_data()), so a download
+ * of a cached file is neither read from the disk nor framed again. bounded by the total size of the blocks it holds.
+ * a file is cached under its path and the block size it was framed with, and belongs to a single version of the file:
+ * its device, inode, size and modification time. a file which was rewritten (or replaced) since it was cached doesn't
+ * match its entry anymore, so it's never served out of date. files are evicted the S3-FIFO way: a new file enters a
+ * small queue, and moves to the main queue only if it's downloaded again before it reaches the end of the small queue.
+ * the files of the main queue are evicted once they reach its end without being downloaded since they last did. files
+ * which were evicted from the small queue recently are remembered, and go straight into the main queue when they're
+ * cached again. so a burst of downloads of files which aren't downloaded again doesn't push the popular files out.
+ * mt-safe */
+struct file_cache;
+
+/* the data blocks of a cached file. valid for as long as a reference to it is held, even if it's evicted meanwhile */
+struct cached_file {
+  atomic_size_t refs;
+  size_t len;
+  uint8_t *blocks;
+};
+
+/* the counters of a cache, since it was created */
+struct file_cache_stats {
+  size_t budget;         // the largest total size of the cached blocks
+  size_t max_file_size;  // larger files aren't cached
+  size_t used;           // the total size of the cached blocks
+  size_t files;
+
+  uintmax_t hits;
+  uintmax_t misses;
+  uintmax_t evictions;
+  uintmax_t invalidations;  // entries dropped since their files changed
+};
+
+/* creates a cache holding up to budget bytes of blocks. returns a pointer to a heap allocated cache on success, NULL on
+ * failure */
+struct file_cache *file_cache_init(size_t budget);
+
+/* destroys the cache. files handed out earlier stay valid until released */
+void file_cache_destroy(struct file_cache *cache);
+
+/* fills stats with the counters of cache. cache may be NULL, in which case every counter is 0 */
+void file_cache_stats(struct file_cache *cache, struct file_cache_stats *stats);
+
+/* returns the blocks of the file at path, framed in blocks of up to block_size bytes, if they're cached and match the
+ * file statbuf describes. cache may be NULL, and files too large to be cached aren't looked up (neither is a miss).
+ * the caller owns a reference to the returned file and must release it with cached_file_release(). returns NULL if
+ * the file isn't cached */
+struct cached_file *file_cache_get(struct file_cache *cache,
+                                   const char *path,
+                                   const struct stat *statbuf,
+                                   uint32_t block_size);
+
+/* reads the file at path through fd, which statbuf describes, frames it in blocks of up to block_size bytes and caches
+ * it. the caller owns a reference to the returned file and must release it with cached_file_release(). returns NULL if
+ * the file can't be cached: it's too large, it couldn't be read or it changed while it was read */
+struct cached_file *file_cache_add(struct file_cache *cache,
+                                   const char *path,
+                                   int fd,
+                                   const struct stat *statbuf,
+                                   uint32_t block_size);
+
+void cached_file_release(struct cached_file *file);
@@ -0,0 +1,273 @@
+#define _GNU_SOURCE  // readahead(), sync_file_range()
+#include "io_policy.h"
+#include <fcntl.h>  // posix_fadvise(), readahead(), sync_file_range()
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#define READAHEAD_LEAD_MS 250                   // a window holds what a download sends in that long
+#define MIN_WINDOW (256 * 1024)                 // the first window of a download, and the smallest one
+#define DROP_BEHIND_WINDOW (8 * 1024 * 1024)    // the window of a download which drops behind without reading ahead
+#define WRITE_BEHIND_WINDOW (8 * 1024 * 1024)   // uploads are handed to writeback a window at a time
+#define DIRECT_IO_BUFFER_LEN (8 * 1024 * 1024)  // the buffer of an upload which writes with O_DIRECT
+#define NSEC_PER_MSEC 1000000LL
+#define MSEC_PER_SEC 1000LL
+
+struct io_policy {
+  off_t readahead_size;
+  off_t drop_behind_size;
+  off_t direct_io_size;
+  struct buffer_pool *buffers;  // the buffers of uploads which write with O_DIRECT. NULL if none does
+
+  atomic_uintmax_t reads;
+  atomic_uintmax_t writes;
+  atomic_uintmax_t windows;
+  atomic_uintmax_t read_ahead;
+  atomic_uintmax_t written_back;
+  atomic_uintmax_t dropped;
+  atomic_uintmax_t direct;
+  atomic_uintmax_t direct_written;
+};
+
+struct io_policy *io_policy_init(off_t readahead_size, off_t drop_behind_size, off_t direct_io_size, size_t max_direct) {
+  if (readahead_size < 0 || drop_behind_size < 0 || direct_io_size < 0 || (direct_io_size && !max_direct)) return NULL;
+
+  struct io_policy *policy = calloc(1, sizeof *policy);
+  if (!policy) return NULL;
+
+  policy->readahead_size = readahead_size;
+  policy->drop_behind_size = drop_behind_size;
+  policy->direct_io_size = direct_io_size;
+
+  if (direct_io_size) {
+    policy->buffers = buffer_pool_init(DIRECT_IO_BUFFER_LEN, DIRECT_IO_ALIGN, max_direct);
+    if (!policy->buffers) {
+      free(policy);
+      return NULL;
+    }
+  }
+
+  atomic_init(&policy->reads, 0);
+  atomic_init(&policy->writes, 0);
+  atomic_init(&policy->windows, 0);
+  atomic_init(&policy->read_ahead, 0);
+  atomic_init(&policy->written_back, 0);
+  atomic_init(&policy->dropped, 0);
+  atomic_init(&policy->direct, 0);
+  atomic_init(&policy->direct_written, 0);
+
+  return policy;
+}
+
+void io_policy_destroy(struct io_policy *policy) {
+  if (!policy) return;
+
+  buffer_pool_destroy(policy->buffers);
+  free(policy);
+}
+
+void io_policy_stats(struct io_policy *policy, struct io_policy_stats *stats) {
+  if (!stats) return;
+
+  *stats = (struct io_policy_stats){0};
+  if (!policy) return;
+
+  stats->readahead_size = policy->readahead_size;
+  stats->drop_behind_size = policy->drop_behind_size;
+  stats->direct_io_size = policy->direct_io_size;
+  stats->reads = atomic_load(&policy->reads);
+  stats->writes = atomic_load(&policy->writes);
+  stats->windows = atomic_load(&policy->windows);
+  stats->read_ahead = atomic_load(&policy->read_ahead);
+  stats->written_back = atomic_load(&policy->written_back);
+  stats->dropped = atomic_load(&policy->dropped);
+  stats->direct = atomic_load(&policy->direct);
+  stats->direct_written = atomic_load(&policy->direct_written);
+}
+
+/* drops the pages of the bytes [stream::dropped, end) of the file. they must be clean, i.e. read or written back */
+static void drop_behind(struct io_stream *stream, off_t end) {
+  if (end <= stream->dropped) return;
+
+  if (posix_fadvise(stream->fd, stream->dropped, end - stream->dropped, POSIX_FADV_DONTNEED) == 0) {
+    atomic_fetch_add(&stream->policy->dropped, (uintmax_t)(end - stream->dropped));
+  }
+  stream->dropped = end;
+}
+
+/* waits for the writeback of the bytes [stream::dropped, stream::ahead) of an upload, and drops them */
+static void drop_written_back(struct io_stream *stream) {
+  off_t len = stream->ahead - stream->dropped;
+  if (len <= 0) return;
+
+  int flags = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER;
+  if (sync_file_range(stream->fd, stream->dropped, len, flags) == 0) drop_behind(stream, stream->ahead);
+}
+
+static long long elapsed_ms(const struct timespec *since) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - since->tv_sec) * MSEC_PER_SEC + (now.tv_nsec - since->tv_nsec) / NSEC_PER_MSEC;
+}
+
+/* sizes the next window of a download after the throughput of the previous part: the bytes the download sends in
+ * READAHEAD_LEAD_MS, between MIN_WINDOW and the largest window of the policy. rounded up to whole units */
+static void size_window(struct io_stream *stream, off_t offset) {
+  off_t max_window = stream->policy->readahead_size ? stream->policy->readahead_size : DROP_BEHIND_WINDOW;
+
+  off_t sent = offset - stream->part_offset;
+  if (sent > 0) {
+    long long ms = elapsed_ms(&stream->part_start);
+    off_t window = ms > 0 ? (off_t)(sent * READAHEAD_LEAD_MS / ms) : max_window;
+
+    stream->window = window < MIN_WINDOW ? MIN_WINDOW : window > max_window ? max_window : window;
+  }
+
+  stream->window = (stream->window + stream->unit - 1) / stream->unit * stream->unit;
+}
+
+void io_stream_read_init(struct io_stream *stream,
+                         struct io_policy *policy,
+                         int fd,
+                         off_t offset,
+                         off_t length,
+                         uint32_t block_size) {
+  if (!stream) return;
+
+  *stream = (struct io_stream){.fd = fd,
+                               .start = offset,
+                               .end = offset + length,
+                               .ahead = offset,
+                               .dropped = offset,
+                               .window = MIN_WINDOW,
+                               .unit = block_size ? block_size : 1,
+                               .part_offset = offset};
+  if (!policy) return;
+
+  stream->drop_behind = policy->drop_behind_size && length >= policy->drop_behind_size;
+  if (!policy->readahead_size && !stream->drop_behind) return;
+
+  stream->policy = policy;
+  atomic_fetch_add(&policy->reads, 1);
+
+  // the kernel doubles its own read ahead for the file, and frees the pages behind it sooner
+  if (policy->readahead_size) (void)posix_fadvise(fd, offset, length, POSIX_FADV_SEQUENTIAL);
+}
+
+off_t io_stream_next_part(struct io_stream *stream, off_t offset) {
+  if (!stream) return 0;
+
+  off_t remaining = stream->end - offset;
+  if (!stream->policy) return remaining;
+
+  // the part before the one which was just sent had time to leave the socket. its pages aren't needed anymore
+  if (stream->drop_behind) drop_behind(stream, stream->part_offset);
+
+  size_window(stream, offset);
+  off_t part = remaining < stream->window ? remaining : stream->window;
+
+  // read the part, and the window after it, ahead. the disk reads the next window while the part is sent
+  if (stream->policy->readahead_size) {
+    off_t ahead = offset + part + stream->window;
+    if (ahead > stream->end) ahead = stream->end;
+
+    if (ahead > stream->ahead) {
+      if (readahead(stream->fd, stream->ahead, (size_t)(ahead - stream->ahead)) == 0) {
+        atomic_fetch_add(&stream->policy->windows, 1);
+        atomic_fetch_add(&stream->policy->read_ahead, (uintmax_t)(ahead - stream->ahead));
+      }
+      stream->ahead = ahead;
+    }
+  }
+
+  stream->part_offset = offset;
+  clock_gettime(CLOCK_MONOTONIC, &stream->part_start);
+  return part;
+}
+
+void io_stream_write_init(struct io_stream *stream, struct io_policy *policy, int fd, off_t offset) {
+  if (!stream) return;
+
+  *stream = (struct io_stream){.fd = fd, .upload = true, .start = offset, .ahead = offset, .dropped = offset};
+  if (!policy || (!policy->drop_behind_size && !policy->direct_io_size)) return;
+
+  stream->policy = policy;
+  atomic_fetch_add(&policy->writes, 1);
+}
+
+/* switches an upload which reached offset to O_DIRECT. the upload stays as it is if there's no buffer left, or if the
+ * file system doesn't support O_DIRECT */
+static void start_direct(struct io_stream *stream, off_t offset) {
+  stream->direct_tried = true;
+  if (!direct_writer_init(&stream->writer, stream->policy->buffers, stream->fd, offset)) return;
+
+  stream->direct = true;
+  atomic_fetch_add(&stream->policy->direct, 1);
+
+  // what was written so far never leaves the page cache otherwise. it's written back and dropped at once
+  if (stream->policy->drop_behind_size && offset - stream->start >= stream->policy->drop_behind_size) {
+    if (offset > stream->ahead) atomic_fetch_add(&stream->policy->written_back, (uintmax_t)(offset - stream->ahead));
+    stream->ahead = offset;
+    drop_written_back(stream);
+    stream->drop_behind = false;
+  }
+}
+
+void io_stream_written(struct io_stream *stream, off_t offset) {
+  if (!stream || !stream->policy || stream->direct) return;
+
+  // the size of an upload isn't known in advance either. it switches to O_DIRECT once it's large enough
+  if (stream->policy->direct_io_size && !stream->direct_tried &&
+      offset - stream->start >= stream->policy->direct_io_size) {
+    start_direct(stream, offset);
+    if (stream->direct) return;
+  }
+
+  // and drops behind once it's large enough
+  if (!stream->drop_behind) {
+    if (!stream->policy->drop_behind_size || offset - stream->start < stream->policy->drop_behind_size) return;
+    stream->drop_behind = true;
+  }
+
+  // dirty pages can't be dropped. every window is handed to writeback as soon as it's written, and dropped once the
+  // next one is written too: by then it's (mostly) on disk, so waiting for it doesn't stall the upload for long
+  while (offset - stream->ahead >= WRITE_BEHIND_WINDOW) {
+    if (sync_file_range(stream->fd, stream->ahead, WRITE_BEHIND_WINDOW, SYNC_FILE_RANGE_WRITE) == 0) {
+      atomic_fetch_add(&stream->policy->written_back, WRITE_BEHIND_WINDOW);
+    }
+
+    drop_written_back(stream);
+    stream->ahead += WRITE_BEHIND_WINDOW;
+  }
+}
+
+struct direct_writer *io_stream_direct_writer(struct io_stream *stream) {
+  return stream && stream->direct ? &stream->writer : NULL;
+}
+
+bool io_stream_flush(struct io_stream *stream, off_t *offset) {
+  if (!stream || !stream->direct) return true;
+
+  bool success = direct_writer_finish(&stream->writer, offset);
+  atomic_fetch_add(&stream->policy->direct_written, stream->writer.written);
+  stream->direct = false;
+
+  return success;
+}
+
+void io_stream_end(struct io_stream *stream, off_t offset) {
+  if (!stream || !stream->policy || !stream->drop_behind) return;
+
+  // a download is done with all of its pages
+  if (!stream->upload) {
+    drop_behind(stream, offset);
+    return;
+  }
+
+  // an upload drops what was handed to writeback, and starts the writeback of the rest
+  drop_written_back(stream);
+
+  if (offset > stream->ahead &&
+      sync_file_range(stream->fd, stream->ahead, offset - stream->ahead, SYNC_FILE_RANGE_WRITE) == 0) {
+    atomic_fetch_add(&stream->policy->written_back, (uintmax_t)(offset - stream->ahead));
+  }
+}
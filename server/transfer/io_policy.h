@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>  // off_t
+#include <time.h>
+#include "direct_writer.h"
+
+/* the way transfers use the page cache. a download reads its file ahead of the data connection, a window at a time,
+ * so the disk reads the next window while the current one is sent. a window holds about as many bytes as the transfer
+ * sends in READAHEAD_LEAD_MS (see io_policy.c), so a slow client doesn't have much of its file cached ahead of it. a
+ * large transfer (either way) drops the pages it's done with ("drop behind"), so it doesn't push the files other
+ * clients use out of the page cache. an upload which gets even larger is written with O_DIRECT from then on, out of
+ * aligned buffers the policy keeps in a pool (see direct_writer.h), and doesn't go through the page cache at all. mt-safe
+ */
+struct io_policy;
+
+/* the counters of a policy, since it was created */
+struct io_policy_stats {
+  off_t readahead_size;      // the largest read ahead window. 0 if read ahead is left to the kernel
+  off_t drop_behind_size;    // transfers of at least that many bytes drop their pages behind. 0 if none does
+  off_t direct_io_size;      // uploads write with O_DIRECT once they wrote that many bytes. 0 if none does
+
+  uintmax_t reads;           // downloads
+  uintmax_t writes;          // uploads
+  uintmax_t windows;         // read ahead windows
+  uintmax_t read_ahead;      // bytes read ahead of downloads
+  uintmax_t written_back;    // bytes of uploads handed to writeback as soon as they were written
+  uintmax_t dropped;         // bytes dropped behind, of downloads and uploads alike
+  uintmax_t direct;          // uploads which switched to O_DIRECT
+  uintmax_t direct_written;  // bytes written with O_DIRECT
+};
+
+/* a single transfer of a file. used by the thread which runs the transfer only */
+struct io_stream {
+  struct io_policy *policy;  // NULL if the transfer takes no page cache hints
+  int fd;
+
+  bool upload;
+  bool drop_behind;
+  off_t start;    // where the transfer started
+  off_t end;      // download: the end of the range to send
+  off_t ahead;    // download: the end of the range read ahead. upload: the end of the range handed to writeback
+  off_t dropped;  // the end of the range dropped behind
+
+  // upload: the writer of an upload which switched to O_DIRECT. an upload tries to switch once only
+  bool direct;
+  bool direct_tried;
+  struct direct_writer writer;
+
+  // download: the size of the next part (a whole number of units), and when the previous one started to be sent
+  off_t window;
+  uint32_t unit;
+  off_t part_offset;
+  struct timespec part_start;
+};
+
+/* creates a policy. readahead_size is the largest read ahead window in bytes (0 leaves read ahead to the kernel).
+ * transfers of at least drop_behind_size bytes drop their pages behind (0 disables drop behind). uploads which wrote
+ * direct_io_size bytes write the rest with O_DIRECT (0 disables direct io), up to max_direct uploads at a time. returns
+ * a pointer to a heap allocated policy on success, NULL on failure */
+struct io_policy *io_policy_init(off_t readahead_size, off_t drop_behind_size, off_t direct_io_size, size_t max_direct);
+
+void io_policy_destroy(struct io_policy *policy);
+
+/* fills stats with the counters of policy. policy may be NULL, in which case every counter is 0 */
+void io_policy_stats(struct io_policy *policy, struct io_policy_stats *stats);
+
+/* starts a download of the bytes [offset, offset + length) of fd, which is sent in parts made of whole blocks of
+ * block_size bytes (see io_stream_next_part()). policy may be NULL */
+void io_stream_read_init(struct io_stream *stream,
+                         struct io_policy *policy,
+                         int fd,
+                         off_t offset,
+                         off_t length,
+                         uint32_t block_size);
+
+/* returns the length of the part to send from offset on (all of the range left if the stream reads nothing ahead
+ * and drops nothing behind), and reads ahead of it. the bytes before offset were sent */
+off_t io_stream_next_part(struct io_stream *stream, off_t offset);
+
+/* starts an upload into fd from offset on. policy may be NULL */
+void io_stream_write_init(struct io_stream *stream, struct io_policy *policy, int fd, off_t offset);
+
+/* tells the stream of an upload the bytes before offset were written. switches the upload to O_DIRECT once it's large
+ * enough */
+void io_stream_written(struct io_stream *stream, off_t offset);
+
+/* returns the writer of an upload which writes with O_DIRECT, NULL if the upload writes into the file directly */
+struct direct_writer *io_stream_direct_writer(struct io_stream *stream);
+
+/* writes what the writer of an upload holds back (see direct_writer_finish()), and sets *offset to the end of what was
+ * written. the upload writes into the file directly from then on. must be called once the data of an upload ends,
+ * before io_stream_end(). returns true on success (or if there's no writer), false otherwise */
+bool io_stream_flush(struct io_stream *stream, off_t *offset);
+
+/* ends a transfer which reached offset, successful or not. drops behind what the transfer left in the page cache */
+void io_stream_end(struct io_stream *stream, off_t offset);